@@ -31,6 +31,24 @@ pub fn build(b: *std.Build) void {
             "src/text.c",
             "src/git.c",
             "src/network_ext.c",
+            "src/walker.c",
+            "src/uring.c",
+            "src/bench.c",
+            "src/scanindex.c",
+            "src/arena.c",
+            "src/filter.c",
+            "src/scanstats.c",
+            "src/watch.c",
+            "src/chunker.c",
+            "src/snapshot.c",
+            "src/sha.c",
+            "src/xxh3.c",
+            "src/blake3.c",
+            "src/mbhash.c",
+            "src/reader.c",
+            "src/manifest.c",
+            "src/treehash.c",
+            "src/crc.c",
         },
         .flags = &.{
             "-Wall",
@@ -58,6 +76,7 @@ pub fn build(b: *std.Build) void {
         exe.linkSystemLibrary("Xss");
         exe.linkSystemLibrary("Xrandr");
         exe.linkSystemLibrary("m");
+        exe.linkSystemLibrary("pthread");
     }
 
     exe.linkLibC();
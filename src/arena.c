@@ -0,0 +1,178 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#endif
+
+#define ARENA_BLOCK_SIZE (256 * 1024)
+#define ARENA_ALIGN 8
+
+struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+};
+
+void arena_init(Arena *arena) {
+    memset(arena, 0, sizeof(*arena));
+}
+
+void* arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size > arena->left) {
+        // Oversized requests get a block of their own
+        size_t payload = size > ARENA_BLOCK_SIZE / 4 ? size : ARENA_BLOCK_SIZE;
+        size_t header = (sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+        ArenaBlock *block = malloc(header + payload);
+        if (!block) return NULL;
+        block->size = header + payload;
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->bytes += block->size;
+        if (payload == size && arena->left > 0) {
+            // Keep filling the current block; the new one is already full
+            return (char *)block + header;
+        }
+        arena->cur = (char *)block + header;
+        arena->left = payload;
+    }
+    void *p = arena->cur;
+    arena->cur += size;
+    arena->left -= size;
+    return p;
+}
+
+char* arena_strndup(Arena *arena, const char *s, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+// Move all of src's blocks into dst. src is left empty; dst keeps
+// allocating from its own current block.
+void arena_merge(Arena *dst, Arena *src) {
+    if (!src->blocks) return;
+    ArenaBlock *last = src->blocks;
+    while (last->next) last = last->next;
+    last->next = dst->blocks;
+    dst->blocks = src->blocks;
+    dst->bytes += src->bytes;
+    if (!dst->cur) {
+        dst->cur = src->cur;
+        dst->left = src->left;
+    }
+    arena_init(src);
+}
+
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->blocks;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena_init(arena);
+}
+
+ScanPath* scan_path_new(Arena *arena, const ScanPath *parent, const char *name) {
+    size_t len = strlen(name);
+    ScanPath *node = arena_alloc(arena, sizeof(ScanPath) + len + 1);
+    if (!node) return NULL;
+    char *copy = (char *)(node + 1);
+    memcpy(copy, name, len + 1);
+    node->parent = parent;
+    node->name = copy;
+    return node;
+}
+
+// Components are joined the same way the walker builds entry->path: with a
+// '/' unless the parent already ends in one (a root of "/" or "dir/")
+static int scan_path_needs_slash(const ScanPath *parent) {
+    size_t len = strlen(parent->name);
+    return len == 0 || parent->name[len - 1] != '/';
+}
+
+const char* scan_path_format(const ScanPath *path, char **buf, size_t *cap) {
+    size_t total = 0;
+    for (const ScanPath *p = path; p; p = p->parent) {
+        total += strlen(p->name);
+        if (p->parent && scan_path_needs_slash(p->parent)) total++;
+    }
+    
+    if (total + 1 > *cap) {
+        size_t new_cap = *cap ? *cap : 256;
+        while (new_cap < total + 1) new_cap *= 2;
+        char *grown = realloc(*buf, new_cap);
+        if (!grown) return NULL;
+        *buf = grown;
+        *cap = new_cap;
+    }
+    
+    // Fill from the end, walking up towards the root
+    size_t pos = total;
+    (*buf)[pos] = '\0';
+    for (const ScanPath *p = path; p; p = p->parent) {
+        size_t len = strlen(p->name);
+        pos -= len;
+        memcpy(*buf + pos, p->name, len);
+        if (p->parent && scan_path_needs_slash(p->parent)) (*buf)[--pos] = '/';
+    }
+    return *buf;
+}
+
+char* scan_path_strdup(const ScanPath *path) {
+    char *buf = NULL;
+    size_t cap = 0;
+    if (!scan_path_format(path, &buf, &cap)) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+#ifndef _WIN32
+int scan_path_open(const ScanPath *path, int flags, char **buf, size_t *cap) {
+    if (!scan_path_format(path, buf, cap)) {
+        errno = ENOMEM;
+        return -1;
+    }
+    char *rest = *buf;
+    size_t len = strlen(rest);
+    if (len < PATH_MAX) return open(rest, flags);
+    
+    // Cut at the last '/' that keeps each directory run under PATH_MAX
+    int dirfd = AT_FDCWD;
+    while (len >= PATH_MAX) {
+        char *cut = rest + PATH_MAX - 1;
+        while (cut > rest && *cut != '/') cut--;
+        if (cut == rest) {
+            if (dirfd != AT_FDCWD) close(dirfd);
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        *cut = '\0';
+        int next = openat(dirfd, rest, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        *cut = '/';
+        int err = errno;
+        if (dirfd != AT_FDCWD) close(dirfd);
+        if (next < 0) {
+            errno = err;
+            return -1;
+        }
+        dirfd = next;
+        len -= (size_t)(cut + 1 - rest);
+        rest = cut + 1;
+    }
+    int fd = openat(dirfd, rest, flags);
+    int err = errno;
+    close(dirfd);
+    errno = err;
+    return fd;
+}
+#endif
@@ -0,0 +1,51 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator for scan results. Allocations are carved out of large
+// blocks and are never freed individually; arena_free() releases
+// everything at once. An arena is not thread-safe, so parallel scans keep
+// one per walker worker and merge them when the walk is done.
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock *blocks;         // most recent block first
+    char *cur;
+    size_t left;
+    size_t bytes;               // total block memory held
+} Arena;
+
+void arena_init(Arena *arena);
+void* arena_alloc(Arena *arena, size_t size);
+char* arena_strndup(Arena *arena, const char *s, size_t len);
+void arena_merge(Arena *dst, Arena *src);
+void arena_free(Arena *arena);
+
+// Interned scan paths: every directory and file is a node holding only
+// its own name plus a pointer to its parent directory's node, so a path
+// costs its last component rather than the full string. The root node's
+// name is the scan root exactly as it was passed to the walker.
+typedef struct ScanPath {
+    const struct ScanPath *parent;
+    const char *name;
+} ScanPath;
+
+ScanPath* scan_path_new(Arena *arena, const ScanPath *parent, const char *name);
+
+// Format the full path into *buf, growing it (realloc) as needed. Returns
+// *buf, or NULL if out of memory.
+const char* scan_path_format(const ScanPath *path, char **buf, size_t *cap);
+
+// Full path as a new malloc'd string
+char* scan_path_strdup(const ScanPath *path);
+
+#ifndef _WIN32
+// open() the path, formatting it into *buf like scan_path_format. Paths
+// longer than PATH_MAX are opened a run of directories at a time with
+// openat, so deep trees stay reachable. Returns the fd, or -1 with errno.
+int scan_path_open(const ScanPath *path, int flags, char **buf, size_t *cap);
+#endif
+
+#endif
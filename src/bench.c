@@ -0,0 +1,474 @@
+#include "bench.h"
+#include "walker.h"
+#include "uring.h"
+#include "hash.h"
+#include "encoding.h"
+#include "filetools.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+
+int cmd_bench_scan(int files, const WalkOptions *opts) {
+    (void)files; (void)opts;
+    fprintf(stderr, "Scan benchmark not supported on Windows yet\n");
+    return 1;
+}
+
+int cmd_bench_kernels(const char *suite, const char *algos, unsigned long long max_size, int json) {
+    (void)suite; (void)algos; (void)max_size; (void)json;
+    fprintf(stderr, "Kernel benchmark not supported on Windows yet\n");
+    return 1;
+}
+
+#else
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#define BENCH_TSC_JSON "true"
+#define BENCH_TSC_NOTE ",\ncycles/byte from the time-stamp counter (nominal clock, not turbo)"
+#else
+#define BENCH_TSC_JSON "false"
+#define BENCH_TSC_NOTE ""
+#endif
+
+// Synthetic tree layout: BENCH_FANOUT^BENCH_LEVELS leaf directories, with
+// the requested number of files spread evenly across them
+#define BENCH_FANOUT 8
+#define BENCH_LEVELS 3
+#define BENCH_RUNS 3
+
+typedef struct BenchCounts {
+    unsigned long long *files;
+    unsigned long long *bytes;
+} BenchCounts;
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_leaf_path(char *buf, size_t size, const char *root, int leaf) {
+    snprintf(buf, size, "%.3900s/d%d/d%d/d%d", root,
+             leaf / (BENCH_FANOUT * BENCH_FANOUT), (leaf / BENCH_FANOUT) % BENCH_FANOUT, leaf % BENCH_FANOUT);
+}
+
+// Files are sparse, so building a large tree costs metadata only
+static int bench_build_tree(const char *root, int files) {
+    char path[4096];
+    int leaves = BENCH_FANOUT * BENCH_FANOUT * BENCH_FANOUT;
+    unsigned int seed = 12345;
+    
+    for (int leaf = 0; leaf < leaves; leaf++) {
+        bench_leaf_path(path, sizeof(path), root, leaf);
+        // mkdir -p for the three levels
+        for (char *p = path + strlen(root) + 1; *p; p++) {
+            if (*p == '/') {
+                *p = '\0';
+                mkdir(path, 0755);
+                *p = '/';
+            }
+        }
+        if (mkdir(path, 0755) != 0) return -1;
+    }
+    
+    for (int i = 0; i < files; i++) {
+        char dir[4096];
+        bench_leaf_path(dir, sizeof(dir), root, i % leaves);
+        snprintf(path, sizeof(path), "%.4000s/file_%07d.dat", dir, i);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return -1;
+        if (ftruncate(fd, (off_t)(rand_r(&seed) % (4 * 1024 * 1024))) != 0) {
+            close(fd);
+            return -1;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+static void bench_remove_tree(const char *root, int files) {
+    char path[4096];
+    char dir[4096];
+    int leaves = BENCH_FANOUT * BENCH_FANOUT * BENCH_FANOUT;
+    
+    for (int i = 0; i < files; i++) {
+        bench_leaf_path(dir, sizeof(dir), root, i % leaves);
+        snprintf(path, sizeof(path), "%.4000s/file_%07d.dat", dir, i);
+        unlink(path);
+    }
+    for (int leaf = 0; leaf < leaves; leaf++) {
+        bench_leaf_path(path, sizeof(path), root, leaf);
+        rmdir(path);
+        if (leaf % BENCH_FANOUT == BENCH_FANOUT - 1) {
+            *strrchr(path, '/') = '\0';
+            rmdir(path);
+        }
+        if (leaf % (BENCH_FANOUT * BENCH_FANOUT) == BENCH_FANOUT * BENCH_FANOUT - 1) {
+            *strrchr(path, '/') = '\0';
+            rmdir(path);
+        }
+    }
+    rmdir(root);
+}
+
+static void bench_visit(const WalkEntry *entry, void *ctx) {
+    BenchCounts *counts = ctx;
+    if (entry->type != WALK_FILE) return;
+    counts->files[entry->worker]++;
+    counts->bytes[entry->worker] += entry->st->st_size;
+}
+
+// Best of BENCH_RUNS walks; returns the wall time in seconds
+static double bench_run_walk(const char *root, const WalkOptions *opts, unsigned long long *files_seen) {
+    int jobs = walk_jobs(opts);
+    double best = -1;
+    
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        BenchCounts counts;
+        counts.files = calloc((size_t)jobs, sizeof(unsigned long long));
+        counts.bytes = calloc((size_t)jobs, sizeof(unsigned long long));
+        if (!counts.files || !counts.bytes) {
+            free(counts.files);
+            free(counts.bytes);
+            return -1;
+        }
+        
+        double start = bench_now();
+        walk_tree(root, opts, bench_visit, &counts);
+        double elapsed = bench_now() - start;
+        
+        *files_seen = 0;
+        for (int i = 0; i < jobs; i++) *files_seen += counts.files[i];
+        free(counts.files);
+        free(counts.bytes);
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+int cmd_bench_scan(int files, const WalkOptions *opts) {
+    if (files <= 0) files = 100000;
+    
+    const char *tmp = getenv("TMPDIR");
+    char root[4096];
+    snprintf(root, sizeof(root), "%s/caffeinated-bench-XXXXXX", tmp ? tmp : "/tmp");
+    if (!mkdtemp(root)) {
+        fprintf(stderr, "Failed to create benchmark directory in %s\n", tmp ? tmp : "/tmp");
+        return 1;
+    }
+    
+    printf("Building synthetic tree with %d files in %s...\n", files, root);
+    if (bench_build_tree(root, files) != 0) {
+        fprintf(stderr, "Failed to build benchmark tree\n");
+        bench_remove_tree(root, files);
+        return 1;
+    }
+    
+    // Walk the way finddup does: paths come from the directory nodes
+    WalkOptions sync_opts = *opts;
+    sync_opts.names_only = 1;
+    sync_opts.backend = WALK_BACKEND_SYNC;
+    WalkOptions uring_opts = sync_opts;
+    uring_opts.backend = WALK_BACKEND_URING;
+    int have_uring = uring_available();
+    
+    printf("Threads: %d, io_uring queue depth: %d (best of %d warm-cache runs)\n\n",
+           walk_jobs(opts), opts->queue_depth > 0 ? opts->queue_depth : 128, BENCH_RUNS);
+    printf("%-10s %12s %12s %16s\n", "Backend", "Files", "Time (s)", "Entries/s");
+    printf("%-10s %12s %12s %16s\n", "-------", "-----", "--------", "---------");
+    
+    unsigned long long seen = 0;
+    double sync_time = bench_run_walk(root, &sync_opts, &seen);
+    printf("%-10s %12llu %12.3f %16.0f\n", "sync", seen, sync_time, seen / sync_time);
+    
+    if (have_uring) {
+        double uring_time = bench_run_walk(root, &uring_opts, &seen);
+        printf("%-10s %12llu %12.3f %16.0f\n", "io_uring", seen, uring_time, seen / uring_time);
+        printf("\nio_uring speedup: %.2fx\n", sync_time / uring_time);
+    } else {
+        printf("%-10s %12s\n", "io_uring", "unavailable (kernel, build or sandbox)");
+    }
+    
+    bench_remove_tree(root, files);
+    return 0;
+}
+
+// Kernel benchmark. Every (kernel, size) pair is warmed up while the
+// number of calls that fill a sample of BENCH_SAMPLE_TIME is found, then
+// sampled until there are enough samples and enough time has passed. The
+// median sample is reported with the spread of all of them.
+#define BENCH_SAMPLE_TIME 0.01
+#define BENCH_MIN_SAMPLES 5
+#define BENCH_MIN_TIME 0.2
+#define BENCH_MAX_SAMPLES 100
+#define BENCH_SIZE_STEP 16
+
+typedef enum {
+    BENCH_HASH,
+    BENCH_BASE64_ENCODE,
+    BENCH_BASE64_DECODE,
+} BenchKind;
+
+typedef struct {
+    BenchKind kind;
+    HashAlgo algo;
+    const char *suite;
+    const char *name;
+    const char *impl;
+} BenchKernel;
+
+typedef struct {
+    uint8_t *data;              // input; also what decoding writes to
+    char *text;                 // base64 output, and input for decoding
+} BenchBuffers;
+
+typedef struct {
+    int samples;
+    double gbps;                // median sample
+    double gbps_min;
+    double gbps_max;
+    double cv;                  // standard deviation over mean, in percent
+    double cycles;              // TSC cycles per byte of the median sample, < 0 if unknown
+} BenchResult;
+
+static volatile size_t bench_sink;
+
+static uint64_t bench_cycles(void) {
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void bench_cpu_name(char *buf, size_t size) {
+    snprintf(buf, size, "unknown");
+#ifdef BENCH_HAVE_TSC
+    unsigned int regs[12];
+    if (__get_cpuid_max(0x80000000, NULL) < 0x80000004) return;
+    for (unsigned int i = 0; i < 3; i++) {
+        __get_cpuid(0x80000002 + i, &regs[4 * i], &regs[4 * i + 1], &regs[4 * i + 2], &regs[4 * i + 3]);
+    }
+    char brand[49];
+    memcpy(brand, regs, 48);
+    brand[48] = '\0';
+    char *start = brand;
+    while (*start == ' ') start++;
+    snprintf(buf, size, "%s", start);
+#endif
+}
+
+// One call over size bytes; -1 if the kernel rejected its input
+static int bench_call(const BenchKernel *kernel, BenchBuffers *buffers, size_t size) {
+    switch (kernel->kind) {
+        case BENCH_HASH: {
+            HashCtx ctx;
+            uint8_t digest[HASH_MAX_DIGEST];
+            hash_init(&ctx, kernel->algo);
+            hash_update(&ctx, buffers->data, size);
+            hash_final(&ctx, digest);
+            bench_sink += digest[0];
+            return 0;
+        }
+        case BENCH_BASE64_ENCODE:
+            bench_sink += base64_encode(buffers->data, size, buffers->text);
+            return 0;
+        case BENCH_BASE64_DECODE: {
+            size_t out_len;
+            if (base64_decode(buffers->text, size, buffers->data, &out_len) != 0) return -1;
+            bench_sink += out_len;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int bench_measure(const BenchKernel *kernel, BenchBuffers *buffers, size_t size, BenchResult *result) {
+    // Decoding reads size characters of valid base64, made from the data
+    if (kernel->kind == BENCH_BASE64_DECODE) base64_encode(buffers->data, size / 4 * 3, buffers->text);
+    
+    unsigned long calls = 1;
+    for (;;) {
+        double start = bench_now();
+        for (unsigned long i = 0; i < calls; i++) {
+            if (bench_call(kernel, buffers, size) != 0) return -1;
+        }
+        if (bench_now() - start >= BENCH_SAMPLE_TIME || calls >= (1UL << 30)) break;
+        calls *= 2;
+    }
+    
+    double gbps[BENCH_MAX_SAMPLES], order[BENCH_MAX_SAMPLES], cycles[BENCH_MAX_SAMPLES];
+    double total = 0;
+    int n = 0;
+    while (n < BENCH_MAX_SAMPLES && (n < BENCH_MIN_SAMPLES || total < BENCH_MIN_TIME)) {
+        // Samples of a second or more are slow enough that three will do
+        if (n >= 3 && total >= 3.0) break;
+        double start = bench_now();
+        uint64_t tsc = bench_cycles();
+        for (unsigned long i = 0; i < calls; i++) bench_call(kernel, buffers, size);
+        tsc = bench_cycles() - tsc;
+        double elapsed = bench_now() - start;
+        double bytes = (double)calls * (double)size;
+        gbps[n] = bytes / elapsed / 1e9;
+        cycles[n] = tsc / bytes;
+        total += elapsed;
+        n++;
+    }
+    
+    // Median by rate; its cycle count goes with it
+    memcpy(order, gbps, n * sizeof(double));
+    qsort(order, (size_t)n, sizeof(double), compare_double);
+    double mean = 0, var = 0;
+    for (int i = 0; i < n; i++) mean += gbps[i];
+    mean /= n;
+    for (int i = 0; i < n; i++) var += (gbps[i] - mean) * (gbps[i] - mean);
+    
+    result->samples = n;
+    result->gbps = order[n / 2];
+    result->gbps_min = order[0];
+    result->gbps_max = order[n - 1];
+    result->cv = mean > 0 ? 100.0 * sqrt(var / n) / mean : 0;
+    result->cycles = -1;
+#ifdef BENCH_HAVE_TSC
+    for (int i = 0; i < n; i++) {
+        if (gbps[i] == result->gbps) result->cycles = cycles[i];
+    }
+#endif
+    return 0;
+}
+
+int cmd_bench_kernels(const char *suite, const char *algos, unsigned long long max_size, int json) {
+    int want_hash = strcmp(suite, "hash") == 0 || strcmp(suite, "all") == 0;
+    int want_base64 = strcmp(suite, "base64") == 0 || strcmp(suite, "all") == 0;
+    if (!want_hash && !want_base64) {
+        fprintf(stderr, "Unknown benchmark: %s (use: scan, hash, base64, all)\n", suite);
+        return 1;
+    }
+    // Base64 decoding runs over whole groups of four characters
+    max_size &= ~3ULL;
+    if (max_size < 64 || max_size > SIZE_MAX / 2) {
+        fprintf(stderr, "Benchmark size must be at least 64 bytes\n");
+        return 1;
+    }
+    
+    BenchKernel kernels[HASH_ALGO_COUNT + 2];
+    int count = 0;
+    if (want_hash) {
+        int picked[HASH_ALGO_COUNT] = { 0 };
+        if (algos) {
+            char list[256];
+            snprintf(list, sizeof(list), "%s", algos);
+            for (char *name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+                HashAlgo algo;
+                if (hash_algo_parse(name, &algo) != 0) {
+                    fprintf(stderr, "Unknown algorithm: %s (use: %s)\n", name, hash_algo_names());
+                    return 1;
+                }
+                picked[algo] = 1;
+            }
+        }
+        for (int a = 0; a < HASH_ALGO_COUNT; a++) {
+            if (algos && !picked[a]) continue;
+            kernels[count++] = (BenchKernel){ BENCH_HASH, (HashAlgo)a, "hash", hash_algo_name((HashAlgo)a),
+                                              hash_algo_impl((HashAlgo)a) };
+        }
+    }
+    if (want_base64) {
+        kernels[count++] = (BenchKernel){ BENCH_BASE64_ENCODE, HASH_MD5, "base64", "b64-enc", base64_impl() };
+        kernels[count++] = (BenchKernel){ BENCH_BASE64_DECODE, HASH_MD5, "base64", "b64-dec", base64_impl() };
+    }
+    
+    size_t sizes[32];
+    int size_count = 0;
+    for (unsigned long long size = 64; size <= max_size; size *= BENCH_SIZE_STEP) sizes[size_count++] = (size_t)size;
+    if (sizes[size_count - 1] != max_size) sizes[size_count++] = (size_t)max_size;
+    
+    BenchBuffers buffers;
+    buffers.data = malloc((size_t)max_size);
+    buffers.text = malloc((size_t)(max_size + 2) / 3 * 4);
+    if (!buffers.data || !buffers.text) {
+        fprintf(stderr, "Cannot allocate %llu bytes of benchmark buffers\n", max_size * 7 / 3);
+        free(buffers.data);
+        free(buffers.text);
+        return 1;
+    }
+    // Random bytes, so nothing data-dependent gets an easy ride
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < max_size; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buffers.data[i] = (uint8_t)x;
+    }
+    memset(buffers.text, 'A', (size_t)(max_size + 2) / 3 * 4);
+    
+    char cpu[64];
+    bench_cpu_name(cpu, sizeof(cpu));
+    if (json) {
+        printf("{\"type\":\"cpu\",\"model\":\"%s\",\"tsc\":%s}\n", cpu, BENCH_TSC_JSON);
+    } else {
+        printf("CPU: %s\n", cpu);
+        printf("Single thread; median of %d+ samples, GB/s = 10^9 bytes of input per second%s\n\n",
+               BENCH_MIN_SAMPLES, BENCH_TSC_NOTE);
+        printf("%-8s %-10s %-8s %10s %10s %10s %8s %8s\n", "Kernel", "Impl", "Size", "GB/s", "Min", "Max",
+               "Spread", "Cyc/B");
+        printf("%-8s %-10s %-8s %10s %10s %10s %8s %8s\n", "------", "----", "----", "----", "---", "---",
+               "------", "-----");
+    }
+    
+    int status = 0;
+    for (int k = 0; k < count; k++) {
+        for (int s = 0; s < size_count; s++) {
+            BenchResult result;
+            if (bench_measure(&kernels[k], &buffers, sizes[s], &result) != 0) {
+                fprintf(stderr, "%s %s failed on %zu bytes\n", kernels[k].suite, kernels[k].name, sizes[s]);
+                status = 1;
+                continue;
+            }
+            if (json) {
+                printf("{\"type\":\"result\",\"suite\":\"%s\",\"kernel\":\"%s\",\"impl\":\"%s\",\"size\":%zu,"
+                       "\"samples\":%d,\"gbps\":%.4f,\"gbps_min\":%.4f,\"gbps_max\":%.4f,\"cv_pct\":%.2f,",
+                       kernels[k].suite, kernels[k].name, kernels[k].impl, sizes[s], result.samples,
+                       result.gbps, result.gbps_min, result.gbps_max, result.cv);
+                if (result.cycles >= 0) {
+                    printf("\"cycles_per_byte\":%.3f}\n", result.cycles);
+                } else {
+                    printf("\"cycles_per_byte\":null}\n");
+                }
+            } else {
+                char size_text[32], cycles_text[16], spread[16];
+                format_size(sizes[s], size_text, sizeof(size_text));
+                snprintf(spread, sizeof(spread), "%.1f%%", result.cv);
+                if (result.cycles >= 0) {
+                    snprintf(cycles_text, sizeof(cycles_text), "%.2f", result.cycles);
+                } else {
+                    snprintf(cycles_text, sizeof(cycles_text), "-");
+                }
+                printf("%-8s %-10s %-8s %10.3f %10.3f %10.3f %8s %8s\n", kernels[k].name, kernels[k].impl,
+                       size_text, result.gbps, result.gbps_min, result.gbps_max, spread, cycles_text);
+            }
+            fflush(stdout);
+        }
+    }
+    
+    free(buffers.data);
+    free(buffers.text);
+    return status;
+}
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "walker.h"
+
+int cmd_bench_scan(int files, const WalkOptions *opts);
+
+// Throughput of the hash and base64 kernels on one thread, over buffers
+// from 64 bytes up to max_size growing 16x at a time. suite is "hash",
+// "base64" or "all"; algos, if given, is a comma-separated list of hash
+// algorithms. json prints one JSON object per line instead of a table.
+int cmd_bench_kernels(const char *suite, const char *algos, unsigned long long max_size, int json);
+
+#endif
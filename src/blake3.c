@@ -0,0 +1,602 @@
+#include "blake3.h"
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define B3_HAVE_X86 1
+#endif
+
+#define B3_CHUNK_START (1 << 0)
+#define B3_CHUNK_END   (1 << 1)
+#define B3_PARENT      (1 << 2)
+#define B3_ROOT        (1 << 3)
+
+#define B3_CHUNK_BLOCKS (BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN)
+// Largest subtree compressed in one go by blake3_update (64 KB of input)
+#define B3_SUBTREE_CHUNKS 64
+
+static const uint32_t b3_iv[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+// Message word order for each of the seven rounds
+static const uint8_t b3_schedule[7][16] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+    { 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+    { 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+    { 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+    { 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+    { 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 },
+};
+
+// One round: the G function on the four columns, then the four diagonals.
+// G is a macro so each instruction set plugs in its own vector ops.
+#define B3_ROUND(G, v, m, r) do { \
+    const uint8_t *s = b3_schedule[r]; \
+    G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]); \
+    G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]); \
+    G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]); \
+    G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]); \
+    G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]); \
+    G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]); \
+    G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]); \
+    G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]); \
+} while (0)
+
+// All seven rounds, with constant schedule rows so the message words can
+// stay in registers
+#define B3_ROUNDS(G, v, m) do { \
+    B3_ROUND(G, v, m, 0); B3_ROUND(G, v, m, 1); B3_ROUND(G, v, m, 2); B3_ROUND(G, v, m, 3); \
+    B3_ROUND(G, v, m, 4); B3_ROUND(G, v, m, 5); B3_ROUND(G, v, m, 6); \
+} while (0)
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define G_SCALAR(a, b, c, d, x, y) do { \
+    a = a + b + (x); d = ROTR32(d ^ a, 16); c = c + d; b = ROTR32(b ^ c, 12); \
+    a = a + b + (y); d = ROTR32(d ^ a, 8); c = c + d; b = ROTR32(b ^ c, 7); \
+} while (0)
+
+static uint32_t load_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void store_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+// Full 16-word output of one compression: the first eight words are the
+// new chaining value, all sixteen are root output (XOF) bytes
+static void b3_compress(const uint32_t cv[8], const uint8_t block[BLAKE3_BLOCK_LEN], uint8_t block_len,
+                        uint64_t counter, uint8_t flags, uint32_t out[16]) {
+    uint32_t m[16], v[16];
+    for (int i = 0; i < 16; i++) m[i] = load_le32(block + 4 * i);
+    for (int i = 0; i < 8; i++) v[i] = cv[i];
+    for (int i = 0; i < 4; i++) v[8 + i] = b3_iv[i];
+    v[12] = (uint32_t)counter;
+    v[13] = (uint32_t)(counter >> 32);
+    v[14] = block_len;
+    v[15] = flags;
+    
+    B3_ROUNDS(G_SCALAR, v, m);
+    
+    for (int i = 0; i < 8; i++) {
+        out[i] = v[i] ^ v[i + 8];
+        out[i + 8] = v[i + 8] ^ cv[i];
+    }
+}
+
+// Compress count inputs of the same number of blocks into chaining values.
+// Input i starts at data + i * stride, its counter is counter + i if
+// increment is set, and its cv is written to out + 32 * i. The first block
+// of each input gets flags_start and the last flags_end on top of flags.
+typedef void (*B3ManyFn)(const uint8_t *data, size_t stride, size_t blocks, const uint32_t key[8],
+                         uint64_t counter, int increment, uint8_t flags, uint8_t flags_start,
+                         uint8_t flags_end, uint8_t *out);
+
+static void b3_many_scalar(const uint8_t *data, size_t stride, size_t blocks, const uint32_t key[8],
+                           uint64_t counter, int increment, uint8_t flags, uint8_t flags_start,
+                           uint8_t flags_end, uint8_t *out) {
+    uint32_t cv[8], words[16];
+    memcpy(cv, key, sizeof(cv));
+    for (size_t b = 0; b < blocks; b++) {
+        uint8_t block_flags = flags | (b == 0 ? flags_start : 0) | (b + 1 == blocks ? flags_end : 0);
+        b3_compress(cv, data + b * BLAKE3_BLOCK_LEN, BLAKE3_BLOCK_LEN, counter, block_flags, words);
+        memcpy(cv, words, sizeof(cv));
+    }
+    for (int i = 0; i < 8; i++) store_le32(out + 4 * i, cv[i]);
+    (void)stride; (void)increment;
+}
+
+#ifdef B3_HAVE_X86
+// Vector kernels: lane i of every register belongs to input i, so the
+// state words, counters and message words are laid out across the lanes
+// and one pass of the round function compresses all inputs at once.
+
+// Counter and chaining-value plumbing shared by the vector kernels
+static void b3_lane_counters(uint64_t counter, int increment, int lanes, uint32_t lo[16], uint32_t hi[16]) {
+    for (int i = 0; i < lanes; i++) {
+        uint64_t c = counter + (increment ? (uint64_t)i : 0);
+        lo[i] = (uint32_t)c;
+        hi[i] = (uint32_t)(c >> 32);
+    }
+}
+
+static void b3_lane_store(const uint32_t *words, int lanes, uint8_t *out) {
+    for (int lane = 0; lane < lanes; lane++) {
+        for (int i = 0; i < 8; i++) store_le32(out + 32 * lane + 4 * i, words[i * lanes + lane]);
+    }
+}
+
+#define ROTR_SSE2(x, n) _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - (n)))
+#define G_SSE2(a, b, c, d, x, y) do { \
+    a = _mm_add_epi32(_mm_add_epi32(a, b), x); d = ROTR_SSE2(_mm_xor_si128(d, a), 16); \
+    c = _mm_add_epi32(c, d); b = ROTR_SSE2(_mm_xor_si128(b, c), 12); \
+    a = _mm_add_epi32(_mm_add_epi32(a, b), y); d = ROTR_SSE2(_mm_xor_si128(d, a), 8); \
+    c = _mm_add_epi32(c, d); b = ROTR_SSE2(_mm_xor_si128(b, c), 7); \
+} while (0)
+
+// Four inputs. Each block's message words are transposed into the lanes
+// from four 4x4 word tiles.
+static void b3_many_sse2(const uint8_t *data, size_t stride, size_t blocks, const uint32_t key[8],
+                         uint64_t counter, int increment, uint8_t flags, uint8_t flags_start,
+                         uint8_t flags_end, uint8_t *out) {
+    uint32_t lo[16], hi[16], words[8 * 4];
+    __m128i h[8], v[16], m[16];
+    b3_lane_counters(counter, increment, 4, lo, hi);
+    for (int i = 0; i < 8; i++) h[i] = _mm_set1_epi32((int)key[i]);
+    
+    for (size_t b = 0; b < blocks; b++) {
+        const uint8_t *block = data + b * BLAKE3_BLOCK_LEN;
+        for (int k = 0; k < 4; k++) {
+            __m128i r0 = _mm_loadu_si128((const __m128i *)(block + 16 * k));
+            __m128i r1 = _mm_loadu_si128((const __m128i *)(block + stride + 16 * k));
+            __m128i r2 = _mm_loadu_si128((const __m128i *)(block + 2 * stride + 16 * k));
+            __m128i r3 = _mm_loadu_si128((const __m128i *)(block + 3 * stride + 16 * k));
+            __m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpacklo_epi32(r2, r3);
+            __m128i t2 = _mm_unpackhi_epi32(r0, r1), t3 = _mm_unpackhi_epi32(r2, r3);
+            m[4 * k] = _mm_unpacklo_epi64(t0, t1);
+            m[4 * k + 1] = _mm_unpackhi_epi64(t0, t1);
+            m[4 * k + 2] = _mm_unpacklo_epi64(t2, t3);
+            m[4 * k + 3] = _mm_unpackhi_epi64(t2, t3);
+        }
+        uint8_t block_flags = flags | (b == 0 ? flags_start : 0) | (b + 1 == blocks ? flags_end : 0);
+        for (int i = 0; i < 8; i++) v[i] = h[i];
+        for (int i = 0; i < 4; i++) v[8 + i] = _mm_set1_epi32((int)b3_iv[i]);
+        v[12] = _mm_loadu_si128((const __m128i *)lo);
+        v[13] = _mm_loadu_si128((const __m128i *)hi);
+        v[14] = _mm_set1_epi32(BLAKE3_BLOCK_LEN);
+        v[15] = _mm_set1_epi32(block_flags);
+        
+        B3_ROUNDS(G_SSE2, v, m);
+        for (int i = 0; i < 8; i++) h[i] = _mm_xor_si128(v[i], v[i + 8]);
+    }
+    
+    for (int i = 0; i < 8; i++) _mm_storeu_si128((__m128i *)(words + 4 * i), h[i]);
+    b3_lane_store(words, 4, out);
+}
+
+#define ROTR_AVX2(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define G_AVX2(a, b, c, d, x, y) do { \
+    a = _mm256_add_epi32(_mm256_add_epi32(a, b), x); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); \
+    c = _mm256_add_epi32(c, d); b = ROTR_AVX2(_mm256_xor_si256(b, c), 12); \
+    a = _mm256_add_epi32(_mm256_add_epi32(a, b), y); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8); \
+    c = _mm256_add_epi32(c, d); b = ROTR_AVX2(_mm256_xor_si256(b, c), 7); \
+} while (0)
+
+// Message words of one block of eight inputs, transposed as two 8x8 tiles:
+// 32-bit and 64-bit unpacks within each 128-bit half, then the halves
+__attribute__((target("avx2")))
+static inline void b3_load_avx2(const uint8_t *block, size_t stride, __m256i m[16]) {
+    for (int half = 0; half < 2; half++) {
+        __m256i r[8], t[8], u[8];
+        for (int i = 0; i < 8; i++) r[i] = _mm256_loadu_si256((const __m256i *)(block + i * stride + 32 * half));
+        for (int i = 0; i < 8; i += 2) {
+            t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+            t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+        }
+        for (int q = 0; q < 8; q += 4) {
+            u[q] = _mm256_unpacklo_epi64(t[q], t[q + 2]);
+            u[q + 1] = _mm256_unpackhi_epi64(t[q], t[q + 2]);
+            u[q + 2] = _mm256_unpacklo_epi64(t[q + 1], t[q + 3]);
+            u[q + 3] = _mm256_unpackhi_epi64(t[q + 1], t[q + 3]);
+        }
+        for (int c = 0; c < 4; c++) {
+            m[8 * half + c] = _mm256_permute2x128_si256(u[c], u[4 + c], 0x20);
+            m[8 * half + 4 + c] = _mm256_permute2x128_si256(u[c], u[4 + c], 0x31);
+        }
+    }
+}
+
+// Eight inputs; the byte-aligned rotations are byte shuffles
+__attribute__((target("avx2")))
+static void b3_many_avx2(const uint8_t *data, size_t stride, size_t blocks, const uint32_t key[8],
+                         uint64_t counter, int increment, uint8_t flags, uint8_t flags_start,
+                         uint8_t flags_end, uint8_t *out) {
+    const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                           2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    const __m256i rot8 = _mm256_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12,
+                                          1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12);
+    uint32_t lo[16], hi[16], words[8 * 8];
+    __m256i h[8], v[16], m[16];
+    b3_lane_counters(counter, increment, 8, lo, hi);
+    for (int i = 0; i < 8; i++) h[i] = _mm256_set1_epi32((int)key[i]);
+    
+    for (size_t b = 0; b < blocks; b++) {
+        const uint8_t *block = data + b * BLAKE3_BLOCK_LEN;
+        b3_load_avx2(block, stride, m);
+        uint8_t block_flags = flags | (b == 0 ? flags_start : 0) | (b + 1 == blocks ? flags_end : 0);
+        for (int i = 0; i < 8; i++) v[i] = h[i];
+        for (int i = 0; i < 4; i++) v[8 + i] = _mm256_set1_epi32((int)b3_iv[i]);
+        v[12] = _mm256_loadu_si256((const __m256i *)lo);
+        v[13] = _mm256_loadu_si256((const __m256i *)hi);
+        v[14] = _mm256_set1_epi32(BLAKE3_BLOCK_LEN);
+        v[15] = _mm256_set1_epi32(block_flags);
+        
+        B3_ROUNDS(G_AVX2, v, m);
+        for (int i = 0; i < 8; i++) h[i] = _mm256_xor_si256(v[i], v[i + 8]);
+    }
+    
+    for (int i = 0; i < 8; i++) _mm256_storeu_si256((__m256i *)(words + 8 * i), h[i]);
+    b3_lane_store(words, 8, out);
+}
+
+#define G_AVX512(a, b, c, d, x, y) do { \
+    a = _mm512_add_epi32(_mm512_add_epi32(a, b), x); d = _mm512_ror_epi32(_mm512_xor_si512(d, a), 16); \
+    c = _mm512_add_epi32(c, d); b = _mm512_ror_epi32(_mm512_xor_si512(b, c), 12); \
+    a = _mm512_add_epi32(_mm512_add_epi32(a, b), y); d = _mm512_ror_epi32(_mm512_xor_si512(d, a), 8); \
+    c = _mm512_add_epi32(c, d); b = _mm512_ror_epi32(_mm512_xor_si512(b, c), 7); \
+} while (0)
+
+// Message words of one block of sixteen inputs: a 16x16 transpose, first
+// within 128-bit lanes, then across them
+__attribute__((target("avx512f")))
+static inline void b3_load_avx512(const uint8_t *block, size_t stride, __m512i m[16]) {
+    __m512i r[16], t[16], u[16];
+    for (int i = 0; i < 16; i++) r[i] = _mm512_loadu_si512(block + i * stride);
+    for (int i = 0; i < 16; i += 2) {
+        t[i] = _mm512_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm512_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for (int q = 0; q < 16; q += 4) {
+        u[q] = _mm512_unpacklo_epi64(t[q], t[q + 2]);
+        u[q + 1] = _mm512_unpackhi_epi64(t[q], t[q + 2]);
+        u[q + 2] = _mm512_unpacklo_epi64(t[q + 1], t[q + 3]);
+        u[q + 3] = _mm512_unpackhi_epi64(t[q + 1], t[q + 3]);
+    }
+    // u[4q + c] holds column 4L + c of rows 4q..4q+3 in 128-bit lane L
+    for (int c = 0; c < 4; c++) {
+        __m512i x0 = _mm512_shuffle_i32x4(u[c], u[4 + c], 0x44);
+        __m512i x1 = _mm512_shuffle_i32x4(u[c], u[4 + c], 0xee);
+        __m512i y0 = _mm512_shuffle_i32x4(u[8 + c], u[12 + c], 0x44);
+        __m512i y1 = _mm512_shuffle_i32x4(u[8 + c], u[12 + c], 0xee);
+        m[c] = _mm512_shuffle_i32x4(x0, y0, 0x88);
+        m[4 + c] = _mm512_shuffle_i32x4(x0, y0, 0xdd);
+        m[8 + c] = _mm512_shuffle_i32x4(x1, y1, 0x88);
+        m[12 + c] = _mm512_shuffle_i32x4(x1, y1, 0xdd);
+    }
+}
+
+// Sixteen inputs, with native rotates
+__attribute__((target("avx512f")))
+static void b3_many_avx512(const uint8_t *data, size_t stride, size_t blocks, const uint32_t key[8],
+                           uint64_t counter, int increment, uint8_t flags, uint8_t flags_start,
+                           uint8_t flags_end, uint8_t *out) {
+    uint32_t lo[16], hi[16], words[8 * 16];
+    __m512i h[8], v[16], m[16];
+    b3_lane_counters(counter, increment, 16, lo, hi);
+    for (int i = 0; i < 8; i++) h[i] = _mm512_set1_epi32((int)key[i]);
+    
+    for (size_t b = 0; b < blocks; b++) {
+        const uint8_t *block = data + b * BLAKE3_BLOCK_LEN;
+        b3_load_avx512(block, stride, m);
+        uint8_t block_flags = flags | (b == 0 ? flags_start : 0) | (b + 1 == blocks ? flags_end : 0);
+        for (int i = 0; i < 8; i++) v[i] = h[i];
+        for (int i = 0; i < 4; i++) v[8 + i] = _mm512_set1_epi32((int)b3_iv[i]);
+        v[12] = _mm512_loadu_si512(lo);
+        v[13] = _mm512_loadu_si512(hi);
+        v[14] = _mm512_set1_epi32(BLAKE3_BLOCK_LEN);
+        v[15] = _mm512_set1_epi32(block_flags);
+        
+        B3_ROUNDS(G_AVX512, v, m);
+        for (int i = 0; i < 8; i++) h[i] = _mm512_xor_si512(v[i], v[i + 8]);
+    }
+    
+    for (int i = 0; i < 8; i++) _mm512_storeu_si512(words + 16 * i, h[i]);
+    b3_lane_store(words, 16, out);
+}
+#endif
+
+typedef struct {
+    B3ManyFn fn;
+    size_t lanes;
+} B3Kernel;
+
+// Widest kernel first; the scalar one (one lane) always ends the list
+static size_t b3_kernels(B3Kernel kernels[4]) {
+    size_t n = 0;
+#ifdef B3_HAVE_X86
+    if (__builtin_cpu_supports("avx512f")) kernels[n++] = (B3Kernel){ b3_many_avx512, 16 };
+    if (__builtin_cpu_supports("avx2")) kernels[n++] = (B3Kernel){ b3_many_avx2, 8 };
+    kernels[n++] = (B3Kernel){ b3_many_sse2, 4 };
+#endif
+    kernels[n++] = (B3Kernel){ b3_many_scalar, 1 };
+    return n;
+}
+
+const char* blake3_impl(void) {
+#ifdef B3_HAVE_X86
+    if (__builtin_cpu_supports("avx512f")) return "avx512";
+    if (__builtin_cpu_supports("avx2")) return "avx2";
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+static void b3_hash_many(const uint8_t *data, size_t count, size_t stride, size_t blocks, const uint32_t key[8],
+                         uint64_t counter, int increment, uint8_t flags, uint8_t flags_start, uint8_t flags_end,
+                         uint8_t *out) {
+    B3Kernel kernels[4];
+    size_t kernel_count = b3_kernels(kernels);
+    for (size_t k = 0; k < kernel_count; k++) {
+        size_t lanes = kernels[k].lanes;
+        while (count >= lanes) {
+            kernels[k].fn(data, stride, blocks, key, counter, increment, flags, flags_start, flags_end, out);
+            data += lanes * stride;
+            out += lanes * BLAKE3_OUT_LEN;
+            count -= lanes;
+            if (increment) counter += lanes;
+        }
+    }
+}
+
+// Chaining values of the two halves of a subtree of chunks (a power of two
+// between 2 and B3_SUBTREE_CHUNKS) starting at chunk counter. Each level of
+// parents is compressed many at a time like the chunks below it.
+static void b3_subtree(const uint8_t *input, size_t chunks, const uint32_t key[8], uint64_t counter,
+                       uint8_t out[2 * BLAKE3_OUT_LEN]) {
+    uint8_t cvs[B3_SUBTREE_CHUNKS * BLAKE3_OUT_LEN];
+    uint8_t parents[B3_SUBTREE_CHUNKS / 2 * BLAKE3_OUT_LEN];
+    
+    b3_hash_many(input, chunks, BLAKE3_CHUNK_LEN, B3_CHUNK_BLOCKS, key, counter, 1, 0, B3_CHUNK_START,
+                 B3_CHUNK_END, cvs);
+    while (chunks > 2) {
+        chunks /= 2;
+        b3_hash_many(cvs, chunks, 2 * BLAKE3_OUT_LEN, 1, key, 0, 0, B3_PARENT, 0, 0, parents);
+        memcpy(cvs, parents, chunks * BLAKE3_OUT_LEN);
+    }
+    memcpy(out, cvs, 2 * BLAKE3_OUT_LEN);
+}
+
+// A node whose compression is deferred: it becomes either a chaining value
+// or, for the root, the output bytes
+typedef struct {
+    uint32_t cv[8];
+    uint8_t block[BLAKE3_BLOCK_LEN];
+    uint8_t block_len;
+    uint64_t counter;
+    uint8_t flags;
+} B3Output;
+
+static void b3_output_cv(const B3Output *o, uint8_t cv[BLAKE3_OUT_LEN]) {
+    uint32_t words[16];
+    b3_compress(o->cv, o->block, o->block_len, o->counter, o->flags, words);
+    for (int i = 0; i < 8; i++) store_le32(cv + 4 * i, words[i]);
+}
+
+static B3Output b3_parent_output(const uint8_t block[BLAKE3_BLOCK_LEN], const uint32_t key[8]) {
+    B3Output o;
+    memcpy(o.cv, key, sizeof(o.cv));
+    memcpy(o.block, block, BLAKE3_BLOCK_LEN);
+    o.block_len = BLAKE3_BLOCK_LEN;
+    o.counter = 0;
+    o.flags = B3_PARENT;
+    return o;
+}
+
+static void b3_chunk_init(Blake3Chunk *chunk, const uint32_t key[8], uint64_t counter) {
+    memset(chunk, 0, sizeof(*chunk));
+    memcpy(chunk->cv, key, sizeof(chunk->cv));
+    chunk->counter = counter;
+}
+
+static size_t b3_chunk_len(const Blake3Chunk *chunk) {
+    return (size_t)chunk->blocks_compressed * BLAKE3_BLOCK_LEN + chunk->buf_len;
+}
+
+static uint8_t b3_chunk_start_flag(const Blake3Chunk *chunk) {
+    return chunk->blocks_compressed == 0 ? B3_CHUNK_START : 0;
+}
+
+// The last block stays buffered: it needs the CHUNK_END flag, and for a
+// single-chunk input the ROOT flag too
+static void b3_chunk_update(Blake3Chunk *chunk, const uint8_t *p, size_t len) {
+    uint32_t words[16];
+    while (len > 0) {
+        if (chunk->buf_len == BLAKE3_BLOCK_LEN) {
+            b3_compress(chunk->cv, chunk->buf, BLAKE3_BLOCK_LEN, chunk->counter, b3_chunk_start_flag(chunk), words);
+            memcpy(chunk->cv, words, sizeof(chunk->cv));
+            chunk->blocks_compressed++;
+            chunk->buf_len = 0;
+        }
+        size_t take = BLAKE3_BLOCK_LEN - chunk->buf_len;
+        if (take > len) take = len;
+        memcpy(chunk->buf + chunk->buf_len, p, take);
+        chunk->buf_len += (uint8_t)take;
+        p += take;
+        len -= take;
+    }
+}
+
+static B3Output b3_chunk_output(const Blake3Chunk *chunk) {
+    B3Output o;
+    memcpy(o.cv, chunk->cv, sizeof(o.cv));
+    memset(o.block, 0, sizeof(o.block));
+    memcpy(o.block, chunk->buf, chunk->buf_len);
+    o.block_len = chunk->buf_len;
+    o.counter = chunk->counter;
+    o.flags = b3_chunk_start_flag(chunk) | B3_CHUNK_END;
+    return o;
+}
+
+// Merge completed subtrees so the stack holds one cv per set bit of
+// total_chunks. Merging lazily, before the next push, keeps the last cv
+// out of a parent until it is known that more input follows.
+static void b3_merge_stack(Blake3Ctx *ctx, uint64_t total_chunks) {
+    size_t post_len = (size_t)__builtin_popcountll(total_chunks);
+    while (ctx->cv_stack_len > post_len) {
+        uint8_t *node = ctx->cv_stack + (ctx->cv_stack_len - 2) * BLAKE3_OUT_LEN;
+        B3Output o = b3_parent_output(node, ctx->key);
+        b3_output_cv(&o, node);
+        ctx->cv_stack_len--;
+    }
+}
+
+static void b3_push_cv(Blake3Ctx *ctx, const uint8_t cv[BLAKE3_OUT_LEN], uint64_t chunk_counter) {
+    b3_merge_stack(ctx, chunk_counter);
+    memcpy(ctx->cv_stack + ctx->cv_stack_len * BLAKE3_OUT_LEN, cv, BLAKE3_OUT_LEN);
+    ctx->cv_stack_len++;
+}
+
+void blake3_init(Blake3Ctx *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+    memcpy(ctx->key, b3_iv, sizeof(ctx->key));
+    b3_chunk_init(&ctx->chunk, ctx->key, 0);
+}
+
+void blake3_update(Blake3Ctx *ctx, const void *data, size_t len) {
+    const uint8_t *p = data;
+    uint8_t cv[2 * BLAKE3_OUT_LEN];
+    
+    // Finish a partly filled chunk first
+    if (b3_chunk_len(&ctx->chunk) > 0) {
+        size_t take = BLAKE3_CHUNK_LEN - b3_chunk_len(&ctx->chunk);
+        if (take > len) take = len;
+        b3_chunk_update(&ctx->chunk, p, take);
+        p += take;
+        len -= take;
+        if (len == 0) return;
+        B3Output o = b3_chunk_output(&ctx->chunk);
+        b3_output_cv(&o, cv);
+        b3_push_cv(ctx, cv, ctx->chunk.counter);
+        b3_chunk_init(&ctx->chunk, ctx->key, ctx->chunk.counter + 1);
+    }
+    
+    // Then whole subtrees straight from the input: the largest power of two
+    // chunks that fits and is aligned to the chunks before it. More than a
+    // chunk has to be left, so a final chunk never ends up on the stack.
+    while (len > BLAKE3_CHUNK_LEN) {
+        size_t subtree = BLAKE3_CHUNK_LEN;
+        while (subtree * 2 <= len && subtree < B3_SUBTREE_CHUNKS * BLAKE3_CHUNK_LEN) subtree *= 2;
+        uint64_t so_far = ctx->chunk.counter * BLAKE3_CHUNK_LEN;
+        while (((uint64_t)(subtree - 1) & so_far) != 0) subtree /= 2;
+        size_t chunks = subtree / BLAKE3_CHUNK_LEN;
+        
+        if (chunks == 1) {
+            Blake3Chunk chunk;
+            b3_chunk_init(&chunk, ctx->key, ctx->chunk.counter);
+            b3_chunk_update(&chunk, p, subtree);
+            B3Output o = b3_chunk_output(&chunk);
+            b3_output_cv(&o, cv);
+            b3_push_cv(ctx, cv, chunk.counter);
+        } else {
+            b3_subtree(p, chunks, ctx->key, ctx->chunk.counter, cv);
+            b3_push_cv(ctx, cv, ctx->chunk.counter);
+            b3_push_cv(ctx, cv + BLAKE3_OUT_LEN, ctx->chunk.counter + chunks / 2);
+        }
+        ctx->chunk.counter += chunks;
+        p += subtree;
+        len -= subtree;
+    }
+    
+    if (len > 0) {
+        b3_chunk_update(&ctx->chunk, p, len);
+        b3_merge_stack(ctx, ctx->chunk.counter);
+    }
+}
+
+void blake3_subtree_cv(const void *data, size_t len, uint64_t chunk_counter, uint8_t cv[BLAKE3_OUT_LEN]) {
+    const uint8_t *p = data;
+    size_t chunks = len / BLAKE3_CHUNK_LEN;
+    uint8_t halves[2 * BLAKE3_OUT_LEN];
+    
+    if (chunks == 1) {
+        Blake3Chunk chunk;
+        b3_chunk_init(&chunk, b3_iv, chunk_counter);
+        b3_chunk_update(&chunk, p, len);
+        B3Output o = b3_chunk_output(&chunk);
+        b3_output_cv(&o, cv);
+        return;
+    }
+    if (chunks <= B3_SUBTREE_CHUNKS) {
+        b3_subtree(p, chunks, b3_iv, chunk_counter, halves);
+        B3Output o = b3_parent_output(halves, b3_iv);
+        b3_output_cv(&o, cv);
+        return;
+    }
+    
+    // Bigger subtrees are built from B3_SUBTREE_CHUNKS pieces, merging
+    // equal-sized neighbours like a binary counter
+    uint8_t stack[(BLAKE3_MAX_DEPTH + 1) * BLAKE3_OUT_LEN];
+    size_t depth = 0;
+    for (size_t piece = 0; piece < chunks / B3_SUBTREE_CHUNKS; piece++) {
+        b3_subtree(p + piece * B3_SUBTREE_CHUNKS * BLAKE3_CHUNK_LEN, B3_SUBTREE_CHUNKS, b3_iv,
+                   chunk_counter + piece * B3_SUBTREE_CHUNKS, halves);
+        B3Output o = b3_parent_output(halves, b3_iv);
+        b3_output_cv(&o, stack + depth++ * BLAKE3_OUT_LEN);
+        for (size_t done = piece + 1; (done & 1) == 0; done >>= 1) {
+            depth--;
+            o = b3_parent_output(stack + (depth - 1) * BLAKE3_OUT_LEN, b3_iv);
+            b3_output_cv(&o, stack + (depth - 1) * BLAKE3_OUT_LEN);
+        }
+    }
+    memcpy(cv, stack, BLAKE3_OUT_LEN);
+}
+
+void blake3_append_subtree(Blake3Ctx *ctx, const uint8_t cv[BLAKE3_OUT_LEN], size_t len) {
+    b3_push_cv(ctx, cv, ctx->chunk.counter);
+    ctx->chunk.counter += len / BLAKE3_CHUNK_LEN;
+}
+
+void blake3_final(const Blake3Ctx *ctx, uint8_t *out, size_t out_len) {
+    B3Output o;
+    size_t remaining;
+    
+    if (ctx->cv_stack_len == 0) {
+        o = b3_chunk_output(&ctx->chunk);
+        remaining = 0;
+    } else if (b3_chunk_len(&ctx->chunk) > 0) {
+        o = b3_chunk_output(&ctx->chunk);
+        remaining = ctx->cv_stack_len;
+    } else {
+        // The input ended on a subtree boundary; the top two stack entries
+        // form the first parent
+        remaining = ctx->cv_stack_len - 2;
+        o = b3_parent_output(ctx->cv_stack + remaining * BLAKE3_OUT_LEN, ctx->key);
+    }
+    while (remaining > 0) {
+        uint8_t block[BLAKE3_BLOCK_LEN];
+        remaining--;
+        memcpy(block, ctx->cv_stack + remaining * BLAKE3_OUT_LEN, BLAKE3_OUT_LEN);
+        b3_output_cv(&o, block + BLAKE3_OUT_LEN);
+        o = b3_parent_output(block, ctx->key);
+    }
+    
+    // Root output: the root node compressed with successive counters
+    uint64_t counter = 0;
+    while (out_len > 0) {
+        uint32_t words[16];
+        uint8_t bytes[2 * BLAKE3_OUT_LEN];
+        b3_compress(o.cv, o.block, o.block_len, counter++, o.flags | B3_ROOT, words);
+        for (int i = 0; i < 16; i++) store_le32(bytes + 4 * i, words[i]);
+        size_t take = out_len < sizeof(bytes) ? out_len : sizeof(bytes);
+        memcpy(out, bytes, take);
+        out += take;
+        out_len -= take;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef BLAKE3_H
+#define BLAKE3_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// BLAKE3 (unkeyed hash mode). Input is split into 1 KB chunks that form
+// the leaves of a binary tree, so whole chunks, and the parent nodes above
+// them, are compressed many at a time: 4, 8 or 16 per call in SSE2, AVX2
+// or AVX-512 lanes, picked at run time. All paths give the same digests.
+
+#define BLAKE3_OUT_LEN 32
+#define BLAKE3_BLOCK_LEN 64
+#define BLAKE3_CHUNK_LEN 1024
+#define BLAKE3_MAX_DEPTH 54
+
+typedef struct {
+    uint32_t cv[8];
+    uint64_t counter;           // index of this chunk
+    uint8_t buf[BLAKE3_BLOCK_LEN];
+    uint8_t buf_len;
+    uint8_t blocks_compressed;
+} Blake3Chunk;
+
+typedef struct {
+    uint32_t key[8];
+    Blake3Chunk chunk;          // the chunk being filled
+    uint8_t cv_stack_len;
+    // Chaining values of completed subtrees, one per set bit of the chunk count
+    uint8_t cv_stack[(BLAKE3_MAX_DEPTH + 1) * BLAKE3_OUT_LEN];
+} Blake3Ctx;
+
+void blake3_init(Blake3Ctx *ctx);
+void blake3_update(Blake3Ctx *ctx, const void *data, size_t len);
+// Any output length; the first 32 bytes are the standard digest
+void blake3_final(const Blake3Ctx *ctx, uint8_t *out, size_t out_len);
+
+// Tree-parallel hashing: split the input into aligned subtrees of a
+// power-of-two number of chunks, compute their chaining values anywhere
+// (e.g. on other threads) with blake3_subtree_cv, then append them in order
+// to a context that sits on a chunk boundary. The input's last bytes must
+// still go through blake3_update, so the root is finalized normally.
+void blake3_subtree_cv(const void *data, size_t len, uint64_t chunk_counter, uint8_t cv[BLAKE3_OUT_LEN]);
+void blake3_append_subtree(Blake3Ctx *ctx, const uint8_t cv[BLAKE3_OUT_LEN], size_t len);
+
+// Kernel used for many chunks at once ("avx512", "avx2", "sse2" or "scalar")
+const char* blake3_impl(void);
+
+#endif
@@ -0,0 +1,213 @@
+#include "chunker.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define CDC_HAVE_AVX2 1
+#endif
+
+// Top bits of the hash, so every byte of the window takes part in the test
+#define CDC_MASK_STRICT (~0ULL << (64 - 15))
+#define CDC_MASK_LOOSE  (~0ULL << (64 - 11))
+
+static uint64_t gear[256];
+
+#define CDC_LANES 4
+
+typedef void (*CdcScanFn)(const uint8_t *data, size_t len, uint64_t *bits);
+static CdcScanFn cdc_scan;
+static const char *cdc_scan_name = "scalar";
+
+// Hash of the window ending just before pos. Terms older than CDC_WINDOW
+// bytes have been shifted out, so this equals the running hash from 0.
+static uint64_t gear_warm(const uint8_t *data, size_t pos) {
+    uint64_t h = 0;
+    for (size_t i = pos > CDC_WINDOW ? pos - CDC_WINDOW : 0; i < pos; i++) {
+        h = (h << 1) + gear[data[i]];
+    }
+    return h;
+}
+
+static void cdc_mark(uint64_t *bits, size_t pos) {
+    bits[pos / 64] |= 1ULL << (pos & 63);
+}
+
+// Length of each of the CDC_LANES stripes (whole bitmap words), or 0 when
+// the buffer is too short to be worth splitting
+static size_t cdc_stripe(size_t len) {
+    size_t stripe = (len / CDC_LANES) & ~(size_t)63;
+    return stripe >= 4 * CDC_WINDOW ? stripe : 0;
+}
+
+// Candidates for positions [from, to) in one sequential pass
+static void cdc_scan_range(const uint8_t *data, size_t from, size_t to, uint64_t *bits) {
+    uint64_t h = gear_warm(data, from);
+    for (size_t i = from; i < to; i++) {
+        h = (h << 1) + gear[data[i]];
+        if (!(h & CDC_MASK_LOOSE)) cdc_mark(bits, i);
+    }
+}
+
+// Each stripe's hash is warmed up on the window before it, which makes the
+// four chains identical to a single sequential pass
+static void cdc_scan_scalar(const uint8_t *data, size_t len, uint64_t *bits) {
+    size_t stripe = cdc_stripe(len);
+    if (stripe) {
+        const uint8_t *p1 = data + stripe, *p2 = data + 2 * stripe, *p3 = data + 3 * stripe;
+        uint64_t h0 = 0, h1 = gear_warm(data, stripe);
+        uint64_t h2 = gear_warm(data, 2 * stripe), h3 = gear_warm(data, 3 * stripe);
+        for (size_t i = 0; i < stripe; i++) {
+            h0 = (h0 << 1) + gear[data[i]];
+            h1 = (h1 << 1) + gear[p1[i]];
+            h2 = (h2 << 1) + gear[p2[i]];
+            h3 = (h3 << 1) + gear[p3[i]];
+            if ((h0 & CDC_MASK_LOOSE) && (h1 & CDC_MASK_LOOSE) && (h2 & CDC_MASK_LOOSE) &&
+                (h3 & CDC_MASK_LOOSE)) {
+                continue;
+            }
+            if (!(h0 & CDC_MASK_LOOSE)) cdc_mark(bits, i);
+            if (!(h1 & CDC_MASK_LOOSE)) cdc_mark(bits, stripe + i);
+            if (!(h2 & CDC_MASK_LOOSE)) cdc_mark(bits, 2 * stripe + i);
+            if (!(h3 & CDC_MASK_LOOSE)) cdc_mark(bits, 3 * stripe + i);
+        }
+    }
+    cdc_scan_range(data, CDC_LANES * stripe, len, bits);
+}
+
+#ifdef CDC_HAVE_AVX2
+// The same four chains in one register. The gear values are loaded with
+// scalar loads (faster than a gather for four lanes); the mask test and
+// the bitmap updates are branch-free and build one word per lane every
+// 64 bytes.
+__attribute__((target("avx2")))
+static void cdc_scan_avx2(const uint8_t *data, size_t len, uint64_t *bits) {
+    size_t stripe = cdc_stripe(len);
+    if (!stripe) {
+        cdc_scan_range(data, 0, len, bits);
+        return;
+    }
+    
+    const uint8_t *p1 = data + stripe, *p2 = data + 2 * stripe, *p3 = data + 3 * stripe;
+    __m256i h = _mm256_set_epi64x((long long)gear_warm(data, 3 * stripe), (long long)gear_warm(data, 2 * stripe),
+                                  (long long)gear_warm(data, stripe), 0);
+    const __m256i mask = _mm256_set1_epi64x((long long)CDC_MASK_LOOSE);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t lane_words = stripe / 64;
+    
+    for (size_t w = 0; w < lane_words; w++) {
+        __m256i found = zero;
+        __m256i bit = _mm256_set1_epi64x(1);
+        for (size_t i = w * 64; i < w * 64 + 64; i++) {
+            __m256i g = _mm256_set_epi64x((long long)gear[p3[i]], (long long)gear[p2[i]],
+                                          (long long)gear[p1[i]], (long long)gear[data[i]]);
+            h = _mm256_add_epi64(_mm256_slli_epi64(h, 1), g);
+            __m256i hit = _mm256_cmpeq_epi64(_mm256_and_si256(h, mask), zero);
+            found = _mm256_or_si256(found, _mm256_and_si256(hit, bit));
+            bit = _mm256_add_epi64(bit, bit);
+        }
+        
+        uint64_t words[CDC_LANES];
+        _mm256_storeu_si256((__m256i *)words, found);
+        for (int lane = 0; lane < CDC_LANES; lane++) {
+            bits[lane * lane_words + w] = words[lane];
+        }
+    }
+    cdc_scan_range(data, CDC_LANES * stripe, len, bits);
+}
+#endif
+
+void cdc_init(void) {
+    if (cdc_scan) return;
+    
+    // splitmix64 from a fixed seed, so cut points never change between runs
+    uint64_t x = 0x2545F4914F6CDD1DULL;
+    for (int i = 0; i < 256; i++) {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        gear[i] = z ^ (z >> 31);
+    }
+    
+    cdc_scan = cdc_scan_scalar;
+#ifdef CDC_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        cdc_scan = cdc_scan_avx2;
+        cdc_scan_name = "avx2";
+    }
+#endif
+}
+
+const char* cdc_impl(void) {
+    return cdc_scan_name;
+}
+
+void cdc_chunker_init(CdcChunker *chunker) {
+    memset(chunker, 0, sizeof(*chunker));
+}
+
+void cdc_chunker_free(CdcChunker *chunker) {
+    free(chunker->candidates);
+    memset(chunker, 0, sizeof(*chunker));
+}
+
+// First set bit in [lo, hi), or hi if there is none
+static size_t cdc_find(const uint64_t *bits, size_t lo, size_t hi) {
+    while (lo < hi) {
+        uint64_t word = bits[lo / 64] >> (lo & 63);
+        if (word) {
+            size_t pos = lo + (size_t)__builtin_ctzll(word);
+            return pos < hi ? pos : hi;
+        }
+        lo = (lo | 63) + 1;
+    }
+    return hi;
+}
+
+// First candidate in [lo, hi) that also meets the strict mask, or hi.
+// Strict matches are a subset of loose ones, so only those are rehashed.
+static size_t cdc_find_strict(const uint8_t *data, const uint64_t *bits, size_t lo, size_t hi) {
+    for (size_t pos = cdc_find(bits, lo, hi); pos < hi; pos = cdc_find(bits, pos + 1, hi)) {
+        if (!(gear_warm(data, pos + 1) & CDC_MASK_STRICT)) return pos;
+    }
+    return hi;
+}
+
+size_t cdc_split(CdcChunker *chunker, const uint8_t *data, size_t len, int final, uint32_t *lens) {
+    size_t words = (len + 63) / 64;
+    if (words > chunker->words) {
+        uint64_t *candidates = realloc(chunker->candidates, words * sizeof(uint64_t));
+        if (!candidates) return (size_t)-1;
+        chunker->candidates = candidates;
+        chunker->words = words;
+    }
+    if (!cdc_scan) cdc_init();
+    if (len) {
+        memset(chunker->candidates, 0, words * sizeof(uint64_t));
+        cdc_scan(data, len, chunker->candidates);
+    }
+    
+    // A cut at position pos ends the chunk with byte pos. Strict candidates
+    // give chunks of CDC_MIN_SIZE to CDC_AVG_SIZE bytes, loose ones the rest
+    // up to CDC_MAX_SIZE.
+    size_t count = 0;
+    size_t start = 0;
+    while (start < len) {
+        size_t end = start + (len - start < CDC_MAX_SIZE ? len - start : CDC_MAX_SIZE);
+        size_t normal = start + CDC_AVG_SIZE < end ? start + CDC_AVG_SIZE : end;
+        size_t pos = cdc_find_strict(data, chunker->candidates, start + CDC_MIN_SIZE - 1, normal);
+        if (pos == normal) pos = cdc_find(chunker->candidates, normal, end);
+        
+        size_t cut;
+        if (pos < end) {
+            cut = pos + 1 - start;
+        } else if (end - start == CDC_MAX_SIZE || final) {
+            cut = end - start;
+        } else {
+            break;                  // the next chunk may end in data not read yet
+        }
+        lens[count++] = (uint32_t)cut;
+        start += cut;
+    }
+    return count;
+}
@@ -0,0 +1,47 @@
+#ifndef CHUNKER_H
+#define CHUNKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Content-defined chunking (FastCDC style). A Gear rolling hash is computed
+// at every byte, h = (h << 1) + gear[byte], so the top bits of h depend on
+// exactly the last CDC_WINDOW bytes. A position is a cut candidate when
+// those bits are all zero: 15 bits (the strict mask) before the average
+// size is reached and 11 bits (the loose mask) after it, which pulls chunk
+// sizes towards the average ("normalized chunking").
+//
+// Because the hash depends only on the window and not on where the current
+// chunk started, loose candidates for a whole buffer are found in one pass
+// and cut points are then picked from the bitmap with bit scans; the rare
+// candidate that has to meet the strict mask is rehashed on the spot. The
+// pass hashes four stripes of the buffer side by side to break up the
+// recurrence's dependency chain, in AVX2 lanes where the CPU has them. Both
+// paths produce the same cuts.
+
+#define CDC_MIN_SIZE (2 * 1024)
+#define CDC_AVG_SIZE (8 * 1024)
+#define CDC_MAX_SIZE (64 * 1024)
+#define CDC_WINDOW 64
+
+typedef struct CdcChunker {
+    uint64_t *candidates;       // loose mask matches, one bit per byte
+    size_t words;
+} CdcChunker;
+
+// Build the gear table; call once before chunking from several threads
+void cdc_init(void);
+// Name of the candidate scan in use ("avx2" or "scalar")
+const char* cdc_impl(void);
+
+void cdc_chunker_init(CdcChunker *chunker);
+void cdc_chunker_free(CdcChunker *chunker);
+
+// Split data[0..len) into chunks, storing their lengths in lens (room for
+// len / CDC_MIN_SIZE + 1 entries) and returning how many there are. data
+// must start at a chunk boundary. Unless final is set, the bytes after the
+// last returned chunk are an incomplete chunk that has to be passed again,
+// followed by more data. Returns (size_t)-1 if out of memory.
+size_t cdc_split(CdcChunker *chunker, const uint8_t *data, size_t len, int final, uint32_t *lens);
+
+#endif
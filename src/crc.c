@@ -0,0 +1,227 @@
+#include "crc.h"
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define CRC_HAVE_X86 1
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#define CRC32C_U64(crc, p) ((uint32_t)_mm_crc32_u64(crc, load_le64(p)))
+#define CRC32C_U8(crc, b) _mm_crc32_u8(crc, b)
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC_HAVE_ARMV8 1
+#define CRC32C_TARGET
+#define CRC32C_U64(crc, p) __crc32cd(crc, load_le64(p))
+#define CRC32C_U8(crc, b) __crc32cb(crc, b)
+#endif
+
+#define CRC32C_POLY 0x82f63b78u                 // 0x1edc6f41 bit-reflected
+#define CRC64_POLY 0xc96c5795d7870f42ULL        // 0x42f0e1eba9ea3693 bit-reflected
+
+// The kernels work on the raw register; the public functions invert it on
+// the way in and out. Slicing-by-8: table[k][b] is byte b followed by k
+// zero bytes.
+static uint32_t crc32c_table[8][256];
+static uint64_t crc64_table[8][256];
+
+// Three-way CRC-32C: the crc32 instruction has three times the latency of
+// its throughput, so each round runs it over three neighbouring blocks at
+// once and then shifts the first two results over the blocks after them
+// with these tables (one per register byte)
+#define CRC32C_LONG 8192
+#define CRC32C_SHORT 256
+static uint32_t crc32c_long[4][256];
+static uint32_t crc32c_short[4][256];
+
+// Compiles to a single load on little-endian targets. The inline matters:
+// without it GCC 12 keeps this out of line, even inside the crc32 loops,
+// and the call costs more than the crc32 instruction it feeds.
+static inline uint64_t load_le64(const uint8_t *p) {
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+           (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+// GF(2) matrix (32 columns) times vector
+static uint32_t gf2_times(const uint32_t *mat, uint32_t vec) {
+    uint32_t sum = 0;
+    for (; vec; vec >>= 1, mat++) {
+        if (vec & 1) sum ^= *mat;
+    }
+    return sum;
+}
+
+// Tables appending len zero bytes (a power of two) to a CRC-32C register:
+// the operator for one zero bit, squared up to len * 8 bits
+static void crc32c_zeros(uint32_t zeros[4][256], size_t len) {
+    uint32_t op[32], square[32];
+    op[0] = CRC32C_POLY;
+    for (int n = 1; n < 32; n++) op[n] = 1u << (n - 1);
+    for (size_t bits = len * 8; bits > 1; bits >>= 1) {
+        for (int n = 0; n < 32; n++) square[n] = gf2_times(op, op[n]);
+        memcpy(op, square, sizeof(op));
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int k = 0; k < 4; k++) zeros[k][n] = gf2_times(op, n << (8 * k));
+    }
+}
+
+static uint32_t crc32c_shift(uint32_t zeros[4][256], uint32_t crc) {
+    return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^ zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+// Before main, so the tables are never built while threads race to use them
+__attribute__((constructor))
+static void crc_init(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        uint64_t d = n;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+            d = d & 1 ? (d >> 1) ^ CRC64_POLY : d >> 1;
+        }
+        crc32c_table[0][n] = c;
+        crc64_table[0][n] = d;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (int n = 0; n < 256; n++) {
+            crc32c_table[k][n] = (crc32c_table[k - 1][n] >> 8) ^ crc32c_table[0][crc32c_table[k - 1][n] & 0xff];
+            crc64_table[k][n] = (crc64_table[k - 1][n] >> 8) ^ crc64_table[0][crc64_table[k - 1][n] & 0xff];
+        }
+    }
+    crc32c_zeros(crc32c_long, CRC32C_LONG);
+    crc32c_zeros(crc32c_short, CRC32C_SHORT);
+}
+
+static uint32_t crc32c_table_update(uint32_t crc, const uint8_t *p, size_t len) {
+    const uint32_t (*t)[256] = crc32c_table;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v = load_le64(p) ^ crc;
+        crc = t[7][v & 0xff] ^ t[6][(v >> 8) & 0xff] ^ t[5][(v >> 16) & 0xff] ^ t[4][(v >> 24) & 0xff] ^
+              t[3][(v >> 32) & 0xff] ^ t[2][(v >> 40) & 0xff] ^ t[1][(v >> 48) & 0xff] ^ t[0][v >> 56];
+    }
+    while (len--) crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+    return crc;
+}
+
+static uint64_t crc64_table_update(uint64_t crc, const uint8_t *p, size_t len) {
+    const uint64_t (*t)[256] = crc64_table;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v = load_le64(p) ^ crc;
+        crc = t[7][v & 0xff] ^ t[6][(v >> 8) & 0xff] ^ t[5][(v >> 16) & 0xff] ^ t[4][(v >> 24) & 0xff] ^
+              t[3][(v >> 32) & 0xff] ^ t[2][(v >> 40) & 0xff] ^ t[1][(v >> 48) & 0xff] ^ t[0][v >> 56];
+    }
+    while (len--) crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+    return crc;
+}
+
+#ifdef CRC32C_TARGET
+// Three-way rounds over blocks of 3 * block bytes while they last
+CRC32C_TARGET
+static uint32_t crc32c_hw_rounds(uint32_t crc, const uint8_t **data, size_t *len, size_t block,
+                                 uint32_t zeros[4][256]) {
+    const uint8_t *p = *data;
+    for (; *len >= 3 * block; *len -= 3 * block) {
+        uint32_t crc1 = 0, crc2 = 0;
+        for (const uint8_t *end = p + block; p < end; p += 8) {
+            crc = CRC32C_U64(crc, p);
+            crc1 = CRC32C_U64(crc1, p + block);
+            crc2 = CRC32C_U64(crc2, p + 2 * block);
+        }
+        crc = crc32c_shift(zeros, crc) ^ crc1;
+        crc = crc32c_shift(zeros, crc) ^ crc2;
+        p += 2 * block;
+    }
+    *data = p;
+    return crc;
+}
+
+CRC32C_TARGET
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t len) {
+    for (; len && ((uintptr_t)p & 7); len--) crc = CRC32C_U8(crc, *p++);
+    crc = crc32c_hw_rounds(crc, &p, &len, CRC32C_LONG, crc32c_long);
+    crc = crc32c_hw_rounds(crc, &p, &len, CRC32C_SHORT, crc32c_short);
+    for (; len >= 8; p += 8, len -= 8) crc = CRC32C_U64(crc, p);
+    for (; len; len--) crc = CRC32C_U8(crc, *p++);
+    return crc;
+}
+#endif
+
+static int crc32c_have_hw(void) {
+#if defined(CRC_HAVE_X86)
+    return __builtin_cpu_supports("sse4.2");
+#elif defined(CRC_HAVE_ARMV8)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+#ifdef CRC_HAVE_X86
+// CRC-64 by carry-less multiplication. Four 128-bit accumulators each take
+// every fourth 16-byte block: an accumulator X = H:L (first 8 bytes H) is
+// moved D bits further along as H * (x^(D+64) mod P) + L * (x^D mod P),
+// which is congruent to X * x^D and fits in 128 bits again. The constants
+// are bit-reflected and hold one power of x less, as a reflected product
+// comes out shifted by one. What is left at the end is 16 bytes with the
+// same CRC as everything folded into them, finished with the tables.
+__attribute__((target("pclmul")))
+static __m128i crc64_fold(__m128i x, __m128i k, __m128i next) {
+    __m128i h = _mm_clmulepi64_si128(x, k, 0x00);
+    __m128i l = _mm_clmulepi64_si128(x, k, 0x11);
+    return _mm_xor_si128(_mm_xor_si128(h, l), next);
+}
+
+__attribute__((target("pclmul")))
+static uint64_t crc64_pclmul(uint64_t crc, const uint8_t *p, size_t len) {
+    const __m128i k512 = _mm_set_epi64x(0x081f6054a7842df4LL, 0x6ae3efbb9dd441f3LL);
+    const __m128i k128 = _mm_set_epi64x((long long)0xdabe95afc7875f40ULL, (long long)0xe05dd497ca393ae4ULL);
+    __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)p), _mm_cvtsi64_si128((long long)crc));
+    __m128i x1 = _mm_loadu_si128((const __m128i *)(p + 16));
+    __m128i x2 = _mm_loadu_si128((const __m128i *)(p + 32));
+    __m128i x3 = _mm_loadu_si128((const __m128i *)(p + 48));
+    for (p += 64, len -= 64; len >= 64; p += 64, len -= 64) {
+        x0 = crc64_fold(x0, k512, _mm_loadu_si128((const __m128i *)p));
+        x1 = crc64_fold(x1, k512, _mm_loadu_si128((const __m128i *)(p + 16)));
+        x2 = crc64_fold(x2, k512, _mm_loadu_si128((const __m128i *)(p + 32)));
+        x3 = crc64_fold(x3, k512, _mm_loadu_si128((const __m128i *)(p + 48)));
+    }
+    x1 = crc64_fold(x0, k128, x1);
+    x2 = crc64_fold(x1, k128, x2);
+    x3 = crc64_fold(x2, k128, x3);
+    for (; len >= 16; p += 16, len -= 16) x3 = crc64_fold(x3, k128, _mm_loadu_si128((const __m128i *)p));
+    
+    uint8_t last[16];
+    _mm_storeu_si128((__m128i *)last, x3);
+    return crc64_table_update(crc64_table_update(0, last, 16), p, len);
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+#ifdef CRC32C_TARGET
+    if (crc32c_have_hw()) return ~crc32c_hw(~crc, data, len);
+#endif
+    return ~crc32c_table_update(~crc, data, len);
+}
+
+uint64_t crc64(uint64_t crc, const void *data, size_t len) {
+#ifdef CRC_HAVE_X86
+    if (len >= 64 && __builtin_cpu_supports("pclmul")) return ~crc64_pclmul(~crc, data, len);
+#endif
+    return ~crc64_table_update(~crc, data, len);
+}
+
+const char* crc32c_impl(void) {
+#if defined(CRC_HAVE_X86)
+    if (crc32c_have_hw()) return "sse4.2";
+#elif defined(CRC_HAVE_ARMV8)
+    return "armv8";
+#endif
+    return "table";
+}
+
+const char* crc64_impl(void) {
+#ifdef CRC_HAVE_X86
+    if (__builtin_cpu_supports("pclmul")) return "pclmul";
+#endif
+    return "table";
+}
@@ -0,0 +1,24 @@
+#ifndef CRC_H
+#define CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32C (Castagnoli: iSCSI, ext4, btrfs) and CRC-64/XZ (ECMA-182
+// polynomial, bit-reflected, as in xz and 7-Zip). Both take the CRC of the
+// data so far (0 to start) and return it extended by len more bytes, so
+// crc32c(0, "123456789", 9) == 0xe3069283 and
+// crc64(0, "123456789", 9) == 0x995dc9bbdf1939fa.
+//
+// CRC-32C uses the SSE4.2 or ARMv8 crc32c instructions on three
+// interleaved streams; CRC-64 folds 64 bytes at a time with PCLMULQDQ.
+// Without them both fall back to slicing-by-8 tables.
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+uint64_t crc64(uint64_t crc, const void *data, size_t len);
+
+// Kernel in use ("sse4.2", "armv8", "pclmul" or "table")
+const char* crc32c_impl(void);
+const char* crc64_impl(void);
+
+#endif
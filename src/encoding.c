@@ -1,4 +1,5 @@
 #include "encoding.h"
+#include "reader.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,131 +9,458 @@
 // Base64 encoding/decoding
 static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-char* base64_encode_data(const unsigned char *data, size_t input_length, size_t *output_length) {
-    *output_length = 4 * ((input_length + 2) / 3);
-    char *encoded_data = malloc(*output_length + 1);
-    if (!encoded_data) return NULL;
-    
-    for (size_t i = 0, j = 0; i < input_length;) {
-        uint32_t octet_a = i < input_length ? data[i++] : 0;
-        uint32_t octet_b = i < input_length ? data[i++] : 0;
-        uint32_t octet_c = i < input_length ? data[i++] : 0;
-        uint32_t triple = (octet_a << 16) + (octet_b << 8) + octet_c;
+// Sextet of every byte, 0x80 for bytes outside the alphabet: the top bit
+// survives ORing lookups together, so one test checks a whole group
+static uint8_t base64_values[256];
+
+__attribute__((constructor))
+static void base64_init(void) {
+    memset(base64_values, 0x80, sizeof(base64_values));
+    for (int i = 0; i < 64; i++) base64_values[(unsigned char)base64_chars[i]] = (uint8_t)i;
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define BASE64_HAVE_X86 1
+
+// Widest kernel this CPU runs: 3 AVX-512 VBMI, 2 AVX2, 1 SSSE3, 0 none
+static int base64_level(void) {
+    if (__builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw")) return 3;
+    if (__builtin_cpu_supports("avx2")) return 2;
+    if (__builtin_cpu_supports("ssse3")) return 1;
+    return 0;
+}
+
+// The kernels follow Muła and Lemire. Encoding shuffles each 3-byte group
+// a b c into b a c b, which two multiplies turn into one sextet per byte;
+// those become ASCII by adding an offset picked by their range. Decoding
+// classifies every character by its two nibbles, which both checks it and
+// gives the offset back to its sextet, then packs four sextets into three
+// bytes with two multiply-adds. Each kernel returns the input it consumed;
+// the scalar code does the rest, and reports any invalid input.
+__attribute__((target("ssse3")))
+static __m128i base64_sextets_ssse3(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    __m128i hi = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i lo = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(hi, lo);
+}
+
+// Offsets: [0] 'a'-26 for 26..51, [1..10] '0'-52, [11] '+'-62, [12] '/'-63,
+// [13] 'A' for 0..25, which saturating 51 away and the compare pick out
+__attribute__((target("ssse3")))
+static __m128i base64_ascii_ssse3(__m128i sextets) {
+    const __m128i offsets = _mm_setr_epi8(71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 65, 0, 0);
+    __m128i range = _mm_subs_epu8(sextets, _mm_set1_epi8(51));
+    range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), sextets), _mm_set1_epi8(13)));
+    return _mm_add_epi8(sextets, _mm_shuffle_epi8(offsets, range));
+}
+
+__attribute__((target("ssse3")))
+static size_t base64_encode_ssse3(const uint8_t *in, size_t len, char *out) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 12, out += 16) {
+        __m128i sextets = base64_sextets_ssse3(_mm_loadu_si128((const __m128i *)(in + i)));
+        _mm_storeu_si128((__m128i *)out, base64_ascii_ssse3(sextets));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t base64_encode_avx2(const uint8_t *in, size_t len, char *out) {
+    const __m256i shuffle = _mm256_broadcastsi128_si256(
+        _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m256i offsets = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 65, 0, 0));
+    size_t i = 0;
+    for (; i + 28 <= len; i += 24, out += 32) {
+        // 12 bytes into each 128-bit lane
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + i))),
+                                            _mm_loadu_si128((const __m128i *)(in + i + 12)), 1);
+        v = _mm256_shuffle_epi8(v, shuffle);
+        __m256i hi = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)),
+                                        _mm256_set1_epi32(0x04000040));
+        __m256i lo = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)),
+                                        _mm256_set1_epi32(0x01000010));
+        __m256i sextets = _mm256_or_si256(hi, lo);
+        __m256i range = _mm256_subs_epu8(sextets, _mm256_set1_epi8(51));
+        range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), sextets),
+                                                        _mm256_set1_epi8(13)));
+        _mm256_storeu_si256((__m256i *)out, _mm256_add_epi8(sextets, _mm256_shuffle_epi8(offsets, range)));
+    }
+    return i;
+}
+
+// VBMI does the whole job with byte permutes: multishift pulls each sextet
+// out at its bit offset, and the alphabet itself is the lookup table
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static size_t base64_encode_avx512(const uint8_t *in, size_t len, char *out) {
+    const __m512i shuffle = _mm512_setr_epi32(
+        0x01020001, 0x04050304, 0x07080607, 0x0a0b090a, 0x0d0e0c0d, 0x10110f10, 0x13141213, 0x16171516,
+        0x191a1819, 0x1c1d1b1c, 0x1f201e1f, 0x22232122, 0x25262425, 0x28292728, 0x2b2c2a2b, 0x2e2f2d2e);
+    const __m512i shifts = _mm512_set1_epi64(0x3036242a1016040aLL);
+    const __m512i alphabet = _mm512_loadu_si512(base64_chars);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 48, out += 64) {
+        __m512i v = _mm512_permutexvar_epi8(shuffle, _mm512_loadu_si512(in + i));
+        __m512i sextets = _mm512_multishift_epi64_epi8(shifts, v);
+        _mm512_storeu_si512(out, _mm512_permutexvar_epi8(sextets, alphabet));
+    }
+    return i;
+}
+
+// Decoding tables: lo and hi have a common bit for every byte outside the
+// alphabet; roll is the offset to the sextet by high nibble ('/' shares
+// its nibble with '+' and is moved to slot 1)
+#define BASE64_DEC_LO 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a
+#define BASE64_DEC_HI 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+#define BASE64_DEC_ROLL 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+
+// Output is written 16 bytes at a time for 12, so a block is only taken
+// while 8 more characters follow: they decode to the 4 bytes overwritten
+__attribute__((target("ssse3")))
+static size_t base64_decode_ssse3(const char *in, size_t len, uint8_t *out) {
+    const __m128i lut_lo = _mm_setr_epi8(BASE64_DEC_LO);
+    const __m128i lut_hi = _mm_setr_epi8(BASE64_DEC_HI);
+    const __m128i lut_roll = _mm_setr_epi8(BASE64_DEC_ROLL);
+    const __m128i mask_2f = _mm_set1_epi8(0x2f);
+    size_t i = 0;
+    for (; i + 24 <= len; i += 16, out += 12) {
+        __m128i str = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+        __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128()))) break;
         
-        encoded_data[j++] = base64_chars[(triple >> 18) & 0x3F];
-        encoded_data[j++] = base64_chars[(triple >> 12) & 0x3F];
-        encoded_data[j++] = base64_chars[(triple >> 6) & 0x3F];
-        encoded_data[j++] = base64_chars[triple & 0x3F];
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(str, mask_2f), hi_nibbles));
+        str = _mm_add_epi8(str, roll);
+        str = _mm_madd_epi16(_mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140)), _mm_set1_epi32(0x00011000));
+        str = _mm_shuffle_epi8(str, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128((__m128i *)out, str);
     }
-    
-    int padding = input_length % 3;
-    if (padding > 0) {
-        for (int i = 0; i < 3 - padding; i++)
-            encoded_data[*output_length - 1 - i] = '=';
+    return i;
+}
+
+// 32 bytes written for 24: 16 more characters must follow
+__attribute__((target("avx2")))
+static size_t base64_decode_avx2(const char *in, size_t len, uint8_t *out) {
+    const __m256i lut_lo = _mm256_broadcastsi128_si256(_mm_setr_epi8(BASE64_DEC_LO));
+    const __m256i lut_hi = _mm256_broadcastsi128_si256(_mm_setr_epi8(BASE64_DEC_HI));
+    const __m256i lut_roll = _mm256_broadcastsi128_si256(_mm_setr_epi8(BASE64_DEC_ROLL));
+    const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+    const __m256i pack = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    size_t i = 0;
+    for (; i + 48 <= len; i += 32, out += 24) {
+        __m256i str = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+        __m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        if (!_mm256_testz_si256(lo, hi)) break;
+        
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(str, mask_2f), hi_nibbles));
+        str = _mm256_add_epi8(str, roll);
+        str = _mm256_madd_epi16(_mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140)),
+                                _mm256_set1_epi32(0x00011000));
+        str = _mm256_shuffle_epi8(str, pack);
+        // 12 bytes at the bottom of each lane
+        str = _mm256_permutevar8x32_epi32(str, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256((__m256i *)out, str);
     }
-    
+    return i;
+}
+
+// base64_values is the lookup table: a two-register permute maps all 128
+// ASCII codes, and any top bit in the input or its sextet is an error
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static size_t base64_decode_avx512(const char *in, size_t len, uint8_t *out) {
+    const __m512i values_lo = _mm512_loadu_si512(base64_values);
+    const __m512i values_hi = _mm512_loadu_si512(base64_values + 64);
+    const __m512i pack = _mm512_setr_epi32(
+        0x06000102, 0x090a0405, 0x0c0d0e08, 0x16101112, 0x191a1415, 0x1c1d1e18, 0x26202122, 0x292a2425,
+        0x2c2d2e28, 0x36303132, 0x393a3435, 0x3c3d3e38, 0, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64, out += 48) {
+        __m512i str = _mm512_loadu_si512(in + i);
+        __m512i sextets = _mm512_permutex2var_epi8(values_lo, str, values_hi);
+        if (_mm512_movepi8_mask(_mm512_or_si512(sextets, str))) break;
+        
+        sextets = _mm512_madd_epi16(_mm512_maddubs_epi16(sextets, _mm512_set1_epi32(0x01400140)),
+                                    _mm512_set1_epi32(0x00011000));
+        _mm512_mask_storeu_epi8(out, 0xffffffffffffULL, _mm512_permutexvar_epi8(pack, sextets));
+    }
+    return i;
+}
+#endif
+
+// Input bytes taken by the SIMD kernel, a multiple of 3
+static size_t base64_encode_simd(const uint8_t *in, size_t len, char *out) {
+#ifdef BASE64_HAVE_X86
+    switch (base64_level()) {
+        case 3: return base64_encode_avx512(in, len, out);
+        case 2: return base64_encode_avx2(in, len, out);
+        case 1: return base64_encode_ssse3(in, len, out);
+    }
+#endif
+    (void)in; (void)len; (void)out;
+    return 0;
+}
+
+// Characters taken by the SIMD kernel, a multiple of 4
+static size_t base64_decode_simd(const char *in, size_t len, uint8_t *out) {
+#ifdef BASE64_HAVE_X86
+    switch (base64_level()) {
+        case 3: return base64_decode_avx512(in, len, out);
+        case 2: return base64_decode_avx2(in, len, out);
+        case 1: return base64_decode_ssse3(in, len, out);
+    }
+#endif
+    (void)in; (void)len; (void)out;
+    return 0;
+}
+
+const char* base64_impl(void) {
+#ifdef BASE64_HAVE_X86
+    switch (base64_level()) {
+        case 3: return "avx512vbmi";
+        case 2: return "avx2";
+        case 1: return "ssse3";
+    }
+#endif
+    return "scalar";
+}
+
+// Whole 3-byte groups only; returns the characters written
+static size_t base64_encode_groups(const unsigned char *in, size_t len, char *out) {
+    size_t i = base64_encode_simd(in, len, out);
+    size_t j = i / 3 * 4;
+    for (; i + 3 <= len; i += 3) {
+        uint32_t triple = ((uint32_t)in[i] << 16) | ((uint32_t)in[i + 1] << 8) | in[i + 2];
+        out[j++] = base64_chars[(triple >> 18) & 0x3F];
+        out[j++] = base64_chars[(triple >> 12) & 0x3F];
+        out[j++] = base64_chars[(triple >> 6) & 0x3F];
+        out[j++] = base64_chars[triple & 0x3F];
+    }
+    return j;
+}
+
+size_t base64_encode(const void *data, size_t len, char *out) {
+    const unsigned char *in = data;
+    size_t j = base64_encode_groups(in, len, out);
+    size_t i = len / 3 * 3;
+    if (i < len) {
+        uint32_t triple = (uint32_t)in[i] << 16;
+        if (i + 1 < len) triple |= (uint32_t)in[i + 1] << 8;
+        out[j++] = base64_chars[(triple >> 18) & 0x3F];
+        out[j++] = base64_chars[(triple >> 12) & 0x3F];
+        out[j++] = i + 1 < len ? base64_chars[(triple >> 6) & 0x3F] : '=';
+        out[j++] = '=';
+    }
+    return j;
+}
+
+char* base64_encode_data(const unsigned char *data, size_t input_length, size_t *output_length) {
+    char *encoded_data = malloc(4 * ((input_length + 2) / 3) + 1);
+    if (!encoded_data) return NULL;
+    *output_length = base64_encode(data, input_length, encoded_data);
     encoded_data[*output_length] = '\0';
     return encoded_data;
 }
 
-int cmd_base64_encode(const char *input, int is_file) {
-    unsigned char *data;
-    size_t length;
+// Files are encoded as they stream in, a reader chunk at a time, so the
+// size of the input does not matter
+#define BASE64_PIECE (48 * 1024)
+
+static int base64_encode_file(const char *path) {
+    Reader *reader = reader_open(path, 0);
+    if (!reader) {
+        fprintf(stderr, "Cannot open file: %s\n", path);
+        return 1;
+    }
     
-    if (is_file) {
-        FILE *fp = fopen(input, "rb");
-        if (!fp) {
-            fprintf(stderr, "Cannot open file: %s\n", input);
-            return 1;
+    static char out[BASE64_PIECE / 3 * 4];
+    unsigned char carry[3];
+    size_t carried = 0;
+    const uint8_t *data;
+    long n;
+    
+    while ((n = reader_next(reader, &data)) > 0) {
+        size_t len = (size_t)n;
+        // Complete a group left over from the previous chunk
+        while (carried > 0 && carried < 3 && len > 0) {
+            carry[carried++] = *data++;
+            len--;
         }
-        
-        fseek(fp, 0, SEEK_END);
-        length = ftell(fp);
-        fseek(fp, 0, SEEK_SET);
-        
-        data = malloc(length);
-        fread(data, 1, length, fp);
-        fclose(fp);
-    } else {
-        data = (unsigned char*)input;
-        length = strlen(input);
+        if (carried == 3) {
+            fwrite(out, 1, base64_encode_groups(carry, 3, out), stdout);
+            carried = 0;
+        }
+        while (len >= 3) {
+            size_t piece = len < BASE64_PIECE ? len / 3 * 3 : BASE64_PIECE;
+            fwrite(out, 1, base64_encode_groups(data, piece, out), stdout);
+            data += piece;
+            len -= piece;
+        }
+        memcpy(carry + carried, data, len);
+        carried += len;
+    }
+    reader_close(reader);
+    if (n < 0) {
+        fprintf(stderr, "Error reading file: %s\n", path);
+        return 1;
     }
     
+    fwrite(out, 1, base64_encode(carry, carried, out), stdout);
+    putchar('\n');
+    return 0;
+}
+
+int cmd_base64_encode(const char *input, int is_file) {
+    if (is_file) return base64_encode_file(input);
+    
     size_t output_length;
-    char *encoded = base64_encode_data(data, length, &output_length);
+    char *encoded = base64_encode_data((const unsigned char *)input, strlen(input), &output_length);
     
     if (encoded) {
         printf("%s\n", encoded);
         free(encoded);
     }
-    
-    if (is_file) free(data);
     return 0;
 }
 
-int base64_decode_char(char c) {
-    if (c >= 'A' && c <= 'Z') return c - 'A';
-    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
-    if (c >= '0' && c <= '9') return c - '0' + 52;
-    if (c == '+') return 62;
-    if (c == '/') return 63;
-    return -1;
+int base64_decode(const char *in, size_t len, uint8_t *out, size_t *out_len) {
+    // Padding ends the input: take it off and decode what is left as an
+    // unpadded tail
+    if (len % 4 == 0 && len > 0 && in[len - 1] == '=') len -= in[len - 2] == '=' ? 2 : 1;
+    if (len % 4 == 1) return -1;
+    
+    // The SIMD kernels stop at the first block with anything invalid in it
+    const unsigned char *s = (const unsigned char *)in;
+    size_t i = base64_decode_simd(in, len, out);
+    size_t j = i / 4 * 3;
+    for (; i + 4 <= len; i += 4) {
+        uint32_t a = base64_values[s[i]], b = base64_values[s[i + 1]];
+        uint32_t c = base64_values[s[i + 2]], d = base64_values[s[i + 3]];
+        if ((a | b | c | d) & 0x80) return -1;
+        uint32_t quad = (a << 18) | (b << 12) | (c << 6) | d;
+        out[j++] = (uint8_t)(quad >> 16);
+        out[j++] = (uint8_t)(quad >> 8);
+        out[j++] = (uint8_t)quad;
+    }
+    if (i < len) {
+        uint32_t a = base64_values[s[i]], b = base64_values[s[i + 1]];
+        uint32_t c = len - i > 2 ? base64_values[s[i + 2]] : 0;
+        if ((a | b | c) & 0x80) return -1;
+        // The bits past the last byte must be zero (RFC 4648 canonical
+        // encoding), or "aB==" and "aA==" would both decode to "h"
+        if (len - i > 2 ? (c & 0x03) : (b & 0x0f)) return -1;
+        uint32_t quad = (a << 18) | (b << 12) | (c << 6);
+        out[j++] = (uint8_t)(quad >> 16);
+        if (len - i > 2) out[j++] = (uint8_t)(quad >> 8);
+    }
+    *out_len = j;
+    return 0;
 }
 
-int cmd_base64_decode(const char *input, int is_file) {
-    const char *data;
-    char *file_data = NULL;
-    
-    if (is_file) {
-        FILE *fp = fopen(input, "r");
-        if (!fp) {
-            fprintf(stderr, "Cannot open file: %s\n", input);
-            return 1;
+// Copy all but whitespace from *data (*len bytes) to out, at most room
+// characters, advancing *data and *len past what was taken. Eight bytes go
+// at once while none of them is below '!': base64 files are mostly long
+// runs between line breaks.
+static size_t base64_compact(const uint8_t **data, size_t *len, char *out, size_t room) {
+    const uint8_t *p = *data, *end = p + *len;
+    size_t n = 0;
+    while (p < end && n < room) {
+        if (end - p >= 8 && room - n >= 8) {
+            uint64_t w;
+            memcpy(&w, p, 8);
+            if (!((w - 0x2121212121212121ULL) & ~w & 0x8080808080808080ULL)) {
+                memcpy(out + n, p, 8);
+                p += 8;
+                n += 8;
+                continue;
+            }
         }
-        
-        fseek(fp, 0, SEEK_END);
-        long length = ftell(fp);
-        fseek(fp, 0, SEEK_SET);
-        
-        file_data = malloc(length + 1);
-        fread(file_data, 1, length, fp);
-        file_data[length] = '\0';
-        fclose(fp);
-        data = file_data;
-    } else {
-        data = input;
+        uint8_t c = *p++;
+        if (c != '\n' && c != '\r' && c != ' ' && c != '\t') out[n++] = (char)c;
+    }
+    *data = p;
+    *len = (size_t)(end - p);
+    return n;
+}
+
+// Decode and write out the characters collected so far. Padding can only
+// end the input, so once some has been seen nothing else may follow.
+static int base64_decode_pending(const char *text, size_t *pending, uint8_t *out, int *finished) {
+    size_t out_len;
+    if (*finished || base64_decode(text, *pending, out, &out_len) != 0) return 1;
+    fwrite(out, 1, out_len, stdout);
+    *finished = text[*pending - 1] == '=';
+    *pending = 0;
+    return 0;
+}
+
+// Streaming decode of a file: line breaks and other whitespace are
+// skipped, the decoded bytes are written out as they are (not as text).
+// Characters are gathered BASE64_PIECE at a time, a whole number of
+// groups, and decoded a buffer at once.
+static int base64_decode_file(const char *path) {
+    Reader *reader = reader_open(path, 0);
+    if (!reader) {
+        fprintf(stderr, "Cannot open file: %s\n", path);
+        return 1;
     }
     
-    size_t input_length = strlen(data);
-    size_t output_length = input_length / 4 * 3;
-    
-    if (data[input_length - 1] == '=') output_length--;
-    if (data[input_length - 2] == '=') output_length--;
+    static char text[BASE64_PIECE];
+    static uint8_t out[BASE64_PIECE / 4 * 3];
+    size_t pending = 0;
+    int finished = 0;
+    int bad = 0;
+    const uint8_t *data;
+    long n = 0;
     
-    unsigned char *decoded = malloc(output_length + 1);
+    while (!bad && (n = reader_next(reader, &data)) > 0) {
+        size_t len = (size_t)n;
+        while (!bad && len > 0) {
+            pending += base64_compact(&data, &len, text + pending, sizeof(text) - pending);
+            if (pending == sizeof(text)) bad = base64_decode_pending(text, &pending, out, &finished);
+        }
+    }
+    reader_close(reader);
+    if (n < 0) {
+        fprintf(stderr, "Error reading file: %s\n", path);
+        return 1;
+    }
     
-    for (size_t i = 0, j = 0; i < input_length;) {
-        uint32_t a = data[i] == '=' ? 0 : base64_decode_char(data[i]);
-        i++;
-        uint32_t b = data[i] == '=' ? 0 : base64_decode_char(data[i]);
-        i++;
-        uint32_t c = data[i] == '=' ? 0 : base64_decode_char(data[i]);
-        i++;
-        uint32_t d = data[i] == '=' ? 0 : base64_decode_char(data[i]);
-        i++;
-        
-        uint32_t triple = (a << 18) + (b << 12) + (c << 6) + d;
-        
-        if (j < output_length) decoded[j++] = (triple >> 16) & 0xFF;
-        if (j < output_length) decoded[j++] = (triple >> 8) & 0xFF;
-        if (j < output_length) decoded[j++] = triple & 0xFF;
+    // Unpadded input may end in a group of two or three characters
+    if (!bad && pending > 0) bad = base64_decode_pending(text, &pending, out, &finished);
+    if (bad) {
+        fprintf(stderr, "Invalid base64 input: %s\n", path);
+        return 1;
     }
+    return 0;
+}
+
+int cmd_base64_decode(const char *input, int is_file) {
+    if (is_file) return base64_decode_file(input);
     
-    decoded[output_length] = '\0';
-    printf("%s\n", decoded);
+    size_t input_length = strlen(input);
+    size_t output_length;
+    uint8_t *decoded = malloc(input_length / 4 * 3 + 3);
+    if (!decoded) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    if (base64_decode(input, input_length, decoded, &output_length) != 0) {
+        fprintf(stderr, "Invalid base64 input\n");
+        free(decoded);
+        return 1;
+    }
     
+    fwrite(decoded, 1, output_length, stdout);
+    putchar('\n');
     free(decoded);
-    if (file_data) free(file_data);
     return 0;
 }
 
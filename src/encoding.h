@@ -1,8 +1,22 @@
 #ifndef ENCODING_H
 #define ENCODING_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 int cmd_base64_encode(const char *input, int is_file);
 int cmd_base64_decode(const char *input, int is_file);
 int cmd_uuid_generate(int count);
 
+// Encode len bytes as 4 * ((len + 2) / 3) characters of padded base64,
+// not terminated. Returns the characters written.
+size_t base64_encode(const void *data, size_t len, char *out);
+// Decode len characters of base64 without line breaks (padded, or ending
+// in a two- or three-character group) into at most len / 4 * 3 + 2 bytes.
+// Returns 0 and the byte count in *out_len, or -1 on invalid input
+// (including a last group with non-zero bits past the final byte).
+int base64_decode(const char *in, size_t len, uint8_t *out, size_t *out_len);
+// Kernel used on this CPU
+const char* base64_impl(void);
+
 #endif
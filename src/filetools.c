@@ -19,7 +19,7 @@ void format_size(unsigned long long size, char *buffer, size_t buffer_size) {
     }
 }
 
-unsigned long long get_dir_size(const char *path) {
+unsigned long long get_dir_size(const char *path, const WalkOptions *opts, SizeMode mode, DirSize *stats) {
     WIN32_FIND_DATA findData;
     HANDLE hFind;
     char search_path[MAX_PATH];
@@ -39,7 +39,7 @@ unsigned long long get_dir_size(const char *path) {
         if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
             char subdir[MAX_PATH];
             snprintf(subdir, sizeof(subdir), "%s\\%s", path, findData.cFileName);
-            total_size += get_dir_size(subdir);
+            total_size += get_dir_size(subdir, opts, mode, NULL);
         } else {
             ULARGE_INTEGER filesize;
             filesize.LowPart = findData.nFileSizeLow;
@@ -49,10 +49,15 @@ unsigned long long get_dir_size(const char *path) {
     } while (FindNextFile(hFind, &findData));
     
     FindClose(hFind);
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+        stats->bytes = total_size;
+    }
     return total_size;
 }
 
-int cmd_diskusage(const char *path) {
+int cmd_diskusage(const char *path, const WalkOptions *opts, int scan, SizeMode mode) {
+    (void)opts; (void)scan; (void)mode;
     ULARGE_INTEGER freeBytesAvailable, totalBytes, totalFreeBytes;
     
     if (GetDiskFreeSpaceEx(path, &freeBytesAvailable, &totalBytes, &totalFreeBytes)) {
@@ -75,7 +80,15 @@ int cmd_diskusage(const char *path) {
     return 1;
 }
 
-int cmd_finddup(const char *path) {
+int cmd_diskusage_tree(const char *path, const WalkOptions *opts, SizeMode mode, int depth,
+                       int top, int stream) {
+    (void)path; (void)opts; (void)mode; (void)depth; (void)top; (void)stream;
+    fprintf(stderr, "Directory breakdown not supported on Windows yet\n");
+    return 1;
+}
+
+int cmd_finddup(const char *path, const WalkOptions *opts, const char *index_path, unsigned flags) {
+    (void)opts; (void)index_path; (void)flags;
     printf("Finding duplicates in: %s\n", path);
     printf("Note: Basic implementation - checking file sizes only\n\n");
     
@@ -84,11 +97,37 @@ int cmd_finddup(const char *path) {
     return 0;
 }
 
+int cmd_index_rebuild(const char *path, const WalkOptions *opts, const char *index_path) {
+    (void)path; (void)opts; (void)index_path;
+    fprintf(stderr, "Scan index not supported on Windows yet\n");
+    return 1;
+}
+
+int cmd_dedupestimate(const char *path, const WalkOptions *opts) {
+    (void)path; (void)opts;
+    fprintf(stderr, "Dedup estimation not supported on Windows yet\n");
+    return 1;
+}
+
 #elif defined(__linux__)
 #include <sys/statvfs.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/vfs.h>
+#include <linux/fs.h>
+#include "hash.h"
+#include "uring.h"
+#include "scanindex.h"
+#include "arena.h"
+#include "chunker.h"
 
 void format_size(unsigned long long size, char *buffer, size_t buffer_size) {
     if (size >= 1024ULL * 1024 * 1024) {
@@ -102,35 +141,305 @@ void format_size(unsigned long long size, char *buffer, size_t buffer_size) {
     }
 }
 
-unsigned long long get_dir_size(const char *path) {
-    DIR *dir = opendir(path);
-    if (!dir) return 0;
+// Disk usage is aggregated bottom-up in a single parallel walk. Every
+// directory gets a DuNode as its walker cookie. Files are added to their
+// directory's own total by the one worker that reads it; once a directory
+// and all of its subdirectories are done, its total is final and is added
+// to the parent, whose pending count then drops. Totals therefore become
+// available (and can be streamed) in the same children-first order as du.
+typedef struct DuNode {
+    ScanPath path;
+    struct DuNode *parent;
+    int depth;
+    long pending;                   // own read + subdirectories not yet complete
+    unsigned long long own;         // entries directly inside; reading worker only
+    unsigned long long own_files;
+    unsigned long long sub;         // completed subdirectories, added atomically
+    unsigned long long sub_files;
+    unsigned long long total;       // own + sub, valid once complete
+    unsigned long long files;
+} DuNode;
+
+// Hard-linked files are counted once, under the first path that reaches
+// the set. Only files with st_nlink > 1 get here, so one lock is enough.
+typedef struct InodeKey {
+    uint64_t dev;
+    uint64_t ino;
+    int used;
+} InodeKey;
+
+typedef struct InodeSet {
+    pthread_mutex_t lock;
+    InodeKey *keys;
+    size_t count;
+    size_t mask;
+} InodeSet;
+
+static size_t inode_slot(const InodeKey *keys, size_t mask, uint64_t dev, uint64_t ino) {
+    uint64_t h = (ino ^ (dev * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+    size_t i = (size_t)(h ^ (h >> 31)) & mask;
+    while (keys[i].used && (keys[i].dev != dev || keys[i].ino != ino)) i = (i + 1) & mask;
+    return i;
+}
+
+// Returns 1 the first time an inode is seen (or if the set can't grow)
+static int inode_set_add(InodeSet *set, uint64_t dev, uint64_t ino) {
+    pthread_mutex_lock(&set->lock);
+    if ((set->count + 1) * 2 > set->mask + 1) {
+        size_t cap = set->keys ? (set->mask + 1) * 2 : 1024;
+        InodeKey *keys = calloc(cap, sizeof(InodeKey));
+        if (!keys) {
+            pthread_mutex_unlock(&set->lock);
+            return 1;
+        }
+        for (size_t i = 0; set->keys && i <= set->mask; i++) {
+            if (set->keys[i].used) keys[inode_slot(keys, cap - 1, set->keys[i].dev, set->keys[i].ino)] = set->keys[i];
+        }
+        free(set->keys);
+        set->keys = keys;
+        set->mask = cap - 1;
+    }
     
-    unsigned long long total_size = 0;
-    struct dirent *entry;
+    InodeKey *key = &set->keys[inode_slot(set->keys, set->mask, dev, ino)];
+    int first = !key->used;
+    if (first) {
+        key->used = 1;
+        key->dev = dev;
+        key->ino = ino;
+        set->count++;
+    }
+    pthread_mutex_unlock(&set->lock);
+    return first;
+}
+
+typedef struct DuWorker {
+    Arena arena;                    // this worker's DuNodes
+    DuNode **nodes;                 // directories within the report depth
+    size_t count;
+    size_t capacity;
+    unsigned long long links;       // hard links skipped
+} DuWorker;
+
+typedef struct DuCtx {
+    DuWorker *workers;
+    SizeMode mode;
+    int max_depth;                  // deepest directory to report, -1 for none
+    int stream;
+    InodeSet inodes;
+    Snapshot *snapshot;             // every file path, may be NULL
+} DuCtx;
+
+typedef struct DuScan {
+    Arena arena;
+    DuNode *root;
+    DuNode **nodes;                 // reported directories, root excluded
+    size_t count;
+    unsigned long long links;
+} DuScan;
+
+static unsigned long long stat_usage(const struct stat *st, SizeMode mode) {
+    if (mode == SIZE_ALLOCATED) return (unsigned long long)st->st_blocks * 512;
+    return (unsigned long long)st->st_size;
+}
+
+static DuNode* du_node_new(Arena *arena, DuNode *parent, const char *name) {
+    DuNode *node = arena_alloc(arena, sizeof(DuNode));
+    char *copy = node ? arena_strndup(arena, name, strlen(name)) : NULL;
+    if (!copy) return NULL;
+    memset(node, 0, sizeof(*node));
+    node->path.parent = parent ? &parent->path : NULL;
+    node->path.name = copy;
+    node->parent = parent;
+    node->depth = parent ? parent->depth + 1 : 0;
+    node->pending = 1;
+    return node;
+}
+
+static void du_print_line(const DuNode *node) {
+    char size_str[50];
+    char *path = scan_path_strdup(&node->path);
+    if (!path) return;
+    format_size(node->total, size_str, sizeof(size_str));
+    printf("%12s  %s\n", size_str, path);
+    free(path);
+}
+
+static void du_visit(const WalkEntry *entry, void *ctx) {
+    DuCtx *du = ctx;
+    DuWorker *w = &du->workers[entry->worker];
+    DuNode *dir = entry->dir_data;
+    if (!dir) return;
     
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-            continue;
+    if (entry->type == WALK_DIR) {
+        DuNode *node = du_node_new(&w->arena, dir, entry->name);
+        if (!node) return;
+        // The directory's own blocks count towards itself, like du
+        if (entry->st && du->mode == SIZE_ALLOCATED) node->own = stat_usage(entry->st, du->mode);
+        __atomic_add_fetch(&dir->pending, 1, __ATOMIC_ACQ_REL);
+        *entry->child_data = node;
         
-        char full_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
-        
-        struct stat st;
-        if (lstat(full_path, &st) == 0) {
-            if (S_ISDIR(st.st_mode)) {
-                total_size += get_dir_size(full_path);
-            } else if (S_ISREG(st.st_mode)) {
-                total_size += st.st_size;
+        if (node->depth <= du->max_depth) {
+            if (w->count == w->capacity) {
+                size_t new_cap = w->capacity ? w->capacity * 2 : 64;
+                DuNode **nodes = realloc(w->nodes, new_cap * sizeof(DuNode*));
+                if (!nodes) return;
+                w->nodes = nodes;
+                w->capacity = new_cap;
             }
+            w->nodes[w->count++] = node;
         }
+        return;
     }
+    if (entry->type != WALK_FILE) return;
     
-    closedir(dir);
-    return total_size;
+    snapshot_add(du->snapshot, entry->worker, entry->path, stat_usage(entry->st, du->mode), entry->st->st_mtime);
+    dir->own_files++;
+    if (entry->st->st_nlink > 1 && !inode_set_add(&du->inodes, entry->st->st_dev, entry->st->st_ino)) {
+        w->links++;
+        return;
+    }
+    dir->own += stat_usage(entry->st, du->mode);
+}
+
+static void du_done(void *dir_data, int worker, void *ctx) {
+    DuCtx *du = ctx;
+    (void)worker;
+    
+    for (DuNode *node = dir_data; node; node = node->parent) {
+        if (__atomic_sub_fetch(&node->pending, 1, __ATOMIC_ACQ_REL) != 0) return;
+        
+        node->total = node->own + __atomic_load_n(&node->sub, __ATOMIC_ACQUIRE);
+        node->files = node->own_files + __atomic_load_n(&node->sub_files, __ATOMIC_ACQUIRE);
+        if (du->stream && node->depth <= du->max_depth) du_print_line(node);
+        if (node->parent) {
+            __atomic_add_fetch(&node->parent->sub, node->total, __ATOMIC_ACQ_REL);
+            __atomic_add_fetch(&node->parent->sub_files, node->files, __ATOMIC_ACQ_REL);
+        }
+    }
+}
+
+static void du_scan_free(DuScan *scan) {
+    arena_free(&scan->arena);
+    free(scan->nodes);
+    memset(scan, 0, sizeof(*scan));
+}
+
+static int du_scan(const char *path, const WalkOptions *opts, SizeMode mode, int max_depth,
+                   int stream, DuScan *scan) {
+    int jobs = walk_jobs(opts);
+    DuCtx du;
+    memset(&du, 0, sizeof(du));
+    memset(scan, 0, sizeof(*scan));
+    du.mode = mode;
+    du.max_depth = max_depth;
+    du.stream = stream;
+    du.snapshot = opts ? opts->snapshot : NULL;
+    du.workers = calloc((size_t)jobs, sizeof(DuWorker));
+    scan->root = du_node_new(&scan->arena, NULL, path);
+    if (!du.workers || !scan->root) {
+        free(du.workers);
+        du_scan_free(scan);
+        return -1;
+    }
+    pthread_mutex_init(&du.inodes.lock, NULL);
+    
+    // Directories take up blocks of their own, the root included
+    struct stat st;
+    if (mode == SIZE_ALLOCATED && stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        scan->root->own = stat_usage(&st, mode);
+    }
+    WalkOptions walk_opts = {0};
+    if (opts) walk_opts = *opts;
+    walk_opts.stat_dirs = mode == SIZE_ALLOCATED;
+    walk_opts.names_only = !walk_opts.snapshot;
+    walk_tree_data(path, scan->root, &walk_opts, du_visit, du_done, &du);
+    
+    size_t total = 0;
+    for (int i = 0; i < jobs; i++) total += du.workers[i].count;
+    scan->nodes = malloc((total ? total : 1) * sizeof(DuNode*));
+    for (int i = 0; i < jobs; i++) {
+        DuWorker *w = &du.workers[i];
+        if (scan->nodes && w->count) {
+            memcpy(scan->nodes + scan->count, w->nodes, w->count * sizeof(DuNode*));
+            scan->count += w->count;
+        }
+        scan->links += w->links;
+        free(w->nodes);
+        arena_merge(&scan->arena, &w->arena);
+    }
+    free(du.workers);
+    free(du.inodes.keys);
+    pthread_mutex_destroy(&du.inodes.lock);
+    return scan->nodes ? 0 : -1;
+}
+
+unsigned long long get_dir_size(const char *path, const WalkOptions *opts, SizeMode mode, DirSize *stats) {
+    DuScan scan;
+    if (du_scan(path, opts, mode, -1, 0, &scan) != 0) return 0;
+    
+    DirSize result;
+    result.bytes = scan.root->total;
+    result.files = scan.root->files;
+    result.links = scan.links;
+    du_scan_free(&scan);
+    
+    if (stats) *stats = result;
+    return result.bytes;
+}
+
+static int compare_du_nodes(const void *a, const void *b) {
+    const DuNode *na = *(const DuNode * const *)a;
+    const DuNode *nb = *(const DuNode * const *)b;
+    if (na->total != nb->total) return na->total < nb->total ? 1 : -1;
+    return 0;
 }
 
-int cmd_diskusage(const char *path) {
+int cmd_diskusage_tree(const char *path, const WalkOptions *opts, SizeMode mode, int depth,
+                       int top, int stream) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Cannot open directory %s\n", path);
+        return 1;
+    }
+    if (depth <= 0) depth = 1;
+    if (top <= 0) top = 20;
+    printf("Disk usage of %s (%s size, directories up to depth %d)\n\n", path,
+           mode == SIZE_ALLOCATED ? "allocated" : "apparent", depth);
+    
+    DuScan scan;
+    scan_stats_stage(opts ? opts->stats : NULL, "scan");
+    if (du_scan(path, opts, mode, depth, stream, &scan) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    if (stream) printf("\n");
+    
+    scan_stats_stage(opts ? opts->stats : NULL, "report");
+    qsort(scan.nodes, scan.count, sizeof(DuNode*), compare_du_nodes);
+    size_t shown = scan.count < (size_t)top ? scan.count : (size_t)top;
+    printf("Top %zu of %zu directories:\n", shown, scan.count);
+    printf("%12s  %10s  %s\n", "Size", "Files", "Path");
+    printf("%12s  %10s  %s\n", "----", "-----", "----");
+    for (size_t i = 0; i < shown; i++) {
+        char size_str[50];
+        char *dir_path = scan_path_strdup(&scan.nodes[i]->path);
+        if (!dir_path) break;
+        format_size(scan.nodes[i]->total, size_str, sizeof(size_str));
+        printf("%12s  %10llu  %s\n", size_str, scan.nodes[i]->files, dir_path);
+        free(dir_path);
+    }
+    
+    char total_str[50];
+    format_size(scan.root->total, total_str, sizeof(total_str));
+    printf("\nTotal: %s in %llu files\n", total_str, scan.root->files);
+    if (scan.links) {
+        printf("Hard links: %llu extra paths to already-counted files\n", scan.links);
+    }
+    du_scan_free(&scan);
+    return 0;
+}
+
+int cmd_diskusage(const char *path, const WalkOptions *opts, int scan, SizeMode mode) {
     struct statvfs stat;
     
     if (statvfs(path, &stat) != 0) {
@@ -156,100 +465,1294 @@ int cmd_diskusage(const char *path) {
     printf("Available: %s\n", avail_str);
     printf("Usage: %.1f%%\n", (used / (double)total) * 100);
     
+    if (scan) {
+        DirSize stats;
+        char size_str[50];
+        scan_stats_stage(opts ? opts->stats : NULL, "scan");
+        get_dir_size(path, opts, mode, &stats);
+        format_size(stats.bytes, size_str, sizeof(size_str));
+        printf("\nContents of %s: %s in %llu files (%s size)\n", path, size_str, stats.files,
+               mode == SIZE_ALLOCATED ? "allocated" : "apparent");
+        if (stats.links) {
+            printf("Hard links: %llu extra paths to already-counted files\n", stats.links);
+        }
+    }
+    
     return 0;
 }
 
 typedef struct FileEntry {
-    char path[1024];
+    const ScanPath *path;
     unsigned long long size;
-    struct FileEntry *next;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    uint64_t partial_hash;
+    uint64_t full_hash;
+    unsigned hashed;                // SCAN_INDEX_HAVE_* bits
+    unsigned nlink;
+    struct FileEntry *next_link;    // other paths to the same inode
+    int is_link;                    // folded into another entry's next_link
+    size_t set;                     // duplicate set number once grouped
 } FileEntry;
 
-void scan_directory(const char *path, FileEntry **files) {
-    DIR *dir = opendir(path);
-    if (!dir) return;
+typedef struct FileList {
+    FileEntry *items;
+    size_t count;
+    size_t capacity;
+    Arena arena;                    // path nodes of the entries
+} FileList;
+
+static FileEntry* file_list_push(FileList *list) {
+    if (list->count == list->capacity) {
+        size_t new_cap = list->capacity ? list->capacity * 2 : 1024;
+        FileEntry *items = realloc(list->items, new_cap * sizeof(FileEntry));
+        if (!items) return NULL;
+        list->items = items;
+        list->capacity = new_cap;
+    }
+    return &list->items[list->count++];
+}
+
+typedef struct ScanCtx {
+    FileList *lists;                // one result list per walker worker
+} ScanCtx;
+
+static void scan_visit(const WalkEntry *entry, void *ctx) {
+    ScanCtx *sc = ctx;
+    FileList *list = &sc->lists[entry->worker];
+    if (entry->type == WALK_DIR) {
+        *entry->child_data = scan_path_new(&list->arena, entry->dir_data, entry->name);
+        return;
+    }
+    if (entry->type != WALK_FILE || !entry->dir_data) return;
     
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-            continue;
+    FileEntry *new_entry = file_list_push(list);
+    if (!new_entry) return;
+    new_entry->path = scan_path_new(&list->arena, entry->dir_data, entry->name);
+    if (!new_entry->path) {
+        list->count--;
+        return;
+    }
+    new_entry->size = entry->st->st_size;
+    new_entry->dev = entry->st->st_dev;
+    new_entry->ino = entry->st->st_ino;
+    new_entry->mtime_ns = (int64_t)entry->st->st_mtim.tv_sec * 1000000000 + entry->st->st_mtim.tv_nsec;
+    new_entry->ctime_ns = (int64_t)entry->st->st_ctim.tv_sec * 1000000000 + entry->st->st_ctim.tv_nsec;
+    new_entry->partial_hash = 0;
+    new_entry->full_hash = 0;
+    new_entry->hashed = 0;
+    new_entry->nlink = (unsigned)entry->st->st_nlink;
+    new_entry->next_link = NULL;
+    new_entry->is_link = 0;
+    new_entry->set = 0;
+}
+
+static void free_file_list(FileList *list) {
+    arena_free(&list->arena);
+    free(list->items);
+    list->items = NULL;
+    list->count = list->capacity = 0;
+}
+
+// Walk the tree in parallel and merge the per-worker results into one list
+int scan_directory(const char *path, const WalkOptions *opts, FileList *files) {
+    int jobs = walk_jobs(opts);
+    ScanCtx sc;
+    sc.lists = calloc((size_t)jobs, sizeof(FileList));
+    if (!sc.lists) return -1;
+    
+    arena_init(&files->arena);
+    ScanPath *root = scan_path_new(&files->arena, NULL, path);
+    if (!root) {
+        free(sc.lists);
+        return -1;
+    }
+    // Files are named through their directory's ScanPath node
+    WalkOptions walk_opts = {0};
+    if (opts) walk_opts = *opts;
+    walk_opts.names_only = 1;
+    walk_tree_data(path, root, &walk_opts, scan_visit, NULL, &sc);
+    
+    size_t total = 0;
+    for (int i = 0; i < jobs; i++) total += sc.lists[i].count;
+    
+    files->items = malloc((total ? total : 1) * sizeof(FileEntry));
+    files->count = 0;
+    files->capacity = total;
+    for (int i = 0; i < jobs; i++) {
+        if (files->items && sc.lists[i].count) {
+            memcpy(files->items + files->count, sc.lists[i].items, sc.lists[i].count * sizeof(FileEntry));
+            files->count += sc.lists[i].count;
+        }
+        free(sc.lists[i].items);
+        arena_merge(&files->arena, &sc.lists[i].arena);
+    }
+    free(sc.lists);
+    return files->items ? 0 : -1;
+}
+
+// Duplicate detection runs as a pipeline of progressively more expensive
+// filters. Each stage groups the surviving files by (size, stage hash) in an
+// open-addressing table and drops every file that ends up alone in its group:
+//   1. size only (no I/O beyond the directory scan)
+//   2. hash of the first and last DUP_PARTIAL_BLOCK bytes
+//   3. hash of the whole file content
+// Files no larger than two partial blocks are fully covered by stage 2, so
+// stage 3 never re-reads them.
+#define DUP_PARTIAL_BLOCK 4096
+#define DUP_READ_BUFFER (1024 * 1024)
+
+typedef struct DupBucket {
+    unsigned long long size;
+    uint64_t hash;
+    size_t count;
+    int used;
+} DupBucket;
+
+typedef struct DupTable {
+    DupBucket *buckets;
+    size_t mask;
+} DupTable;
+
+static uint64_t dup_key_hash(unsigned long long size, uint64_t hash) {
+    uint64_t k = (uint64_t)size * 0x9E3779B97F4A7C15ULL ^ hash;
+    k ^= k >> 31;
+    k *= 0xBF58476D1CE4E5B9ULL;
+    k ^= k >> 29;
+    return k;
+}
+
+static int dup_table_init(DupTable *table, size_t entries) {
+    size_t cap = 16;
+    while (cap < entries * 2) cap <<= 1;
+    table->buckets = calloc(cap, sizeof(DupBucket));
+    table->mask = cap - 1;
+    return table->buckets ? 0 : -1;
+}
+
+static DupBucket* dup_table_slot(DupTable *table, unsigned long long size, uint64_t hash) {
+    size_t i = dup_key_hash(size, hash) & table->mask;
+    while (table->buckets[i].used &&
+           (table->buckets[i].size != size || table->buckets[i].hash != hash)) {
+        i = (i + 1) & table->mask;
+    }
+    return &table->buckets[i];
+}
+
+// Count every (size, hash) key, then keep only the entries whose key was seen
+// at least twice. Returns the number of survivors, compacted to the front of
+// the array.
+static size_t dup_filter_stage(FileEntry **entries, size_t count, int stage) {
+    DupTable table;
+    if (dup_table_init(&table, count) != 0) return count;
+    
+    for (size_t i = 0; i < count; i++) {
+        uint64_t h = stage == 1 ? 0 : stage == 2 ? entries[i]->partial_hash : entries[i]->full_hash;
+        DupBucket *b = dup_table_slot(&table, entries[i]->size, h);
+        b->used = 1;
+        b->size = entries[i]->size;
+        b->hash = h;
+        b->count++;
+    }
+    
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t h = stage == 1 ? 0 : stage == 2 ? entries[i]->partial_hash : entries[i]->full_hash;
+        if (dup_table_slot(&table, entries[i]->size, h)->count > 1) {
+            entries[kept++] = entries[i];
+        }
+    }
+    
+    free(table.buckets);
+    return kept;
+}
+
+static int read_fully_at(int fd, uint8_t *buf, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, offset + (off_t)done);
+        if (n <= 0) return -1;
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+// Stage 2: hash the head and tail blocks. For small files this is the whole
+// content, so the result doubles as the full hash.
+static int hash_partial(FileEntry *file, uint8_t *buffer, char **path_buf, size_t *path_cap,
+                        ScanStats *stats) {
+    // Read time includes the open, which is most of it for small files
+    uint64_t start = scan_stats_now(stats);
+    int fd = scan_path_open(file->path, O_RDONLY | O_CLOEXEC, path_buf, path_cap);
+    if (fd < 0) return -1;
+    
+    Xxh3Ctx ctx;
+    xxh3_init(&ctx);
+    size_t len = file->size <= 2 * DUP_PARTIAL_BLOCK ? (size_t)file->size : 2 * DUP_PARTIAL_BLOCK;
+    int rc;
+    
+    if (file->size <= 2 * DUP_PARTIAL_BLOCK) {
+        rc = read_fully_at(fd, buffer, len, 0);
+    } else {
+        rc = read_fully_at(fd, buffer, DUP_PARTIAL_BLOCK, 0);
+        if (rc == 0) rc = read_fully_at(fd, buffer + DUP_PARTIAL_BLOCK, DUP_PARTIAL_BLOCK,
+                                         (off_t)(file->size - DUP_PARTIAL_BLOCK));
+    }
+    close(fd);
+    if (rc != 0) return -1;
+    scan_stats_read(stats, 0, len, start);
+    
+    start = scan_stats_now(stats);
+    xxh3_update(&ctx, buffer, len);
+    scan_stats_hash(stats, 0, len, start);
+    scan_stats_file_hashed(stats, 0);
+    file->partial_hash = xxh3_64_final(&ctx);
+    file->hashed |= SCAN_INDEX_HAVE_PARTIAL;
+    if (file->size <= 2 * DUP_PARTIAL_BLOCK) {
+        file->full_hash = file->partial_hash;
+        file->hashed |= SCAN_INDEX_HAVE_FULL;
+    }
+    return 0;
+}
+
+// Stage 3: hash the complete content
+static int hash_full(FileEntry *file, uint8_t *buffer, char **path_buf, size_t *path_cap,
+                     ScanStats *stats) {
+    if (file->size <= 2 * DUP_PARTIAL_BLOCK) return 0;
+    
+    uint64_t start = scan_stats_now(stats);
+    int fd = scan_path_open(file->path, O_RDONLY | O_CLOEXEC, path_buf, path_cap);
+    if (fd < 0) return -1;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    scan_stats_read(stats, 0, 0, start);
+    
+    Xxh3Ctx ctx;
+    xxh3_init(&ctx);
+    unsigned long long total = 0;
+    ssize_t n;
+    for (;;) {
+        start = scan_stats_now(stats);
+        n = read(fd, buffer, DUP_READ_BUFFER);
+        if (n <= 0) break;
+        scan_stats_read(stats, 0, (uint64_t)n, start);
         
-        char full_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
+        start = scan_stats_now(stats);
+        xxh3_update(&ctx, buffer, (size_t)n);
+        scan_stats_hash(stats, 0, (uint64_t)n, start);
+        total += (unsigned long long)n;
+    }
+    close(fd);
+    
+    // A file that changed size while we read it is no longer comparable
+    if (n < 0 || total != file->size) return -1;
+    scan_stats_file_hashed(stats, 0);
+    file->full_hash = xxh3_64_final(&ctx);
+    file->hashed |= SCAN_INDEX_HAVE_FULL;
+    return 0;
+}
+
+// Stage 2 through io_uring: open a batch of files with one submission, then
+// read all of their head/tail blocks with a second one. Anything that fails
+// or comes back short is retried on the synchronous path.
+#define DUP_URING_BATCH 64
+
+static size_t dup_hash_partial_uring(FileEntry **entries, size_t count, Uring *ring, uint8_t *buffer,
+                                     ScanStats *stats) {
+    size_t batch_max = uring_depth(ring) / 2;
+    if (batch_max > DUP_URING_BATCH) batch_max = DUP_URING_BATCH;
+    if (batch_max == 0) batch_max = 1;
+    
+    int fds[DUP_URING_BATCH];
+    int reads[2 * DUP_URING_BATCH];
+    char *paths[DUP_URING_BATCH] = {0};     // must outlive the open submission
+    size_t path_caps[DUP_URING_BATCH] = {0};
+    size_t kept = 0;
+    
+    for (size_t base = 0; base < count; base += batch_max) {
+        size_t n = count - base < batch_max ? count - base : batch_max;
+        uint64_t start = scan_stats_now(stats);
+        uint64_t batch_bytes = 0;
+        
+        for (size_t k = 0; k < n; k++) {
+            fds[k] = -1;
+            const char *path = scan_path_format(entries[base + k]->path, &paths[k], &path_caps[k]);
+            if (path) uring_prep_openat(ring, AT_FDCWD, path, O_RDONLY | O_CLOEXEC, k);
+        }
+        uring_submit_wait(ring, fds, n);
         
-        struct stat st;
-        if (lstat(full_path, &st) == 0) {
-            if (S_ISDIR(st.st_mode)) {
-                scan_directory(full_path, files);
-            } else if (S_ISREG(st.st_mode)) {
-                FileEntry *new_entry = malloc(sizeof(FileEntry));
-                strncpy(new_entry->path, full_path, sizeof(new_entry->path) - 1);
-                new_entry->size = st.st_size;
-                new_entry->next = *files;
-                *files = new_entry;
+        for (size_t k = 0; k < n; k++) {
+            FileEntry *file = entries[base + k];
+            uint8_t *buf = buffer + k * 2 * DUP_PARTIAL_BLOCK;
+            reads[2 * k] = reads[2 * k + 1] = -1;
+            if (fds[k] < 0) continue;
+            if (file->size <= 2 * DUP_PARTIAL_BLOCK) {
+                uring_prep_read(ring, fds[k], buf, (unsigned)file->size, 0, 2 * k);
+                reads[2 * k + 1] = 0;
+            } else {
+                uring_prep_read(ring, fds[k], buf, DUP_PARTIAL_BLOCK, 0, 2 * k);
+                uring_prep_read(ring, fds[k], buf + DUP_PARTIAL_BLOCK, DUP_PARTIAL_BLOCK,
+                                file->size - DUP_PARTIAL_BLOCK, 2 * k + 1);
             }
         }
+        uring_submit_wait(ring, reads, 2 * n);
+        for (size_t k = 0; k < 2 * n; k++) {
+            if (reads[k] > 0) batch_bytes += (uint64_t)reads[k];
+        }
+        scan_stats_read(stats, 0, batch_bytes, start);
+        
+        for (size_t k = 0; k < n; k++) {
+            FileEntry *file = entries[base + k];
+            uint8_t *buf = buffer + k * 2 * DUP_PARTIAL_BLOCK;
+            int ok;
+            if (fds[k] >= 0) close(fds[k]);
+            
+            if (file->size <= 2 * DUP_PARTIAL_BLOCK) {
+                ok = fds[k] >= 0 && reads[2 * k] == (int)file->size;
+                if (ok) {
+                    start = scan_stats_now(stats);
+                    file->partial_hash = xxh3_64(buf, file->size);
+                    scan_stats_hash(stats, 0, file->size, start);
+                    scan_stats_file_hashed(stats, 0);
+                    file->full_hash = file->partial_hash;
+                    file->hashed |= SCAN_INDEX_HAVE_PARTIAL | SCAN_INDEX_HAVE_FULL;
+                }
+            } else {
+                ok = fds[k] >= 0 && reads[2 * k] == DUP_PARTIAL_BLOCK &&
+                     reads[2 * k + 1] == DUP_PARTIAL_BLOCK;
+                if (ok) {
+                    start = scan_stats_now(stats);
+                    file->partial_hash = xxh3_64(buf, 2 * DUP_PARTIAL_BLOCK);
+                    scan_stats_hash(stats, 0, 2 * DUP_PARTIAL_BLOCK, start);
+                    scan_stats_file_hashed(stats, 0);
+                    file->hashed |= SCAN_INDEX_HAVE_PARTIAL;
+                }
+            }
+            
+            // buffer beyond this batch's slots is free for the sync retry
+            if (!ok) ok = hash_partial(file, buffer + batch_max * 2 * DUP_PARTIAL_BLOCK,
+                                       &paths[k], &path_caps[k], stats) == 0;
+            if (ok) entries[kept++] = file;
+        }
+    }
+    for (size_t k = 0; k < DUP_URING_BATCH; k++) free(paths[k]);
+    return kept;
+}
+
+// Hash every entry for the given stage, dropping the ones that can't be read.
+// Entries that already carry the stage hash (from the scan index) are moved
+// to the front untouched; *hashed counts the ones that needed I/O.
+static size_t dup_hash_stage(FileEntry **entries, size_t count, int stage, uint8_t *buffer,
+                             Uring *ring, size_t *hashed, ScanStats *stats) {
+    unsigned want = stage == 2 ? SCAN_INDEX_HAVE_PARTIAL : SCAN_INDEX_HAVE_FULL;
+    size_t cached = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i]->hashed & want) {
+            FileEntry *tmp = entries[cached];
+            entries[cached++] = entries[i];
+            entries[i] = tmp;
+        }
     }
     
-    closedir(dir);
+    FileEntry **todo = entries + cached;
+    size_t todo_count = count - cached;
+    if (hashed) *hashed += todo_count;
+    if (stage == 2 && ring) return cached + dup_hash_partial_uring(todo, todo_count, ring, buffer, stats);
+    
+    size_t kept = 0;
+    char *path_buf = NULL;
+    size_t path_cap = 0;
+    for (size_t i = 0; i < todo_count; i++) {
+        int rc = stage == 2 ? hash_partial(todo[i], buffer, &path_buf, &path_cap, stats)
+                            : hash_full(todo[i], buffer, &path_buf, &path_cap, stats);
+        if (rc == 0) todo[kept++] = todo[i];
+    }
+    free(path_buf);
+    return cached + kept;
 }
 
-int cmd_finddup(const char *path) {
-    printf("Finding duplicates in: %s\n", path);
-    printf("Scanning files (by size)...\n\n");
+static int compare_inodes(const void *a, const void *b) {
+    const FileEntry *fa = *(const FileEntry * const *)a;
+    const FileEntry *fb = *(const FileEntry * const *)b;
+    if (fa->dev != fb->dev) return fa->dev < fb->dev ? -1 : 1;
+    if (fa->ino != fb->ino) return fa->ino < fb->ino ? -1 : 1;
+    return fa < fb ? -1 : fa > fb;
+}
+
+// Paths that share (dev, inode) are one file: only the first goes through
+// the hashing pipeline, the rest hang off it through next_link and are
+// listed with it. Only entries with st_nlink > 1 can alias, so the sort
+// touches just those. Returns the number of entries left in the array.
+static size_t dup_fold_links(FileEntry **entries, size_t count, size_t *folded) {
+    size_t linked = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i]->nlink > 1) linked++;
+    }
+    if (linked < 2) return count;
     
-    FileEntry *files = NULL;
-    scan_directory(path, &files);
+    FileEntry **links = malloc(linked * sizeof(FileEntry*));
+    if (!links) return count;
+    linked = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i]->nlink > 1) links[linked++] = entries[i];
+    }
+    qsort(links, linked, sizeof(FileEntry*), compare_inodes);
     
-    int duplicates_found = 0;
-    FileEntry *current = files;
+    // Each run of equal inodes becomes a chain headed by its first entry
+    for (size_t i = 1; i < linked; i++) {
+        if (links[i]->dev != links[i - 1]->dev || links[i]->ino != links[i - 1]->ino) continue;
+        links[i - 1]->next_link = links[i];
+        links[i]->is_link = 1;
+    }
+    free(links);
+    
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!entries[i]->is_link) entries[kept++] = entries[i];
+    }
+    *folded += count - kept;
+    return kept;
+}
+
+// Fill in hashes from a previous run for every file whose inode still has
+// the same size, mtime and ctime. Returns the number of files reused.
+static size_t dup_apply_index(FileList *files, const ScanIndex *index) {
+    size_t reused = 0;
+    for (size_t i = 0; i < files->count; i++) {
+        FileEntry *f = &files->items[i];
+        const IndexRecord *rec = scan_index_lookup(index, f->dev, f->ino);
+        if (!rec || rec->size != f->size || rec->mtime_ns != f->mtime_ns ||
+            rec->ctime_ns != f->ctime_ns) {
+            continue;
+        }
+        f->hashed = rec->flags & (SCAN_INDEX_HAVE_PARTIAL | SCAN_INDEX_HAVE_FULL);
+        f->partial_hash = rec->partial_hash;
+        f->full_hash = rec->full_hash;
+        if (f->hashed) reused++;
+    }
+    return reused;
+}
+
+static int dup_save_index(const char *index_path, const char *root, const FileList *files) {
+    IndexRecord *records = malloc((files->count ? files->count : 1) * sizeof(IndexRecord));
+    if (!records) return -1;
+    
+    size_t count = 0;
+    for (size_t i = 0; i < files->count; i++) {
+        const FileEntry *f = &files->items[i];
+        if (f->is_link) continue;       // same inode as an earlier entry
+        IndexRecord *rec = &records[count++];
+        memset(rec, 0, sizeof(*rec));
+        rec->dev = f->dev;
+        rec->ino = f->ino;
+        rec->size = f->size;
+        rec->mtime_ns = f->mtime_ns;
+        rec->ctime_ns = f->ctime_ns;
+        rec->partial_hash = f->partial_hash;
+        rec->full_hash = f->full_hash;
+        rec->flags = f->hashed;
+    }
+    int rc = scan_index_write(index_path, root, records, count);
+    free(records);
+    return rc;
+}
+
+static int compare_dup_entries(const void *a, const void *b) {
+    const FileEntry *fa = *(const FileEntry * const *)a;
+    const FileEntry *fb = *(const FileEntry * const *)b;
+    if (fa->size != fb->size) return fa->size < fb->size ? 1 : -1;
+    if (fa->full_hash != fb->full_hash) return fa->full_hash < fb->full_hash ? -1 : 1;
+    
+    // Only members of the same set get here, so formatting paths is rare
+    char *pa = scan_path_strdup(fa->path);
+    char *pb = scan_path_strdup(fb->path);
+    int cmp = pa && pb ? strcmp(pa, pb) : 0;
+    free(pa);
+    free(pb);
+    return cmp;
+}
+
+// Open a file for verification or dedupe and make sure it is still the
+// file the scan saw. Returns the fd, or -1.
+static int dup_open_checked(const FileEntry *file, int flags, char **path_buf, size_t *path_cap) {
+    int fd = scan_path_open(file->path, flags | O_CLOEXEC, path_buf, path_cap);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (unsigned long long)st.st_size != file->size ||
+        (uint64_t)st.st_ino != file->ino || (uint64_t)st.st_dev != file->dev) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Stage 4 (--verify): byte-for-byte comparison through read-only mappings,
+// a window at a time so huge files need no huge address space. Returns 1
+// if identical, 0 if different, -1 if b can't be read or has changed.
+#define DUP_VERIFY_WINDOW (64 * 1024 * 1024)
+
+static int dup_files_equal(int fd_a, const FileEntry *b, char **path_buf, size_t *path_cap) {
+    int fd_b = dup_open_checked(b, O_RDONLY, path_buf, path_cap);
+    if (fd_b < 0) return -1;
+    
+    int same = 1;
+    for (unsigned long long off = 0; same == 1 && off < b->size; off += DUP_VERIFY_WINDOW) {
+        size_t len = b->size - off < DUP_VERIFY_WINDOW ? (size_t)(b->size - off) : DUP_VERIFY_WINDOW;
+        void *map_a = mmap(NULL, len, PROT_READ, MAP_SHARED, fd_a, (off_t)off);
+        void *map_b = mmap(NULL, len, PROT_READ, MAP_SHARED, fd_b, (off_t)off);
+        if (map_a == MAP_FAILED || map_b == MAP_FAILED) {
+            same = -1;
+        } else {
+            madvise(map_a, len, MADV_SEQUENTIAL);
+            madvise(map_b, len, MADV_SEQUENTIAL);
+            same = memcmp(map_a, map_b, len) == 0;
+        }
+        if (map_a != MAP_FAILED) munmap(map_a, len);
+        if (map_b != MAP_FAILED) munmap(map_b, len);
+    }
+    close(fd_b);
+    return same;
+}
+
+// Split every (size, full hash) group into sets of files that really are
+// identical, peeling off the files equal to the group's first member until
+// fewer than two are left. Files that can't be read are dropped. Sets are
+// numbered in entry->set and kept contiguous; returns the entries left.
+static size_t dup_verify(FileEntry **entries, size_t count, size_t *unreadable, size_t *differ,
+                         ScanStats *stats) {
+    char *path_buf = NULL;
+    size_t path_cap = 0;
+    size_t kept = 0;
+    size_t set = 0;
     
-    while (current != NULL) {
-        FileEntry *compare = current->next;
-        int found_dup = 0;
+    for (size_t i = 0; i < count;) {
+        size_t end = i + 1;
+        while (end < count && entries[end]->size == entries[i]->size &&
+               entries[end]->full_hash == entries[i]->full_hash) {
+            end++;
+        }
         
-        while (compare != NULL) {
-            if (current->size == compare->size && current->size > 0) {
-                if (!found_dup) {
-                    printf("Duplicate files (size: %llu bytes):\n", current->size);
-                    printf("  %s\n", current->path);
-                    found_dup = 1;
-                    duplicates_found++;
+        size_t j = end;
+        while (j - i > 1) {
+            uint64_t start = scan_stats_now(stats);
+            int fd = dup_open_checked(entries[i], O_RDONLY, &path_buf, &path_cap);
+            if (fd < 0) {
+                (*unreadable)++;
+                i++;
+                continue;
+            }
+            size_t same = i + 1;
+            size_t compared = 0;
+            for (size_t m = i + 1; m < j; m++) {
+                int eq = dup_files_equal(fd, entries[m], &path_buf, &path_cap);
+                compared++;
+                if (eq > 0) {
+                    FileEntry *tmp = entries[same];
+                    entries[same++] = entries[m];
+                    entries[m] = tmp;
+                } else if (eq < 0) {
+                    // Swap it past the end of the group so it is never seen again
+                    (*unreadable)++;
+                    FileEntry *tmp = entries[--j];
+                    entries[j] = entries[m];
+                    entries[m--] = tmp;
                 }
-                printf("  %s\n", compare->path);
             }
-            compare = compare->next;
+            close(fd);
+            scan_stats_read(stats, 0, (uint64_t)entries[i]->size * 2 * compared, start);
+            
+            if (same - i > 1) {
+                set++;
+                for (size_t m = i; m < same; m++) entries[m]->set = set;
+                qsort(entries + i, same - i, sizeof(FileEntry*), compare_dup_entries);
+                memmove(entries + kept, entries + i, (same - i) * sizeof(FileEntry*));
+                kept += same - i;
+            } else {
+                (*differ)++;
+            }
+            i = same;
+        }
+        if (j - i == 1) (*differ)++;
+        i = end;
+    }
+    free(path_buf);
+    return kept;
+}
+
+// --dedupe: reclaim the space of every duplicate in place. Preferred is
+// FIDEDUPERANGE, which makes the duplicate share the kept file's extents
+// after the kernel has compared the ranges itself, so nothing about the
+// file (inode, owner, permissions, times) changes. Where the filesystem
+// can't do that, every path of the duplicate is atomically replaced by a
+// hard link to the kept file: link to a temporary name in the same
+// directory, then rename over the original.
+#define DUP_DEDUPE_CHUNK (16 * 1024 * 1024)
+
+typedef struct DedupeTotals {
+    size_t planned;                 // dry run: duplicates that would be replaced
+    size_t deduped;                 // files sharing extents now
+    size_t linked;                  // paths replaced by hard links
+    size_t skipped;
+    unsigned long long reclaimed;   // only counted once no other link is left
+} DedupeTotals;
+
+// 1 when all of dst now shares src's extents, 0 if the kernel found the
+// contents different, -1 if the filesystem can't dedupe
+static int dup_dedupe_range(int src, int dst, unsigned long long size) {
+#ifdef FIDEDUPERANGE
+    struct {
+        struct file_dedupe_range range;
+        struct file_dedupe_range_info info;
+    } req;
+    unsigned long long off = 0;
+    while (off < size) {
+        memset(&req, 0, sizeof(req));
+        req.range.src_offset = off;
+        req.range.src_length = size - off < DUP_DEDUPE_CHUNK ? size - off : DUP_DEDUPE_CHUNK;
+        req.range.dest_count = 1;
+        req.info.dest_fd = dst;
+        req.info.dest_offset = off;
+        if (ioctl(src, FIDEDUPERANGE, &req) != 0) return -1;
+        if (req.info.status == FILE_DEDUPE_RANGE_DIFFERS) return 0;
+        if (req.info.status != FILE_DEDUPE_RANGE_SAME || req.info.bytes_deduped == 0) return -1;
+        off += req.info.bytes_deduped;
+    }
+    return 1;
+#else
+    (void)src; (void)dst; (void)size;
+    return -1;
+#endif
+}
+
+// Replace path with a hard link to target, atomically
+static int dup_replace_with_link(const char *target, const char *path) {
+    size_t len = strlen(path) + 32;
+    char *tmp = malloc(len);
+    if (!tmp) return -1;
+    snprintf(tmp, len, "%s.finddup.%ld", path, (long)getpid());
+    int rc = link(target, tmp);
+    if (rc == 0) {
+        rc = rename(tmp, path);
+        if (rc != 0) unlink(tmp);
+    }
+    free(tmp);
+    return rc;
+}
+
+static int dup_fs_can_dedupe(const char *path) {
+    struct statfs fs;
+    if (statfs(path, &fs) != 0) return 0;
+    switch ((unsigned long)fs.f_type) {
+        case 0x9123683EUL:          // btrfs
+        case 0x58465342UL:          // xfs (with reflink enabled)
+        case 0xCA451A4EUL:          // bcachefs
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static void dup_dedupe_set(FileEntry **set, size_t n, int dry_run, DedupeTotals *totals) {
+    char *keep = scan_path_strdup(set[0]->path);
+    if (!keep) return;
+    printf("Keeping %s\n", keep);
+    
+    char *path_buf = NULL;
+    size_t path_cap = 0;
+    for (size_t m = 1; m < n; m++) {
+        FileEntry *dup = set[m];
+        size_t paths = 1;
+        for (const FileEntry *link = dup->next_link; link; link = link->next_link) paths++;
+        const char *dup_path = scan_path_format(dup->path, &path_buf, &path_cap);
+        if (!dup_path) break;
+        
+        if (dry_run) {
+            int extents = dup_fs_can_dedupe(dup_path);
+            if (!extents && dup->dev != set[0]->dev) {
+                printf("  would skip %s (other filesystem)\n", dup_path);
+                totals->skipped++;
+                continue;
+            }
+            printf("  would replace %s (%s)\n", dup_path, extents ? "shared extents" : "hard link");
+            totals->planned++;
+            if (extents || paths >= dup->nlink) totals->reclaimed += dup->size;
+            continue;
+        }
+        
+        // Both files must still be the ones that were verified
+        int src = dup_open_checked(set[0], O_RDONLY, &path_buf, &path_cap);
+        int dst = dup_open_checked(dup, O_RDWR, &path_buf, &path_cap);
+        if (dst < 0 && errno == EACCES) dst = dup_open_checked(dup, O_RDONLY, &path_buf, &path_cap);
+        dup_path = scan_path_format(dup->path, &path_buf, &path_cap);
+        if (src < 0 || dst < 0 || !dup_path) {
+            if (src >= 0) close(src);
+            if (dst >= 0) close(dst);
+            printf("  skipped %s (changed or unreadable since the scan)\n", dup_path ? dup_path : "?");
+            totals->skipped++;
+            continue;
+        }
+        
+        int rc = dup_dedupe_range(src, dst, dup->size);
+        close(src);
+        close(dst);
+        if (rc > 0) {
+            printf("  deduplicated %s\n", dup_path);
+            totals->deduped++;
+            totals->reclaimed += dup->size;
+            continue;
+        }
+        if (rc == 0 || dup->dev != set[0]->dev) {
+            printf("  skipped %s (%s)\n", dup_path, rc == 0 ? "contents differ" : "other filesystem");
+            totals->skipped++;
+            continue;
         }
         
-        if (found_dup) printf("\n");
-        current = current->next;
+        size_t replaced = 0;
+        for (const FileEntry *f = dup; f; f = f->next_link) {
+            const char *p = scan_path_format(f->path, &path_buf, &path_cap);
+            if (p && dup_replace_with_link(keep, p) == 0) {
+                printf("  linked %s\n", p);
+                replaced++;
+            } else {
+                printf("  skipped %s (%s)\n", p ? p : "?", strerror(errno));
+                totals->skipped++;
+            }
+        }
+        totals->linked += replaced;
+        if (replaced >= dup->nlink) totals->reclaimed += dup->size;
+    }
+    free(path_buf);
+    free(keep);
+}
+
+// Load the index for this root, if there is a usable one. A missing file is
+// normal on the first run; anything else is reported and ignored.
+static ScanIndex* dup_open_index(const char *index_path, const char *root) {
+    const char *error = NULL;
+    ScanIndex *index = scan_index_open(index_path, &error);
+    if (!index) {
+        if (strcmp(error, "no such file") != 0) {
+            fprintf(stderr, "Ignoring index %s (%s)\n", index_path, error);
+        }
+        return NULL;
+    }
+    if (strcmp(scan_index_root(index), root) != 0) {
+        fprintf(stderr, "Index %s was built for %s; rebuilding it for %s\n",
+                index_path, scan_index_root(index), root);
+        scan_index_close(index);
+        return NULL;
+    }
+    return index;
+}
+
+// Scan path and run the duplicate pipeline. With an index_path, hashes from
+// the previous run are reused (unless rebuilding) and the index is rewritten
+// afterwards. Duplicate sets are printed only when report is set, and
+// verified and deduplicated as flags (FINDDUP_*) ask.
+static int dup_run(const char *path, const WalkOptions *opts, const char *index_path,
+                   int rebuild, int report, unsigned flags) {
+    char root[PATH_MAX];
+    if (!realpath(path, root)) {
+        fprintf(stderr, "Cannot access %s\n", path);
+        return 1;
     }
     
-    // Free memory
-    while (files != NULL) {
-        FileEntry *temp = files;
-        files = files->next;
-        free(temp);
+    ScanStats *stats = opts ? opts->stats : NULL;
+    FileList files = {0};
+    scan_stats_stage(stats, "scan");
+    if (scan_directory(path, opts, &files) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free_file_list(&files);
+        return 1;
     }
     
-    if (duplicates_found == 0) {
-        printf("No duplicate files found (by size)\n");
-    } else {
-        printf("Found %d sets of potential duplicates\n", duplicates_found);
-        printf("Note: This checks file sizes only. Use hash comparison for accuracy.\n");
+    size_t reused = 0;
+    if (index_path && !rebuild) {
+        scan_stats_stage(stats, "index-load");
+        ScanIndex *index = dup_open_index(index_path, root);
+        if (index) {
+            reused = dup_apply_index(&files, index);
+            scan_index_close(index);
+        }
     }
     
+    FileEntry **entries = malloc((files.count ? files.count : 1) * sizeof(FileEntry*));
+    uint8_t *buffer = malloc(DUP_READ_BUFFER);
+    if (!entries || !buffer) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(entries);
+        free(buffer);
+        free_file_list(&files);
+        return 1;
+    }
+    
+    size_t count = 0;
+    for (size_t i = 0; i < files.count; i++) {
+        if (files.items[i].size > 0) entries[count++] = &files.items[i];
+    }
+    
+    size_t scanned = files.count;
+    size_t hashed = 0;
+    size_t folded = 0;
+    scan_stats_stage(stats, "group");
+    count = dup_fold_links(entries, count, &folded);
+    count = dup_filter_stage(entries, count, 1);
+    size_t same_size = count;
+    Uring *ring = opts && opts->backend == WALK_BACKEND_URING ? uring_create((unsigned)opts->queue_depth) : NULL;
+    scan_stats_stage(stats, "hash-partial");
+    size_t dropped = count;
+    count = dup_hash_stage(entries, count, 2, buffer, ring, &hashed, stats);
+    dropped -= count;
+    uring_destroy(ring);
+    count = dup_filter_stage(entries, count, 2);
+    size_t same_partial = count;
+    scan_stats_stage(stats, "hash-full");
+    dropped += count;
+    count = dup_hash_stage(entries, count, 3, buffer, NULL, &hashed, stats);
+    dropped -= count;
+    count = dup_filter_stage(entries, count, 3);
+    
+    // Survivors are sorted so that each duplicate set is contiguous
+    size_t same_hash = count;
+    size_t unreadable = 0, differ = 0;
+    if (report) qsort(entries, count, sizeof(FileEntry*), compare_dup_entries);
+    if (report && (flags & (FINDDUP_VERIFY | FINDDUP_DEDUPE))) {
+        scan_stats_stage(stats, "verify");
+        count = dup_verify(entries, count, &unreadable, &differ, stats);
+    } else if (report) {
+        size_t set = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (i == 0 || entries[i]->size != entries[i - 1]->size ||
+                entries[i]->full_hash != entries[i - 1]->full_hash) {
+                set++;
+            }
+            entries[i]->set = set;
+        }
+    }
+    
+    if (report) {
+        printf("Scanned %zu files: %zu share a size, %zu share head/tail content, %zu confirmed\n",
+               scanned, same_size, same_partial, same_hash);
+        if (dropped) printf("Skipped %zu files that could not be read or changed while hashing\n", dropped);
+        if (flags & (FINDDUP_VERIFY | FINDDUP_DEDUPE)) {
+            printf("Verified byte for byte: %zu identical", count);
+            if (differ) printf(", %zu differ despite equal hashes", differ);
+            if (unreadable) printf(", %zu unreadable or changed", unreadable);
+            printf("\n");
+        }
+        if (folded) {
+            printf("Hard links: %zu extra paths share an inode with another file and were hashed once\n", folded);
+        }
+        if (index_path) {
+            printf("Index: %zu files reused cached hashes, %zu hashes computed this run\n", reused, hashed);
+        }
+        printf("\n");
+    }
+    
+    int duplicates_found = 0;
+    unsigned long long wasted = 0;
+    char *path_buf = NULL;
+    size_t path_cap = 0;
+    if (report) {
+        scan_stats_stage(stats, "report");
+        for (size_t i = 0; i < count;) {
+            size_t j = i + 1;
+            while (j < count && entries[j]->set == entries[i]->set) j++;
+            
+            printf("Duplicate files (size: %llu bytes):\n", entries[i]->size);
+            for (size_t k = i; k < j; k++) {
+                const char *file_path = scan_path_format(entries[k]->path, &path_buf, &path_cap);
+                if (file_path) printf("  %s\n", file_path);
+                for (const FileEntry *link = entries[k]->next_link; link; link = link->next_link) {
+                    file_path = scan_path_format(link->path, &path_buf, &path_cap);
+                    if (file_path) printf("    = %s (hard link)\n", file_path);
+                }
+            }
+            printf("\n");
+            
+            duplicates_found++;
+            wasted += entries[i]->size * (j - i - 1);
+            i = j;
+        }
+    }
+    
+    DedupeTotals totals;
+    memset(&totals, 0, sizeof(totals));
+    int dedupe = report && (flags & FINDDUP_DEDUPE) && count > 0;
+    int dry_run = (flags & FINDDUP_DRY_RUN) != 0;
+    if (dedupe) {
+        scan_stats_stage(stats, "dedupe");
+        printf("%s\n", dry_run ? "Dry run, nothing will be changed:" : "Reclaiming space:");
+        for (size_t i = 0; i < count;) {
+            size_t j = i + 1;
+            while (j < count && entries[j]->set == entries[i]->set) j++;
+            dup_dedupe_set(entries + i, j - i, dry_run, &totals);
+            i = j;
+        }
+        printf("\n");
+    }
+    
+    int rc = 0;
+    if (index_path) {
+        scan_stats_stage(stats, "index-save");
+        if (dup_save_index(index_path, root, &files) != 0) {
+            fprintf(stderr, "Failed to write index %s\n", index_path);
+            rc = 1;
+        } else if (!report) {
+            printf("Indexed %zu files under %s into %s (%zu hashes computed)\n", scanned, root, index_path, hashed);
+        }
+    }
+    
+    free(entries);
+    free(buffer);
+    free(path_buf);
+    free_file_list(&files);
+    
+    if (report) {
+        if (duplicates_found == 0) {
+            printf("No duplicate files found\n");
+        } else {
+            char wasted_str[50];
+            format_size(wasted, wasted_str, sizeof(wasted_str));
+            printf("Found %d sets of duplicates (%s reclaimable)\n", duplicates_found, wasted_str);
+        }
+    }
+    if (dedupe) {
+        char reclaimed_str[50];
+        format_size(totals.reclaimed, reclaimed_str, sizeof(reclaimed_str));
+        if (dry_run) {
+            printf("Dry run: %zu duplicates would be replaced, reclaiming %s", totals.planned, reclaimed_str);
+        } else {
+            printf("Reclaimed %s: %zu files now share extents, %zu paths replaced by hard links",
+                   reclaimed_str, totals.deduped, totals.linked);
+        }
+        if (totals.skipped) printf(", %zu skipped", totals.skipped);
+        printf("\n");
+    }
+    
+    return rc;
+}
+
+int cmd_finddup(const char *path, const WalkOptions *opts, const char *index_path, unsigned flags) {
+    printf("Finding duplicates in: %s\n", path);
+    printf("Scanning files with %d threads...\n\n", walk_jobs(opts));
+    return dup_run(path, opts, index_path, 0, 1, flags);
+}
+
+int cmd_index_rebuild(const char *path, const WalkOptions *opts, const char *index_path) {
+    printf("Rebuilding index for: %s\n", path);
+    return dup_run(path, opts, index_path, 1, 0, 0);
+}
+
+// Dedup estimation: every regular file is cut into content-defined chunks
+// (see chunker.h) and the XXH3-64 of each chunk goes into one shared
+// fingerprint set; bytes of chunks seen for the first time are unique data.
+// Files are handed out largest first to a pool of threads through a shared
+// cursor. The set is split into shards with a lock each, picked by the top
+// fingerprint bits, so inserts from different threads rarely meet. Slots
+// hold only the 64-bit fingerprint (0 marks a free one), at most 4/3 of
+// 8 bytes per unique chunk; at that width a false match is too rare to
+// matter for an estimate.
+#define DEDUP_SHARD_BITS 6
+#define DEDUP_READ_BUFFER (1024 * 1024)
+
+typedef struct FingerprintShard {
+    pthread_mutex_t lock;
+    uint64_t *slots;
+    size_t mask;
+    size_t count;
+} FingerprintShard;
+
+typedef struct DedupCtx {
+    FileEntry **files;
+    size_t count;
+    size_t next;                    // next file to hand out (atomic)
+    FingerprintShard shards[1 << DEDUP_SHARD_BITS];
+    ScanStats *stats;
+} DedupCtx;
+
+typedef struct DedupWorker {
+    DedupCtx *ctx;
+    int index;
+    pthread_t thread;
+    unsigned long long bytes;
+    unsigned long long unique_bytes;
+    unsigned long long chunks;
+    unsigned long long unique_chunks;
+    size_t failed;
+    int out_of_memory;
+} DedupWorker;
+
+static int fingerprint_grow(FingerprintShard *shard) {
+    size_t capacity = shard->slots ? (shard->mask + 1) * 2 : 1024;
+    uint64_t *slots = calloc(capacity, sizeof(uint64_t));
+    if (!slots) return -1;
+    for (size_t i = 0; shard->slots && i <= shard->mask; i++) {
+        uint64_t fp = shard->slots[i];
+        if (!fp) continue;
+        size_t j = (size_t)fp & (capacity - 1);
+        while (slots[j]) j = (j + 1) & (capacity - 1);
+        slots[j] = fp;
+    }
+    free(shard->slots);
+    shard->slots = slots;
+    shard->mask = capacity - 1;
+    return 0;
+}
+
+// Returns 1 if fp is new, 0 if it was seen before, -1 if out of memory
+static int fingerprint_insert(DedupCtx *ctx, uint64_t fp) {
+    if (fp == 0) fp = 1;
+    FingerprintShard *shard = &ctx->shards[fp >> (64 - DEDUP_SHARD_BITS)];
+    pthread_mutex_lock(&shard->lock);
+    if ((!shard->slots || (shard->count + 1) * 4 > (shard->mask + 1) * 3) && fingerprint_grow(shard) != 0) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+    size_t i = (size_t)fp & shard->mask;
+    while (shard->slots[i] && shard->slots[i] != fp) i = (i + 1) & shard->mask;
+    int added = shard->slots[i] == 0;
+    if (added) {
+        shard->slots[i] = fp;
+        shard->count++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return added;
+}
+
+// Chunk one file. buffer holds CDC_MAX_SIZE + DEDUP_READ_BUFFER bytes: the
+// incomplete chunk left over from the previous read is always shorter than
+// CDC_MAX_SIZE and is moved to the front before reading on.
+static int dedup_file(DedupWorker *w, const FileEntry *file, uint8_t *buffer, uint32_t *lens,
+                      CdcChunker *chunker, char **path_buf, size_t *path_cap) {
+    ScanStats *stats = w->ctx->stats;
+    uint64_t start = scan_stats_now(stats);
+    int fd = scan_path_open(file->path, O_RDONLY | O_CLOEXEC, path_buf, path_cap);
+    if (fd < 0) return -1;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    scan_stats_read(stats, w->index, 0, start);
+    
+    size_t have = 0;
+    int eof = 0;
+    int rc = 0;
+    while (!eof && rc == 0) {
+        start = scan_stats_now(stats);
+        ssize_t n = read(fd, buffer + have, DEDUP_READ_BUFFER);
+        if (n < 0) {
+            rc = -1;
+            break;
+        }
+        scan_stats_read(stats, w->index, (uint64_t)n, start);
+        eof = n == 0;
+        have += (size_t)n;
+        
+        start = scan_stats_now(stats);
+        size_t chunks = cdc_split(chunker, buffer, have, eof, lens);
+        if (chunks == (size_t)-1) {
+            w->out_of_memory = 1;
+            rc = -1;
+            break;
+        }
+        size_t offset = 0;
+        for (size_t c = 0; c < chunks; c++) {
+            int added = fingerprint_insert(w->ctx, xxh3_64(buffer + offset, lens[c]));
+            if (added < 0) {
+                w->out_of_memory = 1;
+                rc = -1;
+                break;
+            }
+            w->chunks++;
+            w->bytes += lens[c];
+            if (added) {
+                w->unique_chunks++;
+                w->unique_bytes += lens[c];
+            }
+            offset += lens[c];
+        }
+        scan_stats_hash(stats, w->index, offset, start);
+        memmove(buffer, buffer + offset, have - offset);
+        have -= offset;
+    }
+    close(fd);
+    if (rc == 0) scan_stats_file_hashed(stats, w->index);
+    return rc;
+}
+
+static void* dedup_worker(void *arg) {
+    DedupWorker *w = arg;
+    DedupCtx *ctx = w->ctx;
+    uint8_t *buffer = malloc(CDC_MAX_SIZE + DEDUP_READ_BUFFER);
+    uint32_t *lens = malloc(((CDC_MAX_SIZE + DEDUP_READ_BUFFER) / CDC_MIN_SIZE + 1) * sizeof(uint32_t));
+    CdcChunker chunker;
+    cdc_chunker_init(&chunker);
+    char *path_buf = NULL;
+    size_t path_cap = 0;
+    
+    if (!buffer || !lens) w->out_of_memory = 1;
+    while (!w->out_of_memory) {
+        size_t i = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED);
+        if (i >= ctx->count) break;
+        if (dedup_file(w, ctx->files[i], buffer, lens, &chunker, &path_buf, &path_cap) != 0) w->failed++;
+    }
+    
+    cdc_chunker_free(&chunker);
+    free(path_buf);
+    free(lens);
+    free(buffer);
+    return NULL;
+}
+
+static int compare_size_desc(const void *a, const void *b) {
+    const FileEntry *fa = *(const FileEntry * const *)a;
+    const FileEntry *fb = *(const FileEntry * const *)b;
+    if (fa->size != fb->size) return fa->size < fb->size ? 1 : -1;
+    return 0;
+}
+
+int cmd_dedupestimate(const char *path, const WalkOptions *opts) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Cannot open directory %s\n", path);
+        return 1;
+    }
+    printf("Estimating deduplication in: %s\n", path);
+    
+    ScanStats *stats = opts ? opts->stats : NULL;
+    FileList files = {0};
+    scan_stats_stage(stats, "scan");
+    if (scan_directory(path, opts, &files) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free_file_list(&files);
+        return 1;
+    }
+    
+    FileEntry **entries = malloc((files.count ? files.count : 1) * sizeof(FileEntry*));
+    if (!entries) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free_file_list(&files);
+        return 1;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < files.count; i++) {
+        if (files.items[i].size > 0) entries[count++] = &files.items[i];
+    }
+    size_t folded = 0;
+    count = dup_fold_links(entries, count, &folded);
+    qsort(entries, count, sizeof(FileEntry*), compare_size_desc);
+    
+    cdc_init();
+    int jobs = walk_jobs(opts);
+    if ((size_t)jobs > count) jobs = count ? (int)count : 1;
+    printf("Chunking %zu files with %d threads (%s, chunks of %d-%d KB, %d KB average)...\n\n",
+           count, jobs, cdc_impl(), CDC_MIN_SIZE / 1024, CDC_MAX_SIZE / 1024, CDC_AVG_SIZE / 1024);
+    
+    DedupCtx *ctx = calloc(1, sizeof(DedupCtx));
+    DedupWorker *workers = calloc((size_t)jobs, sizeof(DedupWorker));
+    if (!ctx || !workers) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(ctx);
+        free(workers);
+        free(entries);
+        free_file_list(&files);
+        return 1;
+    }
+    ctx->files = entries;
+    ctx->count = count;
+    ctx->stats = stats;
+    for (size_t i = 0; i < sizeof(ctx->shards) / sizeof(ctx->shards[0]); i++) {
+        pthread_mutex_init(&ctx->shards[i].lock, NULL);
+    }
+    
+    // Worker 0 runs on this thread; if a thread can't be started the
+    // others simply take over its share
+    scan_stats_stage(stats, "chunk");
+    int started = 1;
+    for (int i = 0; i < jobs; i++) {
+        workers[i].ctx = ctx;
+        workers[i].index = i;
+    }
+    for (; started < jobs; started++) {
+        if (pthread_create(&workers[started].thread, NULL, dedup_worker, &workers[started]) != 0) break;
+    }
+    dedup_worker(&workers[0]);
+    for (int i = 1; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    
+    scan_stats_stage(stats, "report");
+    unsigned long long bytes = 0, unique_bytes = 0, chunks = 0, unique_chunks = 0;
+    size_t failed = 0;
+    int out_of_memory = 0;
+    for (int i = 0; i < started; i++) {
+        bytes += workers[i].bytes;
+        unique_bytes += workers[i].unique_bytes;
+        chunks += workers[i].chunks;
+        unique_chunks += workers[i].unique_chunks;
+        failed += workers[i].failed;
+        out_of_memory |= workers[i].out_of_memory;
+    }
+    for (size_t i = 0; i < sizeof(ctx->shards) / sizeof(ctx->shards[0]); i++) {
+        pthread_mutex_destroy(&ctx->shards[i].lock);
+        free(ctx->shards[i].slots);
+    }
+    free(ctx);
+    free(workers);
+    free(entries);
+    free_file_list(&files);
+    
+    if (out_of_memory) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    
+    char total_str[50], unique_str[50], saved_str[50], avg_str[50];
+    format_size(bytes, total_str, sizeof(total_str));
+    format_size(unique_bytes, unique_str, sizeof(unique_str));
+    format_size(bytes - unique_bytes, saved_str, sizeof(saved_str));
+    format_size(chunks ? bytes / chunks : 0, avg_str, sizeof(avg_str));
+    
+    printf("Files:        %zu chunked", count - failed);
+    if (folded) printf(", %zu hard-linked paths counted once", folded);
+    if (failed) printf(", %zu unreadable", failed);
+    printf("\n");
+    printf("Total data:   %s in %llu chunks (average %s)\n", total_str, chunks, avg_str);
+    printf("Unique data:  %s in %llu chunks\n", unique_str, unique_chunks);
+    if (unique_bytes) {
+        printf("Dedup ratio:  %.2fx (%s or %.1f%% could be saved)\n",
+               (double)bytes / unique_bytes, saved_str, 100.0 * (bytes - unique_bytes) / bytes);
+    }
     return 0;
 }
 
 #else
-int cmd_diskusage(const char *path) {
+int cmd_diskusage(const char *path, const WalkOptions *opts, int scan, SizeMode mode) {
     fprintf(stderr, "Disk usage not supported on this platform\n");
     return 1;
 }
 
-int cmd_finddup(const char *path) {
+int cmd_diskusage_tree(const char *path, const WalkOptions *opts, SizeMode mode, int depth,
+                       int top, int stream) {
+    fprintf(stderr, "Disk usage not supported on this platform\n");
+    return 1;
+}
+
+int cmd_finddup(const char *path, const WalkOptions *opts, const char *index_path, unsigned flags) {
     fprintf(stderr, "Duplicate finder not supported on this platform\n");
     return 1;
 }
+
+int cmd_index_rebuild(const char *path, const WalkOptions *opts, const char *index_path) {
+    fprintf(stderr, "Scan index not supported on this platform\n");
+    return 1;
+}
+
+int cmd_dedupestimate(const char *path, const WalkOptions *opts) {
+    fprintf(stderr, "Dedup estimation not supported on this platform\n");
+    return 1;
+}
 #endif
@@ -1,7 +1,37 @@
 #ifndef FILETOOLS_H
 #define FILETOOLS_H
 
-int cmd_diskusage(const char *path);
-int cmd_finddup(const char *path);
+#include "walker.h"
+
+typedef enum {
+    SIZE_APPARENT,          // st_size: the bytes a reader sees
+    SIZE_ALLOCATED          // st_blocks * 512: space used on disk (sparse files,
+                            // block rounding and directories included)
+} SizeMode;
+
+typedef struct DirSize {
+    unsigned long long bytes;
+    unsigned long long files;
+    unsigned long long links;   // extra paths to hard-linked files, not re-counted
+} DirSize;
+
+// scan: also walk path and report its contents in the given size mode
+int cmd_diskusage(const char *path, const WalkOptions *opts, int scan, SizeMode mode);
+// Per-directory breakdown in one bottom-up pass: the top heaviest
+// directories up to depth levels below path; stream prints every total
+// (children first, like du) as soon as its subtree is done
+int cmd_diskusage_tree(const char *path, const WalkOptions *opts, SizeMode mode, int depth,
+                       int top, int stream);
+// finddup flags
+#define FINDDUP_VERIFY   (1 << 0)   // byte-compare candidates (mmap) before reporting
+#define FINDDUP_DEDUPE   (1 << 1)   // reclaim space: FIDEDUPERANGE, else hard links (implies verify)
+#define FINDDUP_DRY_RUN  (1 << 2)   // with FINDDUP_DEDUPE: only show what would be done
+
+int cmd_finddup(const char *path, const WalkOptions *opts, const char *index_path, unsigned flags);
+int cmd_index_rebuild(const char *path, const WalkOptions *opts, const char *index_path);
+// Content-defined chunking over every file: unique vs. total bytes
+int cmd_dedupestimate(const char *path, const WalkOptions *opts);
+void format_size(unsigned long long size, char *buffer, size_t buffer_size);
+unsigned long long get_dir_size(const char *path, const WalkOptions *opts, SizeMode mode, DirSize *stats);
 
 #endif
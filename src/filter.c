@@ -0,0 +1,204 @@
+#include "filter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifndef _WIN32
+#include <fnmatch.h>
+#include <regex.h>
+#endif
+
+void walk_filter_init(WalkFilter *filter) {
+    memset(filter, 0, sizeof(*filter));
+    filter->min_age = -1;
+    filter->max_age = -1;
+    filter->now = time(NULL);
+}
+
+void walk_filter_free(WalkFilter *filter) {
+    for (size_t i = 0; i < filter->count; i++) {
+#ifndef _WIN32
+        if (filter->patterns[i].regex) regfree(filter->patterns[i].regex);
+#endif
+        free(filter->patterns[i].regex);
+        free(filter->patterns[i].text);
+    }
+    free(filter->patterns);
+    walk_filter_init(filter);
+}
+
+int walk_filter_add(WalkFilter *filter, const char *pattern, int regex, int exclude) {
+#ifdef _WIN32
+    (void)filter; (void)regex; (void)exclude;
+    fprintf(stderr, "Pattern filters not supported on Windows yet: %s\n", pattern);
+    return -1;
+#else
+    if (filter->count == filter->capacity) {
+        size_t new_cap = filter->capacity ? filter->capacity * 2 : 8;
+        FilterPattern *patterns = realloc(filter->patterns, new_cap * sizeof(FilterPattern));
+        if (!patterns) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        filter->patterns = patterns;
+        filter->capacity = new_cap;
+    }
+    
+    FilterPattern *p = &filter->patterns[filter->count];
+    memset(p, 0, sizeof(*p));
+    p->text = strdup(pattern);
+    p->exclude = exclude;
+    p->match_path = strchr(pattern, '/') != NULL;
+    if (!p->text) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    
+    if (regex) {
+        p->regex = malloc(sizeof(regex_t));
+        int rc = p->regex ? regcomp(p->regex, pattern, REG_EXTENDED | REG_NOSUB) : REG_ESPACE;
+        if (rc != 0) {
+            char msg[256] = "out of memory";
+            if (p->regex) regerror(rc, p->regex, msg, sizeof(msg));
+            fprintf(stderr, "Invalid regular expression '%s': %s\n", pattern, msg);
+            free(p->regex);
+            free(p->text);
+            return -1;
+        }
+    }
+    
+    filter->count++;
+    if (exclude) {
+        filter->excludes++;
+    } else {
+        filter->includes++;
+    }
+    return 0;
+#endif
+}
+
+// Size with an optional binary suffix: 10, 4K, 100M, 2G, 1T
+int walk_parse_size(const char *text, unsigned long long *out) {
+    char *end;
+    if (!isdigit((unsigned char)text[0])) return -1;
+    unsigned long long value = strtoull(text, &end, 10);
+    int shift = 0;
+    switch (toupper((unsigned char)*end)) {
+        case '\0': break;
+        case 'K': shift = 10; break;
+        case 'M': shift = 20; break;
+        case 'G': shift = 30; break;
+        case 'T': shift = 40; break;
+        default: return -1;
+    }
+    if (*end && end[1] != '\0' && !((end[1] == 'B' || end[1] == 'b') && end[2] == '\0')) return -1;
+    if (shift && value > (~0ULL >> shift)) return -1;
+    *out = value << shift;
+    return 0;
+}
+
+// Age in days by default, or with a unit: 30s, 15m, 12h, 7d, 2w
+static int parse_age(const char *text, long long *out) {
+    char *end;
+    if (!isdigit((unsigned char)text[0])) return -1;
+    long long value = strtoll(text, &end, 10);
+    long long unit;
+    switch (*end) {
+        case 's': unit = 1; break;
+        case 'm': unit = 60; break;
+        case 'h': unit = 3600; break;
+        case '\0':
+        case 'd': unit = 86400; break;
+        case 'w': unit = 7 * 86400; break;
+        default: return -1;
+    }
+    if (*end && end[1] != '\0') return -1;
+    if (value > 0x7fffffffffffffffLL / unit) return -1;
+    *out = value * unit;
+    return 0;
+}
+
+int walk_filter_option(WalkFilter *filter, int argc, char *argv[], int *i) {
+    const char *opt = argv[*i];
+    if (strcmp(opt, "--xdev") == 0 || strcmp(opt, "--one-file-system") == 0) {
+        filter->xdev = 1;
+        return 1;
+    }
+    
+    static const char *const valued[] = {
+        "--exclude", "--include", "--exclude-regex", "--include-regex",
+        "--max-depth", "--min-size", "--max-size", "--min-age", "--max-age", NULL
+    };
+    int known = 0;
+    for (int k = 0; valued[k]; k++) known |= strcmp(opt, valued[k]) == 0;
+    if (!known) return 0;
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "%s requires a value\n", opt);
+        return -1;
+    }
+    const char *value = argv[++*i];
+    
+    if (strcmp(opt, "--exclude") == 0 || strcmp(opt, "--include") == 0) {
+        return walk_filter_add(filter, value, 0, opt[2] == 'e') == 0 ? 1 : -1;
+    }
+    if (strcmp(opt, "--exclude-regex") == 0 || strcmp(opt, "--include-regex") == 0) {
+        return walk_filter_add(filter, value, 1, opt[2] == 'e') == 0 ? 1 : -1;
+    }
+    if (strcmp(opt, "--max-depth") == 0) {
+        filter->max_depth = atoi(value);
+        if (filter->max_depth > 0) return 1;
+        fprintf(stderr, "--max-depth requires a positive number\n");
+        return -1;
+    }
+    if (strcmp(opt, "--min-size") == 0 || strcmp(opt, "--max-size") == 0) {
+        unsigned long long *size = opt[3] == 'i' ? &filter->min_size : &filter->max_size;
+        if (walk_parse_size(value, size) == 0) return 1;
+        fprintf(stderr, "Invalid size for %s: %s (e.g. 4096, 10K, 100M, 2G)\n", opt, value);
+        return -1;
+    }
+    long long *age = opt[3] == 'i' ? &filter->min_age : &filter->max_age;
+    if (parse_age(value, age) == 0) return 1;
+    fprintf(stderr, "Invalid age for %s: %s (days, or with a unit: 30s, 15m, 12h, 7d, 2w)\n", opt, value);
+    return -1;
+}
+
+int walk_filter_active(const WalkFilter *filter) {
+    return filter && (filter->count || filter->max_depth || filter->xdev || filter->min_size ||
+                      filter->max_size || filter->min_age >= 0 || filter->max_age >= 0);
+}
+
+static int pattern_matches(const FilterPattern *p, const char *path, const char *name) {
+#ifdef _WIN32
+    (void)p; (void)path; (void)name;
+    return 0;
+#else
+    if (p->regex) return regexec(p->regex, path, 0, NULL, 0) == 0;
+    return fnmatch(p->text, p->match_path ? path : name, 0) == 0;
+#endif
+}
+
+int walk_filter_excluded(const WalkFilter *filter, const char *path, const char *name) {
+    if (!filter->excludes) return 0;
+    for (size_t i = 0; i < filter->count; i++) {
+        if (filter->patterns[i].exclude && pattern_matches(&filter->patterns[i], path, name)) return 1;
+    }
+    return 0;
+}
+
+int walk_filter_file(const WalkFilter *filter, const char *path, const char *name,
+                     const struct stat *st) {
+    unsigned long long size = (unsigned long long)st->st_size;
+    if (size < filter->min_size) return 0;
+    if (filter->max_size && size > filter->max_size) return 0;
+    
+    long long age = (long long)(filter->now - st->st_mtime);
+    if (filter->min_age >= 0 && age < filter->min_age) return 0;
+    if (filter->max_age >= 0 && age > filter->max_age) return 0;
+    
+    if (!filter->includes) return 1;
+    for (size_t i = 0; i < filter->count; i++) {
+        if (!filter->patterns[i].exclude && pattern_matches(&filter->patterns[i], path, name)) return 1;
+    }
+    return 0;
+}
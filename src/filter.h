@@ -0,0 +1,68 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Scan filters applied by the walker while it reads directories, so an
+// excluded subtree is never opened and an excluded file is never visited.
+// Patterns are compiled once up front:
+//   glob   fnmatch(3) pattern; matched against the entry name, or against
+//          the full path when the pattern contains a '/'
+//   regex  POSIX extended regular expression, searched in the full path
+// Exclude patterns apply to files and directories. If any include pattern
+// is given, a file must match one of them; directories are still descended
+// unless excluded. Size and age predicates apply to regular files only.
+
+typedef struct FilterPattern {
+    char *text;
+    void *regex;                    // compiled regex_t, NULL for globs
+    int exclude;
+    int match_path;                 // glob contains '/'
+} FilterPattern;
+
+typedef struct WalkFilter {
+    FilterPattern *patterns;
+    size_t count;
+    size_t capacity;
+    int excludes;                   // number of exclude patterns
+    int includes;                   // number of include patterns
+    int max_depth;                  // deepest entry reported, 0 = unlimited
+    int xdev;                       // stay on the root's filesystem
+    unsigned long long min_size;
+    unsigned long long max_size;    // 0 = no limit
+    long long min_age;              // seconds since mtime, -1 = no limit
+    long long max_age;
+    time_t now;
+} WalkFilter;
+
+void walk_filter_init(WalkFilter *filter);
+void walk_filter_free(WalkFilter *filter);
+
+// Compile and add a pattern. Returns 0, or -1 after printing the error.
+int walk_filter_add(WalkFilter *filter, const char *pattern, int regex, int exclude);
+
+// Parse one filter option at argv[*i] (--exclude GLOB, --include GLOB,
+// --exclude-regex RE, --include-regex RE, --max-depth N, --xdev,
+// --min-size SIZE, --max-size SIZE, --min-age AGE, --max-age AGE),
+// advancing *i past its value. Returns 1 if consumed, 0 if argv[*i] is not
+// a filter option, -1 on a malformed value.
+int walk_filter_option(WalkFilter *filter, int argc, char *argv[], int *i);
+
+// Size with an optional binary suffix (10, 4K, 100M, 2G, 1T). Returns 0,
+// or -1 if text is not a size.
+int walk_parse_size(const char *text, unsigned long long *out);
+
+// 1 if the filter does anything at all
+int walk_filter_active(const WalkFilter *filter);
+
+// Name and path test, usable before the entry has been stat'ed
+int walk_filter_excluded(const WalkFilter *filter, const char *path, const char *name);
+
+// Include patterns plus size and age predicates for a regular file
+int walk_filter_file(const WalkFilter *filter, const char *path, const char *name,
+                     const struct stat *st);
+
+#endif
@@ -1,156 +1,852 @@
 #include "hash.h"
+#include "sha.h"
+#include "mbhash.h"
+#include "reader.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#endif
 
-// Simple MD5 implementation
-typedef struct {
-    uint32_t state[4];
-    uint32_t count[2];
-    uint8_t buffer[64];
-} MD5_CTX;
-
+// MD5 (RFC 1321)
 #define F(x, y, z) (((x) & (y)) | ((~x) & (z)))
 #define G(x, y, z) (((x) & (z)) | ((y) & (~z)))
 #define H(x, y, z) ((x) ^ (y) ^ (z))
 #define I(x, y, z) ((y) ^ ((x) | (~z)))
 #define ROTATE_LEFT(x, n) (((x) << (n)) | ((x) >> (32-(n))))
 
-static void md5_transform(uint32_t state[4], const uint8_t block[64]);
+#define MD5_STEP(f, a, b, c, d, x, s, t) \
+    (a) = (b) + ROTATE_LEFT((a) + f((b), (c), (d)) + (x) + (uint32_t)(t), s)
+
+void md5_blocks(uint32_t state[4], const uint8_t *block, size_t count) {
+    for (; count; count--, block += 64) {
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], x[16];
+        
+        for (int i = 0; i < 16; i++)
+            x[i] = ((uint32_t)block[i*4]) | (((uint32_t)block[i*4+1]) << 8) |
+                   (((uint32_t)block[i*4+2]) << 16) | (((uint32_t)block[i*4+3]) << 24);
+        
+        // Round 1
+        MD5_STEP(F, a, b, c, d, x[0], 7, 0xd76aa478);
+        MD5_STEP(F, d, a, b, c, x[1], 12, 0xe8c7b756);
+        MD5_STEP(F, c, d, a, b, x[2], 17, 0x242070db);
+        MD5_STEP(F, b, c, d, a, x[3], 22, 0xc1bdceee);
+        MD5_STEP(F, a, b, c, d, x[4], 7, 0xf57c0faf);
+        MD5_STEP(F, d, a, b, c, x[5], 12, 0x4787c62a);
+        MD5_STEP(F, c, d, a, b, x[6], 17, 0xa8304613);
+        MD5_STEP(F, b, c, d, a, x[7], 22, 0xfd469501);
+        MD5_STEP(F, a, b, c, d, x[8], 7, 0x698098d8);
+        MD5_STEP(F, d, a, b, c, x[9], 12, 0x8b44f7af);
+        MD5_STEP(F, c, d, a, b, x[10], 17, 0xffff5bb1);
+        MD5_STEP(F, b, c, d, a, x[11], 22, 0x895cd7be);
+        MD5_STEP(F, a, b, c, d, x[12], 7, 0x6b901122);
+        MD5_STEP(F, d, a, b, c, x[13], 12, 0xfd987193);
+        MD5_STEP(F, c, d, a, b, x[14], 17, 0xa679438e);
+        MD5_STEP(F, b, c, d, a, x[15], 22, 0x49b40821);
+        
+        // Round 2
+        MD5_STEP(G, a, b, c, d, x[1], 5, 0xf61e2562);
+        MD5_STEP(G, d, a, b, c, x[6], 9, 0xc040b340);
+        MD5_STEP(G, c, d, a, b, x[11], 14, 0x265e5a51);
+        MD5_STEP(G, b, c, d, a, x[0], 20, 0xe9b6c7aa);
+        MD5_STEP(G, a, b, c, d, x[5], 5, 0xd62f105d);
+        MD5_STEP(G, d, a, b, c, x[10], 9, 0x02441453);
+        MD5_STEP(G, c, d, a, b, x[15], 14, 0xd8a1e681);
+        MD5_STEP(G, b, c, d, a, x[4], 20, 0xe7d3fbc8);
+        MD5_STEP(G, a, b, c, d, x[9], 5, 0x21e1cde6);
+        MD5_STEP(G, d, a, b, c, x[14], 9, 0xc33707d6);
+        MD5_STEP(G, c, d, a, b, x[3], 14, 0xf4d50d87);
+        MD5_STEP(G, b, c, d, a, x[8], 20, 0x455a14ed);
+        MD5_STEP(G, a, b, c, d, x[13], 5, 0xa9e3e905);
+        MD5_STEP(G, d, a, b, c, x[2], 9, 0xfcefa3f8);
+        MD5_STEP(G, c, d, a, b, x[7], 14, 0x676f02d9);
+        MD5_STEP(G, b, c, d, a, x[12], 20, 0x8d2a4c8a);
+        
+        // Round 3
+        MD5_STEP(H, a, b, c, d, x[5], 4, 0xfffa3942);
+        MD5_STEP(H, d, a, b, c, x[8], 11, 0x8771f681);
+        MD5_STEP(H, c, d, a, b, x[11], 16, 0x6d9d6122);
+        MD5_STEP(H, b, c, d, a, x[14], 23, 0xfde5380c);
+        MD5_STEP(H, a, b, c, d, x[1], 4, 0xa4beea44);
+        MD5_STEP(H, d, a, b, c, x[4], 11, 0x4bdecfa9);
+        MD5_STEP(H, c, d, a, b, x[7], 16, 0xf6bb4b60);
+        MD5_STEP(H, b, c, d, a, x[10], 23, 0xbebfbc70);
+        MD5_STEP(H, a, b, c, d, x[13], 4, 0x289b7ec6);
+        MD5_STEP(H, d, a, b, c, x[0], 11, 0xeaa127fa);
+        MD5_STEP(H, c, d, a, b, x[3], 16, 0xd4ef3085);
+        MD5_STEP(H, b, c, d, a, x[6], 23, 0x04881d05);
+        MD5_STEP(H, a, b, c, d, x[9], 4, 0xd9d4d039);
+        MD5_STEP(H, d, a, b, c, x[12], 11, 0xe6db99e5);
+        MD5_STEP(H, c, d, a, b, x[15], 16, 0x1fa27cf8);
+        MD5_STEP(H, b, c, d, a, x[2], 23, 0xc4ac5665);
+        
+        // Round 4
+        MD5_STEP(I, a, b, c, d, x[0], 6, 0xf4292244);
+        MD5_STEP(I, d, a, b, c, x[7], 10, 0x432aff97);
+        MD5_STEP(I, c, d, a, b, x[14], 15, 0xab9423a7);
+        MD5_STEP(I, b, c, d, a, x[5], 21, 0xfc93a039);
+        MD5_STEP(I, a, b, c, d, x[12], 6, 0x655b59c3);
+        MD5_STEP(I, d, a, b, c, x[3], 10, 0x8f0ccc92);
+        MD5_STEP(I, c, d, a, b, x[10], 15, 0xffeff47d);
+        MD5_STEP(I, b, c, d, a, x[1], 21, 0x85845dd1);
+        MD5_STEP(I, a, b, c, d, x[8], 6, 0x6fa87e4f);
+        MD5_STEP(I, d, a, b, c, x[15], 10, 0xfe2ce6e0);
+        MD5_STEP(I, c, d, a, b, x[6], 15, 0xa3014314);
+        MD5_STEP(I, b, c, d, a, x[13], 21, 0x4e0811a1);
+        MD5_STEP(I, a, b, c, d, x[4], 6, 0xf7537e82);
+        MD5_STEP(I, d, a, b, c, x[11], 10, 0xbd3af235);
+        MD5_STEP(I, c, d, a, b, x[2], 15, 0x2ad7d2bb);
+        MD5_STEP(I, b, c, d, a, x[9], 21, 0xeb86d391);
+        
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+    }
+}
+
+// Algorithm table, in HashAlgo order
+static const struct {
+    const char *name;
+    const char *label;          // as printed in "LABEL (file) = digest"
+    size_t digest_size;
+    size_t block_size;          // 0 if the algorithm buffers its own input
+} hash_algos[HASH_ALGO_COUNT] = {
+    { "md5", "MD5", 16, 64 },
+    { "sha1", "SHA1", 20, 64 },
+    { "sha256", "SHA256", 32, 64 },
+    { "sha512", "SHA512", 64, 128 },
+    { "xxh3", "XXH3", 8, 0 },
+    { "xxh128", "XXH128", 16, 0 },
+    { "blake3", "BLAKE3", BLAKE3_OUT_LEN, 0 },
+    { "crc32c", "CRC32C", 4, 0 },
+    { "crc64", "CRC64", 8, 0 },
+};
+
+int hash_algo_parse(const char *name, HashAlgo *algo) {
+    for (int i = 0; i < HASH_ALGO_COUNT; i++) {
+        if (strcmp(name, hash_algos[i].name) == 0 || strcmp(name, hash_algos[i].label) == 0) {
+            *algo = (HashAlgo)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* hash_algo_name(HashAlgo algo) {
+    return hash_algos[algo].name;
+}
+
+const char* hash_algo_label(HashAlgo algo) {
+    return hash_algos[algo].label;
+}
+
+const char* hash_algo_names(void) {
+    return "md5, sha1, sha256, sha512, xxh3, xxh128, blake3, crc32c, crc64";
+}
+
+size_t hash_digest_size(HashAlgo algo) {
+    return hash_algos[algo].digest_size;
+}
 
-void md5_init(MD5_CTX *ctx) {
-    ctx->count[0] = ctx->count[1] = 0;
-    ctx->state[0] = 0x67452301;
-    ctx->state[1] = 0xefcdab89;
-    ctx->state[2] = 0x98badcfe;
-    ctx->state[3] = 0x10325476;
+const char* hash_algo_impl(HashAlgo algo) {
+    switch (algo) {
+        case HASH_SHA1: return sha1_impl();
+        case HASH_SHA256: return sha256_impl();
+        case HASH_SHA512: return sha512_impl();
+        case HASH_XXH3_64:
+        case HASH_XXH3_128: return xxh3_impl();
+        case HASH_BLAKE3: return blake3_impl();
+        case HASH_CRC32C: return crc32c_impl();
+        case HASH_CRC64: return crc64_impl();
+        default: return "scalar";
+    }
 }
 
-void md5_update(MD5_CTX *ctx, const uint8_t *input, size_t len) {
-    size_t i, index, partLen;
+void hash_init(HashCtx *ctx, HashAlgo algo) {
+    static const uint32_t md5_iv[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    static const uint32_t sha1_iv[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    static const uint32_t sha256_iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    static const uint64_t sha512_iv[8] = {
+        0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+        0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+    };
     
-    index = (size_t)((ctx->count[0] >> 3) & 0x3F);
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->algo = algo;
+    switch (algo) {
+        case HASH_MD5: memcpy(ctx->u.md.state.w32, md5_iv, sizeof(md5_iv)); break;
+        case HASH_SHA1: memcpy(ctx->u.md.state.w32, sha1_iv, sizeof(sha1_iv)); break;
+        case HASH_SHA256: memcpy(ctx->u.md.state.w32, sha256_iv, sizeof(sha256_iv)); break;
+        case HASH_SHA512: memcpy(ctx->u.md.state.w64, sha512_iv, sizeof(sha512_iv)); break;
+        case HASH_XXH3_64:
+        case HASH_XXH3_128: xxh3_init(&ctx->u.xxh3); break;
+        case HASH_BLAKE3: blake3_init(&ctx->u.blake3); break;
+        default: break;
+    }
+}
+
+static void hash_blocks(HashCtx *ctx, const uint8_t *data, size_t count) {
+    switch (ctx->algo) {
+        case HASH_MD5: md5_blocks(ctx->u.md.state.w32, data, count); break;
+        case HASH_SHA1: sha1_blocks(ctx->u.md.state.w32, data, count); break;
+        case HASH_SHA256: sha256_blocks(ctx->u.md.state.w32, data, count); break;
+        case HASH_SHA512: sha512_blocks(ctx->u.md.state.w64, data, count); break;
+        default: break;
+    }
+}
+
+void hash_update(HashCtx *ctx, const void *data, size_t len) {
+    const uint8_t *p = data;
+    size_t block = hash_algos[ctx->algo].block_size;
     
-    if ((ctx->count[0] += ((uint32_t)len << 3)) < ((uint32_t)len << 3))
-        ctx->count[1]++;
-    ctx->count[1] += ((uint32_t)len >> 29);
+    if (ctx->algo == HASH_XXH3_64 || ctx->algo == HASH_XXH3_128) {
+        xxh3_update(&ctx->u.xxh3, data, len);
+        return;
+    }
+    if (ctx->algo == HASH_BLAKE3) {
+        blake3_update(&ctx->u.blake3, data, len);
+        return;
+    }
+    if (ctx->algo == HASH_CRC32C) {
+        ctx->u.crc = crc32c((uint32_t)ctx->u.crc, data, len);
+        return;
+    }
+    if (ctx->algo == HASH_CRC64) {
+        ctx->u.crc = crc64(ctx->u.crc, data, len);
+        return;
+    }
     
-    partLen = 64 - index;
+    size_t buffered = (size_t)(ctx->u.md.total % block);
+    ctx->u.md.total += len;
     
-    if (len >= partLen) {
-        memcpy(&ctx->buffer[index], input, partLen);
-        md5_transform(ctx->state, ctx->buffer);
-        
-        for (i = partLen; i + 63 < len; i += 64)
-            md5_transform(ctx->state, &input[i]);
-        
-        index = 0;
-    } else {
-        i = 0;
+    // Top up a partial block first, then run whole blocks straight from
+    // the input so the kernels see long runs
+    if (buffered) {
+        size_t fill = block - buffered;
+        if (len < fill) {
+            memcpy(ctx->u.md.buffer + buffered, p, len);
+            return;
+        }
+        memcpy(ctx->u.md.buffer + buffered, p, fill);
+        hash_blocks(ctx, ctx->u.md.buffer, 1);
+        p += fill;
+        len -= fill;
+    }
+    if (len >= block) {
+        hash_blocks(ctx, p, len / block);
+        p += len / block * block;
+        len %= block;
+    }
+    memcpy(ctx->u.md.buffer, p, len);
+}
+
+static void put_be64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (56 - 8 * i));
+}
+
+size_t hash_final(HashCtx *ctx, uint8_t *digest) {
+    if (ctx->algo == HASH_XXH3_64) {
+        put_be64(digest, xxh3_64_final(&ctx->u.xxh3));
+        return 8;
     }
+    if (ctx->algo == HASH_XXH3_128) {
+        Xxh128 h = xxh3_128_final(&ctx->u.xxh3);
+        put_be64(digest, h.high);
+        put_be64(digest + 8, h.low);
+        return 16;
+    }
+    if (ctx->algo == HASH_BLAKE3) {
+        blake3_final(&ctx->u.blake3, digest, BLAKE3_OUT_LEN);
+        return BLAKE3_OUT_LEN;
+    }
+    if (ctx->algo == HASH_CRC32C) {
+        for (int i = 0; i < 4; i++) digest[i] = (uint8_t)(ctx->u.crc >> (24 - 8 * i));
+        return 4;
+    }
+    if (ctx->algo == HASH_CRC64) {
+        put_be64(digest, ctx->u.crc);
+        return 8;
+    }
+    
+    size_t block = hash_algos[ctx->algo].block_size;
+    size_t buffered = (size_t)(ctx->u.md.total % block);
+    size_t length_size = block == 128 ? 16 : 8;
+    uint64_t bits = ctx->u.md.total << 3;
+    
+    // 0x80, zeros, then the message length in bits: little-endian for
+    // MD5, big-endian (and 128 bits wide for SHA-512) for the SHA family
+    ctx->u.md.buffer[buffered++] = 0x80;
+    if (buffered > block - length_size) {
+        memset(ctx->u.md.buffer + buffered, 0, block - buffered);
+        hash_blocks(ctx, ctx->u.md.buffer, 1);
+        buffered = 0;
+    }
+    memset(ctx->u.md.buffer + buffered, 0, block - buffered);
+    for (int i = 0; i < 8; i++) {
+        if (ctx->algo == HASH_MD5) {
+            ctx->u.md.buffer[block - 8 + i] = (uint8_t)(bits >> (8 * i));
+        } else {
+            ctx->u.md.buffer[block - 1 - i] = (uint8_t)(bits >> (8 * i));
+        }
+    }
+    if (length_size == 16) ctx->u.md.buffer[block - 9] = (uint8_t)(ctx->u.md.total >> 61);
+    hash_blocks(ctx, ctx->u.md.buffer, 1);
     
-    memcpy(&ctx->buffer[index], &input[i], len - i);
+    size_t size = hash_algos[ctx->algo].digest_size;
+    for (size_t i = 0; i < size; i++) {
+        if (ctx->algo == HASH_MD5) {
+            digest[i] = (uint8_t)(ctx->u.md.state.w32[i / 4] >> (8 * (i % 4)));
+        } else if (ctx->algo == HASH_SHA512) {
+            digest[i] = (uint8_t)(ctx->u.md.state.w64[i / 8] >> (56 - 8 * (i % 8)));
+        } else {
+            digest[i] = (uint8_t)(ctx->u.md.state.w32[i / 4] >> (24 - 8 * (i % 4)));
+        }
+    }
+    return size;
+}
+
+void hash_to_hex(const uint8_t *digest, size_t len, char *hex) {
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 15];
+    }
+    hex[2 * len] = '\0';
+}
+
+// XXH64 - fast non-cryptographic hash used for content comparison
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+#define ROTL64(x, n) (((x) << (n)) | ((x) >> (64-(n))))
+
+static uint64_t xxh_read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t xxh_read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = ROTL64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static uint64_t xxh64_merge_round(uint64_t acc, uint64_t val) {
+    acc ^= xxh64_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
 }
 
-void md5_final(uint8_t digest[16], MD5_CTX *ctx) {
-    uint8_t bits[8];
-    size_t index, padLen;
+void xxh64_init(Xxh64Ctx *ctx, uint64_t seed) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    ctx->v[1] = seed + XXH_PRIME64_2;
+    ctx->v[2] = seed;
+    ctx->v[3] = seed - XXH_PRIME64_1;
+    ctx->seed = seed;
+}
+
+void xxh64_update(Xxh64Ctx *ctx, const void *data, size_t len) {
+    const uint8_t *p = data;
+    const uint8_t *end = p + len;
+    
+    ctx->total_len += len;
     
-    for (int i = 0; i < 8; i++)
-        bits[i] = (uint8_t)((ctx->count[i>>2] >> ((i & 3) << 3)) & 0xFF);
+    // Top up a partially filled stripe first
+    if (ctx->buffered + len < 32) {
+        memcpy(ctx->buffer + ctx->buffered, p, len);
+        ctx->buffered += (uint32_t)len;
+        return;
+    }
     
-    index = (size_t)((ctx->count[0] >> 3) & 0x3f);
-    padLen = (index < 56) ? (56 - index) : (120 - index);
+    if (ctx->buffered) {
+        size_t fill = 32 - ctx->buffered;
+        memcpy(ctx->buffer + ctx->buffered, p, fill);
+        for (int i = 0; i < 4; i++)
+            ctx->v[i] = xxh64_round(ctx->v[i], xxh_read64(ctx->buffer + i * 8));
+        p += fill;
+        ctx->buffered = 0;
+    }
     
-    uint8_t padding[64] = {0x80};
-    md5_update(ctx, padding, padLen);
-    md5_update(ctx, bits, 8);
+    uint64_t v1 = ctx->v[0], v2 = ctx->v[1], v3 = ctx->v[2], v4 = ctx->v[3];
+    while (p + 32 <= end) {
+        v1 = xxh64_round(v1, xxh_read64(p));
+        v2 = xxh64_round(v2, xxh_read64(p + 8));
+        v3 = xxh64_round(v3, xxh_read64(p + 16));
+        v4 = xxh64_round(v4, xxh_read64(p + 24));
+        p += 32;
+    }
+    ctx->v[0] = v1; ctx->v[1] = v2; ctx->v[2] = v3; ctx->v[3] = v4;
     
-    for (int i = 0; i < 16; i++)
-        digest[i] = (uint8_t)((ctx->state[i>>2] >> ((i & 3) << 3)) & 0xFF);
+    if (p < end) {
+        memcpy(ctx->buffer, p, (size_t)(end - p));
+        ctx->buffered = (uint32_t)(end - p);
+    }
 }
 
-static void md5_transform(uint32_t state[4], const uint8_t block[64]) {
-    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], x[16];
+uint64_t xxh64_final(const Xxh64Ctx *ctx) {
+    uint64_t h;
     
-    for (int i = 0; i < 16; i++)
-        x[i] = ((uint32_t)block[i*4]) | (((uint32_t)block[i*4+1]) << 8) |
-               (((uint32_t)block[i*4+2]) << 16) | (((uint32_t)block[i*4+3]) << 24);
+    if (ctx->total_len >= 32) {
+        h = ROTL64(ctx->v[0], 1) + ROTL64(ctx->v[1], 7) +
+            ROTL64(ctx->v[2], 12) + ROTL64(ctx->v[3], 18);
+        for (int i = 0; i < 4; i++)
+            h = xxh64_merge_round(h, ctx->v[i]);
+    } else {
+        h = ctx->seed + XXH_PRIME64_5;
+    }
+    h += ctx->total_len;
     
-    // Round 1
-    a = b + ROTATE_LEFT((a + F(b,c,d) + x[0] + 0xd76aa478), 7);
-    d = a + ROTATE_LEFT((d + F(a,b,c) + x[1] + 0xe8c7b756), 12);
-    c = d + ROTATE_LEFT((c + F(d,a,b) + x[2] + 0x242070db), 17);
-    b = c + ROTATE_LEFT((b + F(c,d,a) + x[3] + 0xc1bdceee), 22);
-    // ... (simplified for brevity)
+    const uint8_t *p = ctx->buffer;
+    size_t len = ctx->buffered;
     
-    state[0] += a;
-    state[1] += b;
-    state[2] += c;
-    state[3] += d;
+    while (len >= 8) {
+        h ^= xxh64_round(0, xxh_read64(p));
+        h = ROTL64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        h ^= (uint64_t)xxh_read32(p) * XXH_PRIME64_1;
+        h = ROTL64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+        len -= 4;
+    }
+    while (len > 0) {
+        h ^= (*p) * XXH_PRIME64_5;
+        h = ROTL64(h, 11) * XXH_PRIME64_1;
+        p++;
+        len--;
+    }
+    
+    // Avalanche
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
 }
 
-// Simple SHA256 implementation (simplified)
-void sha256_string(const char *str, char output[65]) {
-    // For a full implementation, we'd use OpenSSL or implement SHA256
-    // This is a placeholder - in production use a proper crypto library
-    sprintf(output, "SHA256 requires crypto library");
+uint64_t xxh64(const void *data, size_t len, uint64_t seed) {
+    Xxh64Ctx ctx;
+    xxh64_init(&ctx, seed);
+    xxh64_update(&ctx, data, len);
+    return xxh64_final(&ctx);
 }
 
-int cmd_hash_file(const char *filename, const char *algorithm) {
-    FILE *fp = fopen(filename, "rb");
-    if (!fp) {
+// Files up to this size are read whole and hashed in multi-buffer batches
+// of at most HASH_BATCH_BYTES and HASH_BATCH_FILES files
+#define HASH_BATCH_FILE_MAX (1 << 20)
+#define HASH_BATCH_BYTES (8 << 20)
+#define HASH_BATCH_FILES 256
+
+static int hash_stream_file(const char *filename, HashAlgo algo, unsigned reader_flags, uint8_t *digest) {
+    Reader *reader = reader_open(filename, reader_flags);
+    if (!reader) {
         fprintf(stderr, "Cannot open file: %s\n", filename);
-        return 1;
+        return -1;
     }
     
-    if (strcmp(algorithm, "md5") == 0) {
-        MD5_CTX ctx;
-        md5_init(&ctx);
-        
-        uint8_t buffer[1024];
-        size_t bytes;
-        
-        while ((bytes = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
-            md5_update(&ctx, buffer, bytes);
+    HashCtx ctx;
+    hash_init(&ctx, algo);
+    
+    const uint8_t *data;
+    long bytes;
+    while ((bytes = reader_next(reader, &data)) > 0) {
+        hash_update(&ctx, data, (size_t)bytes);
+    }
+    reader_close(reader);
+    if (bytes < 0) {
+        fprintf(stderr, "Error reading file: %s\n", filename);
+        return -1;
+    }
+    hash_final(&ctx, digest);
+    return 0;
+}
+
+#ifndef _WIN32
+// One large file hashed with BLAKE3 on several threads. The file is cut
+// into HASH_TREE_SPAN subtrees whose chaining values the workers compute
+// independently, straight from a shared mapping or, for O_DIRECT, with
+// pread into a buffer of their own. The last bytes go through
+// blake3_update so the root is finalized as usual.
+#define HASH_TREE_MIN (32 << 20)
+#define HASH_TREE_SPAN (4 << 20)
+#define HASH_TREE_ALIGN 4096
+
+typedef struct {
+    int fd;
+    const uint8_t *map;         // NULL: workers pread
+    size_t spans;
+    size_t next;                // next span to claim
+    uint8_t *cvs;               // BLAKE3_OUT_LEN per span
+    int failed;
+} HashTree;
+
+// Reads up to len bytes at offset; returns the count, short only at end
+// of file, or -1
+static long hash_tree_read(int fd, uint8_t *buf, size_t len, uint64_t offset) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = pread(fd, buf + got, len - got, (off_t)(offset + got));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        got += (size_t)n;
+    }
+    return (long)got;
+}
+
+static void* hash_tree_worker(void *arg) {
+    HashTree *tree = arg;
+    void *buffer = NULL;
+    if (!tree->map && posix_memalign(&buffer, HASH_TREE_ALIGN, HASH_TREE_SPAN) != 0) {
+        __atomic_store_n(&tree->failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    
+    for (;;) {
+        size_t i = __atomic_fetch_add(&tree->next, 1, __ATOMIC_RELAXED);
+        if (i >= tree->spans || __atomic_load_n(&tree->failed, __ATOMIC_RELAXED)) break;
+        uint64_t offset = (uint64_t)i * HASH_TREE_SPAN;
+        const uint8_t *data = buffer;
+        if (tree->map) {
+            data = tree->map + offset;
+            madvise((void *)data, HASH_TREE_SPAN, MADV_WILLNEED);
+        } else if (hash_tree_read(tree->fd, buffer, HASH_TREE_SPAN, offset) != HASH_TREE_SPAN) {
+            __atomic_store_n(&tree->failed, 1, __ATOMIC_RELAXED);
+            break;
         }
-        
-        uint8_t digest[16];
-        md5_final(digest, &ctx);
-        
-        printf("MD5 (%s) = ", filename);
-        for (int i = 0; i < 16; i++)
-            printf("%02x", digest[i]);
-        printf("\n");
-        
-    } else {
-        fprintf(stderr, "Unsupported algorithm: %s (use: md5)\n", algorithm);
-        fclose(fp);
-        return 1;
+        blake3_subtree_cv(data, HASH_TREE_SPAN, offset / BLAKE3_CHUNK_LEN, tree->cvs + i * BLAKE3_OUT_LEN);
+    }
+    free(buffer);
+    return NULL;
+}
+
+static int hash_tree_file(const char *filename, uint64_t size, const HashOptions *opts, uint8_t *digest) {
+    int fd = -1;
+#ifdef O_DIRECT
+    if (opts->reader_flags & READER_DIRECT) fd = open(filename, O_RDONLY | O_CLOEXEC | O_DIRECT);
+#endif
+    int direct = fd >= 0;
+    if (fd < 0) fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open file: %s\n", filename);
+        return -1;
+    }
+    
+    HashTree tree = { .fd = fd };
+    // At least one byte is left for blake3_update
+    tree.spans = (size_t)((size - 1) / HASH_TREE_SPAN);
+    uint64_t tail_offset = (uint64_t)tree.spans * HASH_TREE_SPAN;
+    size_t tail = (size_t)(size - tail_offset);
+    void *map = MAP_FAILED;
+    if (!direct && !(opts->reader_flags & READER_NO_MMAP)) {
+        map = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (map != MAP_FAILED) tree.map = map;
+    tree.cvs = malloc(tree.spans * BLAKE3_OUT_LEN);
+    void *tail_buf = NULL;
+    int rc = -1;
+    if (!tree.cvs || (!tree.map && posix_memalign(&tail_buf, HASH_TREE_ALIGN, HASH_TREE_SPAN) != 0)) {
+        fprintf(stderr, "Out of memory\n");
+        goto out;
+    }
+    
+    int threads = opts->jobs < 1 ? 1 : opts->jobs;
+    if ((size_t)threads > tree.spans) threads = (int)tree.spans;
+    pthread_t *workers = malloc((size_t)threads * sizeof(pthread_t));
+    int started = 1;
+    for (; workers && started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, hash_tree_worker, &tree) != 0) break;
+    }
+    hash_tree_worker(&tree);
+    for (int i = 1; i < started; i++) pthread_join(workers[i], NULL);
+    free(workers);
+    
+    const uint8_t *tail_data = tree.map ? tree.map + tail_offset : tail_buf;
+    if (tree.failed || (!tree.map && hash_tree_read(fd, tail_buf, HASH_TREE_SPAN, tail_offset) < (long)tail)) {
+        fprintf(stderr, "Error reading file: %s\n", filename);
+        goto out;
     }
     
+    Blake3Ctx ctx;
+    blake3_init(&ctx);
+    for (size_t i = 0; i < tree.spans; i++) {
+        blake3_append_subtree(&ctx, tree.cvs + i * BLAKE3_OUT_LEN, HASH_TREE_SPAN);
+    }
+    blake3_update(&ctx, tail_data, tail);
+    blake3_final(&ctx, digest, BLAKE3_OUT_LEN);
+    rc = 0;
+
+out:
+    if (tree.map) munmap(map, (size_t)size);
+    free(tree.cvs);
+    free(tail_buf);
+    close(fd);
+    return rc;
+}
+#endif
+
+// Reads a whole file of expected size into buf. Returns the bytes read,
+// or -1 on error or if the file has grown since it was sized.
+static long hash_read_whole(const char *filename, uint8_t *buf, size_t size) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) return -1;
+    size_t got = fread(buf, 1, size, fp);
+    int bad = ferror(fp) || (got == size && fgetc(fp) != EOF);
     fclose(fp);
-    return 0;
+    return bad ? -1 : (long)got;
+}
+
+// A piece of work for one thread: a run of small files hashed as a
+// multi-buffer batch, or a single file to stream
+typedef struct {
+    size_t first;               // into HashPool.order
+    size_t count;
+    int batch;
+} HashUnit;
+
+typedef struct {
+    HashItem *items;
+    HashAlgo algo;
+    unsigned reader_flags;
+    const size_t *order;        // item indices, batched ones by size
+    const HashUnit *units;
+    size_t unit_count;
+    size_t next;                // next unit to claim
+} HashPool;
+
+static void hash_stream_item(HashPool *pool, HashItem *item) {
+    item->ok = hash_stream_file(item->path, pool->algo, pool->reader_flags, item->digest) == 0;
+}
+
+static void hash_batch(HashPool *pool, const HashUnit *unit, uint8_t *buffer) {
+    MbHashJob jobs[HASH_BATCH_FILES];
+    HashItem *job_item[HASH_BATCH_FILES];
+    size_t used = 0, job_count = 0;
+    
+    for (size_t f = unit->first; f < unit->first + unit->count; f++) {
+        HashItem *item = &pool->items[pool->order[f]];
+        long got = hash_read_whole(item->path, buffer + used, (size_t)item->size);
+        if (got < 0) {
+            // Changed under us or unreadable: the streaming path reports it
+            hash_stream_item(pool, item);
+            continue;
+        }
+        jobs[job_count].data = buffer + used;
+        jobs[job_count].len = (size_t)got;
+        job_item[job_count++] = item;
+        used += (size_t)got;
+    }
+    
+    mb_hash(pool->algo, jobs, job_count);
+    for (size_t j = 0; j < job_count; j++) {
+        memcpy(job_item[j]->digest, jobs[j].digest, hash_digest_size(pool->algo));
+        job_item[j]->ok = 1;
+    }
+}
+
+static void* hash_pool_worker(void *arg) {
+    HashPool *pool = arg;
+    uint8_t *buffer = NULL;
+    for (;;) {
+        size_t u = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        if (u >= pool->unit_count) break;
+        const HashUnit *unit = &pool->units[u];
+        if (unit->batch && !buffer) buffer = malloc(HASH_BATCH_BYTES);
+        if (unit->batch && buffer) {
+            hash_batch(pool, unit, buffer);
+        } else {
+            for (size_t f = unit->first; f < unit->first + unit->count; f++) {
+                hash_stream_item(pool, &pool->items[pool->order[f]]);
+            }
+        }
+    }
+    free(buffer);
+    return NULL;
+}
+
+typedef struct {
+    size_t index;
+    int64_t size;
+} HashOrder;
+
+static int compare_size_asc(const void *a, const void *b) {
+    const HashOrder *oa = a, *ob = b;
+    if (oa->size != ob->size) return oa->size < ob->size ? -1 : 1;
+    return oa->index < ob->index ? -1 : oa->index > ob->index;
+}
+
+static int compare_size_desc(const void *a, const void *b) {
+    return compare_size_asc(b, a);
+}
+
+// Small regular files are sorted by size and cut into batches, so each
+// batch holds files of similar length and the multi-buffer lanes finish
+// close together. Other files are streamed, largest first so the long
+// ones do not end up last on a single thread.
+void hash_files(HashItem *items, size_t count, HashAlgo algo, const HashOptions *opts) {
+    int threads = opts->jobs < 1 ? 1 : opts->jobs;
+    int lanes = mb_hash_lanes(algo);
+    // Batches are read through the page cache, so O_DIRECT streams everything
+    int batchable = count > 1 && lanes > 1 && !(opts->reader_flags & READER_DIRECT);
+    HashOrder *small = malloc((count + 1) * sizeof(HashOrder));
+    HashOrder *large = malloc((count + 1) * sizeof(HashOrder));
+    size_t *order = malloc((count + 1) * sizeof(size_t));
+    HashUnit *units = malloc((count + 1) * sizeof(HashUnit));
+    size_t small_count = 0, large_count = 0;
+    
+    if (!small || !large || !order || !units) {
+        fprintf(stderr, "Out of memory\n");
+        goto out;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        HashItem *item = &items[i];
+        item->ok = 0;
+        if (item->size < 0) {
+            struct stat st;
+            if (stat(item->path, &st) == 0 && S_ISREG(st.st_mode)) item->size = (int64_t)st.st_size;
+        }
+        if (batchable && item->size >= 0 && item->size <= HASH_BATCH_FILE_MAX) {
+            small[small_count].index = i;
+            small[small_count++].size = item->size;
+#ifndef _WIN32
+        } else if (algo == HASH_BLAKE3 && threads > 1 && item->size >= HASH_TREE_MIN) {
+            // Hashed below, one at a time with every thread
+            continue;
+#endif
+        } else {
+            large[large_count].index = i;
+            large[large_count++].size = item->size;
+        }
+    }
+    qsort(small, small_count, sizeof(HashOrder), compare_size_asc);
+    qsort(large, large_count, sizeof(HashOrder), compare_size_desc);
+    
+    // Enough batches to go round the threads, each still filling the lanes
+    size_t per_batch = (small_count + (size_t)threads - 1) / (size_t)threads;
+    if (per_batch < (size_t)lanes) per_batch = (size_t)lanes;
+    if (per_batch > HASH_BATCH_FILES) per_batch = HASH_BATCH_FILES;
+    
+    HashPool pool = { .items = items, .algo = algo, .reader_flags = opts->reader_flags, .order = order, .units = units };
+    size_t placed = 0;
+    for (size_t f = 0; f < small_count;) {
+        HashUnit *unit = &units[pool.unit_count++];
+        size_t used = 0;
+        unit->first = placed;
+        unit->count = 0;
+        unit->batch = 1;
+        while (f < small_count && unit->count < per_batch && used + (size_t)small[f].size <= HASH_BATCH_BYTES) {
+            used += (size_t)small[f].size;
+            order[placed++] = small[f++].index;
+            unit->count++;
+        }
+    }
+    for (size_t f = 0; f < large_count; f++) {
+        HashUnit *unit = &units[pool.unit_count++];
+        unit->first = placed;
+        unit->count = 1;
+        unit->batch = 0;
+        order[placed++] = large[f].index;
+    }
+    
+#ifndef _WIN32
+    if ((size_t)threads > pool.unit_count) threads = pool.unit_count ? (int)pool.unit_count : 1;
+    pthread_t *workers = malloc((size_t)threads * sizeof(pthread_t));
+    int started = 1;
+    for (; workers && started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, hash_pool_worker, &pool) != 0) break;
+    }
+    hash_pool_worker(&pool);
+    for (int i = 1; i < started; i++) pthread_join(workers[i], NULL);
+    free(workers);
+    
+    if (algo == HASH_BLAKE3 && opts->jobs > 1) {
+        for (size_t i = 0; i < count; i++) {
+            if (items[i].size >= HASH_TREE_MIN) {
+                items[i].ok = hash_tree_file(items[i].path, (uint64_t)items[i].size, opts, items[i].digest) == 0;
+            }
+        }
+    }
+#else
+    hash_pool_worker(&pool);
+#endif
+
+out:
+    free(small);
+    free(large);
+    free(order);
+    free(units);
+}
+
+int cmd_hash_files(const char *const files[], int count, const char *algorithm, const HashOptions *opts) {
+    HashAlgo algo;
+    if (hash_algo_parse(algorithm, &algo) != 0) {
+        fprintf(stderr, "Unsupported algorithm: %s (use: %s)\n", algorithm, hash_algo_names());
+        return 1;
+    }
+    
+    HashItem *items = calloc((size_t)count, sizeof(HashItem));
+    if (!items) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        items[i].path = files[i];
+        items[i].size = -1;
+    }
+    hash_files(items, (size_t)count, algo, opts);
+    
+    // Digests print in argument order
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        if (!items[i].ok) {
+            failed = 1;
+            continue;
+        }
+        char hex[2 * HASH_MAX_DIGEST + 1];
+        hash_to_hex(items[i].digest, hash_digest_size(algo), hex);
+        printf("%s (%s) = %s\n", hash_algos[algo].label, files[i], hex);
+    }
+    free(items);
+    return failed;
 }
 
 int cmd_hash_text(const char *text, const char *algorithm) {
-    if (strcmp(algorithm, "md5") == 0) {
-        MD5_CTX ctx;
-        md5_init(&ctx);
-        md5_update(&ctx, (const uint8_t*)text, strlen(text));
-        
-        uint8_t digest[16];
-        md5_final(digest, &ctx);
-        
-        printf("MD5 (\"%s\") = ", text);
-        for (int i = 0; i < 16; i++)
-            printf("%02x", digest[i]);
-        printf("\n");
-        
-        return 0;
+    HashAlgo algo;
+    if (hash_algo_parse(algorithm, &algo) != 0) {
+        fprintf(stderr, "Unsupported algorithm: %s (use: %s)\n", algorithm, hash_algo_names());
+        return 1;
     }
     
-    fprintf(stderr, "Unsupported algorithm: %s (use: md5)\n", algorithm);
-    return 1;
+    HashCtx ctx;
+    hash_init(&ctx, algo);
+    hash_update(&ctx, text, strlen(text));
+    
+    uint8_t digest[HASH_MAX_DIGEST];
+    char hex[2 * HASH_MAX_DIGEST + 1];
+    hash_to_hex(digest, hash_final(&ctx, digest), hex);
+    printf("%s (\"%s\") = %s\n", hash_algos[algo].label, text, hex);
+    return 0;
 }
@@ -1,7 +1,106 @@
 #ifndef HASH_H
 #define HASH_H
 
-int cmd_hash_file(const char *filename, const char *algorithm);
+#include <stddef.h>
+#include <stdint.h>
+#include "xxh3.h"
+#include "blake3.h"
+#include "crc.h"
+
+// Streaming XXH64 state (non-cryptographic, used for content comparison)
+typedef struct {
+    uint64_t v[4];
+    uint64_t seed;
+    uint64_t total_len;
+    uint8_t buffer[32];
+    uint32_t buffered;
+} Xxh64Ctx;
+
+void xxh64_init(Xxh64Ctx *ctx, uint64_t seed);
+void xxh64_update(Xxh64Ctx *ctx, const void *data, size_t len);
+uint64_t xxh64_final(const Xxh64Ctx *ctx);
+uint64_t xxh64(const void *data, size_t len, uint64_t seed);
+
+// Streaming digests. All algorithms share one context type so callers can
+// pick one at run time; the SHA family uses the hardware kernels in sha.h,
+// XXH3 and BLAKE3 the SIMD ones in xxh3.h and blake3.h, the CRCs crc.h.
+typedef enum {
+    HASH_MD5,
+    HASH_SHA1,
+    HASH_SHA256,
+    HASH_SHA512,
+    HASH_XXH3_64,
+    HASH_XXH3_128,
+    HASH_BLAKE3,
+    HASH_CRC32C,
+    HASH_CRC64,
+    HASH_ALGO_COUNT
+} HashAlgo;
+
+#define HASH_MAX_DIGEST 64
+
+typedef struct {
+    HashAlgo algo;
+    union {
+        // MD5 and the SHA family
+        struct {
+            uint64_t total;     // bytes hashed so far
+            union {
+                uint32_t w32[8];
+                uint64_t w64[8];
+            } state;
+            uint8_t buffer[128];    // partial block
+        } md;
+        Xxh3Ctx xxh3;
+        Blake3Ctx blake3;
+        uint64_t crc;           // CRC32C and CRC64 of the input so far
+    } u;
+} HashCtx;
+
+// Look up an algorithm by its name ("md5", "sha1", "sha256", "sha512",
+// "xxh3", "xxh128", "blake3", "crc32c", "crc64") or its label ("SHA256").
+// Returns 0, or -1 if the name is unknown.
+int hash_algo_parse(const char *name, HashAlgo *algo);
+const char* hash_algo_name(HashAlgo algo);
+// As printed in "LABEL (file) = digest"
+const char* hash_algo_label(HashAlgo algo);
+// Comma-separated list of all names, for usage messages
+const char* hash_algo_names(void);
+size_t hash_digest_size(HashAlgo algo);
+// Kernel used on this CPU ("sha-ni", "armv8", "avx512", "avx2", "sse2",
+// "sse4.2", "pclmul", "table" or "scalar")
+const char* hash_algo_impl(HashAlgo algo);
+
+// MD5 compression function: runs count 64-byte blocks through state
+void md5_blocks(uint32_t state[4], const uint8_t *block, size_t count);
+
+void hash_init(HashCtx *ctx, HashAlgo algo);
+void hash_update(HashCtx *ctx, const void *data, size_t len);
+// Writes hash_digest_size() bytes to digest and returns that size. XXH3
+// digests and CRCs are written big-endian, as xxhsum and crc tools print them.
+size_t hash_final(HashCtx *ctx, uint8_t *digest);
+// Lower-case hex of a digest; hex needs room for 2 * len + 1 characters
+void hash_to_hex(const uint8_t *digest, size_t len, char *hex);
+
+typedef struct {
+    unsigned reader_flags;      // READER_* from reader.h, for files read in a stream
+    int jobs;                   // threads hashing files side by side, or one large BLAKE3 file
+} HashOptions;
+
+typedef struct {
+    const char *path;
+    int64_t size;               // -1 if unknown; hash_files stats the file
+    int ok;                     // set once digest holds the file's hash
+    uint8_t digest[HASH_MAX_DIGEST];
+} HashItem;
+
+// Hashes every item on opts->jobs threads. Many small files go through the
+// multi-buffer engine; a large file hashed with BLAKE3 is split into
+// subtrees over all the threads. Errors are reported on stderr.
+void hash_files(HashItem *items, size_t count, HashAlgo algo, const HashOptions *opts);
+
+// Hashes each file and prints the digests in argument order
+int cmd_hash_files(const char *const files[], int count, const char *algorithm, const HashOptions *opts);
 int cmd_hash_text(const char *text, const char *algorithm);
 
 #endif
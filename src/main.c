@@ -13,12 +13,19 @@
 #include "clipboard.h"
 #include "utils.h"
 #include "hash.h"
+#include "manifest.h"
+#include "treehash.h"
+#include "reader.h"
 #include "encoding.h"
 #include "timer.h"
 #include "converters.h"
 #include "text.h"
 #include "git.h"
 #include "network_ext.h"
+#include "walker.h"
+#include "bench.h"
+#include "watch.h"
+#include "snapshot.h"
 
 static volatile int running = 1;
 
@@ -27,6 +34,108 @@ void signal_handler(int signum) {
     running = 0;
 }
 
+// Remove a command-specific "name VALUE" pair from argv[first..] so it can be
+// handled before parse_walk_options. Returns VALUE, or NULL if absent.
+static const char* take_option(int *argc, char *argv[], int first, const char *name) {
+    for (int i = first; i + 1 < *argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            const char *value = argv[i + 1];
+            memmove(&argv[i], &argv[i + 2], (size_t)(*argc - i - 2) * sizeof(char *));
+            *argc -= 2;
+            return value;
+        }
+    }
+    return NULL;
+}
+
+// Remove a command-specific boolean flag from argv[first..]. Returns 1 if
+// it was present.
+static int take_flag(int *argc, char *argv[], int first, const char *name) {
+    for (int i = first; i < *argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            memmove(&argv[i], &argv[i + 1], (size_t)(*argc - i - 1) * sizeof(char *));
+            (*argc)--;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Split scan options (-j N, --backend, --queue-depth, --progress,
+// --metrics FILE and the filters in filter.h) out of argv[first..],
+// returning the remaining positional arguments in order. Returns the
+// positional count, or -1 on a malformed option. opts->stats is set when
+// metrics were requested and must be released with scan_stats_free().
+static int parse_walk_options(int argc, char *argv[], int first, WalkOptions *opts,
+                              char **positional, int max_positional) {
+    // Lives for the rest of the process, like the command it configures
+    static WalkFilter filter;
+    const char *metrics = NULL;
+    int progress = 0;
+    int count = 0;
+    memset(opts, 0, sizeof(*opts));
+    walk_filter_init(&filter);
+    opts->filter = &filter;
+
+    for (int i = first; i < argc; i++) {
+        int consumed = walk_filter_option(&filter, argc, argv, &i);
+        if (consumed < 0) return -1;
+        if (consumed) continue;
+        
+        if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) {
+            if (i + 1 >= argc || atoi(argv[i + 1]) <= 0) {
+                fprintf(stderr, "%s requires a positive thread count\n", argv[i]);
+                return -1;
+            }
+            opts->jobs = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "-j", 2) == 0 && atoi(argv[i] + 2) > 0) {
+            opts->jobs = atoi(argv[i] + 2);
+        } else if (strcmp(argv[i], "--backend") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "--backend requires sync or uring\n");
+                return -1;
+            }
+            i++;
+            if (strcmp(argv[i], "sync") == 0) {
+                opts->backend = WALK_BACKEND_SYNC;
+            } else if (strcmp(argv[i], "uring") == 0 || strcmp(argv[i], "io_uring") == 0) {
+                opts->backend = WALK_BACKEND_URING;
+            } else {
+                fprintf(stderr, "Unknown scan backend: %s (use: sync, uring)\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--queue-depth") == 0) {
+            if (i + 1 >= argc || atoi(argv[i + 1]) <= 0) {
+                fprintf(stderr, "--queue-depth requires a positive number\n");
+                return -1;
+            }
+            opts->queue_depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--progress") == 0) {
+            progress = 1;
+        } else if (strcmp(argv[i], "--metrics") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "--metrics requires a file name\n");
+                return -1;
+            }
+            metrics = argv[++i];
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Unknown or incomplete option: %s\n", argv[i]);
+            return -1;
+        } else if (count < max_positional) {
+            positional[count++] = argv[i];
+        } else {
+            fprintf(stderr, "Unexpected argument: %s\n", argv[i]);
+            return -1;
+        }
+    }
+    
+    if (progress || metrics) {
+        opts->stats = scan_stats_new(progress, metrics);
+        if (!opts->stats) return -1;
+    }
+    return count;
+}
+
 void print_usage(const char *progname) {
     printf("Caffeinated - Cross-Platform CLI Power Tools\n\n");
     printf("Usage: %s [command] [options]\n\n", progname);
@@ -47,10 +156,38 @@ void print_usage(const char *progname) {
     printf("\n");
     
     printf("File Operations:\n");
-    printf("  diskusage [path]     Show disk usage\n");
-    printf("  finddup <path>       Find duplicate files\n");
-    printf("  findlarge <path> <mb> Find files larger than size\n");
-    printf("  hash <file> [algo]   Calculate file hash (md5)\n");
+    printf("  diskusage [path]     Show disk usage (--apparent/--allocated also\n");
+    printf("                       total the tree, hard links counted once)\n");
+    printf("                       --tree: heaviest subdirectories (--depth D,\n");
+    printf("                        --top N, --stream); --watch keeps it live\n");
+    printf("  finddup <path>       Find duplicate files (--index <file> reuses hashes,\n");
+    printf("                       --verify compares bytes, --dedupe [--dry-run]\n");
+    printf("                       shares extents or hard-links the copies)\n");
+    printf("                       Scans accept -j N threads, --backend sync|uring,\n");
+    printf("                       --queue-depth N and filters: --exclude/--include\n");
+    printf("                       GLOB, --exclude-regex/--include-regex RE, --xdev,\n");
+    printf("                       --max-depth N, --min-size/--max-size SIZE,\n");
+    printf("                       --min-age/--max-age AGE; --progress and\n");
+    printf("                       --metrics FILE report live scan metrics\n");
+    printf("  dedupestimate <path> Estimate block-level dedup savings (content-\n");
+    printf("                       defined chunks, unique vs. total bytes)\n");
+    printf("  findlarge <path> <mb> Find files larger than size (--top K, --stream,\n");
+    printf("                       --watch)\n");
+    printf("                       diskusage/findlarge --snapshot FILE save every\n");
+    printf("                       file's size and mtime for snapdiff\n");
+    printf("  snapdiff <old> <new> Compare two snapshots: growth hotspots, new and\n");
+    printf("                       deleted files (--depth D, --top N)\n");
+    printf("  index rebuild <path> <file>  Rebuild a finddup scan index from scratch\n");
+    printf("  hash <file>... [--algo A]  Calculate file hashes (md5, sha1, sha256,\n");
+    printf("                       sha512, xxh3, xxh128, blake3, crc32c, crc64;\n");
+    printf("                       --text <text> hashes a string, --direct reads\n");
+    printf("                       around the page cache, -j N threads)\n");
+    printf("  hash --recursive <dir>  Checksum manifest of a tree (SHA-256 unless\n");
+    printf("                       --algo says otherwise, sha256sum -c compatible);\n");
+    printf("                       hash --check <manifest> verifies it, --quick\n");
+    printf("                       skips files with unchanged size/mtime\n");
+    printf("  treehash <dir>       Merkle (BLAKE3) hash of a directory tree; --cache\n");
+    printf("                       FILE keeps digests so reruns read only changes\n");
     printf("\n");
     
     printf("Display & Utilities:\n");
@@ -61,8 +198,8 @@ void print_usage(const char *progname) {
     printf("\n");
     
     printf("Encoding:\n");
-    printf("  base64 encode <text> Encode text to base64\n");
-    printf("  base64 decode <text> Decode base64 to text\n");
+    printf("  base64 encode <text> Encode text to base64 (--file <file> encodes a file)\n");
+    printf("  base64 decode <text> Decode base64 to text (--file <file> decodes a file)\n");
     printf("  uuid [count]         Generate UUIDs\n");
     printf("\n");
     
@@ -84,6 +221,9 @@ void print_usage(const char *progname) {
     
     printf("Developer Tools:\n");
     printf("  gitstats [path]      Git repository statistics\n");
+    printf("  bench scan [files]   Compare scan backends on a synthetic tree\n");
+    printf("  bench <hash|base64>  Kernel throughput from 64 B to 1 GB (--max SIZE,\n");
+    printf("                       --algo A,B, --json for one JSON object per line)\n");
     printf("\n");
     
     printf("Other:\n");
@@ -172,25 +312,137 @@ int main(int argc, char *argv[]) {
     }
 
     if (strcmp(argv[1], "diskusage") == 0) {
-        const char *path = argc > 2 ? argv[2] : ".";
-        return cmd_diskusage(path);
+        WalkOptions opts;
+        char *args[1];
+        int allocated = take_flag(&argc, argv, 2, "--allocated");
+        int apparent = take_flag(&argc, argv, 2, "--apparent");
+        int tree = take_flag(&argc, argv, 2, "--tree");
+        int watch = take_flag(&argc, argv, 2, "--watch");
+        int stream = take_flag(&argc, argv, 2, "--stream");
+        const char *depth = take_option(&argc, argv, 2, "--depth");
+        const char *top = take_option(&argc, argv, 2, "--top");
+        const char *snapshot = take_option(&argc, argv, 2, "--snapshot");
+        int n = parse_walk_options(argc, argv, 2, &opts, args, 1);
+        if (n < 0 || (allocated && apparent) || (!tree && !watch && (stream || depth || top)) ||
+            (watch && (tree || stream || snapshot)) || (depth && atoi(depth) <= 0) || (top && atoi(top) <= 0)) {
+            fprintf(stderr, "Usage: %s diskusage [path] [--apparent | --allocated] [--snapshot FILE] [-j N]\n", argv[0]);
+            fprintf(stderr, "       %s diskusage <path> --tree [--depth D] [--top N] [--stream] [--snapshot FILE]\n", argv[0]);
+            fprintf(stderr, "       %s diskusage <path> --watch [--depth D] [--top N]\n", argv[0]);
+            return 1;
+        }
+        const char *root = n > 0 ? args[0] : ".";
+        if (snapshot && !(opts.snapshot = snapshot_new(root, walk_jobs(&opts), allocated))) {
+            fprintf(stderr, "Memory allocation failed\n");
+            scan_stats_free(opts.stats);
+            return 1;
+        }
+        int rc;
+        if (watch) {
+            signal(SIGINT, signal_handler);
+            signal(SIGTERM, signal_handler);
+            rc = cmd_diskusage_watch(root, &opts,
+                                     allocated ? SIZE_ALLOCATED : SIZE_APPARENT,
+                                     depth ? atoi(depth) : 1, top ? atoi(top) : 20, &running);
+        } else if (tree) {
+            rc = cmd_diskusage_tree(root, &opts,
+                                    allocated ? SIZE_ALLOCATED : SIZE_APPARENT,
+                                    depth ? atoi(depth) : 1, top ? atoi(top) : 20, stream);
+        } else {
+            // A snapshot needs the contents, so it implies a scan
+            rc = cmd_diskusage(root, &opts, allocated || apparent || snapshot,
+                               allocated ? SIZE_ALLOCATED : SIZE_APPARENT);
+        }
+        if (rc == 0 && snapshot && snapshot_write(opts.snapshot, snapshot) != 0) rc = 1;
+        snapshot_free(opts.snapshot);
+        scan_stats_free(opts.stats);
+        return rc;
     }
 
     if (strcmp(argv[1], "finddup") == 0) {
-        if (argc < 3) {
-            fprintf(stderr, "Usage: %s finddup <path>\n", argv[0]);
+        WalkOptions opts;
+        char *args[1];
+        const char *index_path = take_option(&argc, argv, 2, "--index");
+        unsigned flags = 0;
+        if (take_flag(&argc, argv, 2, "--verify")) flags |= FINDDUP_VERIFY;
+        if (take_flag(&argc, argv, 2, "--dedupe")) flags |= FINDDUP_DEDUPE;
+        if (take_flag(&argc, argv, 2, "--dry-run")) flags |= FINDDUP_DRY_RUN;
+        if (parse_walk_options(argc, argv, 2, &opts, args, 1) != 1 ||
+            ((flags & FINDDUP_DRY_RUN) && !(flags & FINDDUP_DEDUPE))) {
+            fprintf(stderr, "Usage: %s finddup [-j N] [--index <file>] [--verify] [--dedupe [--dry-run]] <path>\n", argv[0]);
+            return 1;
+        }
+        int rc = cmd_finddup(args[0], &opts, index_path, flags);
+        scan_stats_free(opts.stats);
+        return rc;
+    }
+    
+    if (strcmp(argv[1], "dedupestimate") == 0) {
+        WalkOptions opts;
+        char *args[1];
+        if (parse_walk_options(argc, argv, 2, &opts, args, 1) != 1) {
+            fprintf(stderr, "Usage: %s dedupestimate [-j N] <path>\n", argv[0]);
+            return 1;
+        }
+        int rc = cmd_dedupestimate(args[0], &opts);
+        scan_stats_free(opts.stats);
+        return rc;
+    }
+    
+    if (strcmp(argv[1], "index") == 0) {
+        WalkOptions opts;
+        char *args[3];
+        const char *index_path = take_option(&argc, argv, 2, "--index");
+        int n = parse_walk_options(argc, argv, 2, &opts, args, 3);
+        if (n == 3 && !index_path) index_path = args[2];
+        if (n < 2 || strcmp(args[0], "rebuild") != 0 || !index_path || (n == 3 && index_path != args[2])) {
+            fprintf(stderr, "Usage: %s index rebuild <path> <index_file> [-j N]\n", argv[0]);
             return 1;
         }
-        return cmd_finddup(argv[2]);
+        int rc = cmd_index_rebuild(args[1], &opts, index_path);
+        scan_stats_free(opts.stats);
+        return rc;
     }
 
     if (strcmp(argv[1], "findlarge") == 0) {
-        if (argc < 4) {
-            fprintf(stderr, "Usage: %s findlarge <path> <size_in_mb>\n", argv[0]);
+        WalkOptions opts;
+        char *args[2];
+        const char *top = take_option(&argc, argv, 2, "--top");
+        int stream = take_flag(&argc, argv, 2, "--stream");
+        int watch = take_flag(&argc, argv, 2, "--watch");
+        const char *snapshot = take_option(&argc, argv, 2, "--snapshot");
+        if (parse_walk_options(argc, argv, 2, &opts, args, 2) != 2 || (top && atoi(top) <= 0) ||
+            (watch && (stream || snapshot))) {
+            fprintf(stderr, "Usage: %s findlarge [-j N] [--top K | --stream | --watch] [--snapshot FILE] <path> <size_in_mb>\n", argv[0]);
             fprintf(stderr, "Example: %s findlarge /home 100\n", argv[0]);
             return 1;
         }
-        return cmd_findlarge(argv[2], atoll(argv[3]));
+        if (snapshot && !(opts.snapshot = snapshot_new(args[0], walk_jobs(&opts), 0))) {
+            fprintf(stderr, "Memory allocation failed\n");
+            scan_stats_free(opts.stats);
+            return 1;
+        }
+        int rc;
+        if (watch) {
+            signal(SIGINT, signal_handler);
+            signal(SIGTERM, signal_handler);
+            rc = cmd_findlarge_watch(args[0], atoll(args[1]), &opts, top ? atoi(top) : 0, &running);
+        } else {
+            rc = cmd_findlarge(args[0], atoll(args[1]), &opts, top ? atoi(top) : 0, stream);
+        }
+        if (rc == 0 && snapshot && snapshot_write(opts.snapshot, snapshot) != 0) rc = 1;
+        snapshot_free(opts.snapshot);
+        scan_stats_free(opts.stats);
+        return rc;
+    }
+    
+    if (strcmp(argv[1], "snapdiff") == 0) {
+        const char *depth = take_option(&argc, argv, 2, "--depth");
+        const char *top = take_option(&argc, argv, 2, "--top");
+        if (argc != 4 || (depth && atoi(depth) <= 0) || (top && atoi(top) <= 0)) {
+            fprintf(stderr, "Usage: %s snapdiff <old_snapshot> <new_snapshot> [--depth D] [--top N]\n", argv[0]);
+            return 1;
+        }
+        return cmd_snapdiff(argv[2], argv[3], depth ? atoi(depth) : 2, top ? atoi(top) : 10);
     }
 
     if (strcmp(argv[1], "flux") == 0) {
@@ -270,23 +522,81 @@ int main(int argc, char *argv[]) {
 
     // New commands
     if (strcmp(argv[1], "hash") == 0) {
-        if (argc < 3) {
-            fprintf(stderr, "Usage: %s hash <file> [algorithm]\n", argv[0]);
+        const char *algo = take_option(&argc, argv, 2, "--algo");
+        const char *text = take_option(&argc, argv, 2, "--text");
+        const char *check = take_option(&argc, argv, 2, "--check");
+        int direct = take_flag(&argc, argv, 2, "--direct");
+        int recursive = take_flag(&argc, argv, 2, "--recursive");
+        int quick = take_flag(&argc, argv, 2, "--quick");
+        WalkOptions walk = {0};
+        char *args[1];
+        int n = 0;
+        if (recursive) {
+            n = parse_walk_options(argc, argv, 2, &walk, args, 1);
+        } else {
+            const char *jobs = take_option(&argc, argv, 2, "-j");
+            walk.jobs = jobs ? atoi(jobs) : 0;
+        }
+        int bad = text ? (argc != 2 || recursive || check) :
+                  check ? (argc != 2 || recursive) :
+                  recursive ? n != 1 : argc < 3;
+        if (bad || (quick && !check)) {
+            fprintf(stderr, "Usage: %s hash [--algo A] [--direct] [-j N] <file>... | --text <text> (A: %s)\n",
+                    argv[0], hash_algo_names());
+            fprintf(stderr, "       %s hash --recursive <dir> [--algo A] [-j N] [scan options] > MANIFEST\n", argv[0]);
+            fprintf(stderr, "       %s hash --check MANIFEST [--quick] [--algo A] [-j N]\n", argv[0]);
+            scan_stats_free(walk.stats);
             return 1;
         }
-        const char *algo = argc > 3 ? argv[3] : "md5";
-        return cmd_hash_file(argv[2], algo);
+        HashAlgo legacy;
+        if (!algo && !text && !check && !recursive && argc == 4 && hash_algo_parse(argv[3], &legacy) == 0) {
+            // Old form: hash <file> <algorithm>
+            algo = argv[3];
+            argc = 3;
+        }
+        if (check) {
+            HashOptions opts = { .reader_flags = direct ? READER_DIRECT : 0, .jobs = walk_jobs(&walk) };
+            return cmd_hash_check(check, algo, quick, &opts);
+        }
+        // Manifests default to SHA-256 so that sha256sum -c reads them
+        if (!algo) algo = recursive ? "sha256" : "md5";
+        if (text) return cmd_hash_text(text, algo);
+        
+        HashOptions opts = { .reader_flags = direct ? READER_DIRECT : 0, .jobs = walk_jobs(&walk) };
+        if (recursive) {
+            int rc = cmd_hash_manifest(args[0], algo, &walk, &opts);
+            scan_stats_free(walk.stats);
+            return rc;
+        }
+        return cmd_hash_files((const char *const *)argv + 2, argc - 2, algo, &opts);
     }
 
+    if (strcmp(argv[1], "treehash") == 0) {
+        WalkOptions opts;
+        char *args[1];
+        const char *cache = take_option(&argc, argv, 2, "--cache");
+        int direct = take_flag(&argc, argv, 2, "--direct");
+        if (parse_walk_options(argc, argv, 2, &opts, args, 1) != 1) {
+            fprintf(stderr, "Usage: %s treehash <dir> [--cache FILE] [--direct] [-j N] [scan options]\n", argv[0]);
+            scan_stats_free(opts.stats);
+            return 1;
+        }
+        HashOptions hash_opts = { .reader_flags = direct ? READER_DIRECT : 0, .jobs = walk_jobs(&opts) };
+        int rc = cmd_treehash(args[0], &opts, &hash_opts, cache);
+        scan_stats_free(opts.stats);
+        return rc;
+    }
+    
     if (strcmp(argv[1], "base64") == 0) {
+        int file = take_flag(&argc, argv, 2, "--file");
         if (argc < 4) {
-            fprintf(stderr, "Usage: %s base64 <encode|decode> <text>\n", argv[0]);
+            fprintf(stderr, "Usage: %s base64 <encode|decode> <text> | --file <file>\n", argv[0]);
             return 1;
         }
         if (strcmp(argv[2], "encode") == 0) {
-            return cmd_base64_encode(argv[3], 0);
+            return cmd_base64_encode(argv[3], file);
         } else if (strcmp(argv[2], "decode") == 0) {
-            return cmd_base64_decode(argv[3], 0);
+            return cmd_base64_decode(argv[3], file);
         }
         return 1;
     }
@@ -349,6 +659,30 @@ int main(int argc, char *argv[]) {
         return cmd_git_stats(path);
     }
 
+    if (strcmp(argv[1], "bench") == 0) {
+        if (argc > 2 && strcmp(argv[2], "scan") != 0) {
+            const char *algos = take_option(&argc, argv, 3, "--algo");
+            const char *max = take_option(&argc, argv, 3, "--max");
+            int json = take_flag(&argc, argv, 3, "--json");
+            unsigned long long max_size = 1ULL << 30;
+            if (argc != 3 || (max && walk_parse_size(max, &max_size) != 0)) {
+                fprintf(stderr, "Usage: %s bench <hash|base64|all> [--algo A,B] [--max SIZE] [--json]\n", argv[0]);
+                return 1;
+            }
+            return cmd_bench_kernels(argv[2], algos, max_size, json);
+        }
+        
+        WalkOptions opts;
+        char *args[2];
+        int n = parse_walk_options(argc, argv, 2, &opts, args, 2);
+        if (n < 1 || strcmp(args[0], "scan") != 0) {
+            fprintf(stderr, "Usage: %s bench scan [files] [-j N] [--queue-depth N]\n", argv[0]);
+            fprintf(stderr, "       %s bench <hash|base64|all> [--algo A,B] [--max SIZE] [--json]\n", argv[0]);
+            return 1;
+        }
+        return cmd_bench_scan(n > 1 ? atoi(args[1]) : 0, &opts);
+    }
+    
     if (strcmp(argv[1], "netstat") == 0) {
         return cmd_netstat();
     }
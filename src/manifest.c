@@ -0,0 +1,441 @@
+#include "manifest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "arena.h"
+
+typedef struct {
+    const char *path;
+    int64_t size;
+    int64_t mtime_ns;
+} ManifestFile;
+
+typedef struct {
+    Arena arena;
+    ManifestFile *items;
+    size_t count;
+    size_t capacity;
+    int failed;
+} ManifestWorker;
+
+static int64_t manifest_mtime(const struct stat *st) {
+#ifdef __linux__
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#else
+    return (int64_t)st->st_mtime * 1000000000;
+#endif
+}
+
+static void manifest_visit(const WalkEntry *entry, void *ctx) {
+    ManifestWorker *w = &((ManifestWorker *)ctx)[entry->worker];
+    if (entry->type != WALK_FILE) return;
+    if (w->count == w->capacity) {
+        size_t new_cap = w->capacity ? w->capacity * 2 : 1024;
+        ManifestFile *items = realloc(w->items, new_cap * sizeof(ManifestFile));
+        if (!items) {
+            w->failed = 1;
+            return;
+        }
+        w->items = items;
+        w->capacity = new_cap;
+    }
+    
+    ManifestFile *file = &w->items[w->count];
+    file->path = arena_strndup(&w->arena, entry->path, strlen(entry->path));
+    if (!file->path) {
+        w->failed = 1;
+        return;
+    }
+    file->size = (int64_t)entry->st->st_size;
+    file->mtime_ns = manifest_mtime(entry->st);
+    w->count++;
+}
+
+static int compare_manifest_files(const void *a, const void *b) {
+    return strcmp(((const ManifestFile *)a)->path, ((const ManifestFile *)b)->path);
+}
+
+// Names holding a backslash or a line break are escaped as coreutils does
+// it: the line gets a leading backslash and those characters are written
+// as \\, \n and \r
+static int path_needs_escape(const char *path) {
+    return strpbrk(path, "\\\n\r") != NULL;
+}
+
+static void print_path(const char *path) {
+    for (const char *p = path; *p; p++) {
+        if (*p == '\\') fputs("\\\\", stdout);
+        else if (*p == '\n') fputs("\\n", stdout);
+        else if (*p == '\r') fputs("\\r", stdout);
+        else putchar(*p);
+    }
+}
+
+static int unescape_path(char *path) {
+    char *out = path;
+    for (const char *p = path; *p; p++) {
+        if (*p != '\\') {
+            *out++ = *p;
+            continue;
+        }
+        p++;
+        if (*p == '\\') *out++ = '\\';
+        else if (*p == 'n') *out++ = '\n';
+        else if (*p == 'r') *out++ = '\r';
+        else return -1;
+    }
+    *out = '\0';
+    return 0;
+}
+
+int cmd_hash_manifest(const char *root, const char *algorithm, const WalkOptions *walk_opts,
+                      const HashOptions *opts) {
+    HashAlgo algo;
+    if (hash_algo_parse(algorithm, &algo) != 0) {
+        fprintf(stderr, "Unsupported algorithm: %s (use: %s)\n", algorithm, hash_algo_names());
+        return 1;
+    }
+    struct stat root_st;
+    if (stat(root, &root_st) != 0 || !S_ISDIR(root_st.st_mode)) {
+        fprintf(stderr, "Cannot access %s\n", root);
+        return 1;
+    }
+    
+    int jobs = walk_jobs(walk_opts);
+    ManifestWorker *workers = calloc((size_t)jobs, sizeof(ManifestWorker));
+    if (!workers) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    for (int i = 0; i < jobs; i++) arena_init(&workers[i].arena);
+    
+    int rc = 1;
+    ManifestFile *files = NULL;
+    HashItem *items = NULL;
+    // Whatever the walk could not read is missing from the manifest: it is
+    // still written, but reported and the exit status says so
+    WalkOptions walk = *walk_opts;
+    walk.report_errors = 1;
+    int walk_errors = walk_tree(root, &walk, manifest_visit, workers);
+    if (walk_errors < 0) goto out;
+    
+    size_t count = 0;
+    for (int i = 0; i < jobs; i++) {
+        if (workers[i].failed) {
+            fprintf(stderr, "Memory allocation failed\n");
+            goto out;
+        }
+        count += workers[i].count;
+    }
+    files = malloc((count ? count : 1) * sizeof(ManifestFile));
+    items = calloc(count ? count : 1, sizeof(HashItem));
+    if (!files || !items) {
+        fprintf(stderr, "Memory allocation failed\n");
+        goto out;
+    }
+    count = 0;
+    for (int i = 0; i < jobs; i++) {
+        if (!workers[i].count) continue;
+        memcpy(files + count, workers[i].items, workers[i].count * sizeof(ManifestFile));
+        count += workers[i].count;
+    }
+    qsort(files, count, sizeof(ManifestFile), compare_manifest_files);
+    
+    for (size_t i = 0; i < count; i++) {
+        items[i].path = files[i].path;
+        items[i].size = files[i].size;
+    }
+    hash_files(items, count, algo, opts);
+    
+    // Size and mtime are the ones the walk saw: a file changed while it was
+    // being hashed gets re-read by the next --quick check rather than trusted
+    rc = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!items[i].ok) {
+            rc = 1;
+            continue;
+        }
+        int64_t sec = files[i].mtime_ns / 1000000000, nsec = files[i].mtime_ns % 1000000000;
+        if (nsec < 0) {
+            nsec += 1000000000;
+            sec--;
+        }
+        char hex[2 * HASH_MAX_DIGEST + 1];
+        hash_to_hex(items[i].digest, hash_digest_size(algo), hex);
+        printf("# size %lld mtime %lld.%09lld\n", (long long)files[i].size, (long long)sec, (long long)nsec);
+        printf("%s%s (", path_needs_escape(files[i].path) ? "\\" : "", hash_algo_label(algo));
+        print_path(files[i].path);
+        printf(") = %s\n", hex);
+    }
+    if (walk_errors > 0) {
+        fprintf(stderr, "WARNING: %d path(s) could not be read; the manifest is incomplete\n", walk_errors);
+        rc = 1;
+    }
+
+out:
+    for (int i = 0; i < jobs; i++) {
+        arena_free(&workers[i].arena);
+        free(workers[i].items);
+    }
+    free(workers);
+    free(files);
+    free(items);
+    return rc;
+}
+
+typedef enum {
+    CHECK_PENDING,
+    CHECK_OK,
+    CHECK_UNCHANGED,            // size and mtime match the manifest, not read
+    CHECK_FAILED,
+    CHECK_UNREADABLE
+} CheckStatus;
+
+typedef struct {
+    const char *path;
+    HashAlgo algo;
+    uint8_t expected[HASH_MAX_DIGEST];
+    int have_meta;              // the manifest recorded size and mtime
+    int64_t size;
+    int64_t mtime_ns;
+    int64_t current_size;       // from the --quick stat, -1 if not known
+    CheckStatus status;
+} CheckEntry;
+
+// Reads one line into *buf without its line ending. Returns 0, -1 at end
+// of file or -2 if out of memory.
+static int read_line(FILE *fp, char **buf, size_t *cap) {
+    size_t len = 0;
+    for (;;) {
+        if (*cap - len < 2) {
+            size_t new_cap = *cap ? *cap * 2 : 256;
+            char *grown = realloc(*buf, new_cap);
+            if (!grown) return -2;
+            *buf = grown;
+            *cap = new_cap;
+        }
+        if (!fgets(*buf + len, (int)(*cap - len), fp)) break;
+        len += strlen(*buf + len);
+        if (len > 0 && (*buf)[len - 1] == '\n') break;
+    }
+    if (len == 0) return -1;
+    while (len > 0 && ((*buf)[len - 1] == '\n' || (*buf)[len - 1] == '\r')) (*buf)[--len] = '\0';
+    return 0;
+}
+
+// "# size N mtime S.NNNNNNNNN" as written by cmd_hash_manifest
+static int parse_meta(const char *line, int64_t *size, int64_t *mtime_ns) {
+    long long sz, sec;
+    char frac[10];
+    if (sscanf(line, "# size %lld mtime %lld.%9[0-9]", &sz, &sec, frac) != 3 || strlen(frac) != 9) return -1;
+    *size = sz;
+    *mtime_ns = (int64_t)sec * 1000000000 + atol(frac);
+    return 0;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int parse_digest(const char *hex, size_t len, HashAlgo algo, uint8_t *digest) {
+    if (len != 2 * hash_digest_size(algo)) return -1;
+    for (size_t i = 0; i < len / 2; i++) {
+        int hi = hex_digit(hex[2 * i]), lo = hex_digit(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return -1;
+        digest[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return 0;
+}
+
+// Untagged lines only carry the digest; its length picks the usual tool
+// (md5sum, sha1sum, sha256sum, sha512sum, xxhsum -H3)
+static int guess_algo(size_t hex_len, HashAlgo *algo) {
+    switch (hex_len) {
+        case 16: *algo = HASH_XXH3_64; return 0;
+        case 32: *algo = HASH_MD5; return 0;
+        case 40: *algo = HASH_SHA1; return 0;
+        case 64: *algo = HASH_SHA256; return 0;
+        case 128: *algo = HASH_SHA512; return 0;
+        default: return -1;
+    }
+}
+
+// "LABEL (path) = digest", or "digest  path" / "digest *path". The path
+// is left in place in line; forced is the algorithm for untagged lines.
+static int parse_check_line(char *line, const HashAlgo *forced, CheckEntry *entry, char **path) {
+    int escaped = line[0] == '\\';
+    if (escaped) line++;
+    
+    const char *open = strstr(line, " (");
+    char *close = NULL;
+    for (char *p = strstr(line, ") = "); p; p = strstr(p + 1, ") = ")) close = p;
+    char label[16];
+    size_t label_len = open ? (size_t)(open - line) : 0;
+    int tagged = open && close && close > open && label_len < sizeof(label);
+    if (tagged) {
+        memcpy(label, line, label_len);
+        label[label_len] = '\0';
+        tagged = hash_algo_parse(label, &entry->algo) == 0;
+    }
+    
+    if (tagged) {
+        const char *hex = close + 4;
+        if (parse_digest(hex, strlen(hex), entry->algo, entry->expected) != 0) return -1;
+        *close = '\0';
+        *path = (char *)open + 2;
+    } else {
+        size_t n = strspn(line, "0123456789abcdefABCDEF");
+        if (n == 0 || line[n] != ' ' || (line[n + 1] != ' ' && line[n + 1] != '*') || !line[n + 2]) return -1;
+        if (forced) {
+            entry->algo = *forced;
+        } else if (guess_algo(n, &entry->algo) != 0) {
+            return -1;
+        }
+        if (parse_digest(line, n, entry->algo, entry->expected) != 0) return -1;
+        *path = line + n + 2;
+    }
+    return escaped ? unescape_path(*path) : 0;
+}
+
+int cmd_hash_check(const char *manifest, const char *algorithm, int quick, const HashOptions *opts) {
+    HashAlgo forced;
+    if (algorithm && hash_algo_parse(algorithm, &forced) != 0) {
+        fprintf(stderr, "Unsupported algorithm: %s (use: %s)\n", algorithm, hash_algo_names());
+        return 1;
+    }
+    FILE *fp = strcmp(manifest, "-") == 0 ? stdin : fopen(manifest, "r");
+    if (!fp) {
+        fprintf(stderr, "Cannot open manifest: %s\n", manifest);
+        return 1;
+    }
+    
+    Arena arena;
+    arena_init(&arena);
+    CheckEntry *entries = NULL;
+    size_t count = 0, capacity = 0, bad_lines = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    int have_meta = 0, r, rc = 1;
+    int64_t meta_size = 0, meta_mtime = 0;
+    HashItem *items = NULL;
+    size_t *item_entry = NULL;
+    
+    while ((r = read_line(fp, &line, &line_cap)) == 0) {
+        if (line[0] == '#') {
+            have_meta = parse_meta(line, &meta_size, &meta_mtime) == 0;
+            continue;
+        }
+        if (!line[0]) continue;
+        if (count == capacity) {
+            size_t new_cap = capacity ? capacity * 2 : 1024;
+            CheckEntry *grown = realloc(entries, new_cap * sizeof(CheckEntry));
+            if (!grown) {
+                r = -2;
+                break;
+            }
+            entries = grown;
+            capacity = new_cap;
+        }
+        
+        CheckEntry *entry = &entries[count];
+        char *path;
+        memset(entry, 0, sizeof(*entry));
+        if (parse_check_line(line, algorithm ? &forced : NULL, entry, &path) != 0) {
+            bad_lines++;
+            have_meta = 0;
+            continue;
+        }
+        if (!(entry->path = arena_strndup(&arena, path, strlen(path)))) {
+            r = -2;
+            break;
+        }
+        entry->have_meta = have_meta;
+        entry->size = meta_size;
+        entry->mtime_ns = meta_mtime;
+        entry->current_size = -1;
+        have_meta = 0;
+        count++;
+    }
+    if (fp != stdin) fclose(fp);
+    if (r == -2) {
+        fprintf(stderr, "Memory allocation failed\n");
+        goto out;
+    }
+    if (count == 0) {
+        fprintf(stderr, "%s: no properly formatted checksum lines found\n", manifest);
+        goto out;
+    }
+    
+    size_t unchanged = 0;
+    for (size_t i = 0; quick && i < count; i++) {
+        struct stat st;
+        if (stat(entries[i].path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        entries[i].current_size = (int64_t)st.st_size;
+        if (entries[i].have_meta && entries[i].size == (int64_t)st.st_size &&
+            entries[i].mtime_ns == manifest_mtime(&st)) {
+            entries[i].status = CHECK_UNCHANGED;
+            unchanged++;
+        }
+    }
+    
+    // Everything else is re-hashed, one algorithm at a time
+    items = malloc(count * sizeof(HashItem));
+    item_entry = malloc(count * sizeof(size_t));
+    if (!items || !item_entry) {
+        fprintf(stderr, "Memory allocation failed\n");
+        goto out;
+    }
+    for (int a = 0; a < HASH_ALGO_COUNT; a++) {
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (entries[i].status != CHECK_PENDING || entries[i].algo != (HashAlgo)a) continue;
+            items[n].path = entries[i].path;
+            items[n].size = entries[i].current_size;
+            item_entry[n++] = i;
+        }
+        if (n == 0) continue;
+        hash_files(items, n, (HashAlgo)a, opts);
+        for (size_t j = 0; j < n; j++) {
+            CheckEntry *entry = &entries[item_entry[j]];
+            if (!items[j].ok) {
+                entry->status = CHECK_UNREADABLE;
+            } else {
+                entry->status = memcmp(items[j].digest, entry->expected, hash_digest_size(entry->algo)) == 0
+                                ? CHECK_OK : CHECK_FAILED;
+            }
+        }
+    }
+    
+    size_t failed = 0, unreadable = 0;
+    for (size_t i = 0; i < count; i++) {
+        const char *result = "OK";
+        if (entries[i].status == CHECK_FAILED) {
+            result = "FAILED";
+            failed++;
+        } else if (entries[i].status == CHECK_UNREADABLE) {
+            result = "FAILED open or read";
+            unreadable++;
+        }
+        if (path_needs_escape(entries[i].path)) putchar('\\');
+        print_path(entries[i].path);
+        printf(": %s\n", result);
+    }
+    
+    if (bad_lines) fprintf(stderr, "WARNING: %zu line(s) improperly formatted\n", bad_lines);
+    if (unreadable) fprintf(stderr, "WARNING: %zu listed file(s) could not be read\n", unreadable);
+    if (failed) fprintf(stderr, "WARNING: %zu computed checksum(s) did NOT match\n", failed);
+    if (quick) fprintf(stderr, "%zu of %zu file(s) unchanged since the manifest, not re-read\n", unchanged, count);
+    rc = failed || unreadable;
+
+out:
+    arena_free(&arena);
+    free(entries);
+    free(line);
+    free(items);
+    free(item_entry);
+    return rc;
+}
@@ -0,0 +1,24 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include "hash.h"
+#include "walker.h"
+
+// Checksum manifests for whole trees. A manifest is plain `hash` output,
+// one "LABEL (path) = digest" line per regular file sorted by path, so
+// sha256sum -c and friends can check it too. Each line is preceded by a
+// "# size N mtime S.NNNNNNNNN" comment that those tools skip and that
+// lets --quick checks pass over files that have not been touched.
+
+// Walk root and print a manifest of every regular file below it
+int cmd_hash_manifest(const char *root, const char *algorithm, const WalkOptions *walk_opts,
+                      const HashOptions *opts);
+
+// Check the files listed in a manifest (ours, or GNU "digest  path" lines
+// whose algorithm is algorithm, or else guessed from the digest length;
+// "-" reads standard input). quick trusts files whose size and mtime still
+// match the manifest instead of reading them. Returns 1 if any file is
+// missing or differs.
+int cmd_hash_check(const char *manifest, const char *algorithm, int quick, const HashOptions *opts);
+
+#endif
@@ -0,0 +1,444 @@
+#include "mbhash.h"
+#include "sha.h"
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define MB_HAVE_X86 1
+#endif
+
+#define MB_MAX_LANES 16
+
+// Chaining state of every lane, transposed: word w of lane l is state[w][l]
+typedef void (*MbKernel)(uint32_t state[][MB_MAX_LANES], const uint8_t *const data[], size_t count);
+
+static const uint32_t mb_md5_iv[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+static const uint32_t mb_sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+#ifdef MB_HAVE_X86
+// Additive constants and message word order of the 64 MD5 steps
+static const uint32_t md5_k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const uint8_t md5_index[64] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    1, 6, 11, 0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12,
+    5, 8, 11, 14, 1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15, 2,
+    0, 7, 14, 5, 12, 3, 10, 1, 8, 15, 6, 13, 4, 11, 2, 9,
+};
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+// MD5 steps t..t+3, whose rotation counts are the same in every group of
+// a round
+#define MD5_GROUP(step, f, t, s0, s1, s2, s3) do { \
+    step(f, a, b, c, d, (t), s0); \
+    step(f, d, a, b, c, (t) + 1, s1); \
+    step(f, c, d, a, b, (t) + 2, s2); \
+    step(f, b, c, d, a, (t) + 3, s3); \
+} while (0)
+
+#define MD5_ROUNDS(step, F, G, H, I) do { \
+    for (int t = 0; t < 16; t += 4) MD5_GROUP(step, F, t, 7, 12, 17, 22); \
+    for (int t = 16; t < 32; t += 4) MD5_GROUP(step, G, t, 5, 9, 14, 20); \
+    for (int t = 32; t < 48; t += 4) MD5_GROUP(step, H, t, 4, 11, 16, 23); \
+    for (int t = 48; t < 64; t += 4) MD5_GROUP(step, I, t, 6, 10, 15, 21); \
+} while (0)
+
+// SHA-256 rounds t..t+7, renaming the working variables instead of moving them
+#define SHA256_GROUP(round, t) do { \
+    round(a, b, c, d, e, f, g, h, (t)); \
+    round(h, a, b, c, d, e, f, g, (t) + 1); \
+    round(g, h, a, b, c, d, e, f, (t) + 2); \
+    round(f, g, h, a, b, c, d, e, (t) + 3); \
+    round(e, f, g, h, a, b, c, d, (t) + 4); \
+    round(d, e, f, g, h, a, b, c, (t) + 5); \
+    round(c, d, e, f, g, h, a, b, (t) + 6); \
+    round(b, c, d, e, f, g, h, a, (t) + 7); \
+} while (0)
+
+// AVX2: eight lanes. Block n of each lane is loaded as two 8x8 word tiles
+// and transposed so m[w] holds message word w of every lane.
+__attribute__((target("avx2")))
+static inline void mb_load_avx2(const uint8_t *const data[], size_t offset, __m256i m[16]) {
+    for (int half = 0; half < 2; half++) {
+        __m256i r[8], t[8], u[8];
+        for (int i = 0; i < 8; i++) r[i] = _mm256_loadu_si256((const __m256i *)(data[i] + offset + 32 * half));
+        for (int i = 0; i < 8; i += 2) {
+            t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+            t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+        }
+        for (int q = 0; q < 8; q += 4) {
+            u[q] = _mm256_unpacklo_epi64(t[q], t[q + 2]);
+            u[q + 1] = _mm256_unpackhi_epi64(t[q], t[q + 2]);
+            u[q + 2] = _mm256_unpacklo_epi64(t[q + 1], t[q + 3]);
+            u[q + 3] = _mm256_unpackhi_epi64(t[q + 1], t[q + 3]);
+        }
+        for (int c = 0; c < 4; c++) {
+            m[8 * half + c] = _mm256_permute2x128_si256(u[c], u[4 + c], 0x20);
+            m[8 * half + 4 + c] = _mm256_permute2x128_si256(u[c], u[4 + c], 0x31);
+        }
+    }
+}
+
+#define ROTL8(x, s) _mm256_or_si256(_mm256_slli_epi32((x), (s)), _mm256_srli_epi32((x), 32 - (s)))
+#define ROTR8(x, s) _mm256_or_si256(_mm256_srli_epi32((x), (s)), _mm256_slli_epi32((x), 32 - (s)))
+#define XOR3_8(x, y, z) _mm256_xor_si256(_mm256_xor_si256((x), (y)), (z))
+
+#define MD5_F8(b, c, d) _mm256_xor_si256((d), _mm256_and_si256((b), _mm256_xor_si256((c), (d))))
+#define MD5_G8(b, c, d) _mm256_xor_si256((c), _mm256_and_si256((d), _mm256_xor_si256((b), (c))))
+#define MD5_H8(b, c, d) XOR3_8((b), (c), (d))
+#define MD5_I8(b, c, d) _mm256_xor_si256((c), _mm256_or_si256((b), _mm256_xor_si256((d), ones)))
+#define MD5_STEP8(f, a, b, c, d, t, s) \
+    (a) = _mm256_add_epi32((b), ROTL8(_mm256_add_epi32(_mm256_add_epi32((a), f((b), (c), (d))), \
+        _mm256_add_epi32(x[md5_index[t]], _mm256_set1_epi32((int)md5_k[t]))), s))
+
+__attribute__((target("avx2")))
+static void md5_x8(uint32_t state[][MB_MAX_LANES], const uint8_t *const data[], size_t count) {
+    const __m256i ones = _mm256_set1_epi32(-1);
+    __m256i a = _mm256_loadu_si256((const __m256i *)state[0]);
+    __m256i b = _mm256_loadu_si256((const __m256i *)state[1]);
+    __m256i c = _mm256_loadu_si256((const __m256i *)state[2]);
+    __m256i d = _mm256_loadu_si256((const __m256i *)state[3]);
+    
+    for (size_t n = 0; n < count; n++) {
+        __m256i x[16];
+        __m256i a0 = a, b0 = b, c0 = c, d0 = d;
+        mb_load_avx2(data, 64 * n, x);
+        MD5_ROUNDS(MD5_STEP8, MD5_F8, MD5_G8, MD5_H8, MD5_I8);
+        a = _mm256_add_epi32(a, a0);
+        b = _mm256_add_epi32(b, b0);
+        c = _mm256_add_epi32(c, c0);
+        d = _mm256_add_epi32(d, d0);
+    }
+    
+    _mm256_storeu_si256((__m256i *)state[0], a);
+    _mm256_storeu_si256((__m256i *)state[1], b);
+    _mm256_storeu_si256((__m256i *)state[2], c);
+    _mm256_storeu_si256((__m256i *)state[3], d);
+}
+
+#define SHA256_ROUND8(a, b, c, d, e, f, g, h, t) do { \
+    __m256i t1 = _mm256_add_epi32(_mm256_add_epi32((h), XOR3_8(ROTR8((e), 6), ROTR8((e), 11), ROTR8((e), 25))), \
+                                  _mm256_add_epi32(_mm256_xor_si256((g), _mm256_and_si256((e), _mm256_xor_si256((f), (g)))), \
+                                                   _mm256_add_epi32(w[t], _mm256_set1_epi32((int)sha256_k[t])))); \
+    __m256i t2 = _mm256_add_epi32(XOR3_8(ROTR8((a), 2), ROTR8((a), 13), ROTR8((a), 22)), \
+                                  _mm256_or_si256(_mm256_and_si256((a), (b)), _mm256_and_si256((c), _mm256_or_si256((a), (b))))); \
+    (d) = _mm256_add_epi32((d), t1); \
+    (h) = _mm256_add_epi32(t1, t2); \
+} while (0)
+
+__attribute__((target("avx2")))
+static void sha256_x8(uint32_t state[][MB_MAX_LANES], const uint8_t *const data[], size_t count) {
+    const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    __m256i s[8];
+    for (int i = 0; i < 8; i++) s[i] = _mm256_loadu_si256((const __m256i *)state[i]);
+    
+    for (size_t n = 0; n < count; n++) {
+        __m256i w[64];
+        mb_load_avx2(data, 64 * n, w);
+        for (int t = 0; t < 16; t++) w[t] = _mm256_shuffle_epi8(w[t], bswap);
+        for (int t = 16; t < 64; t++) {
+            __m256i s0 = XOR3_8(ROTR8(w[t - 15], 7), ROTR8(w[t - 15], 18), _mm256_srli_epi32(w[t - 15], 3));
+            __m256i s1 = XOR3_8(ROTR8(w[t - 2], 17), ROTR8(w[t - 2], 19), _mm256_srli_epi32(w[t - 2], 10));
+            w[t] = _mm256_add_epi32(_mm256_add_epi32(s0, s1), _mm256_add_epi32(w[t - 16], w[t - 7]));
+        }
+        
+        __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int t = 0; t < 64; t += 8) SHA256_GROUP(SHA256_ROUND8, t);
+        s[0] = _mm256_add_epi32(s[0], a);
+        s[1] = _mm256_add_epi32(s[1], b);
+        s[2] = _mm256_add_epi32(s[2], c);
+        s[3] = _mm256_add_epi32(s[3], d);
+        s[4] = _mm256_add_epi32(s[4], e);
+        s[5] = _mm256_add_epi32(s[5], f);
+        s[6] = _mm256_add_epi32(s[6], g);
+        s[7] = _mm256_add_epi32(s[7], h);
+    }
+    
+    for (int i = 0; i < 8; i++) _mm256_storeu_si256((__m256i *)state[i], s[i]);
+}
+
+// AVX-512: sixteen lanes, a 16x16 transpose per block, native rotates and
+// every boolean function in one ternary-logic instruction
+__attribute__((target("avx512f")))
+static inline void mb_load_avx512(const uint8_t *const data[], size_t offset, __m512i m[16]) {
+    __m512i r[16], t[16], u[16];
+    for (int i = 0; i < 16; i++) r[i] = _mm512_loadu_si512(data[i] + offset);
+    for (int i = 0; i < 16; i += 2) {
+        t[i] = _mm512_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm512_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for (int q = 0; q < 16; q += 4) {
+        u[q] = _mm512_unpacklo_epi64(t[q], t[q + 2]);
+        u[q + 1] = _mm512_unpackhi_epi64(t[q], t[q + 2]);
+        u[q + 2] = _mm512_unpacklo_epi64(t[q + 1], t[q + 3]);
+        u[q + 3] = _mm512_unpackhi_epi64(t[q + 1], t[q + 3]);
+    }
+    for (int c = 0; c < 4; c++) {
+        __m512i x0 = _mm512_shuffle_i32x4(u[c], u[4 + c], 0x44);
+        __m512i x1 = _mm512_shuffle_i32x4(u[c], u[4 + c], 0xee);
+        __m512i y0 = _mm512_shuffle_i32x4(u[8 + c], u[12 + c], 0x44);
+        __m512i y1 = _mm512_shuffle_i32x4(u[8 + c], u[12 + c], 0xee);
+        m[c] = _mm512_shuffle_i32x4(x0, y0, 0x88);
+        m[4 + c] = _mm512_shuffle_i32x4(x0, y0, 0xdd);
+        m[8 + c] = _mm512_shuffle_i32x4(x1, y1, 0x88);
+        m[12 + c] = _mm512_shuffle_i32x4(x1, y1, 0xdd);
+    }
+}
+
+#define XOR3_16(x, y, z) _mm512_ternarylogic_epi32((x), (y), (z), 0x96)
+
+#define MD5_F16(b, c, d) _mm512_ternarylogic_epi32((b), (c), (d), 0xca)
+#define MD5_G16(b, c, d) _mm512_ternarylogic_epi32((d), (b), (c), 0xca)
+#define MD5_H16(b, c, d) XOR3_16((b), (c), (d))
+#define MD5_I16(b, c, d) _mm512_ternarylogic_epi32((b), (c), (d), 0x39)
+#define MD5_STEP16(f, a, b, c, d, t, s) \
+    (a) = _mm512_add_epi32((b), _mm512_rol_epi32(_mm512_add_epi32(_mm512_add_epi32((a), f((b), (c), (d))), \
+        _mm512_add_epi32(x[md5_index[t]], _mm512_set1_epi32((int)md5_k[t]))), s))
+
+__attribute__((target("avx512f")))
+static void md5_x16(uint32_t state[][MB_MAX_LANES], const uint8_t *const data[], size_t count) {
+    __m512i a = _mm512_loadu_si512(state[0]);
+    __m512i b = _mm512_loadu_si512(state[1]);
+    __m512i c = _mm512_loadu_si512(state[2]);
+    __m512i d = _mm512_loadu_si512(state[3]);
+    
+    for (size_t n = 0; n < count; n++) {
+        __m512i x[16];
+        __m512i a0 = a, b0 = b, c0 = c, d0 = d;
+        mb_load_avx512(data, 64 * n, x);
+        MD5_ROUNDS(MD5_STEP16, MD5_F16, MD5_G16, MD5_H16, MD5_I16);
+        a = _mm512_add_epi32(a, a0);
+        b = _mm512_add_epi32(b, b0);
+        c = _mm512_add_epi32(c, c0);
+        d = _mm512_add_epi32(d, d0);
+    }
+    
+    _mm512_storeu_si512(state[0], a);
+    _mm512_storeu_si512(state[1], b);
+    _mm512_storeu_si512(state[2], c);
+    _mm512_storeu_si512(state[3], d);
+}
+
+#define ROTR16(x, s) _mm512_ror_epi32((x), (s))
+#define SHA256_ROUND16(a, b, c, d, e, f, g, h, t) do { \
+    __m512i t1 = _mm512_add_epi32(_mm512_add_epi32((h), XOR3_16(ROTR16((e), 6), ROTR16((e), 11), ROTR16((e), 25))), \
+                                  _mm512_add_epi32(_mm512_ternarylogic_epi32((e), (f), (g), 0xca), \
+                                                   _mm512_add_epi32(w[t], _mm512_set1_epi32((int)sha256_k[t])))); \
+    __m512i t2 = _mm512_add_epi32(XOR3_16(ROTR16((a), 2), ROTR16((a), 13), ROTR16((a), 22)), \
+                                  _mm512_ternarylogic_epi32((a), (b), (c), 0xe8)); \
+    (d) = _mm512_add_epi32((d), t1); \
+    (h) = _mm512_add_epi32(t1, t2); \
+} while (0)
+
+__attribute__((target("avx512f,avx512bw")))
+static void sha256_x16(uint32_t state[][MB_MAX_LANES], const uint8_t *const data[], size_t count) {
+    const __m512i bswap = _mm512_broadcast_i32x4(_mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12));
+    __m512i s[8];
+    for (int i = 0; i < 8; i++) s[i] = _mm512_loadu_si512(state[i]);
+    
+    for (size_t n = 0; n < count; n++) {
+        __m512i w[64];
+        mb_load_avx512(data, 64 * n, w);
+        for (int t = 0; t < 16; t++) w[t] = _mm512_shuffle_epi8(w[t], bswap);
+        for (int t = 16; t < 64; t++) {
+            __m512i s0 = XOR3_16(ROTR16(w[t - 15], 7), ROTR16(w[t - 15], 18), _mm512_srli_epi32(w[t - 15], 3));
+            __m512i s1 = XOR3_16(ROTR16(w[t - 2], 17), ROTR16(w[t - 2], 19), _mm512_srli_epi32(w[t - 2], 10));
+            w[t] = _mm512_add_epi32(_mm512_add_epi32(s0, s1), _mm512_add_epi32(w[t - 16], w[t - 7]));
+        }
+        
+        __m512i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int t = 0; t < 64; t += 8) SHA256_GROUP(SHA256_ROUND16, t);
+        s[0] = _mm512_add_epi32(s[0], a);
+        s[1] = _mm512_add_epi32(s[1], b);
+        s[2] = _mm512_add_epi32(s[2], c);
+        s[3] = _mm512_add_epi32(s[3], d);
+        s[4] = _mm512_add_epi32(s[4], e);
+        s[5] = _mm512_add_epi32(s[5], f);
+        s[6] = _mm512_add_epi32(s[6], g);
+        s[7] = _mm512_add_epi32(s[7], h);
+    }
+    
+    for (int i = 0; i < 8; i++) _mm512_storeu_si512(state[i], s[i]);
+}
+#endif
+
+typedef struct {
+    const char *name;
+    int lanes;                  // 1: no kernel, hash jobs one at a time
+    MbKernel kernel;
+    // Once the queue is empty, lanes still busy are finished one message at
+    // a time when at most this many remain: a wide kernel running mostly
+    // idle lanes is slower than a good single-stream one
+    int finish_single;
+} MbImpl;
+
+static MbImpl mb_impl(HashAlgo algo) {
+    MbImpl impl = { hash_algo_impl(algo), 1, NULL, 0 };
+#ifdef MB_HAVE_X86
+    if (algo == HASH_MD5) {
+        if (__builtin_cpu_supports("avx512f")) impl = (MbImpl){ "avx512", 16, md5_x16, 0 };
+        else if (__builtin_cpu_supports("avx2")) impl = (MbImpl){ "avx2", 8, md5_x8, 0 };
+    } else if (algo == HASH_SHA256) {
+        int shani = strcmp(sha256_impl(), "sha-ni") == 0;
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+            impl = (MbImpl){ "avx512", 16, sha256_x16, shani ? 4 : 0 };
+        } else if (__builtin_cpu_supports("avx2") && !shani) {
+            impl = (MbImpl){ "avx2", 8, sha256_x8, 0 };
+        }
+    }
+#endif
+    return impl;
+}
+
+int mb_hash_lanes(HashAlgo algo) {
+    return mb_impl(algo).lanes;
+}
+
+const char* mb_hash_impl(HashAlgo algo) {
+    return mb_impl(algo).name;
+}
+
+typedef struct {
+    MbHashJob *job;             // NULL while the lane is idle
+    const uint8_t *next;        // next block to compress
+    size_t body;                // whole blocks of the message still to go
+    size_t tail;                // then this many padding blocks, from pad
+    uint8_t pad[128];           // last partial block, 0x80, zeros, bit length
+} MbLane;
+
+static void mb_lane_start(MbLane *lane, MbHashJob *job, HashAlgo algo) {
+    size_t rem = job->len % 64;
+    uint64_t bits = (uint64_t)job->len << 3;
+    
+    lane->job = job;
+    lane->body = job->len / 64;
+    lane->tail = rem + 9 > 64 ? 2 : 1;
+    memset(lane->pad, 0, sizeof(lane->pad));
+    if (rem) memcpy(lane->pad, job->data + lane->body * 64, rem);
+    lane->pad[rem] = 0x80;
+    // Bit length: little-endian for MD5, big-endian for SHA-256
+    uint8_t *length = lane->pad + 64 * lane->tail - 8;
+    for (int i = 0; i < 8; i++) {
+        length[i] = (uint8_t)(algo == HASH_MD5 ? bits >> (8 * i) : bits >> (56 - 8 * i));
+    }
+    lane->next = lane->body ? job->data : lane->pad;
+}
+
+// Moves the lane n blocks on; returns 1 once its last block is done
+static int mb_lane_advance(MbLane *lane, size_t n) {
+    if (lane->body) {
+        lane->body -= n;
+        lane->next = lane->body ? lane->next + 64 * n : lane->pad;
+        return 0;
+    }
+    lane->tail -= n;
+    lane->next += 64 * n;
+    return lane->tail == 0;
+}
+
+static void mb_digest(HashAlgo algo, const uint32_t s[8], uint8_t *digest) {
+    if (algo == HASH_MD5) {
+        for (int i = 0; i < 16; i++) digest[i] = (uint8_t)(s[i / 4] >> (8 * (i % 4)));
+    } else {
+        for (int i = 0; i < 32; i++) digest[i] = (uint8_t)(s[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+// Rest of a lane's message through the single-stream kernel
+static void mb_lane_finish_single(MbLane *lane, HashAlgo algo, uint32_t s[8]) {
+    const uint8_t *tail = lane->body ? lane->pad : lane->next;
+    if (algo == HASH_MD5) {
+        if (lane->body) md5_blocks(s, lane->next, lane->body);
+        md5_blocks(s, tail, lane->tail);
+    } else {
+        if (lane->body) sha256_blocks(s, lane->next, lane->body);
+        sha256_blocks(s, tail, lane->tail);
+    }
+}
+
+void mb_hash(HashAlgo algo, MbHashJob *jobs, size_t count) {
+    MbImpl impl = mb_impl(algo);
+    if (!impl.kernel) {
+        for (size_t i = 0; i < count; i++) {
+            HashCtx ctx;
+            hash_init(&ctx, algo);
+            hash_update(&ctx, jobs[i].data, jobs[i].len);
+            hash_final(&ctx, jobs[i].digest);
+        }
+        return;
+    }
+    
+    const uint32_t *iv = algo == HASH_MD5 ? mb_md5_iv : mb_sha256_iv;
+    int words = algo == HASH_MD5 ? 4 : 8;
+    uint32_t state[8][MB_MAX_LANES];
+    MbLane lanes[MB_MAX_LANES];
+    size_t queued = 0;
+    int active = 0;
+    
+    for (int l = 0; l < impl.lanes; l++) lanes[l].job = NULL;
+    for (;;) {
+        for (int l = 0; l < impl.lanes && queued < count; l++) {
+            if (lanes[l].job) continue;
+            mb_lane_start(&lanes[l], &jobs[queued++], algo);
+            for (int w = 0; w < words; w++) state[w][l] = iv[w];
+            active++;
+        }
+        if (active == 0) break;
+        
+        if (queued == count && active <= impl.finish_single) {
+            for (int l = 0; l < impl.lanes; l++) {
+                if (!lanes[l].job) continue;
+                uint32_t s[8];
+                for (int w = 0; w < words; w++) s[w] = state[w][l];
+                mb_lane_finish_single(&lanes[l], algo, s);
+                mb_digest(algo, s, lanes[l].job->digest);
+            }
+            break;
+        }
+        
+        // Run every lane as far as the shortest phase allows. Idle lanes
+        // read along with a busy one and their results are dropped.
+        const uint8_t *data[MB_MAX_LANES];
+        const uint8_t *busy = NULL;
+        size_t n = SIZE_MAX;
+        for (int l = 0; l < impl.lanes; l++) {
+            if (!lanes[l].job) continue;
+            size_t left = lanes[l].body ? lanes[l].body : lanes[l].tail;
+            if (left < n) n = left;
+            busy = lanes[l].next;
+        }
+        for (int l = 0; l < impl.lanes; l++) data[l] = lanes[l].job ? lanes[l].next : busy;
+        impl.kernel(state, data, n);
+        
+        for (int l = 0; l < impl.lanes; l++) {
+            if (!lanes[l].job || !mb_lane_advance(&lanes[l], n)) continue;
+            uint32_t s[8];
+            for (int w = 0; w < words; w++) s[w] = state[w][l];
+            mb_digest(algo, s, lanes[l].job->digest);
+            lanes[l].job = NULL;
+            active--;
+        }
+    }
+}
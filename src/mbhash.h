@@ -0,0 +1,28 @@
+#ifndef MBHASH_H
+#define MBHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hash.h"
+
+// Multi-buffer MD5 and SHA-256: independent messages are hashed side by
+// side, one per 32-bit SIMD lane (8 with AVX2, 16 with AVX-512). A lane
+// that finishes its message is refilled from the queue straight away, so
+// throughput holds up best when neighbouring jobs have similar lengths.
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    uint8_t digest[32];         // hash_digest_size(algo) bytes are written
+} MbHashJob;
+
+// Messages hashed at once for algo on this CPU; 1 if there is no
+// multi-buffer kernel for it and mb_hash runs the jobs one by one
+int mb_hash_lanes(HashAlgo algo);
+// Kernel in use ("avx512", "avx2", or the single-stream one from hash.h)
+const char* mb_hash_impl(HashAlgo algo);
+
+// Hashes every job with any algorithm; only MD5 and SHA-256 use lanes
+void mb_hash(HashAlgo algo, MbHashJob *jobs, size_t count);
+
+#endif
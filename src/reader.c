@@ -0,0 +1,274 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+
+// Plain buffered reads; no mapping or read-ahead thread on Windows yet
+struct Reader {
+    FILE *fp;
+    uint8_t *buffer;
+};
+
+Reader* reader_open(const char *path, unsigned flags) {
+    (void)flags;
+    Reader *reader = calloc(1, sizeof(Reader));
+    if (!reader) return NULL;
+    reader->fp = fopen(path, "rb");
+    reader->buffer = malloc(READER_BUFFER_SIZE);
+    if (!reader->fp || !reader->buffer) {
+        reader_close(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+long reader_next(Reader *reader, const uint8_t **data) {
+    size_t n = fread(reader->buffer, 1, READER_BUFFER_SIZE, reader->fp);
+    if (n == 0 && ferror(reader->fp)) return -1;
+    *data = reader->buffer;
+    return (long)n;
+}
+
+void reader_close(Reader *reader) {
+    if (!reader) return;
+    if (reader->fp) fclose(reader->fp);
+    free(reader->buffer);
+    free(reader);
+}
+
+const char* reader_mode(const Reader *reader) {
+    (void)reader;
+    return "read";
+}
+
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// O_DIRECT wants buffers, offsets and lengths aligned to the logical block
+// size; a page covers every common device
+#define READER_ALIGN 4096
+
+typedef enum {
+    READER_MODE_READ,           // synchronous reads into one buffer
+    READER_MODE_MMAP,
+    READER_MODE_THREAD,         // double buffering on a background thread
+} ReaderMode;
+
+struct Reader {
+    int fd;
+    ReaderMode mode;
+    int direct;                 // opened with O_DIRECT
+    int drop_cache;             // no O_DIRECT here: drop pages once read instead
+    int eof;
+    uint64_t offset;            // bytes read from fd so far
+    
+    uint8_t *map;
+    size_t map_size;
+    size_t map_pos;
+    
+    uint8_t *buffer[2];
+    long filled[2];             // bytes in each buffer, -1 for a read error
+    int ready[2];               // buffer holds data the caller has not taken
+    int error[2];               // errno of a failed read
+    int current;                // buffer the caller reads next or is holding
+    int holding;                // the caller still has buffer[current]
+    int stop;
+    int thread_started;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+// Fill one buffer completely, or up to end of file
+static long reader_fill(Reader *reader, uint8_t *buffer, int *error) {
+    size_t got = 0;
+    while (got < READER_BUFFER_SIZE && !reader->eof) {
+        ssize_t n = read(reader->fd, buffer + got, READER_BUFFER_SIZE - got);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            *error = errno;
+            return -1;
+        }
+        got += (size_t)n;
+        // A short O_DIRECT read only happens at end of file, and reading
+        // on from the unaligned offset would fail
+        if (n == 0 || (reader->direct && got % READER_ALIGN != 0)) reader->eof = 1;
+    }
+#ifdef POSIX_FADV_DONTNEED
+    if (reader->drop_cache && got > 0) posix_fadvise(reader->fd, (off_t)reader->offset, (off_t)got, POSIX_FADV_DONTNEED);
+#endif
+    reader->offset += got;
+    return (long)got;
+}
+
+static void* reader_thread(void *arg) {
+    Reader *reader = arg;
+    for (int next = 0;; next ^= 1) {
+        pthread_mutex_lock(&reader->lock);
+        while (reader->ready[next] && !reader->stop) pthread_cond_wait(&reader->cond, &reader->lock);
+        int stop = reader->stop;
+        pthread_mutex_unlock(&reader->lock);
+        if (stop) break;
+        
+        int error = 0;
+        long n = reader_fill(reader, reader->buffer[next], &error);
+        
+        pthread_mutex_lock(&reader->lock);
+        reader->filled[next] = n;
+        reader->error[next] = error;
+        reader->ready[next] = 1;
+        pthread_cond_broadcast(&reader->cond);
+        pthread_mutex_unlock(&reader->lock);
+        if (n <= 0) break;
+    }
+    return NULL;
+}
+
+static int reader_alloc_buffers(Reader *reader, int count) {
+    for (int i = 0; i < count; i++) {
+        void *p;
+        if (posix_memalign(&p, READER_ALIGN, READER_BUFFER_SIZE) != 0) return -1;
+        reader->buffer[i] = p;
+    }
+    return 0;
+}
+
+Reader* reader_open(const char *path, unsigned flags) {
+    Reader *reader = calloc(1, sizeof(Reader));
+    if (!reader) return NULL;
+    reader->fd = -1;
+    
+    int open_flags = O_RDONLY | O_CLOEXEC;
+#ifdef O_DIRECT
+    if (flags & READER_DIRECT) {
+        reader->fd = open(path, open_flags | O_DIRECT);
+        reader->direct = reader->fd >= 0;
+    }
+#endif
+    if (reader->fd < 0) {
+        // tmpfs and some network filesystems refuse O_DIRECT
+        reader->fd = open(path, open_flags);
+        reader->drop_cache = (flags & READER_DIRECT) != 0;
+    }
+    struct stat st;
+    if (reader->fd < 0 || fstat(reader->fd, &st) != 0) {
+        int saved = errno;
+        reader_close(reader);
+        errno = saved;
+        return NULL;
+    }
+    
+    int regular = S_ISREG(st.st_mode);
+    if (regular && st.st_size <= READER_BUFFER_SIZE) {
+        reader->mode = READER_MODE_READ;
+    } else if (regular && !(flags & (READER_DIRECT | READER_NO_MMAP))) {
+        reader->map_size = (size_t)st.st_size;
+        reader->map = mmap(NULL, reader->map_size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+        if (reader->map == MAP_FAILED) {
+            reader->map = NULL;
+            reader->mode = READER_MODE_THREAD;
+        } else {
+            reader->mode = READER_MODE_MMAP;
+            madvise(reader->map, reader->map_size, MADV_SEQUENTIAL);
+        }
+    } else {
+        reader->mode = READER_MODE_THREAD;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (reader->mode != READER_MODE_MMAP) posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    if (reader->mode == READER_MODE_MMAP) return reader;
+    if (reader_alloc_buffers(reader, reader->mode == READER_MODE_THREAD ? 2 : 1) != 0) {
+        reader_close(reader);
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (reader->mode == READER_MODE_THREAD) {
+        pthread_mutex_init(&reader->lock, NULL);
+        pthread_cond_init(&reader->cond, NULL);
+        if (pthread_create(&reader->thread, NULL, reader_thread, reader) == 0) {
+            reader->thread_started = 1;
+        } else {
+            pthread_mutex_destroy(&reader->lock);
+            pthread_cond_destroy(&reader->cond);
+            reader->mode = READER_MODE_READ;
+        }
+    }
+    return reader;
+}
+
+long reader_next(Reader *reader, const uint8_t **data) {
+    if (reader->mode == READER_MODE_MMAP) {
+        size_t n = reader->map_size - reader->map_pos;
+        if (n > READER_BUFFER_SIZE) n = READER_BUFFER_SIZE;
+        *data = reader->map + reader->map_pos;
+        reader->map_pos += n;
+        return (long)n;
+    }
+    
+    if (reader->mode == READER_MODE_READ) {
+        int error = 0;
+        long n = reader_fill(reader, reader->buffer[0], &error);
+        if (n < 0) errno = error;
+        *data = reader->buffer[0];
+        return n;
+    }
+    
+    // Hand the previous buffer back to the thread, then wait for the next
+    pthread_mutex_lock(&reader->lock);
+    if (reader->holding) {
+        reader->ready[reader->current] = 0;
+        reader->current ^= 1;
+        reader->holding = 0;
+        pthread_cond_broadcast(&reader->cond);
+    }
+    while (!reader->ready[reader->current]) pthread_cond_wait(&reader->cond, &reader->lock);
+    long n = reader->filled[reader->current];
+    int error = reader->error[reader->current];
+    // End of file and errors stay put for any further calls
+    if (n > 0) reader->holding = 1;
+    pthread_mutex_unlock(&reader->lock);
+    
+    if (n < 0) errno = error;
+    *data = reader->buffer[reader->current];
+    return n;
+}
+
+void reader_close(Reader *reader) {
+    if (!reader) return;
+    if (reader->thread_started) {
+        pthread_mutex_lock(&reader->lock);
+        reader->stop = 1;
+        pthread_cond_broadcast(&reader->cond);
+        pthread_mutex_unlock(&reader->lock);
+        pthread_join(reader->thread, NULL);
+        pthread_mutex_destroy(&reader->lock);
+        pthread_cond_destroy(&reader->cond);
+    }
+    if (reader->map) munmap(reader->map, reader->map_size);
+    if (reader->fd >= 0) close(reader->fd);
+    free(reader->buffer[0]);
+    free(reader->buffer[1]);
+    free(reader);
+}
+
+const char* reader_mode(const Reader *reader) {
+    switch (reader->mode) {
+        case READER_MODE_MMAP: return "mmap";
+        case READER_MODE_THREAD: return reader->direct ? "direct" : "thread";
+        default: return "read";
+    }
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Sequential whole-file reader for the streaming commands. Large regular
+// files are memory-mapped with MADV_SEQUENTIAL; pipes and O_DIRECT reads
+// go through two aligned buffers that a background thread fills while the
+// caller works on the other one; small files are read in one go.
+
+#define READER_BUFFER_SIZE (1 << 20)
+
+#define READER_DIRECT   (1u << 0)   // O_DIRECT, keeping the file out of the page cache
+#define READER_NO_MMAP  (1u << 1)   // read into buffers even when mapping would work
+
+typedef struct Reader Reader;
+
+// Returns NULL with errno set if the file cannot be opened
+Reader* reader_open(const char *path, unsigned flags);
+// Next piece of the file, valid until the following call. Returns its
+// length, 0 at end of file or -1 on a read error (errno set).
+long reader_next(Reader *reader, const uint8_t **data);
+void reader_close(Reader *reader);
+
+// How the file is being read ("mmap", "thread", "direct" or "read")
+const char* reader_mode(const Reader *reader);
+
+#endif
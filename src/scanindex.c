@@ -0,0 +1,262 @@
+#include "scanindex.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// On-disk layout (native endianness, the index is a local cache):
+//   IndexHeader
+//   root path, NUL-terminated, padded to a multiple of 8 bytes
+//   IndexRecord[count], sorted by (dev, ino)
+#define SCAN_INDEX_MAGIC "CAFIDX\r\n"
+#define SCAN_INDEX_VERSION 1
+#define SCAN_INDEX_HASH_XXH3 2        // content hash used by finddup (1 was XXH64)
+
+typedef struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t hash_algo;
+    uint32_t record_size;
+    uint32_t root_size;             // padded length of the root path
+    uint64_t count;
+} IndexHeader;
+
+// Records of any type, by the (dev, ino) they all start with
+static int compare_records(const void *a, const void *b) {
+    uint64_t ka[2], kb[2];
+    memcpy(ka, a, sizeof(ka));
+    memcpy(kb, b, sizeof(kb));
+    if (ka[0] != kb[0]) return ka[0] < kb[0] ? -1 : 1;
+    if (ka[1] != kb[1]) return ka[1] < kb[1] ? -1 : 1;
+    return 0;
+}
+
+#ifdef _WIN32
+
+int record_file_map(RecordFile *rf, const char *file, size_t header_size, const char **error) {
+    (void)file; (void)header_size;
+    memset(rf, 0, sizeof(*rf));
+    if (error) *error = "not supported on Windows yet";
+    return -1;
+}
+
+int record_file_set(RecordFile *rf, size_t offset, size_t count, size_t record_size) {
+    (void)rf; (void)offset; (void)count; (void)record_size;
+    return -1;
+}
+
+void record_file_unmap(RecordFile *rf) {
+    (void)rf;
+}
+
+const void* record_file_lookup(const RecordFile *rf, uint64_t dev, uint64_t ino) {
+    (void)rf; (void)dev; (void)ino;
+    return NULL;
+}
+
+int record_file_write(const char *file, const void *header, size_t header_size,
+                      void *records, size_t record_size, size_t count) {
+    (void)file; (void)header; (void)header_size; (void)records; (void)record_size; (void)count;
+    return -1;
+}
+
+ScanIndex* scan_index_open(const char *file, const char **error) {
+    (void)file;
+    if (error) *error = "not supported on Windows yet";
+    return NULL;
+}
+
+void scan_index_close(ScanIndex *index) {
+    (void)index;
+}
+
+const char* scan_index_root(const ScanIndex *index) {
+    (void)index;
+    return "";
+}
+
+size_t scan_index_count(const ScanIndex *index) {
+    (void)index;
+    return 0;
+}
+
+const IndexRecord* scan_index_lookup(const ScanIndex *index, uint64_t dev, uint64_t ino) {
+    (void)index; (void)dev; (void)ino;
+    return NULL;
+}
+
+int scan_index_write(const char *file, const char *root, IndexRecord *records, size_t count) {
+    (void)file; (void)root; (void)records; (void)count;
+    return -1;
+}
+
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int record_file_map(RecordFile *rf, const char *file, size_t header_size, const char **error) {
+    memset(rf, 0, sizeof(*rf));
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        // Only a missing file is routine; an unreadable one must be reported
+        if (error) *error = errno == ENOENT ? "no such file" : strerror(errno);
+        return -1;
+    }
+    
+    struct stat st;
+    const char *reason = NULL;
+    if (fstat(fd, &st) != 0) {
+        reason = strerror(errno);
+    } else if (S_ISDIR(st.st_mode)) {
+        reason = strerror(EISDIR);
+    } else if ((size_t)st.st_size < header_size) {
+        reason = "truncated";
+    } else if ((rf->map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        rf->map = NULL;
+        reason = "mmap failed";
+    } else {
+        rf->map_size = (size_t)st.st_size;
+#ifdef MADV_RANDOM
+        madvise(rf->map, rf->map_size, MADV_RANDOM);
+#endif
+    }
+    close(fd);
+    if (reason && error) *error = reason;
+    return reason ? -1 : 0;
+}
+
+int record_file_set(RecordFile *rf, size_t offset, size_t count, size_t record_size) {
+    if (offset > rf->map_size || count > (rf->map_size - offset) / record_size) return -1;
+    rf->records = (const char *)rf->map + offset;
+    rf->count = count;
+    rf->record_size = record_size;
+    return 0;
+}
+
+void record_file_unmap(RecordFile *rf) {
+    if (rf->map) munmap(rf->map, rf->map_size);
+    memset(rf, 0, sizeof(*rf));
+}
+
+const void* record_file_lookup(const RecordFile *rf, uint64_t dev, uint64_t ino) {
+    if (!rf->records) return NULL;
+    uint64_t key[2] = { dev, ino };
+    return bsearch(key, rf->records, rf->count, rf->record_size, compare_records);
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int record_file_write(const char *file, const void *header, size_t header_size,
+                      void *records, size_t record_size, size_t count) {
+    qsort(records, count, record_size, compare_records);
+    
+    size_t tmp_len = strlen(file) + 32;
+    char *tmp = malloc(tmp_len);
+    if (!tmp) return -1;
+    snprintf(tmp, tmp_len, "%s.tmp.%ld", file, (long)getpid());
+    
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        free(tmp);
+        return -1;
+    }
+    int rc = write_all(fd, header, header_size);
+    if (rc == 0) rc = write_all(fd, records, count * record_size);
+    if (rc == 0) rc = fsync(fd);
+    if (close(fd) != 0) rc = -1;
+    if (rc == 0) rc = rename(tmp, file);
+    if (rc != 0) unlink(tmp);
+    free(tmp);
+    return rc == 0 ? 0 : -1;
+}
+
+struct ScanIndex {
+    RecordFile file;
+    const char *root;
+};
+
+ScanIndex* scan_index_open(const char *file, const char **error) {
+    RecordFile rf;
+    const char *reason = NULL;
+    if (record_file_map(&rf, file, sizeof(IndexHeader), error) != 0) return NULL;
+    
+    const IndexHeader *hdr = rf.map;
+    if (memcmp(hdr->magic, SCAN_INDEX_MAGIC, 8) != 0) {
+        reason = "not a scan index";
+    } else if (hdr->version != SCAN_INDEX_VERSION || hdr->record_size != sizeof(IndexRecord)) {
+        reason = "different format version";
+    } else if (hdr->hash_algo != SCAN_INDEX_HASH_XXH3) {
+        reason = "built with a different content hash";
+    } else if (hdr->root_size == 0 || hdr->root_size % 8 != 0 ||
+               hdr->root_size > rf.map_size - sizeof(IndexHeader) ||
+               record_file_set(&rf, sizeof(IndexHeader) + hdr->root_size, (size_t)hdr->count,
+                               sizeof(IndexRecord)) != 0) {
+        reason = "truncated";
+    } else if (((const char *)rf.map)[sizeof(IndexHeader) + hdr->root_size - 1] != '\0') {
+        reason = "corrupt root path";
+    }
+    
+    ScanIndex *index = reason ? NULL : calloc(1, sizeof(ScanIndex));
+    if (!index) {
+        if (error) *error = reason ? reason : "out of memory";
+        record_file_unmap(&rf);
+        return NULL;
+    }
+    index->file = rf;
+    index->root = (const char *)rf.map + sizeof(IndexHeader);
+    return index;
+}
+
+void scan_index_close(ScanIndex *index) {
+    if (!index) return;
+    record_file_unmap(&index->file);
+    free(index);
+}
+
+const char* scan_index_root(const ScanIndex *index) {
+    return index->root;
+}
+
+size_t scan_index_count(const ScanIndex *index) {
+    return index->file.count;
+}
+
+const IndexRecord* scan_index_lookup(const ScanIndex *index, uint64_t dev, uint64_t ino) {
+    if (!index) return NULL;
+    return record_file_lookup(&index->file, dev, ino);
+}
+
+int scan_index_write(const char *file, const char *root, IndexRecord *records, size_t count) {
+    // The root path, NUL-terminated and padded, is part of the header
+    size_t root_size = (strlen(root) + 1 + 7) & ~(size_t)7;
+    char *header = calloc(1, sizeof(IndexHeader) + root_size);
+    if (!header) return -1;
+    
+    IndexHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SCAN_INDEX_MAGIC, 8);
+    hdr.version = SCAN_INDEX_VERSION;
+    hdr.hash_algo = SCAN_INDEX_HASH_XXH3;
+    hdr.record_size = sizeof(IndexRecord);
+    hdr.root_size = (uint32_t)root_size;
+    hdr.count = count;
+    memcpy(header, &hdr, sizeof(hdr));
+    memcpy(header + sizeof(hdr), root, strlen(root));
+    
+    int rc = record_file_write(file, header, sizeof(IndexHeader) + root_size, records, sizeof(IndexRecord), count);
+    free(header);
+    return rc;
+}
+
+#endif
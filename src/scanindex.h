@@ -0,0 +1,70 @@
+#ifndef SCANINDEX_H
+#define SCANINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Persistent scan index: one fixed-size record per regular file, keyed by
+// (dev, inode) and sorted so lookups are a binary search straight into the
+// memory-mapped file. A record is only trusted while size, mtime and ctime
+// all still match what the current scan reports.
+
+#define SCAN_INDEX_HAVE_PARTIAL  (1u << 0)     // partial_hash is valid
+#define SCAN_INDEX_HAVE_FULL     (1u << 1)     // full_hash is valid
+
+typedef struct IndexRecord {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    uint64_t partial_hash;
+    uint64_t full_hash;
+    uint32_t flags;
+    uint32_t reserved;
+} IndexRecord;
+
+// Shared by the scan index and other on-disk caches: a file of fixed-size
+// records sorted by (dev, ino), after a header the caller defines. Every
+// record type must start with its uint64_t dev and ino.
+typedef struct RecordFile {
+    void *map;
+    size_t map_size;
+    const void *records;
+    size_t count;
+    size_t record_size;
+} RecordFile;
+
+// Map file read-only. Returns 0, or -1 with *error set to a short reason
+// ("no such file" only for ENOENT, strerror() for other open failures,
+// "truncated" when shorter than header_size, ...).
+int record_file_map(RecordFile *rf, const char *file, size_t header_size, const char **error);
+// Once the caller has checked its header: count records of record_size
+// start offset bytes into the file. Returns -1 if they run past its end.
+int record_file_set(RecordFile *rf, size_t offset, size_t count, size_t record_size);
+void record_file_unmap(RecordFile *rf);
+const void* record_file_lookup(const RecordFile *rf, uint64_t dev, uint64_t ino);
+
+// Sort the records and atomically replace file with the header followed
+// by them (written to a temporary file next to it, synced, then renamed).
+// Returns 0 on success.
+int record_file_write(const char *file, const void *header, size_t header_size,
+                      void *records, size_t record_size, size_t count);
+
+typedef struct ScanIndex ScanIndex;
+
+// Map an existing index read-only. Returns NULL (and sets *error to a
+// short reason, if given) when the file is missing, truncated, from another
+// format version or written with a different content hash.
+ScanIndex* scan_index_open(const char *file, const char **error);
+void scan_index_close(ScanIndex *index);
+
+const char* scan_index_root(const ScanIndex *index);
+size_t scan_index_count(const ScanIndex *index);
+const IndexRecord* scan_index_lookup(const ScanIndex *index, uint64_t dev, uint64_t ino);
+
+// Sort the records and atomically replace file (written to a temporary
+// file next to it, then renamed). Returns 0 on success.
+int scan_index_write(const char *file, const char *root, IndexRecord *records, size_t count);
+
+#endif
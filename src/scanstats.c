@@ -0,0 +1,389 @@
+#include "scanstats.h"
+#include "filetools.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+
+ScanStats* scan_stats_new(int progress, const char *json_path) {
+    (void)progress; (void)json_path;
+    fprintf(stderr, "Scan metrics not supported on Windows yet\n");
+    return NULL;
+}
+
+void scan_stats_free(ScanStats *stats) {
+    (void)stats;
+}
+
+void scan_stats_stage(ScanStats *stats, const char *name) {
+    (void)stats; (void)name;
+}
+
+void scan_stats_finish(ScanStats *stats) {
+    (void)stats;
+}
+
+uint64_t scan_stats_now(const ScanStats *stats) {
+    (void)stats;
+    return 0;
+}
+
+void scan_stats_dir(ScanStats *stats, int worker, uint64_t entries) {
+    (void)stats; (void)worker; (void)entries;
+}
+
+void scan_stats_stat(ScanStats *stats, int worker, uint64_t calls, uint64_t start_ns) {
+    (void)stats; (void)worker; (void)calls; (void)start_ns;
+}
+
+void scan_stats_read(ScanStats *stats, int worker, uint64_t bytes, uint64_t start_ns) {
+    (void)stats; (void)worker; (void)bytes; (void)start_ns;
+}
+
+void scan_stats_hash(ScanStats *stats, int worker, uint64_t bytes, uint64_t start_ns) {
+    (void)stats; (void)worker; (void)bytes; (void)start_ns;
+}
+
+void scan_stats_file_hashed(ScanStats *stats, int worker) {
+    (void)stats; (void)worker;
+}
+
+void scan_stats_queue(ScanStats *stats, long pending) {
+    (void)stats; (void)pending;
+}
+
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SCAN_STATS_SLOTS 256            // the walker's worker limit
+#define SCAN_STATS_MAX_STAGES 16
+#define SCAN_STATS_INTERVAL_NS 1000000000ULL
+
+typedef struct ScanCounters {
+    uint64_t dirs;
+    uint64_t entries;
+    uint64_t stat_calls;
+    uint64_t stat_ns;
+    uint64_t read_bytes;
+    uint64_t read_ns;
+    uint64_t hash_bytes;
+    uint64_t hash_ns;
+    uint64_t hashed_files;
+} ScanCounters;
+
+// Padded so that two workers never write to the same cache line
+typedef struct ScanSlot {
+    ScanCounters c;
+    char pad[64];
+} ScanSlot;
+
+typedef struct ScanStage {
+    const char *name;
+    uint64_t ns;
+} ScanStage;
+
+struct ScanStats {
+    ScanSlot *slots;
+    int progress;
+    int tty;                        // progress line is redrawn in place
+    FILE *json;
+    uint64_t start_ns;
+    ScanStage stages[SCAN_STATS_MAX_STAGES];
+    int stage_count;
+    uint64_t stage_start_ns;
+    const char *stage;              // current stage, read by the reporter
+    long queue;
+    long queue_max;
+    
+    int running;
+    int stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    ScanCounters last;              // reporter's previous sample
+    uint64_t last_ns;
+};
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+ScanStats* scan_stats_new(int progress, const char *json_path) {
+    ScanStats *stats = calloc(1, sizeof(ScanStats));
+    if (stats) stats->slots = calloc(SCAN_STATS_SLOTS, sizeof(ScanSlot));
+    if (!stats || !stats->slots) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(stats);
+        return NULL;
+    }
+    if (json_path) {
+        stats->json = fopen(json_path, "w");
+        if (!stats->json) {
+            fprintf(stderr, "Cannot create metrics file %s\n", json_path);
+            free(stats->slots);
+            free(stats);
+            return NULL;
+        }
+    }
+    stats->progress = progress;
+    stats->tty = progress && isatty(STDERR_FILENO);
+    pthread_mutex_init(&stats->lock, NULL);
+    pthread_cond_init(&stats->cond, NULL);
+    return stats;
+}
+
+void scan_stats_free(ScanStats *stats) {
+    if (!stats) return;
+    scan_stats_finish(stats);
+    if (stats->json) fclose(stats->json);
+    pthread_cond_destroy(&stats->cond);
+    pthread_mutex_destroy(&stats->lock);
+    free(stats->slots);
+    free(stats);
+}
+
+uint64_t scan_stats_now(const ScanStats *stats) {
+    return stats ? monotonic_ns() : 0;
+}
+
+static ScanCounters* slot_counters(ScanStats *stats, int worker) {
+    return &stats->slots[(unsigned)worker % SCAN_STATS_SLOTS].c;
+}
+
+#define COUNTER_ADD(field, n) __atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED)
+
+void scan_stats_dir(ScanStats *stats, int worker, uint64_t entries) {
+    if (!stats) return;
+    ScanCounters *c = slot_counters(stats, worker);
+    COUNTER_ADD(c->dirs, 1);
+    COUNTER_ADD(c->entries, entries);
+}
+
+void scan_stats_stat(ScanStats *stats, int worker, uint64_t calls, uint64_t start_ns) {
+    if (!stats) return;
+    ScanCounters *c = slot_counters(stats, worker);
+    COUNTER_ADD(c->stat_calls, calls);
+    COUNTER_ADD(c->stat_ns, monotonic_ns() - start_ns);
+}
+
+void scan_stats_read(ScanStats *stats, int worker, uint64_t bytes, uint64_t start_ns) {
+    if (!stats) return;
+    ScanCounters *c = slot_counters(stats, worker);
+    COUNTER_ADD(c->read_bytes, bytes);
+    COUNTER_ADD(c->read_ns, monotonic_ns() - start_ns);
+}
+
+void scan_stats_hash(ScanStats *stats, int worker, uint64_t bytes, uint64_t start_ns) {
+    if (!stats) return;
+    ScanCounters *c = slot_counters(stats, worker);
+    COUNTER_ADD(c->hash_bytes, bytes);
+    COUNTER_ADD(c->hash_ns, monotonic_ns() - start_ns);
+}
+
+void scan_stats_file_hashed(ScanStats *stats, int worker) {
+    if (!stats) return;
+    COUNTER_ADD(slot_counters(stats, worker)->hashed_files, 1);
+}
+
+void scan_stats_queue(ScanStats *stats, long pending) {
+    if (!stats) return;
+    __atomic_store_n(&stats->queue, pending, __ATOMIC_RELAXED);
+    long max = __atomic_load_n(&stats->queue_max, __ATOMIC_RELAXED);
+    while (pending > max && !__atomic_compare_exchange_n(&stats->queue_max, &max, pending, 1,
+                                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void scan_stats_sum(ScanStats *stats, ScanCounters *total) {
+    memset(total, 0, sizeof(*total));
+    for (int i = 0; i < SCAN_STATS_SLOTS; i++) {
+        const ScanCounters *c = &stats->slots[i].c;
+        total->dirs += __atomic_load_n(&c->dirs, __ATOMIC_RELAXED);
+        total->entries += __atomic_load_n(&c->entries, __ATOMIC_RELAXED);
+        total->stat_calls += __atomic_load_n(&c->stat_calls, __ATOMIC_RELAXED);
+        total->stat_ns += __atomic_load_n(&c->stat_ns, __ATOMIC_RELAXED);
+        total->read_bytes += __atomic_load_n(&c->read_bytes, __ATOMIC_RELAXED);
+        total->read_ns += __atomic_load_n(&c->read_ns, __ATOMIC_RELAXED);
+        total->hash_bytes += __atomic_load_n(&c->hash_bytes, __ATOMIC_RELAXED);
+        total->hash_ns += __atomic_load_n(&c->hash_ns, __ATOMIC_RELAXED);
+        total->hashed_files += __atomic_load_n(&c->hashed_files, __ATOMIC_RELAXED);
+    }
+}
+
+static double per_second(uint64_t amount, uint64_t ns) {
+    return ns ? amount * 1e9 / (double)ns : 0.0;
+}
+
+static void format_count(double value, char *buffer, size_t buffer_size) {
+    if (value >= 1e6) {
+        snprintf(buffer, buffer_size, "%.1fM", value / 1e6);
+    } else if (value >= 1e3) {
+        snprintf(buffer, buffer_size, "%.1fk", value / 1e3);
+    } else {
+        snprintf(buffer, buffer_size, "%.0f", value);
+    }
+}
+
+// One progress line and JSON sample covering the interval since the last one
+static void scan_stats_sample(ScanStats *stats) {
+    ScanCounters now;
+    scan_stats_sum(stats, &now);
+    uint64_t t = monotonic_ns();
+    uint64_t dt = t - stats->last_ns;
+    const ScanCounters *prev = &stats->last;
+    const char *stage = __atomic_load_n(&stats->stage, __ATOMIC_ACQUIRE);
+    long queue = __atomic_load_n(&stats->queue, __ATOMIC_RELAXED);
+    
+    double entries_rate = per_second(now.entries - prev->entries, dt);
+    double read_rate = per_second(now.read_bytes - prev->read_bytes, dt);
+    double hash_rate = per_second(now.hash_bytes - prev->hash_bytes, now.hash_ns - prev->hash_ns);
+    uint64_t stat_calls = now.stat_calls - prev->stat_calls;
+    double stat_us = stat_calls ? (now.stat_ns - prev->stat_ns) / 1e3 / stat_calls : 0.0;
+    
+    if (stats->progress) {
+        char entries_str[32], rate_str[32], read_str[50], read_rate_str[50], hash_rate_str[50];
+        format_count((double)now.entries, entries_str, sizeof(entries_str));
+        format_count(entries_rate, rate_str, sizeof(rate_str));
+        format_size(now.read_bytes, read_str, sizeof(read_str));
+        format_size((unsigned long long)read_rate, read_rate_str, sizeof(read_rate_str));
+        format_size((unsigned long long)hash_rate, hash_rate_str, sizeof(hash_rate_str));
+        fprintf(stderr, "%s[%s %.1fs] %s entries (%s/s), queue %ld, stat %.1f us | "
+                "read %s (%s/s), hash %s/s%s",
+                stats->tty ? "\r" : "", stage ? stage : "-", (t - stats->start_ns) / 1e9,
+                entries_str, rate_str, queue, stat_us, read_str, read_rate_str, hash_rate_str,
+                stats->tty ? "\033[K" : "\n");
+        fflush(stderr);
+    }
+    if (stats->json) {
+        fprintf(stats->json, "{\"type\":\"sample\",\"t\":%.3f,\"stage\":\"%s\",\"entries\":%llu,"
+                "\"entries_per_s\":%.1f,\"dirs\":%llu,\"queue\":%ld,\"stat_calls\":%llu,"
+                "\"stat_avg_us\":%.3f,\"read_bytes\":%llu,\"read_bytes_per_s\":%.1f,"
+                "\"hashed_files\":%llu,\"hashed_bytes\":%llu,\"hash_bytes_per_s\":%.1f}\n",
+                (t - stats->start_ns) / 1e9, stage ? stage : "", (unsigned long long)now.entries,
+                entries_rate, (unsigned long long)now.dirs, queue, (unsigned long long)now.stat_calls,
+                stat_us, (unsigned long long)now.read_bytes, read_rate,
+                (unsigned long long)now.hashed_files, (unsigned long long)now.hash_bytes, hash_rate);
+        fflush(stats->json);
+    }
+    
+    stats->last = now;
+    stats->last_ns = t;
+}
+
+static void* scan_stats_reporter(void *arg) {
+    ScanStats *stats = arg;
+    pthread_mutex_lock(&stats->lock);
+    while (!stats->stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += SCAN_STATS_INTERVAL_NS / 1000000000ULL;
+        pthread_cond_timedwait(&stats->cond, &stats->lock, &deadline);
+        if (stats->stop) break;
+        pthread_mutex_unlock(&stats->lock);
+        scan_stats_sample(stats);
+        pthread_mutex_lock(&stats->lock);
+    }
+    pthread_mutex_unlock(&stats->lock);
+    return NULL;
+}
+
+static void scan_stats_end_stage(ScanStats *stats, uint64_t t) {
+    if (!stats->stage) return;
+    for (int i = 0; i < stats->stage_count; i++) {
+        if (strcmp(stats->stages[i].name, stats->stage) == 0) {
+            stats->stages[i].ns += t - stats->stage_start_ns;
+            return;
+        }
+    }
+    if (stats->stage_count == SCAN_STATS_MAX_STAGES) return;
+    stats->stages[stats->stage_count].name = stats->stage;
+    stats->stages[stats->stage_count].ns = t - stats->stage_start_ns;
+    stats->stage_count++;
+}
+
+void scan_stats_stage(ScanStats *stats, const char *name) {
+    if (!stats) return;
+    uint64_t t = monotonic_ns();
+    scan_stats_end_stage(stats, t);
+    __atomic_store_n(&stats->stage, name, __ATOMIC_RELEASE);
+    stats->stage_start_ns = t;
+    
+    if (!stats->running && !stats->stop) {
+        stats->start_ns = stats->last_ns = t;
+        stats->running = pthread_create(&stats->thread, NULL, scan_stats_reporter, stats) == 0;
+    }
+}
+
+// Which of the timed costs dominates, summed over all threads
+static const char* scan_stats_bound(const ScanCounters *c) {
+    if (c->stat_ns + c->read_ns + c->hash_ns == 0) return "unknown";
+    if (c->stat_ns >= c->read_ns && c->stat_ns >= c->hash_ns) return "metadata";
+    return c->read_ns >= c->hash_ns ? "bandwidth" : "cpu";
+}
+
+void scan_stats_finish(ScanStats *stats) {
+    if (!stats || stats->stop) return;
+    uint64_t t = monotonic_ns();
+    if (!stats->start_ns) stats->start_ns = t;
+    scan_stats_end_stage(stats, t);
+    __atomic_store_n(&stats->stage, NULL, __ATOMIC_RELEASE);
+    
+    pthread_mutex_lock(&stats->lock);
+    stats->stop = 1;
+    pthread_cond_signal(&stats->cond);
+    pthread_mutex_unlock(&stats->lock);
+    if (stats->running) pthread_join(stats->thread, NULL);
+    stats->running = 0;
+    if (stats->tty) fprintf(stderr, "\r\033[K");
+    
+    ScanCounters c;
+    scan_stats_sum(stats, &c);
+    double elapsed = (t - stats->start_ns) / 1e9;
+    double stat_us = c.stat_calls ? c.stat_ns / 1e3 / c.stat_calls : 0.0;
+    const char *bound = scan_stats_bound(&c);
+    
+    if (stats->progress) {
+        char entries_rate[32], read_str[50], read_rate[50], hash_str[50], hash_rate[50];
+        format_count(per_second(c.entries, t - stats->start_ns), entries_rate, sizeof(entries_rate));
+        format_size(c.read_bytes, read_str, sizeof(read_str));
+        format_size((unsigned long long)per_second(c.read_bytes, c.read_ns), read_rate, sizeof(read_rate));
+        format_size(c.hash_bytes, hash_str, sizeof(hash_str));
+        format_size((unsigned long long)per_second(c.hash_bytes, c.hash_ns), hash_rate, sizeof(hash_rate));
+        
+        fprintf(stderr, "Scan metrics (%.3f s):\n", elapsed);
+        for (int i = 0; i < stats->stage_count; i++) {
+            fprintf(stderr, "  %-14s %9.3f s  %5.1f%%\n", stats->stages[i].name, stats->stages[i].ns / 1e9,
+                    elapsed > 0 ? stats->stages[i].ns / 1e9 / elapsed * 100 : 0.0);
+        }
+        fprintf(stderr, "  entries: %llu in %llu directories (%s/s), peak queue %ld\n",
+                (unsigned long long)c.entries, (unsigned long long)c.dirs, entries_rate, stats->queue_max);
+        fprintf(stderr, "  stat: %llu calls, %.2f us average, %.3f s total\n",
+                (unsigned long long)c.stat_calls, stat_us, c.stat_ns / 1e9);
+        fprintf(stderr, "  read: %s in %.3f s (%s/s)\n", read_str, c.read_ns / 1e9, read_rate);
+        fprintf(stderr, "  hash: %s over %llu files in %.3f s (%s/s)\n", hash_str,
+                (unsigned long long)c.hashed_files, c.hash_ns / 1e9, hash_rate);
+        fprintf(stderr, "  mostly bound by: %s\n", bound);
+    }
+    if (stats->json) {
+        fprintf(stats->json, "{\"type\":\"summary\",\"elapsed_s\":%.3f,\"stages\":[", elapsed);
+        for (int i = 0; i < stats->stage_count; i++) {
+            fprintf(stats->json, "%s{\"name\":\"%s\",\"seconds\":%.6f}", i ? "," : "",
+                    stats->stages[i].name, stats->stages[i].ns / 1e9);
+        }
+        fprintf(stats->json, "],\"entries\":%llu,\"dirs\":%llu,\"queue_max\":%ld,\"stat_calls\":%llu,"
+                "\"stat_seconds\":%.6f,\"read_bytes\":%llu,\"read_seconds\":%.6f,\"hashed_files\":%llu,"
+                "\"hashed_bytes\":%llu,\"hash_seconds\":%.6f,\"bound\":\"%s\"}\n",
+                (unsigned long long)c.entries, (unsigned long long)c.dirs, stats->queue_max,
+                (unsigned long long)c.stat_calls, c.stat_ns / 1e9, (unsigned long long)c.read_bytes,
+                c.read_ns / 1e9, (unsigned long long)c.hashed_files, (unsigned long long)c.hash_bytes,
+                c.hash_ns / 1e9, bound);
+        fflush(stats->json);
+    }
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef SCANSTATS_H
+#define SCANSTATS_H
+
+#include <stdint.h>
+
+// Live metrics for the scanners: entries/s, stat latency, directory queue
+// depth, read and hash throughput and time per pipeline stage. Counters are
+// kept per walker worker (each on its own cache line) and summed by a
+// reporter thread once a second, which prints a progress line to stderr
+// and/or appends a JSON sample to a file. Every function accepts a NULL
+// ScanStats and then does nothing, so call sites need no checks.
+
+typedef struct ScanStats ScanStats;
+
+// progress: live line and final summary on stderr. json_path: one JSON
+// object per line, a "sample" each second and a final "summary". Returns
+// NULL (after printing why) if the file can't be created.
+ScanStats* scan_stats_new(int progress, const char *json_path);
+void scan_stats_free(ScanStats *stats);
+
+// Start a named pipeline stage, ending the previous one. The first stage
+// starts the reporter. name must be a string literal.
+void scan_stats_stage(ScanStats *stats, const char *name);
+
+// End the last stage, stop the reporter and emit the summary
+void scan_stats_finish(ScanStats *stats);
+
+// Monotonic nanoseconds, or 0 when stats is NULL (so timing is skipped)
+uint64_t scan_stats_now(const ScanStats *stats);
+
+// Hot-path counters; worker is the walker worker index (0 outside walks)
+void scan_stats_dir(ScanStats *stats, int worker, uint64_t entries);
+void scan_stats_stat(ScanStats *stats, int worker, uint64_t calls, uint64_t start_ns);
+void scan_stats_read(ScanStats *stats, int worker, uint64_t bytes, uint64_t start_ns);
+void scan_stats_hash(ScanStats *stats, int worker, uint64_t bytes, uint64_t start_ns);
+void scan_stats_file_hashed(ScanStats *stats, int worker);
+
+// Directories queued or being read, as seen by the walker
+void scan_stats_queue(ScanStats *stats, long pending);
+
+#endif
@@ -0,0 +1,397 @@
+#include "sha.h"
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SHA_HAVE_SHANI 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_SHA2)
+// Only when the compiler targets the crypto extensions (Apple silicon,
+// -march=armv8-a+crypto or native), so no runtime check is needed
+#include <arm_neon.h>
+#define SHA_HAVE_ARMV8 1
+#endif
+
+static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint64_t K512[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+    0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+    0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+    0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+    0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+    0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+    0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+    0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+    0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+    0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+    0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+    0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+};
+
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+static uint32_t load_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t load_be64(const uint8_t *p) {
+    return ((uint64_t)load_be32(p) << 32) | load_be32(p + 4);
+}
+
+// Portable kernels. The message schedule is kept in a 16-word ring.
+
+static void sha1_blocks_scalar(uint32_t state[5], const uint8_t *data, size_t count) {
+    for (; count; count--, data += 64) {
+        uint32_t w[16];
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+        
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 16) {
+                w[i] = load_be32(data + 4 * i);
+            } else {
+                uint32_t x = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15];
+                w[i & 15] = ROTL32(x, 1);
+            }
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+            uint32_t t = ROTL32(a, 5) + f + e + k + w[i & 15];
+            e = d;
+            d = c;
+            c = ROTL32(b, 30);
+            b = a;
+            a = t;
+        }
+        
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+static void sha256_blocks_scalar(uint32_t state[8], const uint8_t *data, size_t count) {
+    for (; count; count--, data += 64) {
+        uint32_t w[16];
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        
+        for (int i = 0; i < 64; i++) {
+            if (i < 16) {
+                w[i] = load_be32(data + 4 * i);
+            } else {
+                uint32_t w15 = w[(i + 1) & 15], w2 = w[(i + 14) & 15];
+                uint32_t s0 = ROTR32(w15, 7) ^ ROTR32(w15, 18) ^ (w15 >> 3);
+                uint32_t s1 = ROTR32(w2, 17) ^ ROTR32(w2, 19) ^ (w2 >> 10);
+                w[i & 15] += s0 + w[(i + 9) & 15] + s1;
+            }
+            uint32_t t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) +
+                          K256[i] + w[i & 15];
+            uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+static void sha512_blocks_scalar(uint64_t state[8], const uint8_t *data, size_t count) {
+    for (; count; count--, data += 128) {
+        uint64_t w[16];
+        uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+        
+        for (int i = 0; i < 80; i++) {
+            if (i < 16) {
+                w[i] = load_be64(data + 8 * i);
+            } else {
+                uint64_t w15 = w[(i + 1) & 15], w2 = w[(i + 14) & 15];
+                uint64_t s0 = ROTR64(w15, 1) ^ ROTR64(w15, 8) ^ (w15 >> 7);
+                uint64_t s1 = ROTR64(w2, 19) ^ ROTR64(w2, 61) ^ (w2 >> 6);
+                w[i & 15] += s0 + w[(i + 9) & 15] + s1;
+            }
+            uint64_t t1 = h + (ROTR64(e, 14) ^ ROTR64(e, 18) ^ ROTR64(e, 41)) + ((e & f) ^ (~e & g)) +
+                          K512[i] + w[i & 15];
+            uint64_t t2 = (ROTR64(a, 28) ^ ROTR64(a, 34) ^ ROTR64(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef SHA_HAVE_SHANI
+// SHA-NI: sha1rnds4 / sha256rnds2 run four (two) rounds per instruction and
+// sha*msg1/msg2 extend the message schedule four words at a time. The
+// message words of the last four groups live in m[0..3]; the macros are
+// expanded with constant group numbers, so the array stays in registers.
+
+// Rounds 4g..4g+3 of SHA-1, using round function fn (0-3)
+#define SHA1_GROUP(g, fn) do { \
+    if ((g) == 0) { \
+        e[0] = _mm_add_epi32(e[0], m[0]); \
+    } else { \
+        if ((g) < 4) m[(g) & 3] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * (g))), bswap); \
+        e[(g) & 1] = _mm_sha1nexte_epu32(e[(g) & 1], m[(g) & 3]); \
+    } \
+    e[((g) + 1) & 1] = abcd; \
+    if ((g) >= 3 && (g) <= 18) m[((g) + 1) & 3] = _mm_sha1msg2_epu32(m[((g) + 1) & 3], m[(g) & 3]); \
+    abcd = _mm_sha1rnds4_epu32(abcd, e[(g) & 1], fn); \
+    if ((g) >= 1 && (g) <= 16) m[((g) + 3) & 3] = _mm_sha1msg1_epu32(m[((g) + 3) & 3], m[(g) & 3]); \
+    if ((g) >= 2 && (g) <= 17) m[((g) + 2) & 3] = _mm_xor_si128(m[((g) + 2) & 3], m[(g) & 3]); \
+} while (0)
+
+__attribute__((target("sha,sse4.1")))
+static void sha1_blocks_shani(uint32_t state[5], const uint8_t *data, size_t count) {
+    const __m128i bswap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1b);
+    __m128i e_saved = _mm_set_epi32((int)state[4], 0, 0, 0);
+    
+    for (; count; count--, data += 64) {
+        __m128i abcd_saved = abcd;
+        __m128i m[4], e[2];
+        e[0] = e_saved;
+        m[0] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), bswap);
+        
+        SHA1_GROUP(0, 0);  SHA1_GROUP(1, 0);  SHA1_GROUP(2, 0);  SHA1_GROUP(3, 0);
+        SHA1_GROUP(4, 0);  SHA1_GROUP(5, 1);  SHA1_GROUP(6, 1);  SHA1_GROUP(7, 1);
+        SHA1_GROUP(8, 1);  SHA1_GROUP(9, 1);  SHA1_GROUP(10, 2); SHA1_GROUP(11, 2);
+        SHA1_GROUP(12, 2); SHA1_GROUP(13, 2); SHA1_GROUP(14, 2); SHA1_GROUP(15, 3);
+        SHA1_GROUP(16, 3); SHA1_GROUP(17, 3); SHA1_GROUP(18, 3); SHA1_GROUP(19, 3);
+        
+        e_saved = _mm_sha1nexte_epu32(e[0], e_saved);
+        abcd = _mm_add_epi32(abcd, abcd_saved);
+    }
+    
+    _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = (uint32_t)_mm_extract_epi32(e_saved, 3);
+}
+
+// Rounds 4g..4g+3 of SHA-256
+#define SHA256_GROUP(g) do { \
+    if ((g) < 4) { \
+        m[(g) & 3] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * (g))), bswap); \
+    } else { \
+        __m128i w = _mm_add_epi32(_mm_sha256msg1_epu32(m[(g) & 3], m[((g) + 1) & 3]), \
+                                  _mm_alignr_epi8(m[((g) + 3) & 3], m[((g) + 2) & 3], 4)); \
+        m[(g) & 3] = _mm_sha256msg2_epu32(w, m[((g) + 3) & 3]); \
+    } \
+    __m128i wk = _mm_add_epi32(m[(g) & 3], _mm_loadu_si128((const __m128i *)&K256[4 * (g)])); \
+    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk); \
+    abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0e)); \
+} while (0)
+
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani(uint32_t state[8], const uint8_t *data, size_t count) {
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+    // The instructions want the state as ABEF and CDGH
+    __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xb1);
+    __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1b);
+    __m128i abef = _mm_alignr_epi8(dcba, efgh, 8);
+    __m128i cdgh = _mm_blend_epi16(efgh, dcba, 0xf0);
+    
+    for (; count; count--, data += 64) {
+        __m128i abef_saved = abef, cdgh_saved = cdgh;
+        __m128i m[4];
+        
+        SHA256_GROUP(0);  SHA256_GROUP(1);  SHA256_GROUP(2);  SHA256_GROUP(3);
+        SHA256_GROUP(4);  SHA256_GROUP(5);  SHA256_GROUP(6);  SHA256_GROUP(7);
+        SHA256_GROUP(8);  SHA256_GROUP(9);  SHA256_GROUP(10); SHA256_GROUP(11);
+        SHA256_GROUP(12); SHA256_GROUP(13); SHA256_GROUP(14); SHA256_GROUP(15);
+        
+        abef = _mm_add_epi32(abef, abef_saved);
+        cdgh = _mm_add_epi32(cdgh, cdgh_saved);
+    }
+    
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(feba, dchg, 0xf0));
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(dchg, feba, 8));
+}
+
+static int sha_cpu_has_shani(void) {
+    return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+}
+#endif
+
+#ifdef SHA_HAVE_ARMV8
+// ARMv8 crypto extensions: sha1c/p/m and sha256h/h2 run four rounds each,
+// sha*su0/su1 extend the schedule. State is kept in natural order.
+
+static uint32x4_t sha_load_be(const uint8_t *p) {
+    return vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(p)));
+}
+
+static void sha1_blocks_armv8(uint32_t state[5], const uint8_t *data, size_t count) {
+    static const uint32_t k[4] = { 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6 };
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32_t e0 = state[4];
+    
+    for (; count; count--, data += 64) {
+        uint32x4_t abcd_saved = abcd;
+        uint32x4_t m[4];
+        uint32_t e = e0;
+        
+        for (int g = 0; g < 20; g++) {
+            if (g < 4) {
+                m[g] = sha_load_be(data + 16 * g);
+            } else {
+                uint32x4_t w = vsha1su0q_u32(m[g & 3], m[(g + 1) & 3], m[(g + 2) & 3]);
+                m[g & 3] = vsha1su1q_u32(w, m[(g + 3) & 3]);
+            }
+            uint32x4_t wk = vaddq_u32(m[g & 3], vdupq_n_u32(k[g / 5]));
+            uint32_t e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+            if (g < 5) {
+                abcd = vsha1cq_u32(abcd, e, wk);
+            } else if (g >= 10 && g < 15) {
+                abcd = vsha1mq_u32(abcd, e, wk);
+            } else {
+                abcd = vsha1pq_u32(abcd, e, wk);
+            }
+            e = e_next;
+        }
+        
+        abcd = vaddq_u32(abcd, abcd_saved);
+        e0 += e;
+    }
+    
+    vst1q_u32(state, abcd);
+    state[4] = e0;
+}
+
+static void sha256_blocks_armv8(uint32_t state[8], const uint8_t *data, size_t count) {
+    uint32x4_t abcd = vld1q_u32(&state[0]);
+    uint32x4_t efgh = vld1q_u32(&state[4]);
+    
+    for (; count; count--, data += 64) {
+        uint32x4_t abcd_saved = abcd, efgh_saved = efgh;
+        uint32x4_t m[4];
+        
+        for (int g = 0; g < 16; g++) {
+            if (g < 4) {
+                m[g] = sha_load_be(data + 16 * g);
+            } else {
+                uint32x4_t w = vsha256su0q_u32(m[g & 3], m[(g + 1) & 3]);
+                m[g & 3] = vsha256su1q_u32(w, m[(g + 2) & 3], m[(g + 3) & 3]);
+            }
+            uint32x4_t wk = vaddq_u32(m[g & 3], vld1q_u32(&K256[4 * g]));
+            uint32x4_t abcd_prev = abcd;
+            abcd = vsha256hq_u32(abcd, efgh, wk);
+            efgh = vsha256h2q_u32(efgh, abcd_prev, wk);
+        }
+        
+        abcd = vaddq_u32(abcd, abcd_saved);
+        efgh = vaddq_u32(efgh, efgh_saved);
+    }
+    
+    vst1q_u32(&state[0], abcd);
+    vst1q_u32(&state[4], efgh);
+}
+#endif
+
+void sha1_blocks(uint32_t state[5], const uint8_t *data, size_t count) {
+#if defined(SHA_HAVE_SHANI)
+    if (sha_cpu_has_shani()) {
+        sha1_blocks_shani(state, data, count);
+        return;
+    }
+#elif defined(SHA_HAVE_ARMV8)
+    sha1_blocks_armv8(state, data, count);
+    return;
+#endif
+    sha1_blocks_scalar(state, data, count);
+}
+
+void sha256_blocks(uint32_t state[8], const uint8_t *data, size_t count) {
+#if defined(SHA_HAVE_SHANI)
+    if (sha_cpu_has_shani()) {
+        sha256_blocks_shani(state, data, count);
+        return;
+    }
+#elif defined(SHA_HAVE_ARMV8)
+    sha256_blocks_armv8(state, data, count);
+    return;
+#endif
+    sha256_blocks_scalar(state, data, count);
+}
+
+// Neither SHA-NI nor the base ARMv8 crypto extensions cover SHA-512
+void sha512_blocks(uint64_t state[8], const uint8_t *data, size_t count) {
+    sha512_blocks_scalar(state, data, count);
+}
+
+const char* sha1_impl(void) {
+#if defined(SHA_HAVE_SHANI)
+    if (sha_cpu_has_shani()) return "sha-ni";
+#elif defined(SHA_HAVE_ARMV8)
+    return "armv8";
+#endif
+    return "scalar";
+}
+
+const char* sha256_impl(void) {
+    return sha1_impl();
+}
+
+const char* sha512_impl(void) {
+    return "scalar";
+}
@@ -0,0 +1,21 @@
+#ifndef SHA_H
+#define SHA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SHA-1, SHA-256 and SHA-512 compression functions (FIPS 180-4). Each call
+// runs count whole blocks (64 bytes, 128 for SHA-512) through state;
+// buffering and padding are left to the streaming API in hash.h. The SHA
+// instructions (x86 SHA-NI, ARMv8 crypto extensions) are used when present.
+
+void sha1_blocks(uint32_t state[5], const uint8_t *data, size_t count);
+void sha256_blocks(uint32_t state[8], const uint8_t *data, size_t count);
+void sha512_blocks(uint64_t state[8], const uint8_t *data, size_t count);
+
+// Name of the kernel in use ("sha-ni", "armv8" or "scalar")
+const char* sha1_impl(void);
+const char* sha256_impl(void);
+const char* sha512_impl(void);
+
+#endif
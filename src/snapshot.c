@@ -0,0 +1,568 @@
+#include "snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "arena.h"
+#include "hash.h"
+#include "filetools.h"
+
+// On-disk layout. Integers are LEB128 varints, so the file is the same on
+// every platform and small numbers stay small:
+//   magic, then version, flags, creation time (unix seconds), file count,
+//   total bytes, root path length and the root path (absolute)
+//   per file, sorted by path in byte order: length of the prefix shared
+//   with the previous path, length of the rest, the rest, size, and the
+//   mtime as a zigzag-encoded offset from the creation time
+#define SNAPSHOT_MAGIC "CAFSNAP\n"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_ALLOCATED (1u << 0)    // sizes are st_blocks * 512
+#define SNAPSHOT_IO_BUFFER (1024 * 1024)
+
+typedef struct SnapshotEntry {
+    const char *path;               // relative to the root
+    uint64_t size;
+    int64_t mtime;
+} SnapshotEntry;
+
+typedef struct SnapshotWorker {
+    Arena arena;
+    SnapshotEntry *items;
+    size_t count;
+    size_t capacity;
+    int failed;
+} SnapshotWorker;
+
+struct Snapshot {
+    char *root;                     // as given to the walker
+    size_t root_len;
+    int allocated;
+    int jobs;
+    SnapshotWorker *workers;
+};
+
+Snapshot* snapshot_new(const char *root, int jobs, int allocated) {
+    Snapshot *snap = calloc(1, sizeof(Snapshot));
+    if (!snap) return NULL;
+    snap->root = strdup(root);
+    snap->root_len = strlen(root);
+    snap->allocated = allocated;
+    snap->jobs = jobs > 0 ? jobs : 1;
+    snap->workers = calloc((size_t)snap->jobs, sizeof(SnapshotWorker));
+    if (!snap->root || !snap->workers) {
+        snapshot_free(snap);
+        return NULL;
+    }
+    for (int i = 0; i < snap->jobs; i++) arena_init(&snap->workers[i].arena);
+    return snap;
+}
+
+void snapshot_free(Snapshot *snap) {
+    if (!snap) return;
+    for (int i = 0; snap->workers && i < snap->jobs; i++) {
+        arena_free(&snap->workers[i].arena);
+        free(snap->workers[i].items);
+    }
+    free(snap->workers);
+    free(snap->root);
+    free(snap);
+}
+
+void snapshot_add(Snapshot *snap, int worker, const char *path, uint64_t size, int64_t mtime) {
+    if (!snap || worker < 0 || worker >= snap->jobs) return;
+    SnapshotWorker *w = &snap->workers[worker];
+    if (w->count == w->capacity) {
+        size_t new_cap = w->capacity ? w->capacity * 2 : 1024;
+        SnapshotEntry *items = realloc(w->items, new_cap * sizeof(SnapshotEntry));
+        if (!items) {
+            w->failed = 1;
+            return;
+        }
+        w->items = items;
+        w->capacity = new_cap;
+    }
+    
+    const char *rel = path;
+    if (strncmp(path, snap->root, snap->root_len) == 0) {
+        rel = path + snap->root_len;
+        if (*rel == '/') rel++;
+    }
+    SnapshotEntry *entry = &w->items[w->count];
+    entry->path = arena_strndup(&w->arena, rel, strlen(rel));
+    if (!entry->path) {
+        w->failed = 1;
+        return;
+    }
+    entry->size = size;
+    entry->mtime = mtime;
+    w->count++;
+}
+
+static void put_varint(FILE *out, uint64_t value) {
+    while (value >= 0x80) {
+        putc((int)(value & 0x7f) | 0x80, out);
+        value >>= 7;
+    }
+    putc((int)value, out);
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static int compare_snapshot_entries(const void *a, const void *b) {
+    const SnapshotEntry *ea = *(const SnapshotEntry * const *)a;
+    const SnapshotEntry *eb = *(const SnapshotEntry * const *)b;
+    return strcmp(ea->path, eb->path);
+}
+
+int snapshot_write(Snapshot *snap, const char *file) {
+    size_t count = 0;
+    for (int i = 0; i < snap->jobs; i++) {
+        if (snap->workers[i].failed) {
+            fprintf(stderr, "Out of memory while recording the snapshot\n");
+            return -1;
+        }
+        count += snap->workers[i].count;
+    }
+    
+    SnapshotEntry **entries = malloc((count ? count : 1) * sizeof(SnapshotEntry*));
+    size_t tmp_len = strlen(file) + 8;
+    char *tmp = malloc(tmp_len);
+    if (!entries || !tmp) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(entries);
+        free(tmp);
+        return -1;
+    }
+    count = 0;
+    uint64_t total = 0;
+    for (int i = 0; i < snap->jobs; i++) {
+        for (size_t k = 0; k < snap->workers[i].count; k++) {
+            entries[count++] = &snap->workers[i].items[k];
+            total += snap->workers[i].items[k].size;
+        }
+    }
+    qsort(entries, count, sizeof(SnapshotEntry*), compare_snapshot_entries);
+    
+    snprintf(tmp, tmp_len, "%s.tmp", file);
+    FILE *out = fopen(tmp, "wb");
+    if (!out) {
+        fprintf(stderr, "Cannot create snapshot %s\n", tmp);
+        free(entries);
+        free(tmp);
+        return -1;
+    }
+    setvbuf(out, NULL, _IOFBF, SNAPSHOT_IO_BUFFER);
+    
+    // The header names the root by its absolute path
+#ifdef _WIN32
+    char *root = _fullpath(NULL, snap->root, 0);
+#else
+    char *root = realpath(snap->root, NULL);
+#endif
+    const char *root_name = root ? root : snap->root;
+    int64_t created = (int64_t)time(NULL);
+    fwrite(SNAPSHOT_MAGIC, 1, 8, out);
+    put_varint(out, SNAPSHOT_VERSION);
+    put_varint(out, snap->allocated ? SNAPSHOT_ALLOCATED : 0);
+    put_varint(out, (uint64_t)created);
+    put_varint(out, count);
+    put_varint(out, total);
+    put_varint(out, strlen(root_name));
+    fwrite(root_name, 1, strlen(root_name), out);
+    free(root);
+    
+    const char *prev = "";
+    for (size_t i = 0; i < count; i++) {
+        const char *path = entries[i]->path;
+        size_t shared = 0;
+        while (prev[shared] && prev[shared] == path[shared]) shared++;
+        size_t rest = strlen(path + shared);
+        put_varint(out, shared);
+        put_varint(out, rest);
+        fwrite(path + shared, 1, rest, out);
+        put_varint(out, entries[i]->size);
+        put_varint(out, zigzag(created - entries[i]->mtime));
+        prev = path;
+    }
+    free(entries);
+    
+    int failed = ferror(out);
+    if (fclose(out) != 0) failed = 1;
+#ifdef _WIN32
+    if (!failed) remove(file);
+#endif
+    if (failed || rename(tmp, file) != 0) {
+        fprintf(stderr, "Failed to write snapshot %s\n", file);
+        remove(tmp);
+        free(tmp);
+        return -1;
+    }
+    free(tmp);
+    printf("Snapshot of %zu files written to %s\n", count, file);
+    return 0;
+}
+
+// Sequential reader: one decoded record at a time, the current path kept
+// in a buffer that the next record's shared prefix is taken from
+typedef struct SnapshotReader {
+    const char *file;
+    FILE *in;
+    char *root;
+    int allocated;
+    int64_t created;
+    uint64_t count;
+    uint64_t total;
+    uint64_t remaining;
+    char *path;
+    size_t path_len;
+    size_t path_cap;
+    uint64_t size;
+    int64_t mtime;
+} SnapshotReader;
+
+static int get_varint(FILE *in, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = getc(in);
+        if (c == EOF) return -1;
+        result |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int reader_path_reserve(SnapshotReader *r, size_t len) {
+    if (len + 1 <= r->path_cap) return 0;
+    size_t cap = r->path_cap ? r->path_cap : 256;
+    while (cap < len + 1) cap *= 2;
+    char *path = realloc(r->path, cap);
+    if (!path) return -1;
+    r->path = path;
+    r->path_cap = cap;
+    return 0;
+}
+
+static void reader_close(SnapshotReader *r) {
+    if (r->in) fclose(r->in);
+    free(r->root);
+    free(r->path);
+    memset(r, 0, sizeof(*r));
+}
+
+static int reader_open(SnapshotReader *r, const char *file) {
+    memset(r, 0, sizeof(*r));
+    r->file = file;
+    r->in = fopen(file, "rb");
+    if (!r->in) {
+        fprintf(stderr, "Cannot open snapshot %s\n", file);
+        return -1;
+    }
+    setvbuf(r->in, NULL, _IOFBF, SNAPSHOT_IO_BUFFER);
+    
+    char magic[8];
+    uint64_t version, flags, created, root_len;
+    const char *reason = NULL;
+    if (fread(magic, 1, 8, r->in) != 8 || memcmp(magic, SNAPSHOT_MAGIC, 8) != 0) {
+        reason = "not a snapshot";
+    } else if (get_varint(r->in, &version) != 0 || version != SNAPSHOT_VERSION) {
+        reason = "different format version";
+    } else if (get_varint(r->in, &flags) != 0 || get_varint(r->in, &created) != 0 ||
+               get_varint(r->in, &r->count) != 0 || get_varint(r->in, &r->total) != 0 ||
+               get_varint(r->in, &root_len) != 0 || root_len > 65536 ||
+               !(r->root = malloc((size_t)root_len + 1)) ||
+               fread(r->root, 1, (size_t)root_len, r->in) != root_len) {
+        reason = "truncated";
+    }
+    if (reason) {
+        fprintf(stderr, "Cannot read snapshot %s (%s)\n", file, reason);
+        reader_close(r);
+        return -1;
+    }
+    r->root[root_len] = '\0';
+    r->allocated = (flags & SNAPSHOT_ALLOCATED) != 0;
+    r->created = (int64_t)created;
+    r->remaining = r->count;
+    if (reader_path_reserve(r, 0) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        reader_close(r);
+        return -1;
+    }
+    return 0;
+}
+
+// 1 with the next record in r, 0 at the end, -1 (reported) if corrupt
+static int reader_next(SnapshotReader *r) {
+    if (r->remaining == 0) return 0;
+    uint64_t shared, rest, mtime;
+    if (get_varint(r->in, &shared) != 0 || get_varint(r->in, &rest) != 0 ||
+        shared > r->path_len || rest > 65536 || reader_path_reserve(r, (size_t)(shared + rest)) != 0 ||
+        fread(r->path + shared, 1, (size_t)rest, r->in) != rest ||
+        get_varint(r->in, &r->size) != 0 || get_varint(r->in, &mtime) != 0) {
+        fprintf(stderr, "Snapshot %s is truncated or corrupt\n", r->file);
+        return -1;
+    }
+    r->path_len = (size_t)(shared + rest);
+    r->path[r->path_len] = '\0';
+    r->mtime = r->created - unzigzag(mtime);
+    r->remaining--;
+    return 1;
+}
+
+// Per-directory totals for the growth report, keyed by the path prefix of
+// the file's directory cut at the report depth ("." for the root itself)
+typedef struct DiffDir {
+    const char *path;
+    uint64_t hash;
+    unsigned long long old_bytes;
+    unsigned long long new_bytes;
+} DiffDir;
+
+typedef struct DiffDirs {
+    DiffDir *slots;
+    size_t mask;
+    size_t count;
+    Arena arena;
+    DiffDir *last;                  // records arrive sorted, so mostly a repeat
+} DiffDirs;
+
+static size_t diff_dir_prefix(const char *path, int depth) {
+    size_t len = 0;
+    for (size_t i = 0; path[i]; i++) {
+        if (path[i] != '/') continue;
+        len = i;
+        if (--depth == 0) break;
+    }
+    return len;
+}
+
+static DiffDir* diff_dir_get(DiffDirs *dirs, const char *path, int depth) {
+    size_t len = diff_dir_prefix(path, depth);
+    const char *key = len ? path : ".";
+    if (!len) len = 1;
+    if (dirs->last && strncmp(dirs->last->path, key, len) == 0 && dirs->last->path[len] == '\0') {
+        return dirs->last;
+    }
+    
+    if ((dirs->count + 1) * 2 > dirs->mask + 1) {
+        size_t cap = dirs->slots ? (dirs->mask + 1) * 2 : 256;
+        DiffDir *slots = calloc(cap, sizeof(DiffDir));
+        if (!slots) return NULL;
+        for (size_t i = 0; dirs->slots && i <= dirs->mask; i++) {
+            if (!dirs->slots[i].path) continue;
+            size_t j = (size_t)dirs->slots[i].hash & (cap - 1);
+            while (slots[j].path) j = (j + 1) & (cap - 1);
+            slots[j] = dirs->slots[i];
+        }
+        free(dirs->slots);
+        dirs->slots = slots;
+        dirs->mask = cap - 1;
+        dirs->last = NULL;
+    }
+    
+    uint64_t hash = xxh64(key, len, 0);
+    size_t i = (size_t)hash & dirs->mask;
+    while (dirs->slots[i].path && (dirs->slots[i].hash != hash || strncmp(dirs->slots[i].path, key, len) != 0 ||
+                                   dirs->slots[i].path[len] != '\0')) {
+        i = (i + 1) & dirs->mask;
+    }
+    if (!dirs->slots[i].path) {
+        char *copy = arena_strndup(&dirs->arena, key, len);
+        if (!copy) return NULL;
+        dirs->slots[i].path = copy;
+        dirs->slots[i].hash = hash;
+        dirs->count++;
+    }
+    dirs->last = &dirs->slots[i];
+    return dirs->last;
+}
+
+// The top largest files of one kind, kept sorted, largest first
+typedef struct DiffTop {
+    char **paths;
+    unsigned long long *sizes;
+    size_t count;
+    size_t limit;
+} DiffTop;
+
+static void diff_top_add(DiffTop *top, const char *path, unsigned long long size) {
+    if (top->count == top->limit) {
+        if (top->limit == 0 || size <= top->sizes[top->count - 1]) return;
+        free(top->paths[--top->count]);
+    }
+    char *copy = strdup(path);
+    if (!copy) return;
+    
+    size_t i = top->count++;
+    while (i > 0 && top->sizes[i - 1] < size) {
+        top->paths[i] = top->paths[i - 1];
+        top->sizes[i] = top->sizes[i - 1];
+        i--;
+    }
+    top->paths[i] = copy;
+    top->sizes[i] = size;
+}
+
+static void diff_top_print(const DiffTop *top, const char *title, char sign, unsigned long long files) {
+    if (!files) return;
+    printf("\n%s (%zu of %llu):\n", title, top->count, files);
+    for (size_t i = 0; i < top->count; i++) {
+        char size_str[50];
+        format_size(top->sizes[i], size_str, sizeof(size_str));
+        printf("  %c%12s  %s\n", sign, size_str, top->paths[i]);
+    }
+}
+
+static void format_delta(long long delta, char *buffer, size_t buffer_size) {
+    buffer[0] = delta < 0 ? '-' : '+';
+    format_size((unsigned long long)(delta < 0 ? -delta : delta), buffer + 1, buffer_size - 1);
+}
+
+static int compare_diff_dirs(const void *a, const void *b) {
+    const DiffDir *da = *(const DiffDir * const *)a;
+    const DiffDir *db = *(const DiffDir * const *)b;
+    long long ga = (long long)(da->new_bytes - da->old_bytes);
+    long long gb = (long long)(db->new_bytes - db->old_bytes);
+    if (ga != gb) return ga < gb ? 1 : -1;
+    return strcmp(da->path, db->path);
+}
+
+static void print_snapshot_line(const char *label, const SnapshotReader *r) {
+    char when[32], size_str[50];
+    time_t created = (time_t)r->created;
+    struct tm *tm = localtime(&created);
+    if (!tm || !strftime(when, sizeof(when), "%Y-%m-%d %H:%M", tm)) snprintf(when, sizeof(when), "?");
+    format_size(r->total, size_str, sizeof(size_str));
+    printf("  %s %s  %s, %llu files, %s (%s size)\n", label, when, r->root, (unsigned long long)r->count,
+           size_str, r->allocated ? "allocated" : "apparent");
+}
+
+int cmd_snapdiff(const char *old_file, const char *new_file, int depth, int top) {
+    if (depth <= 0) depth = 2;
+    if (top <= 0) top = 10;
+    
+    SnapshotReader a, b;
+    if (reader_open(&a, old_file) != 0) return 1;
+    if (reader_open(&b, new_file) != 0) {
+        reader_close(&a);
+        return 1;
+    }
+    printf("Comparing snapshots:\n");
+    print_snapshot_line("old:", &a);
+    print_snapshot_line("new:", &b);
+    if (a.allocated != b.allocated) {
+        printf("  (sizes were measured differently; changes include the switch)\n");
+    }
+    
+    DiffDirs dirs;
+    memset(&dirs, 0, sizeof(dirs));
+    arena_init(&dirs.arena);
+    DiffTop added_top = {0}, removed_top = {0};
+    added_top.limit = removed_top.limit = (size_t)top;
+    added_top.paths = calloc((size_t)top, sizeof(char*));
+    added_top.sizes = calloc((size_t)top, sizeof(unsigned long long));
+    removed_top.paths = calloc((size_t)top, sizeof(char*));
+    removed_top.sizes = calloc((size_t)top, sizeof(unsigned long long));
+    int rc = 0;
+    if (!added_top.paths || !added_top.sizes || !removed_top.paths || !removed_top.sizes) {
+        fprintf(stderr, "Memory allocation failed\n");
+        rc = 1;
+    }
+    
+    // Both files are sorted by path, so one pass pairs up every file
+    unsigned long long added = 0, removed = 0, changed = 0, same = 0;
+    unsigned long long added_bytes = 0, removed_bytes = 0;
+    long long changed_delta = 0;
+    int ha = rc ? 0 : reader_next(&a);
+    int hb = rc ? 0 : reader_next(&b);
+    while (ha > 0 || hb > 0) {
+        int cmp = ha <= 0 ? 1 : hb <= 0 ? -1 : strcmp(a.path, b.path);
+        const char *path = cmp <= 0 ? a.path : b.path;
+        DiffDir *dir = diff_dir_get(&dirs, path, depth);
+        if (!dir) {
+            fprintf(stderr, "Memory allocation failed\n");
+            rc = 1;
+            break;
+        }
+        
+        if (cmp < 0) {
+            removed++;
+            removed_bytes += a.size;
+            dir->old_bytes += a.size;
+            diff_top_add(&removed_top, a.path, a.size);
+        } else if (cmp > 0) {
+            added++;
+            added_bytes += b.size;
+            dir->new_bytes += b.size;
+            diff_top_add(&added_top, b.path, b.size);
+        } else {
+            if (a.size != b.size || a.mtime != b.mtime) {
+                changed++;
+                changed_delta += (long long)(b.size - a.size);
+            } else {
+                same++;
+            }
+            dir->old_bytes += a.size;
+            dir->new_bytes += b.size;
+        }
+        if (cmp <= 0) ha = reader_next(&a);
+        if (cmp >= 0) hb = reader_next(&b);
+    }
+    if (ha < 0 || hb < 0) rc = 1;
+    
+    if (rc == 0) {
+        char delta_str[50], added_str[50], removed_str[50], changed_str[50];
+        format_delta((long long)(b.total - a.total), delta_str, sizeof(delta_str));
+        format_delta((long long)added_bytes, added_str, sizeof(added_str));
+        format_delta(-(long long)removed_bytes, removed_str, sizeof(removed_str));
+        format_delta(changed_delta, changed_str, sizeof(changed_str));
+        printf("\nNet change: %s (%+lld files)\n", delta_str, (long long)(b.count - a.count));
+        printf("  New files:      %10llu  %12s\n", added, added_str);
+        printf("  Deleted files:  %10llu  %12s\n", removed, removed_str);
+        printf("  Changed files:  %10llu  %12s\n", changed, changed_str);
+        printf("  Unchanged:      %10llu\n", same);
+        
+        DiffDir **grown = malloc((dirs.count ? dirs.count : 1) * sizeof(DiffDir*));
+        size_t count = 0;
+        for (size_t i = 0; grown && dirs.slots && i <= dirs.mask; i++) {
+            if (dirs.slots[i].path && dirs.slots[i].new_bytes > dirs.slots[i].old_bytes) {
+                grown[count++] = &dirs.slots[i];
+            }
+        }
+        if (grown) qsort(grown, count, sizeof(DiffDir*), compare_diff_dirs);
+        size_t shown = count < (size_t)top ? count : (size_t)top;
+        printf("\nGrowth hotspots (directories up to depth %d, %zu of %zu that grew):\n", depth, shown, count);
+        if (shown) printf("  %12s  %12s  %12s  %s\n", "Change", "Old", "New", "Path");
+        for (size_t i = 0; i < shown; i++) {
+            char old_str[50], new_str[50];
+            format_delta((long long)(grown[i]->new_bytes - grown[i]->old_bytes), delta_str, sizeof(delta_str));
+            format_size(grown[i]->old_bytes, old_str, sizeof(old_str));
+            format_size(grown[i]->new_bytes, new_str, sizeof(new_str));
+            printf("  %12s  %12s  %12s  %s\n", delta_str, old_str, new_str, grown[i]->path);
+        }
+        free(grown);
+        
+        diff_top_print(&added_top, "Largest new files", '+', added);
+        diff_top_print(&removed_top, "Largest deleted files", '-', removed);
+    }
+    
+    for (size_t i = 0; i < added_top.count; i++) free(added_top.paths[i]);
+    for (size_t i = 0; i < removed_top.count; i++) free(removed_top.paths[i]);
+    free(added_top.paths);
+    free(added_top.sizes);
+    free(removed_top.paths);
+    free(removed_top.sizes);
+    free(dirs.slots);
+    arena_free(&dirs.arena);
+    reader_close(&a);
+    reader_close(&b);
+    return rc;
+}
@@ -0,0 +1,33 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+// Tree snapshots: diskusage and findlarge can record every regular file
+// they scan (path relative to the scan root, size, mtime) and save them as
+// a compact binary file sorted by path, with each path stored as the
+// length it shares with the previous one plus the rest. Two snapshots are
+// compared by snapdiff in one streaming merge, without touching the tree.
+// Every path is recorded, so a hard-linked file appears under each name.
+
+typedef struct Snapshot Snapshot;
+
+// root is the scan root exactly as given to the walker; jobs the number of
+// walker workers. allocated records that sizes are st_blocks based.
+Snapshot* snapshot_new(const char *root, int jobs, int allocated);
+void snapshot_free(Snapshot *snap);
+
+// Record one regular file from a walker callback; path is the entry's full
+// path. Per-worker, so no locking. Does nothing when snap is NULL.
+void snapshot_add(Snapshot *snap, int worker, const char *path, uint64_t size, int64_t mtime);
+
+// Sort and write the snapshot to file (through a temporary file that is
+// renamed over it). Returns 0, or -1 after printing the error.
+int snapshot_write(Snapshot *snap, const char *file);
+
+// Compare two snapshots: totals, new/deleted/changed files, the directories
+// (up to depth levels below the root) that grew the most and the largest
+// new and deleted files, top of each
+int cmd_snapdiff(const char *old_file, const char *new_file, int depth, int top);
+
+#endif
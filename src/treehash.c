@@ -0,0 +1,414 @@
+#include "treehash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "filetools.h"
+#include "scanindex.h"
+
+#ifdef _WIN32
+
+int cmd_treehash(const char *root, const WalkOptions *walk_opts, const HashOptions *opts,
+                 const char *cache_path) {
+    (void)root; (void)walk_opts; (void)opts; (void)cache_path;
+    fprintf(stderr, "Tree hashing not supported on Windows yet\n");
+    return 1;
+}
+
+#else
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Cache layout (native endianness, like the scan index it is a local
+// cache): TreeCacheHeader, then TreeRecord[count] sorted by (dev, ino)
+#define TREE_CACHE_MAGIC "CAFTREE\n"
+#define TREE_CACHE_VERSION 1
+
+typedef struct TreeCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t count;
+} TreeCacheHeader;
+
+typedef struct TreeRecord {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    uint64_t entries_hash;      // directories: XXH3 of their entries' types, names and inodes
+    uint32_t type;              // TreeNode type byte
+    uint32_t reserved;
+    uint8_t digest[BLAKE3_OUT_LEN];
+} TreeRecord;
+
+typedef struct TreeNode {
+    ScanPath path;              // own name and the parent directory's path node
+    struct TreeNode *parent;
+    int depth;
+    char type;                  // 'f', 'x', 'l' or 'd'
+    int clean;                  // digest is the cached one: nothing here changed
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    uint64_t entries_hash;
+    size_t first_child;         // directories: their entries in the sorted list
+    size_t child_count;
+    uint8_t digest[BLAKE3_OUT_LEN];
+} TreeNode;
+
+typedef struct TreeWorker {
+    Arena arena;
+    TreeNode **nodes;
+    size_t count;
+    size_t capacity;
+    size_t errors;
+    int failed;                 // out of memory
+} TreeWorker;
+
+// A missing cache is not an error; a damaged one is ignored and rewritten
+static void tree_cache_open(RecordFile *cache, const char *file) {
+    const char *reason = NULL;
+    if (record_file_map(cache, file, sizeof(TreeCacheHeader), &reason) != 0) {
+        if (strcmp(reason, "no such file") != 0) fprintf(stderr, "Ignoring cache %s (%s)\n", file, reason);
+        return;
+    }
+    
+    const TreeCacheHeader *hdr = cache->map;
+    if (memcmp(hdr->magic, TREE_CACHE_MAGIC, 8) != 0) {
+        reason = "not a tree hash cache";
+    } else if (hdr->version != TREE_CACHE_VERSION || hdr->record_size != sizeof(TreeRecord)) {
+        reason = "different format version";
+    } else if (record_file_set(cache, sizeof(TreeCacheHeader), (size_t)hdr->count, sizeof(TreeRecord)) != 0) {
+        reason = "truncated";
+    }
+    if (reason) {
+        fprintf(stderr, "Ignoring cache %s (%s)\n", file, reason);
+        record_file_unmap(cache);
+    }
+}
+
+static const TreeRecord* tree_cache_lookup(const RecordFile *cache, const TreeNode *node) {
+    const TreeRecord *rec = record_file_lookup(cache, node->dev, node->ino);
+    return rec && rec->type == (uint32_t)node->type ? rec : NULL;
+}
+
+// Sort the records and atomically replace file. Returns 0 on success.
+static int tree_cache_write(const char *file, TreeRecord *records, size_t count) {
+    TreeCacheHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TREE_CACHE_MAGIC, 8);
+    hdr.version = TREE_CACHE_VERSION;
+    hdr.record_size = sizeof(TreeRecord);
+    hdr.count = count;
+    return record_file_write(file, &hdr, sizeof(hdr), records, sizeof(TreeRecord), count);
+}
+
+static int64_t stat_mtime_ns(const struct stat *st) {
+#ifdef __linux__
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#else
+    return (int64_t)st->st_mtime * 1000000000;
+#endif
+}
+
+static int64_t stat_ctime_ns(const struct stat *st) {
+#ifdef __linux__
+    return (int64_t)st->st_ctim.tv_sec * 1000000000 + st->st_ctim.tv_nsec;
+#else
+    return (int64_t)st->st_ctime * 1000000000;
+#endif
+}
+
+static TreeNode* tree_node_new(Arena *arena, TreeNode *parent, const char *name, char type,
+                               const struct stat *st) {
+    TreeNode *node = arena_alloc(arena, sizeof(TreeNode));
+    char *copy = node ? arena_strndup(arena, name, strlen(name)) : NULL;
+    if (!copy) return NULL;
+    memset(node, 0, sizeof(*node));
+    node->path.parent = parent ? &parent->path : NULL;
+    node->path.name = copy;
+    node->parent = parent;
+    node->depth = parent ? parent->depth + 1 : 0;
+    node->type = type;
+    if (st) {
+        node->dev = (uint64_t)st->st_dev;
+        node->ino = (uint64_t)st->st_ino;
+        node->size = (uint64_t)st->st_size;
+        node->mtime_ns = stat_mtime_ns(st);
+        node->ctime_ns = stat_ctime_ns(st);
+    }
+    return node;
+}
+
+static void tree_visit(const WalkEntry *entry, void *ctx) {
+    TreeWorker *w = &((TreeWorker *)ctx)[entry->worker];
+    TreeNode *dir = entry->dir_data;
+    if (!dir) return;
+    
+    char type;
+    if (entry->type == WALK_DIR) type = 'd';
+    else if (entry->type == WALK_SYMLINK) type = 'l';
+    else if (entry->type == WALK_FILE) type = (entry->st->st_mode & S_IXUSR) ? 'x' : 'f';
+    else return;                // devices, sockets and fifos have no content to hash
+    
+    if (w->count == w->capacity) {
+        size_t new_cap = w->capacity ? w->capacity * 2 : 1024;
+        TreeNode **nodes = realloc(w->nodes, new_cap * sizeof(TreeNode*));
+        if (!nodes) {
+            w->failed = 1;
+            return;
+        }
+        w->nodes = nodes;
+        w->capacity = new_cap;
+    }
+    TreeNode *node = tree_node_new(&w->arena, dir, entry->name, type, entry->st);
+    if (!node) {
+        w->failed = 1;
+        return;
+    }
+    w->nodes[w->count++] = node;
+    
+    if (type == 'd') {
+        *entry->child_data = node;
+    } else if (type == 'l') {
+        // Links are hashed on the spot: reading one costs no more than a stat
+        char target[PATH_MAX];
+        ssize_t len = readlinkat(entry->dirfd, entry->name, target, sizeof(target));
+        if (len < 0) {
+            char *path = scan_path_strdup(&node->path);
+            fprintf(stderr, "Cannot read link: %s\n", path ? path : entry->name);
+            free(path);
+            w->errors++;
+            return;
+        }
+        Blake3Ctx ctx;
+        blake3_init(&ctx);
+        blake3_update(&ctx, target, (size_t)len);
+        blake3_final(&ctx, node->digest, BLAKE3_OUT_LEN);
+        node->clean = 1;
+    }
+}
+
+// Entries grouped by directory, each directory's in name order
+static int compare_tree_children(const void *a, const void *b) {
+    const TreeNode *na = *(const TreeNode * const *)a;
+    const TreeNode *nb = *(const TreeNode * const *)b;
+    if (na->parent != nb->parent) return (uintptr_t)na->parent < (uintptr_t)nb->parent ? -1 : 1;
+    return strcmp(na->path.name, nb->path.name);
+}
+
+static int compare_tree_depth(const void *a, const void *b) {
+    const TreeNode *na = *(const TreeNode * const *)a;
+    const TreeNode *nb = *(const TreeNode * const *)b;
+    return nb->depth - na->depth;
+}
+
+// Reuses the cached digest of a directory whose entries are the ones
+// recorded and all unchanged, or hashes its listing
+static int tree_hash_dir(TreeNode *dir, TreeNode **children, const RecordFile *cache) {
+    Xxh3Ctx entries;
+    xxh3_init(&entries);
+    int clean = 1;
+    for (size_t i = 0; i < dir->child_count; i++) {
+        const TreeNode *child = children[dir->first_child + i];
+        xxh3_update(&entries, &child->type, 1);
+        xxh3_update(&entries, child->path.name, strlen(child->path.name) + 1);
+        xxh3_update(&entries, &child->dev, sizeof(child->dev));
+        xxh3_update(&entries, &child->ino, sizeof(child->ino));
+        // Links have no inode of their own here (the walker doesn't stat
+        // them), so a retargeted link only shows in its fresh digest
+        if (child->type == 'l') xxh3_update(&entries, child->digest, BLAKE3_OUT_LEN);
+        clean &= child->clean;
+    }
+    dir->entries_hash = xxh3_64_final(&entries);
+    
+    const TreeRecord *rec = tree_cache_lookup(cache, dir);
+    if (clean && rec && rec->entries_hash == dir->entries_hash) {
+        memcpy(dir->digest, rec->digest, BLAKE3_OUT_LEN);
+        dir->clean = 1;
+        return 0;
+    }
+    
+    Blake3Ctx ctx;
+    blake3_init(&ctx);
+    for (size_t i = 0; i < dir->child_count; i++) {
+        const TreeNode *child = children[dir->first_child + i];
+        blake3_update(&ctx, &child->type, 1);
+        blake3_update(&ctx, child->path.name, strlen(child->path.name) + 1);
+        blake3_update(&ctx, child->digest, BLAKE3_OUT_LEN);
+    }
+    blake3_final(&ctx, dir->digest, BLAKE3_OUT_LEN);
+    return 1;
+}
+
+int cmd_treehash(const char *root, const WalkOptions *walk_opts, const HashOptions *opts,
+                 const char *cache_path) {
+    struct stat root_st;
+    if (stat(root, &root_st) != 0 || !S_ISDIR(root_st.st_mode)) {
+        fprintf(stderr, "Cannot access %s\n", root);
+        return 1;
+    }
+    
+    // Directories need their inode for the cache. A digest covers the
+    // whole tree, so anything the walk could not read is an error.
+    WalkOptions walk = *walk_opts;
+    walk.stat_dirs = 1;
+    walk.report_errors = 1;
+    walk.names_only = 1;
+    int jobs = walk_jobs(&walk);
+    TreeWorker *workers = calloc((size_t)jobs, sizeof(TreeWorker));
+    Arena arena;
+    arena_init(&arena);
+    TreeNode *top = tree_node_new(&arena, NULL, root, 'd', &root_st);
+    if (!workers || !top) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(workers);
+        arena_free(&arena);
+        return 1;
+    }
+    for (int i = 0; i < jobs; i++) arena_init(&workers[i].arena);
+    
+    RecordFile cache;
+    memset(&cache, 0, sizeof(cache));
+    TreeNode **nodes = NULL, **dirs = NULL;
+    HashItem *items = NULL;
+    TreeNode **item_node = NULL;
+    TreeRecord *records = NULL;
+    size_t count = 0, errors = 0, item_count = 0;
+    int rc = 1;
+    
+    scan_stats_stage(walk.stats, "scan");
+    int walk_errors = walk_tree_data(root, top, &walk, tree_visit, NULL, workers);
+    if (walk_errors < 0) goto out;
+    errors = (size_t)walk_errors;
+    for (int i = 0; i < jobs; i++) {
+        if (workers[i].failed) {
+            fprintf(stderr, "Memory allocation failed\n");
+            goto out;
+        }
+        count += workers[i].count;
+        errors += workers[i].errors;
+    }
+    
+    nodes = malloc((count + 1) * sizeof(TreeNode*));
+    dirs = malloc((count + 1) * sizeof(TreeNode*));
+    items = malloc((count + 1) * sizeof(HashItem));
+    item_node = malloc((count + 1) * sizeof(TreeNode*));
+    records = malloc((count + 1) * sizeof(TreeRecord));
+    if (!nodes || !dirs || !items || !item_node || !records) {
+        fprintf(stderr, "Memory allocation failed\n");
+        goto out;
+    }
+    count = 0;
+    for (int i = 0; i < jobs; i++) {
+        if (!workers[i].count) continue;
+        memcpy(nodes + count, workers[i].nodes, workers[i].count * sizeof(TreeNode*));
+        count += workers[i].count;
+    }
+    qsort(nodes, count, sizeof(TreeNode*), compare_tree_children);
+    for (size_t i = 0; i < count;) {
+        TreeNode *parent = nodes[i]->parent;
+        parent->first_child = i;
+        while (i < count && nodes[i]->parent == parent) i++;
+        parent->child_count = i - parent->first_child;
+    }
+    
+    // Files whose size, mtime and ctime still match keep their digest; the
+    // rest are read, in parallel
+    if (cache_path) tree_cache_open(&cache, cache_path);
+    uint64_t hashed_bytes = 0;
+    size_t dir_count = 0;
+    dirs[dir_count++] = top;
+    for (size_t i = 0; i < count; i++) {
+        TreeNode *node = nodes[i];
+        if (node->type == 'd') dirs[dir_count++] = node;
+        if (node->type != 'f' && node->type != 'x') continue;
+        const TreeRecord *rec = tree_cache_lookup(&cache, node);
+        if (rec && rec->size == node->size && rec->mtime_ns == node->mtime_ns && rec->ctime_ns == node->ctime_ns) {
+            memcpy(node->digest, rec->digest, BLAKE3_OUT_LEN);
+            node->clean = 1;
+            continue;
+        }
+        char *path = scan_path_strdup(&node->path);
+        if (!path) {
+            fprintf(stderr, "Memory allocation failed\n");
+            goto out;
+        }
+        items[item_count].path = path;
+        items[item_count].size = (int64_t)node->size;
+        item_node[item_count++] = node;
+        hashed_bytes += node->size;
+    }
+    scan_stats_stage(walk.stats, "hash");
+    hash_files(items, item_count, HASH_BLAKE3, opts);
+    for (size_t i = 0; i < item_count; i++) {
+        if (items[i].ok) memcpy(item_node[i]->digest, items[i].digest, BLAKE3_OUT_LEN);
+        else errors++;
+    }
+    if (errors) {
+        fprintf(stderr, "%zu entries could not be read; no tree hash\n", errors);
+        goto out;
+    }
+    
+    // Children before parents
+    qsort(dirs, dir_count, sizeof(TreeNode*), compare_tree_depth);
+    size_t recomputed = 0;
+    for (size_t i = 0; i < dir_count; i++) recomputed += (size_t)tree_hash_dir(dirs[i], nodes, &cache);
+    
+    char hex[2 * BLAKE3_OUT_LEN + 1];
+    hash_to_hex(top->digest, BLAKE3_OUT_LEN, hex);
+    printf("%s  %s\n", hex, root);
+    char size_str[50];
+    format_size(hashed_bytes, size_str, sizeof(size_str));
+    fprintf(stderr, "%zu entries in %zu directories: %zu files read (%s), %zu directories rehashed\n",
+            count, dir_count, item_count, size_str, recomputed);
+    rc = 0;
+    
+    if (cache_path) {
+        size_t record_count = 0;
+        for (size_t i = 0; i <= count; i++) {
+            const TreeNode *node = i < count ? nodes[i] : top;
+            if (node->type == 'l') continue;
+            TreeRecord *rec = &records[record_count++];
+            memset(rec, 0, sizeof(*rec));
+            rec->dev = node->dev;
+            rec->ino = node->ino;
+            rec->size = node->size;
+            rec->mtime_ns = node->mtime_ns;
+            rec->ctime_ns = node->ctime_ns;
+            rec->entries_hash = node->entries_hash;
+            rec->type = (uint32_t)node->type;
+            memcpy(rec->digest, node->digest, BLAKE3_OUT_LEN);
+        }
+        // The old mapping goes before its file is replaced
+        record_file_unmap(&cache);
+        if (tree_cache_write(cache_path, records, record_count) != 0) {
+            fprintf(stderr, "Cannot write cache %s\n", cache_path);
+            rc = 1;
+        }
+    }
+
+out:
+    record_file_unmap(&cache);
+    for (size_t i = 0; i < item_count; i++) free((char *)items[i].path);
+    for (int i = 0; i < jobs; i++) {
+        arena_free(&workers[i].arena);
+        free(workers[i].nodes);
+    }
+    free(workers);
+    arena_free(&arena);
+    free(nodes);
+    free(dirs);
+    free(items);
+    free(item_node);
+    free(records);
+    return rc;
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef TREEHASH_H
+#define TREEHASH_H
+
+#include "hash.h"
+#include "walker.h"
+
+// Content-addressed Merkle hash of a directory tree. A file's digest is
+// the BLAKE3 hash of its contents; a directory's is the BLAKE3 hash of its
+// entries sorted by name, each as a type byte ('f' file, 'x' executable,
+// 'l' symlink, 'd' directory), the name, a NUL and the entry's digest.
+// Symlinks hash their target. Names above the root do not take part, so
+// the same tree hashes the same wherever it lives.
+//
+// With a cache file, every file and directory digest is kept keyed by
+// (dev, inode) and trusted while size, mtime and ctime still match; a
+// directory's only while its own entry and every entry below it are
+// unchanged. A re-run still stats the whole tree, but only reads changed
+// files and only rehashes the directories on their way to the root.
+
+int cmd_treehash(const char *root, const WalkOptions *walk_opts, const HashOptions *opts,
+                 const char *cache_path);
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "uring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+struct Uring {
+    int fd;
+    unsigned depth;
+    unsigned queued;        // prepared but not yet submitted
+    unsigned inflight;      // submitted but not yet reaped
+    
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+// Make sure the running kernel implements every opcode the scanners use
+static int uring_probe_ops(int fd) {
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, len);
+    if (!probe) return 0;
+    
+    int ok = 0;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        int ops[] = { IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ };
+        ok = 1;
+        for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+            if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) ok = 0;
+        }
+    }
+    free(probe);
+    return ok;
+}
+
+Uring* uring_create(unsigned queue_depth) {
+    if (queue_depth == 0) queue_depth = 64;
+    if (queue_depth > 4096) queue_depth = 4096;
+    
+    Uring *ring = calloc(1, sizeof(Uring));
+    if (!ring) return NULL;
+    
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring->fd = uring_setup(queue_depth, &p);
+    if (ring->fd < 0) {
+        free(ring);
+        return NULL;
+    }
+    if (!uring_probe_ops(ring->fd)) {
+        close(ring->fd);
+        free(ring);
+        return NULL;
+    }
+    
+    ring->depth = p.sq_entries;
+    ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size) ring->sq_size = ring->cq_size;
+        ring->cq_size = ring->sq_size;
+    }
+    
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) goto fail;
+    
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            ring->cq_ptr = NULL;
+            goto fail;
+        }
+    }
+    
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        goto fail;
+    }
+    
+    char *sq = ring->sq_ptr;
+    char *cq = ring->cq_ptr;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return ring;
+
+fail:
+    if (ring->sq_ptr == MAP_FAILED) ring->sq_ptr = NULL;
+    uring_destroy(ring);
+    return NULL;
+}
+
+void uring_destroy(Uring *ring) {
+    if (!ring) return;
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_size);
+    if (ring->sq_ptr) munmap(ring->sq_ptr, ring->sq_size);
+    close(ring->fd);
+    free(ring);
+}
+
+unsigned uring_depth(const Uring *ring) {
+    return ring ? ring->depth : 0;
+}
+
+int uring_available(void) {
+    Uring *ring = uring_create(8);
+    if (!ring) return 0;
+    uring_destroy(ring);
+    return 1;
+}
+
+static struct io_uring_sqe* uring_get_sqe(Uring *ring) {
+    // Never queue more than the CQ can hold without reaping
+    if (ring->queued + ring->inflight >= ring->depth) return NULL;
+    
+    unsigned tail = *ring->sq_tail + ring->queued;
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head >= ring->depth) return NULL;
+    
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->queued++;
+    return sqe;
+}
+
+int uring_prep_statx(Uring *ring, int dirfd, const char *path, int flags,
+                     unsigned mask, struct statx *buf, uint64_t user_data) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = dirfd;
+    sqe->addr = (uint64_t)(uintptr_t)path;
+    sqe->len = mask;
+    sqe->off = (uint64_t)(uintptr_t)buf;
+    sqe->statx_flags = (uint32_t)flags;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+int uring_prep_openat(Uring *ring, int dirfd, const char *path, int flags, uint64_t user_data) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = dirfd;
+    sqe->addr = (uint64_t)(uintptr_t)path;
+    sqe->open_flags = (uint32_t)flags;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+int uring_prep_read(Uring *ring, int fd, void *buf, unsigned len, uint64_t offset, uint64_t user_data) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+static void uring_reap(Uring *ring, int *results, size_t results_len) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        if (cqe->user_data < results_len) results[cqe->user_data] = cqe->res;
+        ring->inflight--;
+        head++;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+int uring_submit_wait(Uring *ring, int *results, size_t results_len) {
+    if (ring->queued) {
+        __atomic_store_n(ring->sq_tail, *ring->sq_tail + ring->queued, __ATOMIC_RELEASE);
+        ring->inflight += ring->queued;
+    }
+    
+    unsigned to_submit = ring->queued;
+    ring->queued = 0;
+    while (ring->inflight > 0) {
+        int ret = uring_enter(ring->fd, to_submit, ring->inflight, IORING_ENTER_GETEVENTS);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        to_submit -= (unsigned)ret < to_submit ? (unsigned)ret : to_submit;
+        uring_reap(ring, results, results_len);
+    }
+    return 0;
+}
+
+#else
+
+Uring* uring_create(unsigned queue_depth) {
+    (void)queue_depth;
+    return NULL;
+}
+
+void uring_destroy(Uring *ring) {
+    (void)ring;
+}
+
+unsigned uring_depth(const Uring *ring) {
+    (void)ring;
+    return 0;
+}
+
+int uring_available(void) {
+    return 0;
+}
+
+int uring_prep_statx(Uring *ring, int dirfd, const char *path, int flags,
+                     unsigned mask, struct statx *buf, uint64_t user_data) {
+    (void)ring; (void)dirfd; (void)path; (void)flags; (void)mask; (void)buf; (void)user_data;
+    return -1;
+}
+
+int uring_prep_openat(Uring *ring, int dirfd, const char *path, int flags, uint64_t user_data) {
+    (void)ring; (void)dirfd; (void)path; (void)flags; (void)user_data;
+    return -1;
+}
+
+int uring_prep_read(Uring *ring, int fd, void *buf, unsigned len, uint64_t offset, uint64_t user_data) {
+    (void)ring; (void)fd; (void)buf; (void)len; (void)offset; (void)user_data;
+    return -1;
+}
+
+int uring_submit_wait(Uring *ring, int *results, size_t results_len) {
+    (void)ring; (void)results; (void)results_len;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal io_uring wrapper (raw syscalls, no liburing) used to batch the
+// metadata and read requests issued by the tree scanners. uring_create()
+// returns NULL when the kernel, platform or sandbox doesn't support the
+// opcodes we need; callers then use their synchronous code path.
+
+struct statx;
+typedef struct Uring Uring;
+
+Uring* uring_create(unsigned queue_depth);
+void uring_destroy(Uring *ring);
+unsigned uring_depth(const Uring *ring);
+int uring_available(void);
+
+// Queue a request; returns -1 when the submission queue is full
+int uring_prep_statx(Uring *ring, int dirfd, const char *path, int flags,
+                     unsigned mask, struct statx *buf, uint64_t user_data);
+int uring_prep_openat(Uring *ring, int dirfd, const char *path, int flags, uint64_t user_data);
+int uring_prep_read(Uring *ring, int fd, void *buf, unsigned len, uint64_t offset, uint64_t user_data);
+
+// Submit everything queued and wait until all of it has completed. For
+// each completion, results[user_data] receives the cqe result (>= 0 on
+// success, -errno on failure). user_data must index into results.
+int uring_submit_wait(Uring *ring, int *results, size_t results_len);
+
+#endif
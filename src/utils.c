@@ -1,4 +1,5 @@
 #include "utils.h"
+#include "arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -374,39 +375,102 @@ int cmd_passgen(int length, int flags) {
     return 0;
 }
 
-// Find large files
+// Find large files. Only the K largest matches are kept, in a bounded
+// min-heap whose root is the smallest file still in the running, so a scan
+// with n matches costs O(n log K) rather than a sorted insert per match.
+// Result paths live in an arena that is released in one go at the end.
+#define FINDLARGE_DEFAULT_TOP 50
+
 typedef struct FileInfo {
-    char path[1024];
+    const ScanPath *path;
     unsigned long long size;
-    struct FileInfo *next;
 } FileInfo;
 
-void add_file(FileInfo **list, const char *path, unsigned long long size) {
-    FileInfo *new_file = malloc(sizeof(FileInfo));
-    if (!new_file) return;
-    
-    strncpy(new_file->path, path, sizeof(new_file->path) - 1);
-    new_file->path[sizeof(new_file->path) - 1] = '\0';
-    new_file->size = size;
-    new_file->next = NULL;
-    
-    if (*list == NULL || size > (*list)->size) {
-        new_file->next = *list;
-        *list = new_file;
+typedef struct LargeHeap {
+    FileInfo *items;
+    size_t count;
+    size_t limit;
+} LargeHeap;
+
+static int large_heap_init(LargeHeap *heap, size_t limit) {
+    heap->items = malloc(limit * sizeof(FileInfo));
+    heap->count = 0;
+    heap->limit = limit;
+    return heap->items ? 0 : -1;
+}
+
+// Whether a file of this size would make it into the heap; checked before
+// the path is interned so rejected matches cost nothing
+static int large_heap_wants(const LargeHeap *heap, unsigned long long size) {
+    return heap->count < heap->limit || size > heap->items[0].size;
+}
+
+static void large_heap_push(LargeHeap *heap, FileInfo file) {
+    FileInfo *items = heap->items;
+    if (heap->count < heap->limit) {
+        // Sift the new leaf up past any larger parents
+        size_t i = heap->count++;
+        while (i > 0 && items[(i - 1) / 2].size > file.size) {
+            items[i] = items[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        items[i] = file;
         return;
     }
-    
-    FileInfo *current = *list;
-    while (current->next != NULL && current->next->size > size) {
-        current = current->next;
+    if (file.size <= items[0].size) return;
+    
+    // Replace the smallest and sift it down
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= heap->count) break;
+        if (child + 1 < heap->count && items[child + 1].size < items[child].size) child++;
+        if (items[child].size >= file.size) break;
+        items[i] = items[child];
+        i = child;
     }
-    
-    new_file->next = current->next;
-    current->next = new_file;
+    items[i] = file;
+}
+
+static int compare_large_files(const void *a, const void *b) {
+    const FileInfo *fa = a;
+    const FileInfo *fb = b;
+    if (fa->size != fb->size) return fa->size < fb->size ? 1 : -1;
+    return 0;
+}
+
+void add_file(LargeHeap *heap, Arena *arena, const char *path, unsigned long long size) {
+    if (!large_heap_wants(heap, size)) return;
+    
+    FileInfo file;
+    file.path = scan_path_new(arena, NULL, path);
+    if (!file.path) return;
+    file.size = size;
+    large_heap_push(heap, file);
+}
+
+void format_large_size(unsigned long long size, char *buffer, size_t buffer_size) {
+    if (size >= 1024ULL * 1024 * 1024) {
+        snprintf(buffer, buffer_size, "%.2f GB", size / (1024.0 * 1024.0 * 1024.0));
+    } else if (size >= 1024ULL * 1024) {
+        snprintf(buffer, buffer_size, "%.2f MB", size / (1024.0 * 1024.0));
+    } else if (size >= 1024ULL) {
+        snprintf(buffer, buffer_size, "%.2f KB", size / 1024.0);
+    } else {
+        snprintf(buffer, buffer_size, "%llu B", size);
+    }
+}
+
+// --stream: one line per match as soon as it is seen, in scan order
+static void print_streamed_file(const char *path, unsigned long long size) {
+    char size_str[50];
+    format_large_size(size, size_str, sizeof(size_str));
+    printf("%15s  %s\n", size_str, path);
 }
 
-void scan_for_large_files(const char *path, unsigned long long min_size, FileInfo **list, int *count) {
 #ifdef _WIN32
+void scan_for_large_files(const char *path, unsigned long long min_size, int stream, Arena *arena,
+                          LargeHeap *heap, int *count) {
     WIN32_FIND_DATA findData;
     HANDLE hFind;
     char search_path[MAX_PATH];
@@ -424,114 +488,171 @@ void scan_for_large_files(const char *path, unsigned long long min_size, FileInf
         snprintf(full_path, sizeof(full_path), "%s\\%s", path, findData.cFileName);
         
         if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-            scan_for_large_files(full_path, min_size, list, count);
+            scan_for_large_files(full_path, min_size, stream, arena, heap, count);
         } else {
             ULARGE_INTEGER filesize;
             filesize.LowPart = findData.nFileSizeLow;
             filesize.HighPart = findData.nFileSizeHigh;
             
             if (filesize.QuadPart >= min_size) {
-                add_file(list, full_path, filesize.QuadPart);
+                if (stream) {
+                    print_streamed_file(full_path, filesize.QuadPart);
+                } else {
+                    add_file(heap, arena, full_path, filesize.QuadPart);
+                }
                 (*count)++;
             }
         }
     } while (FindNextFile(hFind, &findData));
     
     FindClose(hFind);
+}
 #else
-    DIR *dir = opendir(path);
-    if (!dir) return;
+typedef struct LargeScanCtx {
+    unsigned long long min_size;
+    int stream;
+    LargeHeap *heaps;               // top-K candidates, one heap per walker worker
+    int *counts;
+    Arena *arenas;                  // path nodes, one arena per walker worker
+    Snapshot *snapshot;             // every file, may be NULL
+} LargeScanCtx;
+
+static void large_file_visit(const WalkEntry *entry, void *ctx) {
+    LargeScanCtx *lc = ctx;
+    Arena *arena = &lc->arenas[entry->worker];
+    if (entry->type == WALK_DIR) {
+        if (!lc->stream) *entry->child_data = scan_path_new(arena, entry->dir_data, entry->name);
+        return;
+    }
+    if (entry->type != WALK_FILE) return;
+    snapshot_add(lc->snapshot, entry->worker, entry->path, entry->st->st_size, entry->st->st_mtime);
+    if ((unsigned long long)entry->st->st_size < lc->min_size) return;
+    lc->counts[entry->worker]++;
     
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-            continue;
-        
-        char full_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
-        
-        struct stat st;
-        if (lstat(full_path, &st) == 0) {
-            if (S_ISDIR(st.st_mode)) {
-                scan_for_large_files(full_path, min_size, list, count);
-            } else if (S_ISREG(st.st_mode)) {
-                if ((unsigned long long)st.st_size >= min_size) {
-                    add_file(list, full_path, st.st_size);
-                    (*count)++;
-                }
-            }
-        }
+    if (lc->stream) {
+        print_streamed_file(entry->path, entry->st->st_size);
+        return;
     }
     
-    closedir(dir);
-#endif
+    LargeHeap *heap = &lc->heaps[entry->worker];
+    if (!entry->dir_data || !large_heap_wants(heap, entry->st->st_size)) return;
+    FileInfo file;
+    file.path = scan_path_new(arena, entry->dir_data, entry->name);
+    if (!file.path) return;
+    file.size = entry->st->st_size;
+    large_heap_push(heap, file);
 }
 
-void format_large_size(unsigned long long size, char *buffer, size_t buffer_size) {
-    if (size >= 1024ULL * 1024 * 1024) {
-        snprintf(buffer, buffer_size, "%.2f GB", size / (1024.0 * 1024.0 * 1024.0));
-    } else if (size >= 1024ULL * 1024) {
-        snprintf(buffer, buffer_size, "%.2f MB", size / (1024.0 * 1024.0));
-    } else if (size >= 1024ULL) {
-        snprintf(buffer, buffer_size, "%.2f KB", size / 1024.0);
-    } else {
-        snprintf(buffer, buffer_size, "%llu B", size);
+void scan_for_large_files(const char *path, unsigned long long min_size, const WalkOptions *opts,
+                          int stream, Arena *arena, LargeHeap *heap, int *count) {
+    int jobs = walk_jobs(opts);
+    LargeScanCtx lc;
+    lc.min_size = min_size;
+    lc.stream = stream;
+    lc.snapshot = opts ? opts->snapshot : NULL;
+    lc.heaps = calloc((size_t)jobs, sizeof(LargeHeap));
+    lc.counts = calloc((size_t)jobs, sizeof(int));
+    lc.arenas = calloc((size_t)jobs, sizeof(Arena));
+    ScanPath *root = scan_path_new(arena, NULL, path);
+    int alloc_failed = !lc.heaps || !lc.counts || !lc.arenas || !root;
+    for (int i = 0; !alloc_failed && i < jobs; i++) {
+        if (large_heap_init(&lc.heaps[i], heap->limit) != 0) alloc_failed = 1;
+    }
+    
+    if (!alloc_failed) {
+        // Top-K names files through their directory's ScanPath node
+        WalkOptions walk_opts = {0};
+        if (opts) walk_opts = *opts;
+        walk_opts.names_only = !stream && !lc.snapshot;
+        walk_tree_data(path, root, &walk_opts, large_file_visit, NULL, &lc);
     }
+    
+    // Each worker's heap holds its own top K; the overall top K is among them
+    for (int i = 0; lc.heaps && i < jobs; i++) {
+        for (size_t k = 0; k < lc.heaps[i].count; k++) {
+            large_heap_push(heap, lc.heaps[i].items[k]);
+        }
+        free(lc.heaps[i].items);
+        if (lc.counts) *count += lc.counts[i];
+        if (lc.arenas) arena_merge(arena, &lc.arenas[i]);
+    }
+    free(lc.heaps);
+    free(lc.counts);
+    free(lc.arenas);
 }
+#endif
 
-int cmd_findlarge(const char *path, unsigned long long min_size_mb) {
+int cmd_findlarge(const char *path, unsigned long long min_size_mb, const WalkOptions *opts,
+                  int top, int stream) {
     unsigned long long min_size = min_size_mb * 1024 * 1024;
+    size_t limit = top > 0 ? (size_t)top : FINDLARGE_DEFAULT_TOP;
     
     printf("Scanning for files larger than %llu MB in: %s\n", min_size_mb, path);
     printf("This may take a while...\n\n");
     
-    FileInfo *files = NULL;
+    LargeHeap heap;
     int count = 0;
+    Arena arena;
+    arena_init(&arena);
+    if (large_heap_init(&heap, limit) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
     
-    scan_for_large_files(path, min_size, &files, &count);
+#ifdef _WIN32
+    (void)opts;
+    scan_for_large_files(path, min_size, stream, &arena, &heap, &count);
+#else
+    scan_stats_stage(opts ? opts->stats : NULL, "scan");
+    scan_for_large_files(path, min_size, opts, stream, &arena, &heap, &count);
+    scan_stats_stage(opts ? opts->stats : NULL, "report");
+#endif
     
     if (count == 0) {
         printf("No files found larger than %llu MB\n", min_size_mb);
+    } else if (stream) {
+        printf("\nFound %d large files\n", count);
+    }
+    if (count == 0 || stream) {
+        free(heap.items);
+        arena_free(&arena);
         return 0;
     }
     
+    // Only the survivors get sorted: O(K log K)
+    qsort(heap.items, heap.count, sizeof(FileInfo), compare_large_files);
+    
     printf("Found %d large files:\n\n", count);
     printf("%-60s %15s\n", "Path", "Size");
     printf("%-60s %15s\n", "------------------------------------------------------------", "---------------");
     
-    int displayed = 0;
-    FileInfo *current = files;
-    while (current != NULL && displayed < 50) {
+    char *path_buf = NULL;
+    size_t path_cap = 0;
+    for (size_t i = 0; i < heap.count; i++) {
         char size_str[50];
-        format_large_size(current->size, size_str, sizeof(size_str));
+        format_large_size(heap.items[i].size, size_str, sizeof(size_str));
+        
+        const char *file_path = scan_path_format(heap.items[i].path, &path_buf, &path_cap);
+        if (!file_path) break;
         
         // Truncate path if too long
         char display_path[61];
-        if (strlen(current->path) > 60) {
-            snprintf(display_path, sizeof(display_path), "...%s", current->path + strlen(current->path) - 57);
+        if (strlen(file_path) > 60) {
+            snprintf(display_path, sizeof(display_path), "...%s", file_path + strlen(file_path) - 57);
         } else {
-            strncpy(display_path, current->path, sizeof(display_path) - 1);
+            strncpy(display_path, file_path, sizeof(display_path) - 1);
             display_path[60] = '\0';
         }
         
         printf("%-60s %15s\n", display_path, size_str);
-        
-        FileInfo *temp = current;
-        current = current->next;
-        free(temp);
-        displayed++;
-    }
-    
-    if (count > 50) {
-        printf("\n... and %d more files\n", count - 50);
     }
     
-    // Free remaining files
-    while (current != NULL) {
-        FileInfo *temp = current;
-        current = current->next;
-        free(temp);
+    if ((size_t)count > heap.count) {
+        printf("\n... and %zu more files\n", (size_t)count - heap.count);
     }
     
+    free(path_buf);
+    free(heap.items);
+    arena_free(&arena);
     return 0;
 }
@@ -1,10 +1,15 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include "walker.h"
+
 int cmd_env(const char *var);
 int cmd_env_inspect(const char *env_file);
 int cmd_passgen(int length, int flags);
-int cmd_findlarge(const char *path, unsigned long long min_size_mb);
+// top: how many of the largest matches to list (0 = default of 50);
+// stream: print matches as they are found instead of a sorted table
+int cmd_findlarge(const char *path, unsigned long long min_size_mb, const WalkOptions *opts,
+                  int top, int stream);
 
 // Password generator flags
 #define PASS_ALPHA     (1 << 0)
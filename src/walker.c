@@ -0,0 +1,724 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "walker.h"
+#include "uring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+
+int walk_jobs(const WalkOptions *opts) {
+    (void)opts;
+    return 1;
+}
+
+int walk_tree(const char *root, const WalkOptions *opts, walk_visit_fn visit, void *ctx) {
+    return walk_tree_data(root, NULL, opts, visit, NULL, ctx);
+}
+
+int walk_tree_data(const char *root, void *root_data, const WalkOptions *opts,
+                   walk_visit_fn visit, walk_done_fn done, void *ctx) {
+    (void)root; (void)root_data; (void)opts; (void)visit; (void)done; (void)ctx;
+    fprintf(stderr, "Parallel directory walking not supported on Windows yet\n");
+    return -1;
+}
+
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/sysmacros.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#define WALK_MAX_JOBS 256
+#define WALK_IDLE_WAIT_NS 1000000L
+#define WALK_DENTS_BUFFER (64 * 1024)
+#define WALK_DEFAULT_QUEUE_DEPTH 128
+
+#ifdef STATX_TYPE
+#define WALK_HAVE_STATX 1
+#endif
+
+// Layout of the records returned by getdents64(2)
+struct walk_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// A directory that has been discovered but not necessarily read yet. Child
+// directories are opened relative to their parent's fd, so the parent stays
+// open until every child has been opened: refs counts the parent's own
+// reader plus each child still waiting in a queue. The full path is only
+// kept for reporting and can be of any length.
+typedef struct WalkDir {
+    struct WalkDir *parent;
+    char *path;
+    size_t path_len;
+    const char *name;       // points into path
+    void *data;             // caller's cookie, see WalkEntry.dir_data
+    int depth;
+    int fd;
+    int refs;
+} WalkDir;
+
+// Per-worker double-ended queue of directories still to be read. The owner
+// pushes and pops at the tail so it walks depth-first with good locality;
+// idle workers steal from the head, which holds the shallowest (and usually
+// largest) pending subtrees.
+typedef struct WalkDeque {
+    pthread_mutex_t lock;
+    WalkDir **tasks;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} WalkDeque;
+
+typedef struct Walker {
+    WalkDeque *deques;
+    int jobs;
+    int stat_dirs;
+    const WalkFilter *filter;   // NULL when nothing is filtered
+    dev_t root_dev;         // for filter->xdev
+    ScanStats *stats;
+    walk_visit_fn visit;
+    walk_done_fn done;
+    void *ctx;
+    long pending;           // directories queued or being read
+    long errors;            // entries that could not be read
+    int report_errors;
+    int file_paths;         // build entry->path for non-directories
+    int sleeping;           // workers waiting for work
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+} Walker;
+
+#ifdef WALK_HAVE_STATX
+// statx requests waiting to be submitted through the worker's io_uring
+typedef struct WalkBatch {
+    const char **names;
+    size_t *path_at;        // the path the exclude test joined, as an offset
+                            // into the worker's path_buf; SIZE_MAX if none
+    size_t *path_len;
+    struct statx *stx;
+    int *results;
+    size_t count;
+    size_t capacity;
+} WalkBatch;
+#endif
+
+typedef struct WalkWorker {
+    Walker *walker;
+    int id;
+    unsigned int seed;
+    char *path_buf;
+    size_t path_cap;
+    size_t path_keep;       // leading path_buf bytes held by batched entries
+    char *dents;
+    Uring *ring;            // NULL when using the synchronous backend
+#ifdef WALK_HAVE_STATX
+    WalkBatch batch;
+#endif
+} WalkWorker;
+
+// Each worker gets its own ring (rings are not thread-safe). Workers that
+// can't get one, or builds without statx, fall back to fstatat().
+static void walk_worker_init_backend(WalkWorker *worker, const WalkOptions *opts) {
+    if (!opts || opts->backend != WALK_BACKEND_URING) return;
+#ifdef WALK_HAVE_STATX
+    unsigned depth = opts->queue_depth > 0 ? (unsigned)opts->queue_depth : WALK_DEFAULT_QUEUE_DEPTH;
+    worker->ring = uring_create(depth);
+    if (!worker->ring) return;
+    
+    WalkBatch *batch = &worker->batch;
+    batch->capacity = uring_depth(worker->ring);
+    batch->names = malloc(batch->capacity * sizeof(const char*));
+    batch->path_at = malloc(batch->capacity * sizeof(size_t));
+    batch->path_len = malloc(batch->capacity * sizeof(size_t));
+    batch->stx = malloc(batch->capacity * sizeof(struct statx));
+    batch->results = malloc(batch->capacity * sizeof(int));
+    if (!batch->names || !batch->path_at || !batch->path_len || !batch->stx || !batch->results) {
+        uring_destroy(worker->ring);
+        worker->ring = NULL;
+    }
+#endif
+}
+
+static void walk_worker_free_backend(WalkWorker *worker) {
+    uring_destroy(worker->ring);
+    worker->ring = NULL;
+#ifdef WALK_HAVE_STATX
+    free(worker->batch.names);
+    free(worker->batch.path_at);
+    free(worker->batch.path_len);
+    free(worker->batch.stx);
+    free(worker->batch.results);
+#endif
+}
+
+int walk_jobs(const WalkOptions *opts) {
+    int jobs = opts ? opts->jobs : 0;
+    if (jobs <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? (int)cpus : 1;
+    }
+    return jobs > WALK_MAX_JOBS ? WALK_MAX_JOBS : jobs;
+}
+
+static int walk_deque_push(WalkDeque *dq, WalkDir *task) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail == dq->capacity) {
+        if (dq->head > 0) {
+            memmove(dq->tasks, dq->tasks + dq->head, (dq->tail - dq->head) * sizeof(WalkDir*));
+            dq->tail -= dq->head;
+            dq->head = 0;
+        } else {
+            size_t new_cap = dq->capacity ? dq->capacity * 2 : 64;
+            WalkDir **tasks = realloc(dq->tasks, new_cap * sizeof(WalkDir*));
+            if (!tasks) {
+                pthread_mutex_unlock(&dq->lock);
+                return -1;
+            }
+            dq->tasks = tasks;
+            dq->capacity = new_cap;
+        }
+    }
+    dq->tasks[dq->tail++] = task;
+    pthread_mutex_unlock(&dq->lock);
+    return 0;
+}
+
+static WalkDir* walk_deque_pop(WalkDeque *dq) {
+    WalkDir *task = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) {
+        task = dq->tasks[--dq->tail];
+        if (dq->tail == dq->head) dq->head = dq->tail = 0;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return task;
+}
+
+static WalkDir* walk_deque_steal(WalkDeque *dq) {
+    WalkDir *task = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) {
+        task = dq->tasks[dq->head++];
+        if (dq->tail == dq->head) dq->head = dq->tail = 0;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return task;
+}
+
+static WalkDir* walk_steal(WalkWorker *worker) {
+    Walker *walker = worker->walker;
+    if (walker->jobs < 2) return NULL;
+    
+    // Start at a random victim so thieves don't all hammer the same deque
+    int start = (int)(rand_r(&worker->seed) % (unsigned int)walker->jobs);
+    for (int i = 0; i < walker->jobs; i++) {
+        int victim = (start + i) % walker->jobs;
+        if (victim == worker->id) continue;
+        WalkDir *task = walk_deque_steal(&walker->deques[victim]);
+        if (task) return task;
+    }
+    return NULL;
+}
+
+static void walk_wake_idle(Walker *walker, int broadcast) {
+    if (__atomic_load_n(&walker->sleeping, __ATOMIC_ACQUIRE) == 0 && !broadcast) return;
+    pthread_mutex_lock(&walker->idle_lock);
+    if (broadcast) {
+        pthread_cond_broadcast(&walker->idle_cond);
+    } else {
+        pthread_cond_signal(&walker->idle_cond);
+    }
+    pthread_mutex_unlock(&walker->idle_lock);
+}
+
+static WalkDir* walk_dir_new(WalkDir *parent, const char *path, size_t path_len, size_t name_off, int depth) {
+    WalkDir *dir = malloc(sizeof(WalkDir));
+    if (!dir) return NULL;
+    dir->path = malloc(path_len + 1);
+    if (!dir->path) {
+        free(dir);
+        return NULL;
+    }
+    memcpy(dir->path, path, path_len + 1);
+    dir->path_len = path_len;
+    dir->name = dir->path + name_off;
+    dir->parent = parent;
+    dir->data = NULL;
+    dir->depth = depth;
+    dir->fd = -1;
+    dir->refs = 1;
+    return dir;
+}
+
+static void walk_dir_release(WalkDir *dir) {
+    if (__atomic_sub_fetch(&dir->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+    if (dir->fd >= 0) close(dir->fd);
+    free(dir->path);
+    free(dir);
+}
+
+// Join dir's path and name at offset at of the worker's buffer, past any
+// paths still held there by a pending statx batch
+static const char* walk_join_path(WalkWorker *worker, const WalkDir *dir, const char *name,
+                                  size_t *name_off, size_t *path_len) {
+    size_t at = worker->path_keep;
+    size_t name_len = strlen(name);
+    size_t needed = at + dir->path_len + 1 + name_len + 1;
+    
+    if (needed > worker->path_cap) {
+        size_t new_cap = worker->path_cap ? worker->path_cap : 256;
+        while (new_cap < needed) new_cap *= 2;
+        char *buf = realloc(worker->path_buf, new_cap);
+        if (!buf) return NULL;
+        worker->path_buf = buf;
+        worker->path_cap = new_cap;
+    }
+    
+    char *out = worker->path_buf + at;
+    memcpy(out, dir->path, dir->path_len);
+    size_t pos = dir->path_len;
+    if (pos == 0 || dir->path[pos - 1] != '/') out[pos++] = '/';
+    memcpy(out + pos, name, name_len + 1);
+    *name_off = pos;
+    *path_len = pos + name_len;
+    return out;
+}
+
+// An entry's full path in the worker's buffer, joined on first use so that
+// the exclude test and the visit share one copy
+typedef struct WalkPath {
+    const char *full;       // NULL until joined
+    size_t name_off;
+    size_t len;
+} WalkPath;
+
+static const char* walk_entry_path(WalkWorker *worker, const WalkDir *dir, const char *name,
+                                   WalkPath *path) {
+    if (!path->full) path->full = walk_join_path(worker, dir, name, &path->name_off, &path->len);
+    return path->full;
+}
+
+// Something below the root could not be read. It is counted, so callers
+// can tell that the walk is incomplete, and reported if they asked for it.
+static void walk_error(WalkWorker *worker, const char *path, int err) {
+    Walker *walker = worker->walker;
+    __atomic_add_fetch(&walker->errors, 1, __ATOMIC_RELAXED);
+    if (walker->report_errors) fprintf(stderr, "Cannot read %s: %s\n", path ? path : "?", strerror(err));
+}
+
+// Same for an entry of dir that has no full path yet
+static void walk_entry_error(WalkWorker *worker, const WalkDir *dir, const char *name, int err) {
+    size_t name_off, path_len;
+    walk_error(worker, walk_join_path(worker, dir, name, &name_off, &path_len), err);
+}
+
+static WalkType walk_type_from_dirent(unsigned char d_type) {
+    switch (d_type) {
+        case DT_REG: return WALK_FILE;
+        case DT_DIR: return WALK_DIR;
+        case DT_LNK: return WALK_SYMLINK;
+        case DT_UNKNOWN: return WALK_UNKNOWN;
+        default: return WALK_OTHER;
+    }
+}
+
+static WalkType walk_type_from_mode(mode_t mode) {
+    if (S_ISREG(mode)) return WALK_FILE;
+    if (S_ISDIR(mode)) return WALK_DIR;
+    if (S_ISLNK(mode)) return WALK_SYMLINK;
+    return WALK_OTHER;
+}
+
+static int walk_open_dir(WalkDir *dir) {
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+    if (!dir->parent) return open(dir->path, flags);
+    
+    // Relative to the parent, so the kernel only resolves one component
+    int fd = openat(dir->parent->fd, dir->name, flags | O_NOFOLLOW);
+    int err = errno;
+    walk_dir_release(dir->parent);
+    dir->parent = NULL;
+    errno = err;
+    return fd;
+}
+
+static void walk_queue_child(WalkWorker *worker, WalkDir *dir, const char *path,
+                             size_t path_len, size_t name_off, void *data) {
+    Walker *walker = worker->walker;
+    WalkDir *child = walk_dir_new(dir, path, path_len, name_off, dir->depth + 1);
+    if (!child) {
+        walk_error(worker, path, ENOMEM);
+        if (walker->done) walker->done(data, worker->id, walker->ctx);
+        return;
+    }
+    child->data = data;
+    
+    __atomic_add_fetch(&dir->refs, 1, __ATOMIC_ACQ_REL);
+    scan_stats_queue(walker->stats, __atomic_add_fetch(&walker->pending, 1, __ATOMIC_ACQ_REL));
+    if (walk_deque_push(&walker->deques[worker->id], child) != 0) {
+        __atomic_sub_fetch(&walker->pending, 1, __ATOMIC_ACQ_REL);
+        walk_error(worker, path, ENOMEM);
+        if (walker->done) walker->done(data, worker->id, walker->ctx);
+        walk_dir_release(child);
+        walk_dir_release(dir);
+        return;
+    }
+    walk_wake_idle(walker, 0);
+}
+
+// Whether to read a directory that has just been reported
+static int walk_descend(const Walker *walker, const WalkDir *dir, const struct stat *st) {
+    const WalkFilter *filter = walker->filter;
+    if (!filter) return 1;
+    if (filter->max_depth && dir->depth + 1 >= filter->max_depth) return 0;
+    if (filter->xdev && st && st->st_dev != walker->root_dev) return 0;
+    return 1;
+}
+
+// Exclude patterns only need the name, so they are checked before the
+// entry is stat'ed and excluded directories are never opened
+static int walk_excluded(WalkWorker *worker, const WalkDir *dir, const char *name, WalkPath *path) {
+    const WalkFilter *filter = worker->walker->filter;
+    if (!filter || !filter->excludes) return 0;
+    const char *full_path = walk_entry_path(worker, dir, name, path);
+    return full_path && walk_filter_excluded(filter, full_path, name);
+}
+
+// path may already hold the entry's full path; directories always get one,
+// other entries only if the caller or a pattern needs it
+static void walk_emit(WalkWorker *worker, WalkDir *dir, const char *name, WalkType type,
+                      const struct stat *st, WalkPath *path) {
+    Walker *walker = worker->walker;
+    if ((type == WALK_DIR || walker->file_paths) && !walk_entry_path(worker, dir, name, path)) return;
+    if (type == WALK_FILE && walker->filter && st &&
+        !walk_filter_file(walker->filter, path->full, name, st)) {
+        return;
+    }
+    
+    void *child_data = NULL;
+    WalkEntry we = {
+        .path = path->full,
+        .name = name,
+        .type = type,
+        .st = st,
+        .dirfd = dir->fd,
+        .depth = dir->depth + 1,
+        .worker = worker->id,
+        .dir_data = dir->data,
+        .child_data = type == WALK_DIR ? &child_data : NULL,
+    };
+    walker->visit(&we, walker->ctx);
+    
+    if (type != WALK_DIR) return;
+    if (walk_descend(walker, dir, st)) {
+        walk_queue_child(worker, dir, path->full, path->len, path->name_off, child_data);
+    } else if (walker->done) {
+        walker->done(child_data, worker->id, walker->ctx);
+    }
+}
+
+// d_type lets us skip the stat for anything the caller doesn't need
+// metadata for; only DT_UNKNOWN forces a lookup to classify the entry
+static int walk_needs_stat(const Walker *walker, WalkType type) {
+    return type == WALK_FILE || type == WALK_UNKNOWN || (type == WALK_DIR && walker->stat_dirs);
+}
+
+#ifdef WALK_HAVE_STATX
+#define WALK_STATX_MASK (STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_INO | \
+                         STATX_SIZE | STATX_BLOCKS | STATX_MTIME | STATX_CTIME)
+
+static void walk_statx_to_stat(const struct statx *stx, struct stat *st) {
+    memset(st, 0, sizeof(*st));
+    st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    st->st_ino = stx->stx_ino;
+    st->st_mode = stx->stx_mode;
+    st->st_nlink = stx->stx_nlink;
+    st->st_uid = stx->stx_uid;
+    st->st_gid = stx->stx_gid;
+    st->st_size = (off_t)stx->stx_size;
+    st->st_blksize = stx->stx_blksize;
+    st->st_blocks = (blkcnt_t)stx->stx_blocks;
+    st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+    st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+    st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+// A batched entry's path, if the exclude test already joined it
+static WalkPath walk_batch_path(const WalkWorker *worker, size_t i) {
+    const WalkBatch *batch = &worker->batch;
+    WalkPath path = {0};
+    if (batch->path_at[i] == SIZE_MAX) return path;
+    path.full = worker->path_buf + batch->path_at[i];
+    path.len = batch->path_len[i];
+    path.name_off = path.len - strlen(batch->names[i]);
+    return path;
+}
+
+// Issue the queued statx requests as one io_uring submission, then report
+// the entries in the order they were read
+static void walk_flush_batch(WalkWorker *worker, WalkDir *dir) {
+    WalkBatch *batch = &worker->batch;
+    if (batch->count == 0) return;
+    
+    for (size_t i = 0; i < batch->count; i++) {
+        batch->results[i] = -1;
+        uring_prep_statx(worker->ring, dir->fd, batch->names[i], AT_SYMLINK_NOFOLLOW,
+                         WALK_STATX_MASK, &batch->stx[i], i);
+    }
+    uint64_t start = scan_stats_now(worker->walker->stats);
+    int rc = uring_submit_wait(worker->ring, batch->results, batch->count);
+    scan_stats_stat(worker->walker->stats, worker->id, batch->count, start);
+    if (rc != 0) {
+        // The ring is unusable; finish this batch and the walk synchronously
+        for (size_t i = 0; i < batch->count; i++) batch->results[i] = -1;
+        uring_destroy(worker->ring);
+        worker->ring = NULL;
+        for (size_t i = 0; i < batch->count; i++) {
+            struct stat st;
+            if (fstatat(dir->fd, batch->names[i], &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                walk_entry_error(worker, dir, batch->names[i], errno);
+                continue;
+            }
+            WalkPath path = walk_batch_path(worker, i);
+            walk_emit(worker, dir, batch->names[i], walk_type_from_mode(st.st_mode), &st, &path);
+        }
+        batch->count = 0;
+        worker->path_keep = 0;
+        return;
+    }
+    
+    for (size_t i = 0; i < batch->count; i++) {
+        if (batch->results[i] != 0) {
+            walk_entry_error(worker, dir, batch->names[i], -batch->results[i]);
+            continue;
+        }
+        struct stat st;
+        WalkPath path = walk_batch_path(worker, i);
+        walk_statx_to_stat(&batch->stx[i], &st);
+        walk_emit(worker, dir, batch->names[i], walk_type_from_mode(st.st_mode), &st, &path);
+    }
+    batch->count = 0;
+    worker->path_keep = 0;
+}
+#endif
+
+static void walk_process_dir(WalkWorker *worker, WalkDir *dir) {
+    Walker *walker = worker->walker;
+    dir->fd = walk_open_dir(dir);
+    if (dir->fd < 0) {
+        walk_error(worker, dir->path, errno);
+        if (walker->done) walker->done(dir->data, worker->id, walker->ctx);
+        walk_dir_release(dir);
+        return;
+    }
+    
+    uint64_t entries = 0;
+    long nread;
+    while ((nread = syscall(SYS_getdents64, dir->fd, worker->dents, WALK_DENTS_BUFFER)) > 0) {
+        for (long off = 0; off < nread;) {
+            struct walk_dirent64 *d = (struct walk_dirent64 *)(worker->dents + off);
+            off += d->d_reclen;
+            
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+            entries++;
+            
+            WalkPath path = {0};
+            if (walk_excluded(worker, dir, name, &path)) continue;
+            
+            WalkType type = walk_type_from_dirent(d->d_type);
+            if (!walk_needs_stat(walker, type)) {
+                walk_emit(worker, dir, name, type, NULL, &path);
+                continue;
+            }
+            
+#ifdef WALK_HAVE_STATX
+            if (worker->ring) {
+                // Names point into the dents buffer, which stays valid
+                // until the batch is flushed below. A joined path stays
+                // put in path_buf: later joins go after it.
+                WalkBatch *batch = &worker->batch;
+                batch->names[batch->count] = name;
+                batch->path_at[batch->count] = path.full ? (size_t)(path.full - worker->path_buf) : SIZE_MAX;
+                batch->path_len[batch->count] = path.len;
+                if (path.full) worker->path_keep += path.len + 1;
+                batch->count++;
+                if (batch->count == batch->capacity) walk_flush_batch(worker, dir);
+                continue;
+            }
+#endif
+            
+            struct stat st;
+            uint64_t start = scan_stats_now(walker->stats);
+            int rc = fstatat(dir->fd, name, &st, AT_SYMLINK_NOFOLLOW);
+            int err = errno;
+            scan_stats_stat(walker->stats, worker->id, 1, start);
+            if (rc != 0) {
+                walk_entry_error(worker, dir, name, err);
+                continue;
+            }
+            walk_emit(worker, dir, name, walk_type_from_mode(st.st_mode), &st, &path);
+        }
+#ifdef WALK_HAVE_STATX
+        if (worker->ring) walk_flush_batch(worker, dir);
+#endif
+    }
+    if (nread < 0) walk_error(worker, dir->path, errno);
+    
+    scan_stats_dir(walker->stats, worker->id, entries);
+    if (walker->done) walker->done(dir->data, worker->id, walker->ctx);
+    walk_dir_release(dir);
+}
+
+static void* walk_worker_main(void *arg) {
+    WalkWorker *worker = arg;
+    Walker *walker = worker->walker;
+    
+    for (;;) {
+        WalkDir *task = walk_deque_pop(&walker->deques[worker->id]);
+        if (!task) task = walk_steal(worker);
+        if (task) {
+            walk_process_dir(worker, task);
+            long pending = __atomic_sub_fetch(&walker->pending, 1, __ATOMIC_ACQ_REL);
+            scan_stats_queue(walker->stats, pending);
+            if (pending == 0) walk_wake_idle(walker, 1);
+            continue;
+        }
+        
+        if (__atomic_load_n(&walker->pending, __ATOMIC_ACQUIRE) == 0) break;
+        
+        // Nothing to steal right now; other workers are still reading
+        // directories that may produce more work. The timeout bounds the
+        // cost of a wakeup that races with going to sleep.
+        pthread_mutex_lock(&walker->idle_lock);
+        __atomic_add_fetch(&walker->sleeping, 1, __ATOMIC_ACQ_REL);
+        if (__atomic_load_n(&walker->pending, __ATOMIC_ACQUIRE) != 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += WALK_IDLE_WAIT_NS;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&walker->idle_cond, &walker->idle_lock, &deadline);
+        }
+        __atomic_sub_fetch(&walker->sleeping, 1, __ATOMIC_ACQ_REL);
+        pthread_mutex_unlock(&walker->idle_lock);
+    }
+    
+    return NULL;
+}
+
+// Parents stay open while their children wait in a queue, so a wide tree
+// can hold many descriptors at once; allow as many as the hard limit does.
+static void walk_raise_fd_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+int walk_tree(const char *root, const WalkOptions *opts, walk_visit_fn visit, void *ctx) {
+    return walk_tree_data(root, NULL, opts, visit, NULL, ctx);
+}
+
+int walk_tree_data(const char *root, void *root_data, const WalkOptions *opts,
+                   walk_visit_fn visit, walk_done_fn done, void *ctx) {
+    Walker walker;
+    memset(&walker, 0, sizeof(walker));
+    walker.jobs = walk_jobs(opts);
+    walker.stat_dirs = opts ? opts->stat_dirs : 0;
+    walker.stats = opts ? opts->stats : NULL;
+    walker.filter = opts && walk_filter_active(opts->filter) ? opts->filter : NULL;
+    if (walker.filter && walker.filter->xdev) {
+        // Mount points are only recognised by their st_dev
+        struct stat st;
+        walker.stat_dirs = 1;
+        if (stat(root, &st) == 0) walker.root_dev = st.st_dev;
+    }
+    walker.report_errors = opts ? opts->report_errors : 0;
+    // Patterns match against the path; size and age predicates don't
+    walker.file_paths = !(opts && opts->names_only) ||
+                        (walker.filter && (walker.filter->excludes || walker.filter->includes));
+    walker.visit = visit;
+    walker.done = done;
+    walker.ctx = ctx;
+    
+    walker.deques = calloc((size_t)walker.jobs, sizeof(WalkDeque));
+    WalkWorker *workers = calloc((size_t)walker.jobs, sizeof(WalkWorker));
+    pthread_t *threads = calloc((size_t)walker.jobs, sizeof(pthread_t));
+    WalkDir *root_dir = walk_dir_new(NULL, root, strlen(root), 0, 0);
+    if (root_dir) root_dir->data = root_data;
+    int alloc_failed = !walker.deques || !workers || !threads || !root_dir;
+    for (int i = 0; !alloc_failed && i < walker.jobs; i++) {
+        workers[i].dents = malloc(WALK_DENTS_BUFFER);
+        if (!workers[i].dents) alloc_failed = 1;
+    }
+    if (alloc_failed) {
+        fprintf(stderr, "Memory allocation failed\n");
+        for (int i = 0; workers && i < walker.jobs; i++) free(workers[i].dents);
+        if (root_dir) walk_dir_release(root_dir);
+        free(walker.deques);
+        free(workers);
+        free(threads);
+        return -1;
+    }
+    
+    walk_raise_fd_limit();
+    pthread_mutex_init(&walker.idle_lock, NULL);
+    pthread_cond_init(&walker.idle_cond, NULL);
+    for (int i = 0; i < walker.jobs; i++) {
+        pthread_mutex_init(&walker.deques[i].lock, NULL);
+        workers[i].walker = &walker;
+        workers[i].id = i;
+        workers[i].seed = (unsigned int)i * 2654435761u + 1;
+        walk_worker_init_backend(&workers[i], opts);
+    }
+    
+    walker.pending = 1;
+    walk_deque_push(&walker.deques[0], root_dir);
+    
+    // The calling thread acts as worker 0
+    int started[WALK_MAX_JOBS] = {0};
+    for (int i = 1; i < walker.jobs; i++) {
+        started[i] = pthread_create(&threads[i], NULL, walk_worker_main, &workers[i]) == 0;
+    }
+    walk_worker_main(&workers[0]);
+    for (int i = 1; i < walker.jobs; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+    
+    for (int i = 0; i < walker.jobs; i++) {
+        pthread_mutex_destroy(&walker.deques[i].lock);
+        free(walker.deques[i].tasks);
+        free(workers[i].path_buf);
+        free(workers[i].dents);
+        walk_worker_free_backend(&workers[i]);
+    }
+    pthread_cond_destroy(&walker.idle_cond);
+    pthread_mutex_destroy(&walker.idle_lock);
+    free(walker.deques);
+    free(workers);
+    free(threads);
+    return walker.errors > INT_MAX ? INT_MAX : (int)walker.errors;
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef WALKER_H
+#define WALKER_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "filter.h"
+#include "scanstats.h"
+#include "snapshot.h"
+
+// Shared parallel directory walker used by finddup, findlarge and
+// get_dir_size. Directories are distributed over a work-stealing pool of
+// worker threads; the visit callback runs concurrently on those workers.
+// On Linux directories are read with getdents64 and every lookup is made
+// relative to the parent directory fd, so paths can be of any length.
+
+typedef enum {
+    WALK_BACKEND_SYNC,      // one fstatat() per entry
+    WALK_BACKEND_URING      // batched statx through io_uring, falls back to sync
+} WalkBackend;
+
+typedef struct WalkOptions {
+    int jobs;               // worker threads, 0 = one per online CPU
+    int stat_dirs;          // also fill in st for directories
+    WalkBackend backend;
+    int queue_depth;        // io_uring submission batch size, 0 = default
+    const WalkFilter *filter;   // entries to prune during the walk, may be NULL
+    ScanStats *stats;       // live metrics, may be NULL
+    Snapshot *snapshot;     // diskusage/findlarge record every file here,
+                            // may be NULL
+    int report_errors;      // print every directory or entry that can't be
+                            // read to stderr
+    int names_only;         // visit only reads entry->name: entry->path is NULL
+                            // except for directories, saving a copy per file
+} WalkOptions;
+
+typedef enum {
+    WALK_FILE,
+    WALK_DIR,
+    WALK_SYMLINK,
+    WALK_OTHER,
+    WALK_UNKNOWN            // internal: d_type not reported by the filesystem
+} WalkType;
+
+typedef struct WalkEntry {
+    const char *path;       // full path of the entry (see names_only)
+    const char *name;       // last path component
+    WalkType type;
+    const struct stat *st;  // lstat() result for regular files, NULL when
+                            // the entry type alone was enough
+    int dirfd;              // open fd of the containing directory
+    int depth;              // 1 for direct children of the root
+    int worker;             // index of the reporting worker, < walk_jobs()
+    void *dir_data;         // cookie attached to the containing directory
+    void **child_data;      // WALK_DIR only: set *child_data to attach a
+                            // cookie that this directory's entries will see
+} WalkEntry;
+
+// Called for every entry below the root that passes opts->filter
+// (directories included, before they are descended into). Callbacks for
+// different workers run in parallel, so per-worker state should be
+// indexed by entry->worker.
+typedef void (*walk_visit_fn)(const WalkEntry *entry, void *ctx);
+
+// Called once per directory cookie (including root_data) after every entry
+// of that directory has been visited, or after it failed to open or was
+// not descended into (max depth, other filesystem). Children
+// may still be pending; callers that aggregate bottom-up count them.
+typedef void (*walk_done_fn)(void *dir_data, int worker, void *ctx);
+
+int walk_jobs(const WalkOptions *opts);
+
+// Both return -1 if the walk could not be started, otherwise the number of
+// directories and entries below the root that could not be read (failed
+// opens, directory read errors, failed stats). Those are left out of the
+// walk, so a caller that must see the whole tree has to check for 0.
+int walk_tree(const char *root, const WalkOptions *opts, walk_visit_fn visit, void *ctx);
+
+// Same as walk_tree, with root_data as the dir_data of the root's entries.
+// Directory cookies let callers build per-directory state (such as a path
+// tree) without re-parsing entry->path. done may be NULL.
+int walk_tree_data(const char *root, void *root_data, const WalkOptions *opts,
+                   walk_visit_fn visit, walk_done_fn done, void *ctx);
+
+#endif
@@ -0,0 +1,593 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "watch.h"
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef __linux__
+
+int cmd_diskusage_watch(const char *path, const WalkOptions *opts, SizeMode mode, int depth,
+                        int top, volatile int *running) {
+    (void)path; (void)opts; (void)mode; (void)depth; (void)top; (void)running;
+    fprintf(stderr, "Watch mode not supported on this platform yet\n");
+    return 1;
+}
+
+int cmd_findlarge_watch(const char *path, unsigned long long min_size_mb, const WalkOptions *opts,
+                        int top, volatile int *running) {
+    (void)path; (void)min_size_mb; (void)opts; (void)top; (void)running;
+    fprintf(stderr, "Watch mode not supported on this platform yet\n");
+    return 1;
+}
+
+#else
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define WATCH_RENDER_MS 1000
+#define WATCH_EVENT_BUFFER (64 * 1024)
+#define WATCH_INITIAL_SLOTS 1024
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | \
+                    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | \
+                    IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+// Events after which the named file is re-stat'ed
+#define WATCH_REFRESH (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_TO)
+
+typedef struct WatchFile WatchFile;
+
+typedef struct WatchDir {
+    ScanPath path;                  // name plus parent, see arena.h
+    struct WatchDir *parent;
+    struct WatchDir *children;      // first subdirectory
+    struct WatchDir *next;          // next sibling
+    WatchFile *files;               // regular files directly inside
+    int wd;                         // inotify watch descriptor, -1 if none
+    int depth;
+    long long total;                // subtree bytes
+    long long count;                // subtree files
+} WatchDir;
+
+struct WatchFile {
+    WatchDir *dir;
+    WatchFile *prev;                // files of the same directory
+    WatchFile *next;
+    unsigned long long size;
+    char name[];
+};
+
+typedef enum {
+    WATCH_VIEW_DIRS,
+    WATCH_VIEW_FILES
+} WatchView;
+
+typedef struct Watch {
+    int fd;                         // inotify instance
+    const char *root_path;
+    WatchDir *root;
+    WatchDir **by_wd;               // indexed by watch descriptor
+    size_t wd_cap;
+    WatchFile **slots;              // (dir, name) -> file, open addressing
+    size_t used;                    // live entries plus tombstones
+    size_t live;
+    size_t mask;
+    SizeMode mode;
+    const WalkOptions *opts;
+    const WalkFilter *filter;       // NULL unless it filters something
+    pthread_mutex_t lock;           // taken by walker workers during scans
+    unsigned long long events;
+    unsigned long long watch_failures;
+    int changed;
+    int overflow;                   // kernel queue overflowed: rescan
+    int lost_root;
+    
+    WatchView view;
+    int depth;
+    int top;
+    unsigned long long min_size;
+} Watch;
+
+// Marks a deleted hash slot so probe chains stay intact
+static WatchFile watch_tombstone;
+#define WATCH_TOMBSTONE (&watch_tombstone)
+
+static unsigned long long watch_usage(const Watch *w, const struct stat *st) {
+    if (w->mode == SIZE_ALLOCATED) return (unsigned long long)st->st_blocks * 512;
+    return (unsigned long long)st->st_size;
+}
+
+static size_t watch_hash(const WatchDir *dir, const char *name) {
+    uint64_t h = 14695981039346656037ULL ^ (uint64_t)(uintptr_t)dir;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return (size_t)(h ^ (h >> 29));
+}
+
+// The slot holding (dir, name), or the one a new entry should go into
+static WatchFile** watch_slot(Watch *w, const WatchDir *dir, const char *name) {
+    WatchFile **free_slot = NULL;
+    for (size_t i = watch_hash(dir, name) & w->mask;; i = (i + 1) & w->mask) {
+        WatchFile *f = w->slots[i];
+        if (!f) return free_slot ? free_slot : &w->slots[i];
+        if (f == WATCH_TOMBSTONE) {
+            if (!free_slot) free_slot = &w->slots[i];
+        } else if (f->dir == dir && strcmp(f->name, name) == 0) {
+            return &w->slots[i];
+        }
+    }
+}
+
+// Rebuild the table, doubling it if it is filling up with live entries
+static int watch_rehash(Watch *w) {
+    size_t cap = w->mask + 1;
+    if (w->live * 4 >= cap) cap *= 2;
+    WatchFile **old = w->slots;
+    size_t old_cap = w->mask + 1;
+    w->slots = calloc(cap, sizeof(WatchFile*));
+    if (!w->slots) {
+        w->slots = old;
+        return -1;
+    }
+    w->mask = cap - 1;
+    w->used = w->live;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i] && old[i] != WATCH_TOMBSTONE) *watch_slot(w, old[i]->dir, old[i]->name) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+static void watch_account(WatchDir *dir, long long bytes, long long files) {
+    for (; dir; dir = dir->parent) {
+        dir->total += bytes;
+        dir->count += files;
+    }
+}
+
+static void watch_set_file(Watch *w, WatchDir *dir, const char *name, unsigned long long size) {
+    if ((w->used + 1) * 2 > w->mask + 1 && watch_rehash(w) != 0) return;
+    WatchFile **slot = watch_slot(w, dir, name);
+    WatchFile *f = *slot;
+    if (f && f != WATCH_TOMBSTONE) {
+        watch_account(dir, (long long)size - (long long)f->size, 0);
+        f->size = size;
+        return;
+    }
+    
+    size_t len = strlen(name);
+    f = malloc(sizeof(WatchFile) + len + 1);
+    if (!f) return;
+    memcpy(f->name, name, len + 1);
+    f->dir = dir;
+    f->size = size;
+    f->prev = NULL;
+    f->next = dir->files;
+    if (dir->files) dir->files->prev = f;
+    dir->files = f;
+    
+    if (!*slot) w->used++;
+    *slot = f;
+    w->live++;
+    watch_account(dir, (long long)size, 1);
+}
+
+static void watch_unlink_file(Watch *w, WatchFile **slot) {
+    WatchFile *f = *slot;
+    if (f->prev) {
+        f->prev->next = f->next;
+    } else {
+        f->dir->files = f->next;
+    }
+    if (f->next) f->next->prev = f->prev;
+    *slot = WATCH_TOMBSTONE;
+    w->live--;
+    free(f);
+}
+
+static int watch_remove_file(Watch *w, WatchDir *dir, const char *name) {
+    WatchFile **slot = watch_slot(w, dir, name);
+    WatchFile *f = *slot;
+    if (!f || f == WATCH_TOMBSTONE) return 0;
+    watch_account(dir, -(long long)f->size, -1);
+    watch_unlink_file(w, slot);
+    return 1;
+}
+
+static int watch_map_wd(Watch *w, WatchDir *dir) {
+    if ((size_t)dir->wd >= w->wd_cap) {
+        size_t cap = w->wd_cap ? w->wd_cap : 1024;
+        while (cap <= (size_t)dir->wd) cap *= 2;
+        WatchDir **by_wd = realloc(w->by_wd, cap * sizeof(WatchDir*));
+        if (!by_wd) return -1;
+        memset(by_wd + w->wd_cap, 0, (cap - w->wd_cap) * sizeof(WatchDir*));
+        w->by_wd = by_wd;
+        w->wd_cap = cap;
+    }
+    w->by_wd[dir->wd] = dir;
+    return 0;
+}
+
+// Link a new directory under parent. The inotify watch is added by the
+// caller before the directory is read, so nothing created meanwhile is lost.
+static WatchDir* watch_dir_new(Watch *w, WatchDir *parent, const char *name, int wd) {
+    size_t len = strlen(name);
+    WatchDir *dir = calloc(1, sizeof(WatchDir) + len + 1);
+    if (!dir) {
+        if (wd >= 0) inotify_rm_watch(w->fd, wd);
+        return NULL;
+    }
+    char *copy = (char *)(dir + 1);
+    memcpy(copy, name, len + 1);
+    dir->path.parent = parent ? &parent->path : NULL;
+    dir->path.name = copy;
+    dir->parent = parent;
+    dir->depth = parent ? parent->depth + 1 : 0;
+    dir->wd = wd;
+    if (parent) {
+        dir->next = parent->children;
+        parent->children = dir;
+    }
+    
+    if (wd < 0) {
+        w->watch_failures++;
+    } else if (watch_map_wd(w, dir) != 0) {
+        inotify_rm_watch(w->fd, wd);
+        dir->wd = -1;
+        w->watch_failures++;
+    }
+    return dir;
+}
+
+static void watch_dir_free(Watch *w, WatchDir *dir) {
+    WatchDir *child = dir->children;
+    while (child) {
+        WatchDir *next = child->next;
+        watch_dir_free(w, child);
+        child = next;
+    }
+    while (dir->files) watch_unlink_file(w, watch_slot(w, dir, dir->files->name));
+    if (dir->wd >= 0 && w->by_wd[dir->wd] == dir) {
+        if (w->fd >= 0) inotify_rm_watch(w->fd, dir->wd);
+        w->by_wd[dir->wd] = NULL;
+    }
+    free(dir);
+}
+
+static void watch_remove_dir(Watch *w, WatchDir *dir) {
+    WatchDir **link = &dir->parent->children;
+    while (*link != dir) link = &(*link)->next;
+    *link = dir->next;
+    watch_account(dir->parent, -dir->total, -dir->count);
+    watch_dir_free(w, dir);
+}
+
+static WatchDir* watch_find_child(WatchDir *dir, const char *name) {
+    for (WatchDir *child = dir->children; child; child = child->next) {
+        if (strcmp(child->path.name, name) == 0) return child;
+    }
+    return NULL;
+}
+
+static void watch_visit(const WalkEntry *entry, void *ctx) {
+    Watch *w = ctx;
+    WatchDir *dir = entry->dir_data;
+    if (!dir) return;
+    
+    if (entry->type == WALK_DIR) {
+        int wd = inotify_add_watch(w->fd, entry->path, WATCH_MASK);
+        pthread_mutex_lock(&w->lock);
+        *entry->child_data = watch_dir_new(w, dir, entry->name, wd);
+        pthread_mutex_unlock(&w->lock);
+    } else if (entry->type == WALK_FILE) {
+        unsigned long long size = watch_usage(w, entry->st);
+        pthread_mutex_lock(&w->lock);
+        watch_set_file(w, dir, entry->name, size);
+        pthread_mutex_unlock(&w->lock);
+    }
+}
+
+static int watch_build(Watch *w) {
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd < 0) {
+        fprintf(stderr, "inotify unavailable: %s\n", strerror(errno));
+        return -1;
+    }
+    w->mask = WATCH_INITIAL_SLOTS - 1;
+    w->slots = calloc(WATCH_INITIAL_SLOTS, sizeof(WatchFile*));
+    w->root = w->slots ? watch_dir_new(w, NULL, w->root_path, inotify_add_watch(w->fd, w->root_path, WATCH_MASK)) : NULL;
+    if (!w->root) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    walk_tree_data(w->root_path, w->root, w->opts, watch_visit, NULL, w);
+    return 0;
+}
+
+static void watch_teardown(Watch *w) {
+    // Closing the instance drops every watch at once
+    if (w->fd >= 0) close(w->fd);
+    w->fd = -1;
+    if (w->root) watch_dir_free(w, w->root);
+    free(w->slots);
+    free(w->by_wd);
+    w->root = NULL;
+    w->slots = NULL;
+    w->by_wd = NULL;
+    w->wd_cap = 0;
+    w->used = w->live = w->mask = 0;
+}
+
+static const char* watch_entry_path(const WatchDir *dir, const char *name, char **buf, size_t *cap) {
+    ScanPath entry;
+    entry.parent = &dir->path;
+    entry.name = name;
+    return scan_path_format(&entry, buf, cap);
+}
+
+static void watch_handle_event(Watch *w, const struct inotify_event *ev, char **buf, size_t *cap) {
+    if (ev->mask & IN_Q_OVERFLOW) {
+        w->overflow = 1;
+        return;
+    }
+    WatchDir *dir = ev->wd >= 0 && (size_t)ev->wd < w->wd_cap ? w->by_wd[ev->wd] : NULL;
+    if (!dir) return;
+    if (ev->mask & IN_IGNORED) {
+        w->by_wd[ev->wd] = NULL;
+        dir->wd = -1;
+        return;
+    }
+    if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        if (dir == w->root) w->lost_root = 1;
+        return;
+    }
+    if (ev->len == 0) return;
+    
+    const char *name = ev->name;
+    const char *path = watch_entry_path(dir, name, buf, cap);
+    if (!path) return;
+    int excluded = w->filter && walk_filter_excluded(w->filter, path, name);
+    w->events++;
+    
+    if (ev->mask & IN_ISDIR) {
+        WatchDir *child = watch_find_child(dir, name);
+        if (child && (ev->mask & (IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))) {
+            watch_remove_dir(w, child);
+            child = NULL;
+            w->changed = 1;
+        }
+        // A directory created while its parent was being scanned may
+        // already be known; anything moved in is scanned afresh
+        if (!child && !excluded && (ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+            child = watch_dir_new(w, dir, name, inotify_add_watch(w->fd, path, WATCH_MASK));
+            if (child) walk_tree_data(path, child, w->opts, watch_visit, NULL, w);
+            w->changed = 1;
+        }
+        return;
+    }
+    
+    struct stat st;
+    if (!(ev->mask & WATCH_REFRESH) || excluded || lstat(path, &st) != 0 || !S_ISREG(st.st_mode) ||
+        (w->filter && !walk_filter_file(w->filter, path, name, &st))) {
+        w->changed |= watch_remove_file(w, dir, name);
+        return;
+    }
+    watch_set_file(w, dir, name, watch_usage(w, &st));
+    w->changed = 1;
+}
+
+// Read and apply everything queued. A burst of writes to one file arrives
+// as a run of identical events, which only needs one stat.
+static void watch_drain(Watch *w, char *events, char **buf, size_t *cap) {
+    ssize_t len;
+    while ((len = read(w->fd, events, WATCH_EVENT_BUFFER)) > 0) {
+        const struct inotify_event *prev = NULL;
+        for (char *p = events; p < events + len;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            int repeat = prev && ev->wd == prev->wd && ev->len && prev->len &&
+                         !(ev->mask & IN_ISDIR) && (ev->mask & WATCH_REFRESH) &&
+                         (prev->mask & WATCH_REFRESH) && strcmp(ev->name, prev->name) == 0;
+            prev = ev;
+            if (!repeat) watch_handle_event(w, ev, buf, cap);
+        }
+    }
+}
+
+static int compare_watch_dirs(const void *a, const void *b) {
+    const WatchDir *da = *(const WatchDir * const *)a;
+    const WatchDir *db = *(const WatchDir * const *)b;
+    if (da->total != db->total) return da->total < db->total ? 1 : -1;
+    return 0;
+}
+
+static void watch_collect_dirs(WatchDir *dir, int depth, WatchDir ***list, size_t *count, size_t *cap) {
+    for (WatchDir *child = dir->children; child; child = child->next) {
+        if (*count == *cap) {
+            size_t new_cap = *cap ? *cap * 2 : 64;
+            WatchDir **grown = realloc(*list, new_cap * sizeof(WatchDir*));
+            if (!grown) return;
+            *list = grown;
+            *cap = new_cap;
+        }
+        (*list)[(*count)++] = child;
+        if (child->depth < depth) watch_collect_dirs(child, depth, list, count, cap);
+    }
+}
+
+static void watch_render_dirs(Watch *w, char **buf, size_t *cap) {
+    WatchDir **list = NULL;
+    size_t count = 0, list_cap = 0;
+    watch_collect_dirs(w->root, w->depth, &list, &count, &list_cap);
+    qsort(list, count, sizeof(WatchDir*), compare_watch_dirs);
+    
+    size_t shown = count < (size_t)w->top ? count : (size_t)w->top;
+    printf("Top %zu of %zu directories (depth %d):\n", shown, count, w->depth);
+    printf("%12s  %10s  %s\n", "Size", "Files", "Path");
+    printf("%12s  %10s  %s\n", "----", "-----", "----");
+    for (size_t i = 0; i < shown; i++) {
+        char size_str[50];
+        const char *path = scan_path_format(&list[i]->path, buf, cap);
+        if (!path) break;
+        format_size((unsigned long long)list[i]->total, size_str, sizeof(size_str));
+        printf("%12s  %10lld  %s\n", size_str, list[i]->count, path);
+    }
+    free(list);
+}
+
+static void watch_render_files(Watch *w, char **buf, size_t *cap) {
+    // Insertion into a small sorted array: one pass over the table
+    WatchFile **best = calloc((size_t)w->top, sizeof(WatchFile*));
+    size_t count = 0;
+    unsigned long long matches = 0;
+    if (!best) return;
+    for (size_t i = 0; i <= w->mask; i++) {
+        WatchFile *f = w->slots[i];
+        if (!f || f == WATCH_TOMBSTONE || f->size < w->min_size) continue;
+        matches++;
+        if (count == (size_t)w->top && f->size <= best[count - 1]->size) continue;
+        size_t pos = count < (size_t)w->top ? count++ : count - 1;
+        while (pos > 0 && best[pos - 1]->size < f->size) {
+            best[pos] = best[pos - 1];
+            pos--;
+        }
+        best[pos] = f;
+    }
+    
+    printf("Top %zu of %llu files of at least %llu MB:\n", count, matches, w->min_size / (1024 * 1024));
+    printf("%12s  %s\n", "Size", "Path");
+    printf("%12s  %s\n", "----", "----");
+    for (size_t i = 0; i < count; i++) {
+        char size_str[50];
+        const char *path = watch_entry_path(best[i]->dir, best[i]->name, buf, cap);
+        if (!path) break;
+        format_size(best[i]->size, size_str, sizeof(size_str));
+        printf("%12s  %s\n", size_str, path);
+    }
+    free(best);
+}
+
+static void watch_render(Watch *w, char **buf, size_t *cap) {
+    char time_str[16], total_str[50];
+    time_t now = time(NULL);
+    strftime(time_str, sizeof(time_str), "%H:%M:%S", localtime(&now));
+    format_size((unsigned long long)w->root->total, total_str, sizeof(total_str));
+    
+    if (isatty(STDOUT_FILENO)) printf("\033[2J\033[H");
+    printf("Watching %s (%s size) - %s, %llu events, Ctrl+C to exit\n", w->root_path,
+           w->mode == SIZE_ALLOCATED ? "allocated" : "apparent", time_str, w->events);
+    printf("Total: %s in %lld files\n", total_str, w->root->count);
+    if (w->watch_failures) {
+        printf("Warning: %llu directories are not watched (see fs.inotify.max_user_watches)\n",
+               w->watch_failures);
+    }
+    printf("\n");
+    
+    if (w->view == WATCH_VIEW_DIRS) {
+        watch_render_dirs(w, buf, cap);
+    } else {
+        watch_render_files(w, buf, cap);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static uint64_t watch_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static int watch_run(Watch *w, volatile int *running) {
+    struct stat st;
+    if (stat(w->root_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Cannot open directory %s\n", w->root_path);
+        return 1;
+    }
+    w->filter = w->opts && walk_filter_active(w->opts->filter) ? w->opts->filter : NULL;
+    pthread_mutex_init(&w->lock, NULL);
+    
+    char *events = malloc(WATCH_EVENT_BUFFER);
+    char *buf = NULL;
+    size_t cap = 0;
+    int rc = 0;
+    printf("Scanning %s...\n", w->root_path);
+    fflush(stdout);
+    if (!events || watch_build(w) != 0) {
+        rc = 1;
+        goto out;
+    }
+    watch_render(w, &buf, &cap);
+    
+    uint64_t last_render = watch_now_ms();
+    while (*running && !w->lost_root) {
+        struct pollfd pfd = { .fd = w->fd, .events = POLLIN, .revents = 0 };
+        int ready = poll(&pfd, 1, WATCH_RENDER_MS);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready > 0) watch_drain(w, events, &buf, &cap);
+        
+        if (w->overflow) {
+            // Events were dropped, so the tree can't be trusted any more
+            fprintf(stderr, "inotify queue overflowed, rescanning %s\n", w->root_path);
+            watch_teardown(w);
+            w->overflow = 0;
+            if (watch_build(w) != 0) {
+                rc = 1;
+                break;
+            }
+            w->changed = 1;
+        }
+        if (w->changed && watch_now_ms() - last_render >= WATCH_RENDER_MS) {
+            watch_render(w, &buf, &cap);
+            w->changed = 0;
+            last_render = watch_now_ms();
+        }
+    }
+    if (w->lost_root) fprintf(stderr, "%s was removed or moved away\n", w->root_path);
+
+out:
+    watch_teardown(w);
+    pthread_mutex_destroy(&w->lock);
+    free(events);
+    free(buf);
+    return rc;
+}
+
+static void watch_init(Watch *w, const char *path, const WalkOptions *opts, SizeMode mode) {
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    w->root_path = path;
+    w->opts = opts;
+    w->mode = mode;
+}
+
+int cmd_diskusage_watch(const char *path, const WalkOptions *opts, SizeMode mode, int depth,
+                        int top, volatile int *running) {
+    Watch w;
+    watch_init(&w, path, opts, mode);
+    w.view = WATCH_VIEW_DIRS;
+    w.depth = depth > 0 ? depth : 1;
+    w.top = top > 0 ? top : 20;
+    return watch_run(&w, running);
+}
+
+int cmd_findlarge_watch(const char *path, unsigned long long min_size_mb, const WalkOptions *opts,
+                        int top, volatile int *running) {
+    Watch w;
+    watch_init(&w, path, opts, SIZE_APPARENT);
+    w.view = WATCH_VIEW_FILES;
+    w.top = top > 0 ? top : 50;
+    w.min_size = min_size_mb * 1024 * 1024;
+    return watch_run(&w, running);
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "filetools.h"
+
+// Live views that scan once and then follow changes through inotify
+// instead of rescanning: a watch is placed on every directory, each event
+// re-stats only the entry it names, and size changes are propagated up the
+// in-memory tree. The view is redrawn (at most once a second) when
+// something changed, until *running drops to 0.
+//
+// Hard links are counted once per path and directories contribute no
+// blocks of their own, so totals can differ slightly from diskusage --tree.
+
+// Heaviest subdirectories up to depth levels below path
+int cmd_diskusage_watch(const char *path, const WalkOptions *opts, SizeMode mode, int depth,
+                        int top, volatile int *running);
+
+// Largest files of at least min_size_mb
+int cmd_findlarge_watch(const char *path, unsigned long long min_size_mb, const WalkOptions *opts,
+                        int top, volatile int *running);
+
+#endif
@@ -0,0 +1,547 @@
+#include "xxh3.h"
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define XXH3_HAVE_X86 1
+#endif
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME32_2 0x85EBCA77U
+#define PRIME32_3 0xC2B2AE3DU
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define XXH3_SECRET_SIZE 192
+#define XXH3_STRIPE_LEN 64
+#define XXH3_SECRET_CONSUME_RATE 8
+#define XXH3_SECRET_LIMIT (XXH3_SECRET_SIZE - XXH3_STRIPE_LEN)
+#define XXH3_STRIPES_PER_BLOCK (XXH3_SECRET_LIMIT / XXH3_SECRET_CONSUME_RATE)
+#define XXH3_BLOCK_LEN (XXH3_STRIPE_LEN * XXH3_STRIPES_PER_BLOCK)
+#define XXH3_SECRET_LASTACC_START 7
+#define XXH3_SECRET_MERGEACCS_START 11
+#define XXH3_MIDSIZE_MAX 240
+#define XXH3_BUFFER_STRIPES (sizeof(((Xxh3Ctx *)0)->buffer) / XXH3_STRIPE_LEN)
+
+static const uint8_t xxh3_secret[XXH3_SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t rotl64(uint64_t x, int n) {
+    return (x << n) | (x >> (64 - n));
+}
+
+static uint32_t swap32(uint32_t x) {
+    return ((x << 24) & 0xff000000U) | ((x << 8) & 0x00ff0000U) | ((x >> 8) & 0x0000ff00U) |
+           ((x >> 24) & 0x000000ffU);
+}
+
+static uint64_t swap64(uint64_t x) {
+    return ((uint64_t)swap32((uint32_t)x) << 32) | swap32((uint32_t)(x >> 32));
+}
+
+static Xxh128 mul64to128(uint64_t a, uint64_t b) {
+    Xxh128 r;
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 p = (unsigned __int128)a * b;
+    r.low = (uint64_t)p;
+    r.high = (uint64_t)(p >> 64);
+#else
+    uint64_t lo_lo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+    uint64_t hi_lo = (a >> 32) * (b & 0xFFFFFFFF);
+    uint64_t lo_hi = (a & 0xFFFFFFFF) * (b >> 32);
+    uint64_t hi_hi = (a >> 32) * (b >> 32);
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+    r.high = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+    r.low = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+#endif
+    return r;
+}
+
+static uint64_t mul128_fold64(uint64_t a, uint64_t b) {
+    Xxh128 p = mul64to128(a, b);
+    return p.low ^ p.high;
+}
+
+static uint64_t xxh64_avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64_t xxh3_avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64_t xxh3_rrmxmx(uint64_t h, uint64_t len) {
+    h ^= rotl64(h, 49) ^ rotl64(h, 24);
+    h *= 0x9FB21C651E98DF25ULL;
+    h ^= (h >> 35) + len;
+    h *= 0x9FB21C651E98DF25ULL;
+    return h ^ (h >> 28);
+}
+
+static uint64_t xxh3_mix16(const uint8_t *p, const uint8_t *secret, uint64_t seed) {
+    return mul128_fold64(read64(p) ^ (read64(secret) + seed), read64(p + 8) ^ (read64(secret + 8) - seed));
+}
+
+// Inputs of up to 240 bytes: a few multiplies, no accumulator
+
+static uint64_t xxh3_64_short(const uint8_t *p, size_t len) {
+    const uint8_t *secret = xxh3_secret;
+    
+    if (len == 0) return xxh64_avalanche(read64(secret + 56) ^ read64(secret + 64));
+    if (len <= 3) {
+        uint32_t combined = ((uint32_t)p[0] << 16) | ((uint32_t)p[len >> 1] << 24) | p[len - 1] |
+                            ((uint32_t)len << 8);
+        uint64_t bitflip = read32(secret) ^ read32(secret + 4);
+        return xxh64_avalanche((uint64_t)combined ^ bitflip);
+    }
+    if (len <= 8) {
+        uint64_t bitflip = read64(secret + 8) ^ read64(secret + 16);
+        uint64_t input = read32(p + len - 4) + ((uint64_t)read32(p) << 32);
+        return xxh3_rrmxmx(input ^ bitflip, len);
+    }
+    if (len <= 16) {
+        uint64_t lo = read64(p) ^ (read64(secret + 24) ^ read64(secret + 32));
+        uint64_t hi = read64(p + len - 8) ^ (read64(secret + 40) ^ read64(secret + 48));
+        return xxh3_avalanche(len + swap64(lo) + hi + mul128_fold64(lo, hi));
+    }
+    
+    uint64_t acc = len * PRIME64_1;
+    if (len <= 128) {
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) {
+                    acc += xxh3_mix16(p + 48, secret + 96, 0);
+                    acc += xxh3_mix16(p + len - 64, secret + 112, 0);
+                }
+                acc += xxh3_mix16(p + 32, secret + 64, 0);
+                acc += xxh3_mix16(p + len - 48, secret + 80, 0);
+            }
+            acc += xxh3_mix16(p + 16, secret + 32, 0);
+            acc += xxh3_mix16(p + len - 32, secret + 48, 0);
+        }
+        acc += xxh3_mix16(p, secret, 0);
+        acc += xxh3_mix16(p + len - 16, secret + 16, 0);
+        return xxh3_avalanche(acc);
+    }
+    
+    size_t rounds = len / 16;
+    for (size_t i = 0; i < 8; i++) acc += xxh3_mix16(p + 16 * i, secret + 16 * i, 0);
+    acc = xxh3_avalanche(acc);
+    for (size_t i = 8; i < rounds; i++) acc += xxh3_mix16(p + 16 * i, secret + 16 * (i - 8) + 3, 0);
+    acc += xxh3_mix16(p + len - 16, secret + 136 - 17, 0);
+    return xxh3_avalanche(acc);
+}
+
+static Xxh128 xxh3_mix32(Xxh128 acc, const uint8_t *a, const uint8_t *b, const uint8_t *secret, uint64_t seed) {
+    acc.low += xxh3_mix16(a, secret, seed);
+    acc.low ^= read64(b) + read64(b + 8);
+    acc.high += xxh3_mix16(b, secret + 16, seed);
+    acc.high ^= read64(a) + read64(a + 8);
+    return acc;
+}
+
+static Xxh128 xxh3_128_short(const uint8_t *p, size_t len) {
+    const uint8_t *secret = xxh3_secret;
+    Xxh128 h;
+    
+    if (len == 0) {
+        h.low = xxh64_avalanche(read64(secret + 64) ^ read64(secret + 72));
+        h.high = xxh64_avalanche(read64(secret + 80) ^ read64(secret + 88));
+        return h;
+    }
+    if (len <= 3) {
+        uint32_t lo = ((uint32_t)p[0] << 16) | ((uint32_t)p[len >> 1] << 24) | p[len - 1] | ((uint32_t)len << 8);
+        uint32_t hi = swap32(lo);
+        hi = (hi << 13) | (hi >> 19);
+        h.low = xxh64_avalanche((uint64_t)lo ^ (read32(secret) ^ read32(secret + 4)));
+        h.high = xxh64_avalanche((uint64_t)hi ^ (read32(secret + 8) ^ read32(secret + 12)));
+        return h;
+    }
+    if (len <= 8) {
+        uint64_t input = read32(p) + ((uint64_t)read32(p + len - 4) << 32);
+        uint64_t keyed = input ^ (read64(secret + 16) ^ read64(secret + 24));
+        h = mul64to128(keyed, PRIME64_1 + (len << 2));
+        h.high += h.low << 1;
+        h.low ^= h.high >> 3;
+        h.low ^= h.low >> 35;
+        h.low *= 0x9FB21C651E98DF25ULL;
+        h.low ^= h.low >> 28;
+        h.high = xxh3_avalanche(h.high);
+        return h;
+    }
+    if (len <= 16) {
+        uint64_t lo = read64(p), hi = read64(p + len - 8);
+        Xxh128 m = mul64to128(lo ^ hi ^ (read64(secret + 32) ^ read64(secret + 40)), PRIME64_1);
+        m.low += (uint64_t)(len - 1) << 54;
+        hi ^= read64(secret + 48) ^ read64(secret + 56);
+        m.high += hi + (uint64_t)(uint32_t)hi * (PRIME32_2 - 1);
+        m.low ^= swap64(m.high);
+        h = mul64to128(m.low, PRIME64_2);
+        h.high += m.high * PRIME64_2;
+        h.low = xxh3_avalanche(h.low);
+        h.high = xxh3_avalanche(h.high);
+        return h;
+    }
+    
+    Xxh128 acc = { len * PRIME64_1, 0 };
+    if (len <= 128) {
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) acc = xxh3_mix32(acc, p + 48, p + len - 64, secret + 96, 0);
+                acc = xxh3_mix32(acc, p + 32, p + len - 48, secret + 64, 0);
+            }
+            acc = xxh3_mix32(acc, p + 16, p + len - 32, secret + 32, 0);
+        }
+        acc = xxh3_mix32(acc, p, p + len - 16, secret, 0);
+    } else {
+        size_t rounds = len / 32;
+        for (size_t i = 0; i < 4; i++) acc = xxh3_mix32(acc, p + 32 * i, p + 32 * i + 16, secret + 32 * i, 0);
+        acc.low = xxh3_avalanche(acc.low);
+        acc.high = xxh3_avalanche(acc.high);
+        for (size_t i = 4; i < rounds; i++) {
+            acc = xxh3_mix32(acc, p + 32 * i, p + 32 * i + 16, secret + 3 + 32 * (i - 4), 0);
+        }
+        acc = xxh3_mix32(acc, p + len - 16, p + len - 32, secret + 136 - 17 - 16, 0);
+    }
+    h.low = xxh3_avalanche(acc.low + acc.high);
+    h.high = 0 - xxh3_avalanche(acc.low * PRIME64_1 + acc.high * PRIME64_4 + len * PRIME64_2);
+    return h;
+}
+
+// Long inputs: eight 64-bit lanes take one 64-byte stripe at a time, each
+// stripe keyed with the secret at an 8-byte offset; after a block of 16
+// stripes the lanes are scrambled.
+
+typedef void (*Xxh3AccumulateFn)(uint64_t *acc, const uint8_t *input, const uint8_t *secret, size_t stripes);
+typedef void (*Xxh3ScrambleFn)(uint64_t *acc, const uint8_t *secret);
+
+typedef struct {
+    Xxh3AccumulateFn accumulate;
+    Xxh3ScrambleFn scramble;
+    const char *name;
+} Xxh3Kernel;
+
+#ifndef XXH3_HAVE_X86
+static void xxh3_accumulate_scalar(uint64_t *acc, const uint8_t *input, const uint8_t *secret, size_t stripes) {
+    for (size_t n = 0; n < stripes; n++, input += XXH3_STRIPE_LEN, secret += XXH3_SECRET_CONSUME_RATE) {
+        for (int i = 0; i < 8; i++) {
+            uint64_t data = read64(input + 8 * i);
+            uint64_t key = data ^ read64(secret + 8 * i);
+            acc[i ^ 1] += data;
+            acc[i] += (uint64_t)(uint32_t)key * (key >> 32);
+        }
+    }
+}
+
+static void xxh3_scramble_scalar(uint64_t *acc, const uint8_t *secret) {
+    for (int i = 0; i < 8; i++) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= read64(secret + 8 * i);
+        acc[i] = a * PRIME32_1;
+    }
+}
+#else
+// SSE2 is part of x86-64, so the scalar versions are only for other CPUs.
+// The SIMD versions: key = data ^ secret, then the 32x32->64 product of
+// each lane's halves (mul_epu32) plus the neighbouring lane's raw data
+
+static void xxh3_accumulate_sse2(uint64_t *acc, const uint8_t *input, const uint8_t *secret, size_t stripes) {
+    __m128i a[4];
+    for (int i = 0; i < 4; i++) a[i] = _mm_loadu_si128((const __m128i *)acc + i);
+    for (size_t n = 0; n < stripes; n++, input += XXH3_STRIPE_LEN, secret += XXH3_SECRET_CONSUME_RATE) {
+        for (int i = 0; i < 4; i++) {
+            __m128i data = _mm_loadu_si128((const __m128i *)input + i);
+            __m128i key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i *)secret + i));
+            __m128i product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+            __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, swapped));
+        }
+    }
+    for (int i = 0; i < 4; i++) _mm_storeu_si128((__m128i *)acc + i, a[i]);
+}
+
+static void xxh3_scramble_sse2(uint64_t *acc, const uint8_t *secret) {
+    const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+    for (int i = 0; i < 4; i++) {
+        __m128i a = _mm_loadu_si128((const __m128i *)acc + i);
+        a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+        a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i *)secret + i));
+        __m128i lo = _mm_mul_epu32(a, prime);
+        __m128i hi = _mm_mul_epu32(_mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+        _mm_storeu_si128((__m128i *)acc + i, _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
+    }
+}
+
+__attribute__((target("avx2")))
+static void xxh3_accumulate_avx2(uint64_t *acc, const uint8_t *input, const uint8_t *secret, size_t stripes) {
+    __m256i a0 = _mm256_loadu_si256((const __m256i *)acc);
+    __m256i a1 = _mm256_loadu_si256((const __m256i *)acc + 1);
+    for (size_t n = 0; n < stripes; n++, input += XXH3_STRIPE_LEN, secret += XXH3_SECRET_CONSUME_RATE) {
+        __m256i d0 = _mm256_loadu_si256((const __m256i *)input);
+        __m256i d1 = _mm256_loadu_si256((const __m256i *)input + 1);
+        __m256i k0 = _mm256_xor_si256(d0, _mm256_loadu_si256((const __m256i *)secret));
+        __m256i k1 = _mm256_xor_si256(d1, _mm256_loadu_si256((const __m256i *)secret + 1));
+        __m256i p0 = _mm256_mul_epu32(k0, _mm256_shuffle_epi32(k0, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m256i p1 = _mm256_mul_epu32(k1, _mm256_shuffle_epi32(k1, _MM_SHUFFLE(0, 3, 0, 1)));
+        a0 = _mm256_add_epi64(a0, _mm256_add_epi64(p0, _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2))));
+        a1 = _mm256_add_epi64(a1, _mm256_add_epi64(p1, _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+    _mm256_storeu_si256((__m256i *)acc, a0);
+    _mm256_storeu_si256((__m256i *)acc + 1, a1);
+}
+
+__attribute__((target("avx2")))
+static void xxh3_scramble_avx2(uint64_t *acc, const uint8_t *secret) {
+    const __m256i prime = _mm256_set1_epi32((int)PRIME32_1);
+    for (int i = 0; i < 2; i++) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)acc + i);
+        a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+        a = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i *)secret + i));
+        __m256i lo = _mm256_mul_epu32(a, prime);
+        __m256i hi = _mm256_mul_epu32(_mm256_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+        _mm256_storeu_si256((__m256i *)acc + i, _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void xxh3_accumulate_avx512(uint64_t *acc, const uint8_t *input, const uint8_t *secret, size_t stripes) {
+    __m512i a = _mm512_loadu_si512(acc);
+    for (size_t n = 0; n < stripes; n++, input += XXH3_STRIPE_LEN, secret += XXH3_SECRET_CONSUME_RATE) {
+        __m512i data = _mm512_loadu_si512(input);
+        __m512i key = _mm512_xor_si512(data, _mm512_loadu_si512(secret));
+        __m512i product = _mm512_mul_epu32(key, _mm512_shuffle_epi32(key, (_MM_PERM_ENUM)_MM_SHUFFLE(0, 3, 0, 1)));
+        __m512i swapped = _mm512_shuffle_epi32(data, (_MM_PERM_ENUM)_MM_SHUFFLE(1, 0, 3, 2));
+        a = _mm512_add_epi64(a, _mm512_add_epi64(product, swapped));
+    }
+    _mm512_storeu_si512(acc, a);
+}
+
+__attribute__((target("avx512f")))
+static void xxh3_scramble_avx512(uint64_t *acc, const uint8_t *secret) {
+    const __m512i prime = _mm512_set1_epi32((int)PRIME32_1);
+    __m512i a = _mm512_loadu_si512(acc);
+    a = _mm512_xor_si512(a, _mm512_srli_epi64(a, 47));
+    a = _mm512_xor_si512(a, _mm512_loadu_si512(secret));
+    __m512i lo = _mm512_mul_epu32(a, prime);
+    __m512i hi = _mm512_mul_epu32(_mm512_shuffle_epi32(a, (_MM_PERM_ENUM)_MM_SHUFFLE(0, 3, 0, 1)), prime);
+    _mm512_storeu_si512(acc, _mm512_add_epi64(lo, _mm512_slli_epi64(hi, 32)));
+}
+#endif
+
+static const Xxh3Kernel *xxh3_kernel(void) {
+#ifdef XXH3_HAVE_X86
+    static const Xxh3Kernel sse2 = { xxh3_accumulate_sse2, xxh3_scramble_sse2, "sse2" };
+    static const Xxh3Kernel avx2 = { xxh3_accumulate_avx2, xxh3_scramble_avx2, "avx2" };
+    static const Xxh3Kernel avx512 = { xxh3_accumulate_avx512, xxh3_scramble_avx512, "avx512" };
+    if (__builtin_cpu_supports("avx512f")) return &avx512;
+    if (__builtin_cpu_supports("avx2")) return &avx2;
+    return &sse2;
+#else
+    static const Xxh3Kernel scalar = { xxh3_accumulate_scalar, xxh3_scramble_scalar, "scalar" };
+    return &scalar;
+#endif
+}
+
+const char* xxh3_impl(void) {
+    return xxh3_kernel()->name;
+}
+
+static void xxh3_acc_init(uint64_t acc[8]) {
+    acc[0] = PRIME32_3;
+    acc[1] = PRIME64_1;
+    acc[2] = PRIME64_2;
+    acc[3] = PRIME64_3;
+    acc[4] = PRIME64_4;
+    acc[5] = PRIME32_2;
+    acc[6] = PRIME64_5;
+    acc[7] = PRIME32_1;
+}
+
+static uint64_t xxh3_merge(const uint64_t acc[8], const uint8_t *secret, uint64_t start) {
+    uint64_t result = start;
+    for (int i = 0; i < 4; i++) {
+        result += mul128_fold64(acc[2 * i] ^ read64(secret + 16 * i), acc[2 * i + 1] ^ read64(secret + 16 * i + 8));
+    }
+    return xxh3_avalanche(result);
+}
+
+// Run the accumulator over all of a long input
+static void xxh3_long(uint64_t acc[8], const uint8_t *p, size_t len) {
+    const Xxh3Kernel *k = xxh3_kernel();
+    size_t blocks = (len - 1) / XXH3_BLOCK_LEN;
+    
+    xxh3_acc_init(acc);
+    for (size_t n = 0; n < blocks; n++) {
+        k->accumulate(acc, p + n * XXH3_BLOCK_LEN, xxh3_secret, XXH3_STRIPES_PER_BLOCK);
+        k->scramble(acc, xxh3_secret + XXH3_SECRET_LIMIT);
+    }
+    size_t stripes = ((len - 1) - XXH3_BLOCK_LEN * blocks) / XXH3_STRIPE_LEN;
+    k->accumulate(acc, p + blocks * XXH3_BLOCK_LEN, xxh3_secret, stripes);
+    k->accumulate(acc, p + len - XXH3_STRIPE_LEN, xxh3_secret + XXH3_SECRET_LIMIT - XXH3_SECRET_LASTACC_START, 1);
+}
+
+uint64_t xxh3_64(const void *data, size_t len) {
+    if (len <= XXH3_MIDSIZE_MAX) return xxh3_64_short(data, len);
+    uint64_t acc[8];
+    xxh3_long(acc, data, len);
+    return xxh3_merge(acc, xxh3_secret + XXH3_SECRET_MERGEACCS_START, (uint64_t)len * PRIME64_1);
+}
+
+static Xxh128 xxh3_128_merge(const uint64_t acc[8], uint64_t len) {
+    Xxh128 h;
+    h.low = xxh3_merge(acc, xxh3_secret + XXH3_SECRET_MERGEACCS_START, len * PRIME64_1);
+    h.high = xxh3_merge(acc, xxh3_secret + XXH3_SECRET_SIZE - XXH3_STRIPE_LEN - XXH3_SECRET_MERGEACCS_START,
+                        ~(len * PRIME64_2));
+    return h;
+}
+
+Xxh128 xxh3_128(const void *data, size_t len) {
+    if (len <= XXH3_MIDSIZE_MAX) return xxh3_128_short(data, len);
+    uint64_t acc[8];
+    xxh3_long(acc, data, len);
+    return xxh3_128_merge(acc, len);
+}
+
+// Accumulate stripes that continue the current block, scrambling when the
+// block fills up
+static void xxh3_consume(const Xxh3Kernel *k, uint64_t acc[8], size_t *stripes_so_far, const uint8_t *p,
+                         size_t stripes) {
+    size_t to_end = XXH3_STRIPES_PER_BLOCK - *stripes_so_far;
+    if (stripes >= to_end) {
+        k->accumulate(acc, p, xxh3_secret + *stripes_so_far * XXH3_SECRET_CONSUME_RATE, to_end);
+        k->scramble(acc, xxh3_secret + XXH3_SECRET_LIMIT);
+        k->accumulate(acc, p + to_end * XXH3_STRIPE_LEN, xxh3_secret, stripes - to_end);
+        *stripes_so_far = stripes - to_end;
+    } else {
+        k->accumulate(acc, p, xxh3_secret + *stripes_so_far * XXH3_SECRET_CONSUME_RATE, stripes);
+        *stripes_so_far += stripes;
+    }
+}
+
+void xxh3_init(Xxh3Ctx *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+    xxh3_acc_init(ctx->acc);
+}
+
+// At least one byte always stays buffered: the last stripe is only known
+// at the end, and short totals are hashed from the buffer directly. When
+// input is consumed straight from the caller, the 64 bytes before the
+// remainder are kept at the end of the buffer for the last stripe.
+void xxh3_update(Xxh3Ctx *ctx, const void *data, size_t len) {
+    const uint8_t *p = data;
+    const uint8_t *end = p + len;
+    
+    ctx->total_len += len;
+    if (ctx->buffered + len <= sizeof(ctx->buffer)) {
+        memcpy(ctx->buffer + ctx->buffered, p, len);
+        ctx->buffered += len;
+        return;
+    }
+    
+    const Xxh3Kernel *k = xxh3_kernel();
+    if (ctx->buffered) {
+        size_t fill = sizeof(ctx->buffer) - ctx->buffered;
+        memcpy(ctx->buffer + ctx->buffered, p, fill);
+        p += fill;
+        xxh3_consume(k, ctx->acc, &ctx->stripes, ctx->buffer, XXH3_BUFFER_STRIPES);
+        ctx->buffered = 0;
+    }
+    
+    if ((size_t)(end - p) > XXH3_BLOCK_LEN) {
+        // Whole blocks straight from the input
+        size_t stripes = (size_t)(end - 1 - p) / XXH3_STRIPE_LEN;
+        size_t to_end = XXH3_STRIPES_PER_BLOCK - ctx->stripes;
+        k->accumulate(ctx->acc, p, xxh3_secret + ctx->stripes * XXH3_SECRET_CONSUME_RATE, to_end);
+        k->scramble(ctx->acc, xxh3_secret + XXH3_SECRET_LIMIT);
+        p += to_end * XXH3_STRIPE_LEN;
+        stripes -= to_end;
+        while (stripes >= XXH3_STRIPES_PER_BLOCK) {
+            k->accumulate(ctx->acc, p, xxh3_secret, XXH3_STRIPES_PER_BLOCK);
+            k->scramble(ctx->acc, xxh3_secret + XXH3_SECRET_LIMIT);
+            p += XXH3_BLOCK_LEN;
+            stripes -= XXH3_STRIPES_PER_BLOCK;
+        }
+        k->accumulate(ctx->acc, p, xxh3_secret, stripes);
+        p += stripes * XXH3_STRIPE_LEN;
+        ctx->stripes = stripes;
+        memcpy(ctx->buffer + sizeof(ctx->buffer) - XXH3_STRIPE_LEN, p - XXH3_STRIPE_LEN, XXH3_STRIPE_LEN);
+    } else if ((size_t)(end - p) > sizeof(ctx->buffer)) {
+        const uint8_t *limit = end - sizeof(ctx->buffer);
+        do {
+            xxh3_consume(k, ctx->acc, &ctx->stripes, p, XXH3_BUFFER_STRIPES);
+            p += sizeof(ctx->buffer);
+        } while (p < limit);
+        memcpy(ctx->buffer + sizeof(ctx->buffer) - XXH3_STRIPE_LEN, p - XXH3_STRIPE_LEN, XXH3_STRIPE_LEN);
+    }
+    
+    memcpy(ctx->buffer, p, (size_t)(end - p));
+    ctx->buffered = (size_t)(end - p);
+}
+
+// Finish the accumulator on a copy, so the context can keep going
+static void xxh3_digest_long(const Xxh3Ctx *ctx, uint64_t acc[8]) {
+    const Xxh3Kernel *k = xxh3_kernel();
+    memcpy(acc, ctx->acc, sizeof(ctx->acc));
+    if (ctx->buffered >= XXH3_STRIPE_LEN) {
+        size_t stripes_so_far = ctx->stripes;
+        xxh3_consume(k, acc, &stripes_so_far, ctx->buffer, (ctx->buffered - 1) / XXH3_STRIPE_LEN);
+        k->accumulate(acc, ctx->buffer + ctx->buffered - XXH3_STRIPE_LEN,
+                      xxh3_secret + XXH3_SECRET_LIMIT - XXH3_SECRET_LASTACC_START, 1);
+    } else {
+        uint8_t last[XXH3_STRIPE_LEN];
+        size_t catchup = XXH3_STRIPE_LEN - ctx->buffered;
+        memcpy(last, ctx->buffer + sizeof(ctx->buffer) - catchup, catchup);
+        memcpy(last + catchup, ctx->buffer, ctx->buffered);
+        k->accumulate(acc, last, xxh3_secret + XXH3_SECRET_LIMIT - XXH3_SECRET_LASTACC_START, 1);
+    }
+}
+
+uint64_t xxh3_64_final(const Xxh3Ctx *ctx) {
+    if (ctx->total_len <= XXH3_MIDSIZE_MAX) return xxh3_64_short(ctx->buffer, (size_t)ctx->total_len);
+    uint64_t acc[8];
+    xxh3_digest_long(ctx, acc);
+    return xxh3_merge(acc, xxh3_secret + XXH3_SECRET_MERGEACCS_START, ctx->total_len * PRIME64_1);
+}
+
+Xxh128 xxh3_128_final(const Xxh3Ctx *ctx) {
+    if (ctx->total_len <= XXH3_MIDSIZE_MAX) return xxh3_128_short(ctx->buffer, (size_t)ctx->total_len);
+    uint64_t acc[8];
+    xxh3_digest_long(ctx, acc);
+    return xxh3_128_merge(acc, ctx->total_len);
+}
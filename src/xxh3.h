@@ -0,0 +1,38 @@
+#ifndef XXH3_H
+#define XXH3_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// XXH3 (xxHash 0.8, seed 0, default secret) in its 64- and 128-bit
+// variants. Non-cryptographic: for change detection and dedup, where it
+// runs at memory speed. Inputs over 240 bytes go through the stripe
+// accumulator, which has SSE2, AVX2 and AVX-512 versions picked at run
+// time; every version gives the same digests.
+
+typedef struct {
+    uint64_t low;
+    uint64_t high;
+} Xxh128;
+
+// Streaming state, shared by both widths
+typedef struct {
+    uint64_t acc[8];
+    uint64_t total_len;
+    size_t stripes;             // stripes accumulated in the current block
+    size_t buffered;
+    uint8_t buffer[256];        // unconsumed input, ending with the last stripe
+} Xxh3Ctx;
+
+void xxh3_init(Xxh3Ctx *ctx);
+void xxh3_update(Xxh3Ctx *ctx, const void *data, size_t len);
+uint64_t xxh3_64_final(const Xxh3Ctx *ctx);
+Xxh128 xxh3_128_final(const Xxh3Ctx *ctx);
+
+uint64_t xxh3_64(const void *data, size_t len);
+Xxh128 xxh3_128(const void *data, size_t len);
+
+// Accumulator in use ("avx512", "avx2", "sse2" or "scalar")
+const char* xxh3_impl(void);
+
+#endif